@@ -0,0 +1,35 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdalign.h>
+#include <stddef.h>
+
+#define ARENA_ALIGN alignof(max_align_t)
+#define ARENA_CHUNK_SIZE 65536
+// Anything larger gets a chunk of its own, so that the current one is not
+// cut short.
+#define ARENA_LARGE_SIZE (ARENA_CHUNK_SIZE / 4)
+
+typedef struct ArenaChunk ArenaChunk;
+
+typedef struct ArenaChunk
+{
+    ArenaChunk* next;
+    alignas(ARENA_ALIGN) char data[];
+} ArenaChunk;
+
+// Hands out memory that is never freed on its own, only all at once with
+// the arena, by bumping next through the current chunk.
+typedef struct Arena
+{
+    ArenaChunk* chunks;
+    char* next;
+    char* end;
+} Arena;
+
+void initArena(Arena* arena);
+void freeArena(Arena* arena);
+void* allocateArena(Arena* arena, size_t size);
+void* reallocateArena(Arena* arena, void* pointer, size_t oldSize, size_t size);
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A minimal x86-64 encoder for code that is generated instruction by
+// instruction rather than copied from stencils. Arithmetic is 32-bit, like
+// the interpreter's ints; loads, stores and moves are 64-bit.
+
+typedef enum Register
+{
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+    NO_REGISTER
+} Register;
+
+typedef enum XmmRegister
+{
+    XMM0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6, XMM7
+} XmmRegister;
+
+// Extension field of the 0x81 group; the register forms use 8 * op + 1.
+typedef enum AluOp
+{
+    ALU_ADD = 0,
+    ALU_OR = 1,
+    ALU_AND = 4,
+    ALU_SUB = 5,
+    ALU_XOR = 6,
+    ALU_CMP = 7
+} AluOp;
+
+// Extension field of the 0xF7 group.
+typedef enum UnaryOp
+{
+    UNARY_NOT = 2,
+    UNARY_NEG = 3,
+    UNARY_IDIV = 7
+} UnaryOp;
+
+// Extension field of the 0xC1 and 0xD3 groups.
+typedef enum ShiftOp
+{
+    SHIFT_ROL = 0,
+    SHIFT_ROR = 1,
+    SHIFT_SHL = 4,
+    SHIFT_SAR = 7
+} ShiftOp;
+
+// Condition codes; flipping the low bit negates a condition.
+typedef enum Condition
+{
+    COND_E = 0x4,
+    COND_NE = 0x5,
+    COND_P = 0xA,
+    COND_NP = 0xB,
+    COND_L = 0xC,
+    COND_GE = 0xD,
+    COND_LE = 0xE,
+    COND_G = 0xF
+} Condition;
+
+#define NEGATE_CONDITION(cond) ((Condition)((cond) ^ 1))
+
+typedef struct Assembler
+{
+    uint8_t* data;
+    size_t capacity;
+    size_t count;
+} Assembler;
+
+void initAssembler(Assembler* as);
+void freeAssembler(Assembler* as);
+
+void emitMov(Assembler* as, Register dst, Register src);
+void emitMovImm(Assembler* as, Register dst, int32_t imm);
+void emitMovImm64(Assembler* as, Register dst, uint64_t imm);
+void emitLoad(Assembler* as, Register dst, Register base, int32_t disp);
+void emitLoadNarrow(Assembler* as, Register dst, Register base, int32_t disp, int size, bool sign);
+void emitLoadDouble(Assembler* as, XmmRegister dst, Register base, int32_t disp);
+void emitLoadFloat(Assembler* as, XmmRegister dst, Register base, int32_t disp);
+void emitStore(Assembler* as, Register base, int32_t disp, Register src);
+void emitStoreImm(Assembler* as, Register base, int32_t disp, int32_t imm);
+void emitLea(Assembler* as, Register dst, Register base, int32_t disp);
+void emitAlu(Assembler* as, AluOp op, Register dst, Register src);
+void emitAluImm(Assembler* as, AluOp op, Register dst, int32_t imm);
+void emitAlu64(Assembler* as, AluOp op, Register dst, Register src);
+void emitAlu64Imm(Assembler* as, AluOp op, Register dst, int32_t imm);
+void emitImul(Assembler* as, Register dst, Register src);
+void emitImulImm(Assembler* as, Register dst, Register src, int32_t imm);
+void emitUnary(Assembler* as, UnaryOp op, Register reg);
+void emitShift(Assembler* as, ShiftOp op, Register reg);
+void emitShiftImm(Assembler* as, ShiftOp op, Register reg, uint8_t imm);
+void emitExtend(Assembler* as, Register dst, Register src, int size, bool sign);
+void emitWidenFloat(Assembler* as, XmmRegister reg);
+void emitMovFromXmm(Assembler* as, Register dst, XmmRegister src);
+void emitCompareDouble(Assembler* as, XmmRegister a, XmmRegister b);
+void emitCdq(Assembler* as);
+void emitTest(Assembler* as, Register a, Register b);
+void emitSetcc(Assembler* as, Condition cond, Register dst);
+void emitCmov(Assembler* as, Condition cond, Register dst, Register src);
+void emitBsf(Assembler* as, Register dst, Register src);
+void emitBsr(Assembler* as, Register dst, Register src);
+void emitPopcnt(Assembler* as, Register dst, Register src);
+void emitBswap(Assembler* as, Register reg);
+size_t emitJcc(Assembler* as, Condition cond);
+size_t emitJmp(Assembler* as);
+void emitJmpTo(Assembler* as, size_t target);
+void patchJumpTo(Assembler* as, size_t at, size_t target);
+void emitCall(Assembler* as, void* function);
+void emitCallRegister(Assembler* as, Register reg);
+void emitJmpRegister(Assembler* as, Register reg);
+void emitPush(Assembler* as, Register reg);
+void emitPop(Assembler* as, Register reg);
+void emitRet(Assembler* as);
+
+#endif
@@ -1,9 +1,12 @@
 #ifndef AST_H
 #define AST_H
 
+#include "arena.h"
 #include "token.h"
 #include "vector.h"
+#include "value.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef struct AST AST;
 typedef struct StringObject StringObject;
@@ -13,13 +16,18 @@ typedef struct Service Service;
 typedef enum ASTType
 {
     AST_ASSIGNMENT,
+    AST_AWAIT,
     AST_BINARY,
     AST_BOOLEAN,
     AST_CHARACTER,
     AST_COMPOUND,
+    AST_CONVERSION,
+    AST_EXTERN_DEFINITION,
     AST_FLOAT,
+    AST_FOR,
     AST_FUNCTION_CALL,
     AST_FUNCTION_DEFINITION,
+    AST_IF,
     AST_INTEGER,
     AST_PARAMETER,
     AST_PREFIX,
@@ -28,6 +36,8 @@ typedef enum ASTType
     AST_STRING,
     AST_VARIABLE,
     AST_VARIABLE_DEFINITION,
+    AST_WHILE,
+    AST_YIELD,
     AST_NONE
 } ASTType;
 
@@ -55,6 +65,27 @@ typedef struct AST
             Vector statements;
         } compound;
 
+        struct {
+            AST* expr;
+            int typeId;
+        } conversion;
+
+        struct {
+            Scope* scope;
+            StringObject* id;
+            Vector params;
+            int typeId;
+            Service* service;
+        } externDefinition;
+
+        struct {
+            AST* variable;
+            AST* generator;
+            AST* call;
+            Vector body;
+            bool defines;
+        } forStatement;
+
         struct {
             Scope* scope;
             Vector args;
@@ -67,8 +98,16 @@ typedef struct AST
             Vector params;
             int typeId;
             AST* body;
+            bool async;
+            bool generator;
         } functionDefinition;
 
+        struct {
+            AST* condition;
+            Vector body;
+            Vector elseBody;
+        } ifStatement;
+
         struct {
             Scope* scope;
             StringObject* id;
@@ -101,21 +140,29 @@ typedef struct AST
             AST* expr;
         } variableDefinition;
 
+        struct {
+            AST* condition;
+            Vector body;
+        } whileStatement;
+
         bool boolValue;
-        float floatValue;
-        int intValue;
+        double floatValue;
+        int64_t intValue;
         Token character;
         Token string;
         AST* expression;
     };
 } AST;
 
-AST* createAST(ASTType type);
-void freeAST(AST* ast);
+AST* createAST(Arena* arena, ASTType type);
 Scope* getScope(AST* ast);
 int getTypeId(AST* ast);
+NumberKind getNumberKind(int typeId);
+bool isLiteral(AST* ast);
 bool isFunctionCall(AST* ast);
 bool isFunctionDefinition(AST* ast);
+bool isAsyncCall(AST* ast);
+bool isGeneratorCall(AST* ast);
 bool isParameter(AST* ast);
 bool isPrefix(AST* ast);
 bool isPrefixOperand(AST* ast);
@@ -2,7 +2,12 @@
 #define BYTECODE_H
 
 #include "codeobject.h"
+#include <stdint.h>
 
 void disassemble(CodeObject* code);
+void disassembleRegisters(CodeObject* code);
+const char* getOpcodeName(uint8_t opcode);
+int getInstructionLength(uint8_t opcode);
+const char* getRegisterOpcodeName(uint8_t opcode);
 
 #endif
@@ -0,0 +1,67 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include "loop.h"
+#include "value.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// A power of two.
+#define CHANNEL_CHUNK_SIZE 256
+#define CHANNEL_CHUNKS_MAX 4096
+// A channel's id has its index in these bits and its generation above.
+#define CHANNEL_INDEX_BITS 20
+
+// A parked sender or receiver, or a buffered value with future -1.
+typedef struct Parked
+{
+    int future;
+    Value value;
+} Parked;
+
+// A ring of them in the order they came.
+typedef struct ParkedQueue
+{
+    Parked* items;
+    int capacity;
+    int head;
+    int count;
+} ParkedQueue;
+
+// Carries values between tasks, buffering up to capacity of them. Closed
+// channels are chained through next until they are reused.
+typedef struct Channel
+{
+    pthread_mutex_t lock;
+    bool open;
+    uint32_t generation;
+    int next;
+    int capacity;
+    ParkedQueue buffer;
+    ParkedQueue senders;
+    ParkedQueue receivers;
+} Channel;
+
+// Chunks never move once published, so finding a channel takes no lock.
+// lock guards the free chain and the live counts.
+typedef struct ChannelTable
+{
+    _Atomic(Channel*) chunks[CHANNEL_CHUNKS_MAX];
+    atomic_int count;
+    int freeChannel;
+    int freeChannelTail;
+    size_t liveCount;
+    size_t livePeak;
+    pthread_mutex_t lock;
+} ChannelTable;
+
+void initChannels(ChannelTable* table);
+void freeChannels(ChannelTable* table);
+int createChannel(EventLoop* loop, int32_t capacity);
+int sendChannel(EventLoop* loop, int channel, Value value);
+int receiveChannel(EventLoop* loop, int channel);
+bool closeChannel(EventLoop* loop, int channel);
+
+#endif
@@ -21,6 +21,7 @@ void clearCodeObject(CodeObject* code);
 size_t countCodeObject(CodeObject* code);
 void reserveCodeObject(CodeObject* code, size_t capacity);
 void resizeCodeObject(CodeObject* code, size_t size);
+void truncateCodeObject(CodeObject* code, size_t size);
 size_t pushByte(CodeObject* code, uint8_t byte);
 void setByteAt(CodeObject* code, size_t index, uint8_t byte);
 uint8_t* codeObjectBegin(CodeObject* code);
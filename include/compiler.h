@@ -1,10 +1,49 @@
 #ifndef COMPILER_H
 #define COMPILER_H
 
+#include "ast.h"
+#include "functionobject.h"
 #include "moduleobject.h"
+#include "parser.h"
+#include "vector.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
-void initCompiler(ModuleObject* module);
-void freeCompiler();
-void compile(char* source);
+#define HISTORY_MAX 2
+
+typedef struct Instruction
+{
+    uint8_t opcode;
+    int operand;
+    size_t offset;
+} Instruction;
+
+// Compiles source into one module. Each compiler keeps its own parser and
+// touches no module but its own, so separate modules can be compiled on
+// separate threads. Top-level statements are compiled once: the REPL
+// passes more source to the same compiler and only what is new is added.
+// iteration is the outermost for of the function being compiled that the
+// statement being compiled is in, if any.
+typedef struct Compiler
+{
+    Parser parser;
+    Vector functionReferences;
+    ModuleObject* module;
+    FunctionObject* function;
+    AST* ast;
+    size_t statementCount;
+    int stackCount;
+    Instruction history[HISTORY_MAX];
+    int historyCount;
+    int blockDepth;
+    bool async;
+    bool generator;
+    AST* iteration;
+} Compiler;
+
+void initCompiler(Compiler* compiler, ModuleObject* module);
+void freeCompiler(Compiler* compiler);
+void compile(Compiler* compiler, char* source);
 
 #endif
@@ -2,11 +2,12 @@
 #define CONVERSION_H
 
 #include <stddef.h>
+#include <stdint.h>
 
-float integerLiteralToValue(char* str, size_t len);
-int binaryLiteralToValue(char* str, size_t len);
-int hexadecimalLiteralToValue(char* str, size_t len);
-int octalLiteralToValue(char* str, size_t len);
-int floatLiteralToValue(char* str, size_t len);
+int64_t integerLiteralToValue(char* str, size_t len);
+int64_t binaryLiteralToValue(char* str, size_t len);
+int64_t hexadecimalLiteralToValue(char* str, size_t len);
+int64_t octalLiteralToValue(char* str, size_t len);
+double floatLiteralToValue(char* str, size_t len);
 
 #endif
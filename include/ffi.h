@@ -0,0 +1,18 @@
+#ifndef FFI_H
+#define FFI_H
+
+#include "service.h"
+#include <stdbool.h>
+
+// Arguments go in registers only: six of the integer types and eight of
+// the floating point ones.
+#define FFI_INT_ARGS_MAX 6
+#define FFI_FLOAT_ARGS_MAX 8
+
+void initFfi();
+void freeFfi();
+bool openLibrary(const char* path);
+void* findSymbol(const char* name);
+Service* registerExtern(const char* name, void* symbol, int typeId, int paramCount, const int* params);
+
+#endif
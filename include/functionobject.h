@@ -2,9 +2,18 @@
 #define FUNCTION_OBJECT_H
 
 #include "codeobject.h"
+#include <stdbool.h>
+#include <stdint.h>
 
 #define AS_FUNCTION_OBJECT(value) ((FunctionObject*)AS_OBJECT(value))
 
+typedef enum Tier
+{
+    TIER_INTERPRETED,
+    TIER_OPTIMIZED,
+    TIER_NATIVE
+} Tier;
+
 typedef struct FunctionObject
 {
     Object obj;
@@ -12,8 +21,26 @@ typedef struct FunctionObject
     int paramCount;
     int localCount;
     int maxStackCount;
+    int registerCount;
+    uint64_t callCount;
+    uint64_t loopCount;
+    uint64_t nextTier;
+    Tier tier;
+    void* native;
+    bool generator;
 } FunctionObject;
 
+// Counts the backward branches taken by one loop. Loop instructions name
+// their counter by its index in the module. entry is the loop header in
+// the function's native code, where interpreted frames can move over.
+typedef struct LoopCounter
+{
+    FunctionObject* function;
+    uint64_t count;
+    uint64_t threshold;
+    void* entry;
+} LoopCounter;
+
 FunctionObject* createFunctionObject();
 void freeFunctionObject(FunctionObject* function);
 
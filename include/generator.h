@@ -0,0 +1,43 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include "functionobject.h"
+#include "value.h"
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct Generator Generator;
+
+// A function that yields, started by a for. Its arguments and locals,
+// with the three slots of a return link between them, live in frame, and
+// fp points into it while the generator runs just as it would into the
+// stack for a call. Operands go on the stack of whoever resumed it,
+// starting at sp; at a yield the value is the only one. ip is where the
+// next resume carries on.
+typedef struct Generator
+{
+    FunctionObject* function;
+    uint8_t* ip;
+    Value* fp;
+    Value* sp;
+    Generator* below;
+    size_t capacity;
+    Value frame[];
+} Generator;
+
+// A for that runs inside another, or inside the generator another runs,
+// ends first, so generators end in the reverse order they start in. The
+// live ones are kept as a stack and the ones that ended are kept for the
+// next for, so that a for run over and over allocates nothing.
+typedef struct GeneratorStack
+{
+    Generator* top;
+    Generator* spare;
+} GeneratorStack;
+
+void initGenerators(GeneratorStack* stack);
+void freeGenerators(GeneratorStack* stack);
+Generator* startGenerator(GeneratorStack* stack, FunctionObject* function, Value* args);
+void endGenerator(GeneratorStack* stack, Generator* generator);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include "stringobject.h"
+#include <pthread.h>
+#include <stddef.h>
+
+// A power of two.
+#define INTERN_INITIAL_CAPACITY 256
+
+// One string for every distinct name the program has seen: the
+// identifiers of every script compiled, the services and the signatures
+// of extern trampolines. Any two interned strings are equal only if they
+// are the same object, so tables keyed by them compare pointers. The slots
+// are probed linearly from the hash and kept at most three quarters full.
+// Compilers may run on separate threads, so the table has a lock. Strings
+// are only freed at exit, so a process that keeps compiling new sources
+// grows by every distinct name it ever sees.
+typedef struct InternTable
+{
+    StringObject** strings;
+    size_t capacity;
+    size_t count;
+    pthread_mutex_t lock;
+} InternTable;
+
+void initInterning();
+void freeInterning();
+StringObject* internString(const char* chars, size_t length);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "functionobject.h"
+#include "value.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_SUPPORTED
+#endif
+
+#define JIT_CODE_MAX (16 * 1024 * 1024)
+
+struct VM;
+
+// Native code takes the VM and the operand stack pointer just past the
+// arguments, builds the same frame the interpreter would and returns the
+// function's result.
+typedef Value (*native_t)(struct VM* vm, Value* sp);
+
+// Enters native code at a loop header with a frame the interpreter built.
+typedef Value (*osr_t)(struct VM* vm, Value* fp, Value* sp, void* entry);
+
+typedef enum JitMode
+{
+    JIT_OFF,
+    JIT_BASELINE,
+    JIT_TRACE
+} JitMode;
+
+typedef struct Jit
+{
+    JitMode mode;
+    uint8_t* data;
+    size_t capacity;
+    size_t count;
+    void* osrEntry;
+} Jit;
+
+void initJit(Jit* jit, JitMode mode);
+void freeJit(Jit* jit);
+bool compileNative(struct VM* vm, FunctionObject* function);
+void* installCode(Jit* jit, const uint8_t* code, size_t size);
+Value enterNative(struct VM* vm, Value* fp, Value* sp, void* entry);
+bool hasPopcount(void);
+
+// Helpers called from native code with the operand stack pointer; each
+// returns the stack pointer after the operation.
+Value* jitRegister(struct VM* vm, Value* sp, intptr_t x);
+Value* jitPower(struct VM* vm, Value* sp, intptr_t x);
+Value* jitConvert(struct VM* vm, Value* sp, intptr_t x);
+
+#endif
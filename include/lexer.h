@@ -3,7 +3,22 @@
 
 #include "token.h"
 
-void initLexer(char* source);
-Token scanToken();
+typedef struct Position
+{
+    char* chars;
+    int line;
+    int column;
+} Position;
+
+// Where scanning has got to in one source. Lexers share nothing, so any
+// number of them can run at once.
+typedef struct Lexer
+{
+    Position current;
+    Position start;
+} Lexer;
+
+void initLexer(Lexer* lexer, char* source);
+Token scanToken(Lexer* lexer);
 
 #endif
@@ -0,0 +1,151 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include "functionobject.h"
+#include "value.h"
+#include "wheel.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOOP_EVENTS_MAX 64
+// A future's id has its index in these bits and its generation above.
+#define FUTURE_INDEX_BITS 21
+#define FUTURES_MAX (1 << FUTURE_INDEX_BITS)
+// Pauses of under a microsecond, then one bucket per power of two.
+#define LOOP_PAUSE_BUCKETS 32
+
+struct ChannelTable;
+struct Scheduler;
+struct VM;
+
+typedef struct Task Task;
+
+typedef enum FutureState
+{
+    FUTURE_FREE,
+    FUTURE_PENDING,
+    FUTURE_DONE
+} FutureState;
+
+// A timer, descriptor or task that one task can await. timer is the
+// wheel's timer while a timer is pending, and -1 otherwise.
+typedef struct Future
+{
+    FutureState state;
+    bool detached;
+    Value result;
+    Task* waiter;
+    int timer;
+    uint32_t generation;
+    int next;
+} Future;
+
+// A called async function. A suspended task keeps only its own frame,
+// with fp as an offset into it.
+typedef struct Task
+{
+    int future;
+    uint8_t* ip;
+    Value* frame;
+    size_t size;
+    size_t fp;
+    Value value;
+    bool started;
+    Task* caller;
+    Task* next;
+} Task;
+
+// The futures waiting on one descriptor, -1 for none.
+typedef struct Watch
+{
+    int reader;
+    int writer;
+    bool registered;
+} Watch;
+
+typedef enum MessageType
+{
+    MESSAGE_AWAIT,
+    MESSAGE_RESOLVE,
+    MESSAGE_DETACH,
+    MESSAGE_CANCEL
+} MessageType;
+
+// Asks the loop that owns future to act on it for another worker.
+typedef struct Message
+{
+    MessageType type;
+    int future;
+    Value value;
+    Task* task;
+    struct Message* next;
+} Message;
+
+// How long the loop ran tasks between polls. Once a pause reaches target,
+// in nanoseconds, the loop polls; over counts pauses a task ran past it.
+typedef struct Pauses
+{
+    bool enabled;
+    uint64_t target;
+    uint64_t counts[LOOP_PAUSE_BUCKETS];
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+    uint64_t over;
+} Pauses;
+
+// Runs the tasks of one VM and waits in epoll for descriptors and timers.
+// Under a scheduler a future's id also carries the worker that owns it.
+typedef struct EventLoop
+{
+    Future* futures;
+    int futureCapacity;
+    int freeFuture;
+    int freeFutureTail;
+    size_t futureCount;
+    size_t futurePeak;
+    Task* current;
+    Task* readyHead;
+    Task* readyTail;
+    size_t suspendedCount;
+    TimerWheel wheel;
+    uint64_t epoch;
+    Watch* watches;
+    int watchCapacity;
+    size_t watchCount;
+    int epoll;
+    bool resuming;
+    struct Scheduler* scheduler;
+    int worker;
+    int workerCount;
+    int wakeup;
+    struct ChannelTable* channels;
+    Pauses pauses;
+} EventLoop;
+
+void initLoop(EventLoop* loop);
+void freeLoop(EventLoop* loop);
+void freeTask(Task* task);
+int createFuture(EventLoop* loop);
+void completeFuture(EventLoop* loop, int future, Value value);
+void startTask(EventLoop* loop);
+int spawnTask(EventLoop* loop, FunctionObject* function, Value* args);
+bool isDone(EventLoop* loop, int future);
+Value takeResult(EventLoop* loop, int future);
+int suspendTask(EventLoop* loop, int future, uint8_t* ip, Value* fp, Value* sp);
+int resolveTask(EventLoop* loop, Value value);
+void detachFuture(EventLoop* loop, int future);
+int createTimer(EventLoop* loop, int32_t milliseconds);
+bool cancelFuture(EventLoop* loop, int future);
+int watchDescriptor(EventLoop* loop, int fd, bool write);
+void closeDescriptor(EventLoop* loop, int fd);
+void handleMessage(EventLoop* loop, Message* message);
+void pollLoop(EventLoop* loop, bool wait);
+uint64_t startPause(EventLoop* loop);
+bool isPauseOver(EventLoop* loop, uint64_t start);
+void endPause(EventLoop* loop, uint64_t start);
+void addPauses(Pauses* pauses, const Pauses* other);
+void runLoop(struct VM* vm);
+
+#endif
@@ -1,18 +1,39 @@
 #ifndef MODULE_OBJECT_H
 #define MODULE_OBJECT_H
 
+#include "functionobject.h"
 #include "object.h"
+#include "vector.h"
+#include <stddef.h>
 
 #define AS_MODULE_OBJECT(value) ((ModuleObject*)AS_OBJECT(value))
 
+typedef enum Backend
+{
+    BACKEND_STACK,
+    BACKEND_REGISTER
+} Backend;
+
+// An isolate's module shares the compiled code of the module it was made
+// from, which must outlive it, and has functions and loop counters of its
+// own for the interpreter to count in.
+typedef struct ModuleObject ModuleObject;
+
 typedef struct ModuleObject
 {
     Object obj;
     ValueArray constants;
+    Vector functions;
+    Vector loops;
+    Backend backend;
+    ModuleObject* shared;
 } ModuleObject;
 
 ModuleObject* createModuleObject();
+ModuleObject* createIsolateModule(ModuleObject* module);
 void freeModuleObject(ModuleObject* module);
+FunctionObject* addFunction(ModuleObject* module);
+size_t addLoop(ModuleObject* module, FunctionObject* function);
 void disassembleModule(ModuleObject* module);
 
 #endif
@@ -2,13 +2,94 @@
 #define NATIVE_H
 
 #include "value.h"
+#include <stdint.h>
 
-Value __exit(Value* args);
-Value __print(Value* args);
-Value __clamp(Value* args);
-Value __abs(Value* args);
-Value __min(Value* args);
-Value __max(Value* args);
-Value __byteorder(Value* args);
+struct VM;
+
+void __exit(struct VM* vm, Value* args);
+void __print(struct VM* vm, Value* args);
+void __clamp(struct VM* vm, Value* args);
+void __abs(struct VM* vm, Value* args);
+void __min(struct VM* vm, Value* args);
+void __max(struct VM* vm, Value* args);
+void __byteorder(struct VM* vm, Value* args);
+void __popcount(struct VM* vm, Value* args);
+void __clz(struct VM* vm, Value* args);
+void __ctz(struct VM* vm, Value* args);
+void __rotl(struct VM* vm, Value* args);
+void __rotr(struct VM* vm, Value* args);
+void __bswap(struct VM* vm, Value* args);
+void __timer(struct VM* vm, Value* args);
+void __cancel(struct VM* vm, Value* args);
+void __readable(struct VM* vm, Value* args);
+void __writable(struct VM* vm, Value* args);
+void __tcplisten(struct VM* vm, Value* args);
+void __tcpaccept(struct VM* vm, Value* args);
+void __tcpconnect(struct VM* vm, Value* args);
+void __tcpsend(struct VM* vm, Value* args);
+void __tcprecv(struct VM* vm, Value* args);
+void __closefd(struct VM* vm, Value* args);
+void __channew(struct VM* vm, Value* args);
+void __chansend(struct VM* vm, Value* args);
+void __chanrecv(struct VM* vm, Value* args);
+void __chanclose(struct VM* vm, Value* args);
+
+// The int operations behind the services the compiler inlines, shared by
+// the natives and the interpreter so that both agree with native code:
+// abs wraps, clz and ctz of 0 are 32 and rotations take the count mod 32.
+
+static inline int32_t absInt(int32_t n)
+{
+    return n < 0 ? (int32_t)(0 - (uint32_t)n) : n;
+}
+
+static inline int32_t minInt(int32_t a, int32_t b)
+{
+    return a < b ? a : b;
+}
+
+static inline int32_t maxInt(int32_t a, int32_t b)
+{
+    return a > b ? a : b;
+}
+
+static inline int32_t clampInt(int32_t num, int32_t min, int32_t max)
+{
+    return num < min ? min : num > max ? max : num;
+}
+
+static inline int32_t popcountInt(int32_t n)
+{
+    return __builtin_popcount((uint32_t)n);
+}
+
+static inline int32_t clzInt(int32_t n)
+{
+    return n == 0 ? 32 : __builtin_clz((uint32_t)n);
+}
+
+static inline int32_t ctzInt(int32_t n)
+{
+    return n == 0 ? 32 : __builtin_ctz((uint32_t)n);
+}
+
+static inline int32_t rotlInt(int32_t n, int32_t count)
+{
+    uint32_t x = n;
+
+    return (int32_t)(x << (count & 31) | x >> (-count & 31));
+}
+
+static inline int32_t rotrInt(int32_t n, int32_t count)
+{
+    uint32_t x = n;
+
+    return (int32_t)(x >> (count & 31) | x << (-count & 31));
+}
+
+static inline int32_t bswapInt(int32_t n)
+{
+    return (int32_t)__builtin_bswap32((uint32_t)n);
+}
 
 #endif
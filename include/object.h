@@ -5,6 +5,7 @@
 #include <stdlib.h>
 
 #define ALLOCATE_OBJECT(type, objectType) (type*)allocateObject(sizeof(type), objectType)
+#define FREE_OBJECT(type, object) freeObject((Object*)(object), sizeof(type))
 #define AS_OBJECT(value) ((Object*)AS_POINTER(value))
 
 typedef enum ObjectType
@@ -15,7 +16,8 @@ typedef enum ObjectType
     OBJ_INT,
     OBJ_FUNCTION,
     OBJ_MODULE,
-    OBJ_STRING
+    OBJ_STRING,
+    OBJ_TYPE_COUNT
 } ObjectType;
 
 typedef struct Object
@@ -24,5 +26,8 @@ typedef struct Object
 } Object;
 
 Object* allocateObject(size_t size, ObjectType type);
+void freeObject(Object* object, size_t size);
+size_t getAllocationCount(ObjectType type);
+const char* getObjectTypeName(ObjectType type);
 
 #endif
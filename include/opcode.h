@@ -4,7 +4,7 @@
 typedef enum Opcode
 {
     OP_HLT,         // hlt
-    OP_REQS,        // reqs imm8
+    OP_REQS,        // reqs imm16, imm8
     OP_LDC,         // ldc imm8
     OP_REG,         // reg
     OP_LDG,         // ldg imm8
@@ -50,7 +50,166 @@ typedef enum Opcode
     OP_JMP,         // jmp imm16
     OP_CALL,        // call imm16
     OP_RET,         // ret
-    OP_RETV         // retv
+    OP_RETV,        // retv
+    OP_ADDI,        // addi imm8
+    OP_SUBI,        // subi imm8
+    OP_MULI,        // muli imm8
+    OP_DIVI,        // divi imm8
+    OP_REMI,        // remi imm8
+    OP_LDL_ADD,     // ldl_add imm8
+    OP_LDL_SUB,     // ldl_sub imm8
+    OP_LDL_MUL,     // ldl_mul imm8
+    OP_LDL_LDL_ADD, // ldl_ldl_add imm8, imm8
+    OP_LDL_LDL_SUB, // ldl_ldl_sub imm8, imm8
+    OP_LDL_LDL_MUL, // ldl_ldl_mul imm8, imm8
+    OP_EQ,          // eq
+    OP_NE,          // ne
+    OP_LT,          // lt
+    OP_LE,          // le
+    OP_GT,          // gt
+    OP_GE,          // ge
+    OP_JZ,          // jz imm16
+    OP_LOOP,        // loop imm16, imm16
+    OP_TRACE,       // trace imm16, imm16
+
+    // The other numeric types. int8, int16 and the unsigned types up to 32
+    // bits share the int opcodes wherever the bits come out the same, as
+    // uint64 shares those of int64; float compares as the double it is
+    // kept as.
+    OP_CONV,        // conv imm8
+    OP_ADD_I64,     // add_i64
+    OP_SUB_I64,     // sub_i64
+    OP_MUL_I64,     // mul_i64
+    OP_DIV_I64,     // div_i64
+    OP_REM_I64,     // rem_i64
+    OP_NEG_I64,     // neg_i64
+    OP_BAND_I64,    // band_i64
+    OP_BOR_I64,     // bor_i64
+    OP_BXOR_I64,    // bxor_i64
+    OP_BNOT_I64,    // bnot_i64
+    OP_LSL_I64,     // lsl_i64
+    OP_LSR_I64,     // lsr_i64
+    OP_EQ_I64,      // eq_i64
+    OP_NE_I64,      // ne_i64
+    OP_LT_I64,      // lt_i64
+    OP_LE_I64,      // le_i64
+    OP_GT_I64,      // gt_i64
+    OP_GE_I64,      // ge_i64
+    OP_DIV_U64,     // div_u64
+    OP_REM_U64,     // rem_u64
+    OP_LSR_U64,     // lsr_u64
+    OP_LT_U64,      // lt_u64
+    OP_LE_U64,      // le_u64
+    OP_GT_U64,      // gt_u64
+    OP_GE_U64,      // ge_u64
+    OP_DIV_U32,     // div_u32
+    OP_REM_U32,     // rem_u32
+    OP_LSR_U32,     // lsr_u32
+    OP_LT_U32,      // lt_u32
+    OP_LE_U32,      // le_u32
+    OP_GT_U32,      // gt_u32
+    OP_GE_U32,      // ge_u32
+    OP_ADD_F32,     // add_f32
+    OP_SUB_F32,     // sub_f32
+    OP_MUL_F32,     // mul_f32
+    OP_DIV_F32,     // div_f32
+    OP_ADD_F64,     // add_f64
+    OP_SUB_F64,     // sub_f64
+    OP_MUL_F64,     // mul_f64
+    OP_DIV_F64,     // div_f64
+    OP_NEG_F64,     // neg_f64
+    OP_EQ_F64,      // eq_f64
+    OP_NE_F64,      // ne_f64
+    OP_LT_F64,      // lt_f64
+    OP_LE_F64,      // le_f64
+    OP_GT_F64,      // gt_f64
+    OP_GE_F64,      // ge_f64
+
+    // Services the compiler inlines. Each replaces its arguments with its
+    // result, like the service it stands for.
+    OP_ABS,         // abs
+    OP_MIN,         // min
+    OP_MAX,         // max
+    OP_CLAMP,       // clamp
+    OP_POPCNT,      // popcnt
+    OP_CLZ,         // clz
+    OP_CTZ,         // ctz
+    OP_ROTL,        // rotl
+    OP_ROTR,        // rotr
+    OP_BSWAP,       // bswap
+
+    // Async functions. async calls like call but starts a task and leaves
+    // the int naming its future; resolve returns from the task with the
+    // same. detach drops a future no one will await.
+    OP_ASYNC,       // async imm16
+    OP_AWAIT,       // await
+    OP_RESOLVE,     // resolve
+    OP_DETACH,      // detach
+
+    // Generators. generate starts one from its arguments and leaves it
+    // for next, which resumes it: a yield comes back with a value, while
+    // finish, at its end, comes back by taking the jump next carries.
+    // close ends a generator that a return leaves early.
+    OP_GENERATE,    // generate imm16
+    OP_NEXT,        // next imm16
+    OP_YIELD,       // yield
+    OP_FINISH,      // finish
+    OP_CLOSE,       // close
+
+    // Compound assignments to globals, which tasks on other workers may
+    // make at the same time. lkg takes the globals and loads one under
+    // the right operand; ulg stores it and gives them back.
+    OP_LKG,         // lkg imm8
+    OP_ULG,         // ulg imm8
+
+    // Written by the bytecode optimizer, never by the compiler.
+    OP_JEQ,         // jeq imm16
+    OP_JNE,         // jne imm16
+    OP_JLT,         // jlt imm16
+    OP_JLE,         // jle imm16
+    OP_JGT,         // jgt imm16
+    OP_JGE,         // jge imm16
+    OP_INCL         // incl imm8, imm8
 } Opcode;
 
+// Register instructions are four bytes wide: opcode, a, b, c.
+// Registers are frame-relative; imm16 occupies the b and c bytes.
+typedef enum RegisterOpcode
+{
+    ROP_HLT,        // hlt
+    ROP_REQS,       // reqs ra, imm16
+    ROP_LDC,        // ldc ra, imm16
+    ROP_LDI,        // ldi ra, imm16
+    ROP_REG,        // reg ra
+    ROP_LDG,        // ldg ra, imm16
+    ROP_STG,        // stg ra, imm16
+    ROP_MOV,        // mov ra, rb
+    ROP_ADD,        // add ra, rb, rc
+    ROP_SUB,        // sub ra, rb, rc
+    ROP_MUL,        // mul ra, rb, rc
+    ROP_DIV,        // div ra, rb, rc
+    ROP_REM,        // rem ra, rb, rc
+    ROP_POW,        // pow ra, rb, rc
+    ROP_BAND,       // band ra, rb, rc
+    ROP_BOR,        // bor ra, rb, rc
+    ROP_BXOR,       // bxor ra, rb, rc
+    ROP_LSL,        // lsl ra, rb, rc
+    ROP_LSR,        // lsr ra, rb, rc
+    ROP_BNOT,       // bnot ra, rb
+    ROP_NOT,        // not ra, rb
+    ROP_NEG,        // neg ra, rb
+    ROP_CALL,       // call ra, imm16
+    ROP_RET,        // ret
+    ROP_RETV,       // retv ra
+    ROP_EQ,         // eq ra, rb, rc
+    ROP_NE,         // ne ra, rb, rc
+    ROP_LT,         // lt ra, rb, rc
+    ROP_LE,         // le ra, rb, rc
+    ROP_GT,         // gt ra, rb, rc
+    ROP_GE,         // ge ra, rb, rc
+    ROP_JZ,         // jz ra, imm16
+    ROP_JMP,        // jmp imm16
+    ROP_LOOP        // loop imm16
+} RegisterOpcode;
+
 #endif
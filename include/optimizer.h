@@ -0,0 +1,12 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "functionobject.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+struct VM;
+
+bool optimizeFunction(struct VM* vm, FunctionObject* function, uint8_t** ip);
+
+#endif
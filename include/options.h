@@ -1,11 +1,29 @@
 #ifndef OPTIONS_H
 #define OPTIONS_H
 
+#include "jit.h"
+#include "moduleobject.h"
+#include "tier.h"
 #include <stdbool.h>
+#include <stdint.h>
+
+#define OPTIONS_LIBRARIES_MAX 16
 
 typedef struct Options
 {
     bool disassemble;
+    bool statistics;
+    bool profile;
+    bool counters;
+    Backend backend;
+    JitMode jit;
+    TierPolicy policy;
+    const char* libraries[OPTIONS_LIBRARIES_MAX];
+    int libraryCount;
+    uint32_t isolates;
+    uint32_t jobs;
+    uint32_t workers;
+    uint32_t pauseTarget;
     const char* filename;
 } Options;
 
@@ -1,9 +1,33 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include "arena.h"
 #include "ast.h"
+#include "lexer.h"
+#include "scope.h"
+#include "token.h"
+#include <stdbool.h>
 
-void initParser(AST* ast);
-void parse(char* source);
+// One parse in progress, with the lexer feeding it. The scopes and nodes
+// it builds hang off topLevel and belong to it alone, and all of them come
+// from its arena; the names in them are interned. iterating is set
+// while the generator call of a for is read, and forDepth counts the fors
+// around the statement being read in the current function.
+typedef struct Parser
+{
+    Arena arena;
+    Lexer lexer;
+    Token currentToken;
+    Token prevToken;
+    Scope* currentScope;
+    AST* currentFunction;
+    AST* topLevel;
+    bool iterating;
+    int forDepth;
+} Parser;
+
+void initParser(Parser* parser);
+void freeParser(Parser* parser);
+void parse(Parser* parser, char* source);
 
 #endif
@@ -0,0 +1,66 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "moduleobject.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// A power of two.
+#define POOL_QUEUE_SIZE 1024
+#define POOL_THREADS_MAX 256
+#define CACHE_LINE 64
+
+// A script to run and when it was submitted, started and finished, in
+// seconds on the monotonic clock. The module is only read, so any number
+// of jobs may share it while they run.
+typedef struct Job
+{
+    ModuleObject* module;
+    double submitted;
+    double started;
+    double finished;
+} Job;
+
+// A bounded queue any thread may push to and pop from without taking a
+// lock. Each slot carries a sequence number that says whether it is ready
+// to be written or to be read in the current lap of the ring.
+typedef struct JobSlot
+{
+    atomic_size_t sequence;
+    Job* job;
+} JobSlot;
+
+typedef struct JobQueue
+{
+    JobSlot slots[POOL_QUEUE_SIZE];
+    alignas(CACHE_LINE) atomic_size_t head;
+    alignas(CACHE_LINE) atomic_size_t tail;
+} JobQueue;
+
+// Runs jobs on a fixed number of threads, each with a VM of its own: an
+// isolate. Isolates share the compiled modules and nothing else, so every
+// job starts with empty globals and stack. They run interpreted; tiering
+// up would rewrite code the other isolates are running.
+typedef struct Pool
+{
+    JobQueue queue;
+    pthread_t threads[POOL_THREADS_MAX];
+    int threadCount;
+    sem_t pending;
+    sem_t done;
+    atomic_size_t submitted;
+    atomic_size_t finished;
+    atomic_bool stopping;
+} Pool;
+
+bool initPool(Pool* pool, int threadCount);
+void freePool(Pool* pool);
+bool submitJob(Pool* pool, Job* job);
+void waitPool(Pool* pool);
+void printLatencies(Job* jobs, size_t count, double seconds);
+
+#endif
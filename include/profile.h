@@ -0,0 +1,27 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROFILE_OPCODES_MAX 256
+#define PROFILE_TRIPLES_MAX 65536
+
+typedef const char* (*opcode_name_t)(uint8_t opcode);
+
+typedef struct Profile
+{
+    uint64_t pairs[PROFILE_OPCODES_MAX][PROFILE_OPCODES_MAX];
+    uint32_t tripleKeys[PROFILE_TRIPLES_MAX];
+    uint64_t tripleCounts[PROFILE_TRIPLES_MAX];
+    uint64_t total;
+    uint32_t history;
+    int historyCount;
+} Profile;
+
+Profile* createProfile();
+void freeProfile(Profile* profile);
+void recordOpcode(Profile* profile, uint8_t opcode);
+void printProfile(Profile* profile, opcode_name_t name, size_t limit);
+
+#endif
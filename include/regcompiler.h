@@ -0,0 +1,29 @@
+#ifndef REG_COMPILER_H
+#define REG_COMPILER_H
+
+#include "ast.h"
+#include "functionobject.h"
+#include "moduleobject.h"
+#include "parser.h"
+#include "vector.h"
+#include <stddef.h>
+
+// The register backend's counterpart of Compiler, just as independent.
+typedef struct RegisterCompiler
+{
+    Parser parser;
+    Vector functionReferences;
+    ModuleObject* module;
+    FunctionObject* function;
+    AST* ast;
+    size_t statementCount;
+    int temporaryBase;
+    int registerTop;
+    int blockDepth;
+} RegisterCompiler;
+
+void initRegisterCompiler(RegisterCompiler* compiler, ModuleObject* module);
+void freeRegisterCompiler(RegisterCompiler* compiler);
+void compileRegisters(RegisterCompiler* compiler, char* source);
+
+#endif
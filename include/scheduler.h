@@ -0,0 +1,100 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "channel.h"
+#include "loop.h"
+#include "moduleobject.h"
+#include "pool.h"
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SCHEDULER_WORKERS_MAX POOL_THREADS_MAX
+// A power of two.
+#define DEQUE_SIZE 256
+// Ready tasks a worker runs before it looks at its descriptors and timers.
+#define SCHEDULER_POLL_INTERVAL 64
+
+typedef struct DequeArray DequeArray;
+
+// A ring of tasks; a deque that outgrows it moves to one twice the size.
+// Thieves may still be reading the old one, so it is kept, as retired,
+// until the deque goes away.
+typedef struct DequeArray
+{
+    int64_t size;
+    DequeArray* retired;
+    _Atomic(Task*) tasks[];
+} DequeArray;
+
+// A Chase-Lev deque. Its owner pushes and pops at bottom without taking a
+// lock, and only races the others for the last task; any thread may steal
+// from top, and thieves race each other with a compare and swap on it.
+typedef struct Deque
+{
+    alignas(CACHE_LINE) _Atomic int64_t top;
+    alignas(CACHE_LINE) _Atomic int64_t bottom;
+    _Atomic(DequeArray*) array;
+} Deque;
+
+typedef enum WorkerState
+{
+    WORKER_RUNNING,
+    WORKER_SLEEPING,
+    WORKER_BLOCKED
+} WorkerState;
+
+// A thread with a VM of its own, whose ready tasks are in its deque. Other
+// workers post messages for the futures of its loop to its inbox, a stack
+// it takes whole. A worker with nothing to run or steal sleeps in epoll; a
+// blocked one has no timers or descriptors either, so only another worker
+// can wake it. Workers share the module's bytecode and the globals the
+// script left behind, which they load and store atomically; each has its
+// own copy of the functions so that their counters stay apart.
+typedef struct Worker
+{
+    Deque deque;
+    alignas(CACHE_LINE) _Atomic(Message*) inbox;
+    _Atomic int state;
+    struct VM* vm;
+    ModuleObject* isolate;
+    pthread_t thread;
+    uint32_t seed;
+    uint64_t turns;
+    struct Scheduler* scheduler;
+} Worker;
+
+// Runs the tasks of a script on workerCount threads, M:N: the script
+// itself runs first, on the calling thread as worker 0, and every async
+// call spawns a task in the deque of the worker making it. Idle workers
+// steal from a victim picked at random. live counts the tasks that have
+// not finished; the scheduler stops once none are left, or once every
+// worker is blocked and no message is on its way, when none ever will.
+// globals is held across the load and store of a compound assignment to
+// a global, so that none is lost to another worker's.
+typedef struct Scheduler
+{
+    Worker* workers;
+    int workerCount;
+    ChannelTable channels;
+    pthread_mutex_t globals;
+    alignas(CACHE_LINE) atomic_size_t live;
+    alignas(CACHE_LINE) atomic_size_t messages;
+    atomic_int sleeping;
+    atomic_int blocked;
+    atomic_bool stopping;
+} Scheduler;
+
+bool initScheduler(Scheduler* scheduler, struct VM* vm, int workerCount);
+void freeScheduler(Scheduler* scheduler);
+void addTask(Scheduler* scheduler, int worker, Task* task);
+void scheduleTask(Scheduler* scheduler, int worker, Task* task);
+void finishTask(Scheduler* scheduler);
+void postMessage(Scheduler* scheduler, int worker, Message* message);
+void runScheduler(Scheduler* scheduler);
+void lockGlobals(Scheduler* scheduler);
+void unlockGlobals(Scheduler* scheduler);
+
+#endif
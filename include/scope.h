@@ -1,6 +1,7 @@
 #ifndef SCOPE_H
 #define SCOPE_H
 
+#include "arena.h"
 #include "object.h"
 #include "table.h"
 
@@ -15,11 +16,11 @@ typedef struct Scope
     Table symbols;
 } Scope;
 
-Scope* createScope(Scope* parent);
-void freeScope(Scope* scope);
+Scope* createScope(Arena* arena, Scope* parent);
 size_t getLocalCount(Scope* scope);
 size_t getLevel(Scope* scope);
 bool isTopLevel(Scope* scope);
+size_t reserveLocal(Scope* scope);
 AST* setLocalSymbol(Scope* scope, StringObject* id, AST* symbol);
 AST* setLocalVariableSymbol(Scope* scope, StringObject* id, AST* symbol);
 AST* getLocalSymbol(Scope* scope, StringObject* id);
@@ -1,17 +1,49 @@
 #ifndef SVC_H
 #define SVC_H
 
-#define SERVICES_MAX 7
+#include "stringobject.h"
+#include "table.h"
+#include "value.h"
+#include "vector.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
+// reqs has sixteen bits for the service and four for each count.
+#define SERVICES_MAX (UINT16_MAX + 1)
+#define SERVICE_PARAMS_MAX 15
+
+struct VM;
+
+// Natives get the VM and their first argument and overwrite the arguments
+// with their results.
+typedef void (*service_t)(struct VM* vm, Value* args);
+
+// What the compiler knows about a service. A future that a statement
+// drops is detached.
 typedef struct Service
 {
-    char* name;
+    StringObject* name;
     int opcode;
     int paramCount;
-    int params[4];
+    int resultCount;
+    int params[SERVICE_PARAMS_MAX];
     int typeId;
+    bool future;
 } Service;
 
+// Built-in and registered services. lock guards names and services; a
+// slot of functions is written once, before its opcode is handed out.
+typedef struct ServiceRegistry
+{
+    Vector services;
+    Table names;
+    pthread_mutex_t lock;
+    service_t functions[SERVICES_MAX];
+} ServiceRegistry;
+
+// The built-in services, registered first and in this order.
 typedef enum ServiceOpcode
 {
     SOP_EXIT,
@@ -20,11 +52,34 @@ typedef enum ServiceOpcode
     SOP_ABS,
     SOP_MIN,
     SOP_MAX,
-    SOP_BYTEORDER
+    SOP_BYTEORDER,
+    SOP_POPCOUNT,
+    SOP_CLZ,
+    SOP_CTZ,
+    SOP_ROTL,
+    SOP_ROTR,
+    SOP_BSWAP,
+    SOP_TIMER,
+    SOP_CANCEL,
+    SOP_READABLE,
+    SOP_WRITABLE,
+    SOP_TCPLISTEN,
+    SOP_TCPACCEPT,
+    SOP_TCPCONNECT,
+    SOP_TCPSEND,
+    SOP_TCPRECV,
+    SOP_CLOSEFD,
+    SOP_CHANNEW,
+    SOP_CHANSEND,
+    SOP_CHANRECV,
+    SOP_CLOSECHANNEL
 } ServiceOpcode;
 
-Service services[SERVICES_MAX];
+extern ServiceRegistry serviceRegistry;
 
-Service* getServiceByName(char* name);
+void initServices();
+void freeServices();
+Service* registerService(const char* name, service_t function, int typeId, int paramCount, const int* params);
+Service* getServiceByName(StringObject* name);
 
 #endif
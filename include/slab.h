@@ -0,0 +1,43 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdalign.h>
+#include <stddef.h>
+
+// Blocks come in classes SLAB_ALIGN bytes apart, up to SLAB_SIZE_MAX.
+#define SLAB_ALIGN 16
+#define SLAB_SIZE_MAX 256
+#define SLAB_CLASSES (SLAB_SIZE_MAX / SLAB_ALIGN)
+// What each class takes from malloc at a time.
+#define SLAB_SIZE 65536
+
+typedef struct Block Block;
+typedef struct Slab Slab;
+
+typedef struct Block
+{
+    Block* next;
+} Block;
+
+// The blocks of one class on one thread: those freed, newest first, and
+// the part of its last slab not handed out yet.
+typedef struct SlabClass
+{
+    Block* free;
+    char* next;
+    char* end;
+} SlabClass;
+
+// Slabs are chained so that they can all go at exit, and are only ever
+// given back then.
+typedef struct Slab
+{
+    Slab* next;
+    alignas(SLAB_ALIGN) char blocks[];
+} Slab;
+
+void* allocateSlab(size_t size);
+void freeSlab(void* block, size_t size);
+void freeSlabs();
+
+#endif
@@ -14,7 +14,6 @@ typedef struct StringObject
 } StringObject;
 
 StringObject* createStringObject(char* chars, size_t len, size_t hash);
-StringObject* copyStringObject(const char* chars, size_t len);
 void freeStringObject(StringObject* string);
 bool compareStringObject(StringObject* a, StringObject* b);
 size_t hashStringObject(const char* chars, size_t len);
@@ -1,6 +1,7 @@
 #ifndef TABLE_H
 #define TABLE_H
 
+#include "arena.h"
 #include "stringobject.h"
 #include <stddef.h>
 
@@ -13,16 +14,21 @@ typedef struct TableItem
     TableItem* next;
 } TableItem;
 
+// Keys are interned strings, so two are the same key only if they are the
+// same string. A table with an arena takes its buckets and items from it
+// and goes with it; the keys are never the table's.
 typedef struct Table
 {
     TableItem** data;
     size_t capacity;
     size_t count;
+    Arena* arena;
 } Table;
 
-TableItem* createTableItem(StringObject* key, void* value, TableItem* next);
+TableItem* createTableItem(Arena* arena, StringObject* key, void* value, TableItem* next);
 void freeTableItem(TableItem* item);
 void initTable(Table* table, size_t capacity);
+void initArenaTable(Table* table, size_t capacity, Arena* arena);
 void freeTable(Table* table);
 size_t countTable(Table* table);
 void* getTableAt(Table* table, StringObject* key);
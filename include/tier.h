@@ -0,0 +1,40 @@
+#ifndef TIER_H
+#define TIER_H
+
+#include "functionobject.h"
+#include "moduleobject.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TIER_OPTIMIZE_THRESHOLD 10
+#define TIER_NATIVE_THRESHOLD 100
+#define TIER_TRACE_THRESHOLD 56
+#define TIER_OSR_BACKOFF 1024
+
+struct VM;
+
+// Hotness at which code moves up a tier; zero turns a tier off. A
+// function's hotness is its calls plus the backward branches taken in it,
+// a loop's is its backward branches.
+typedef struct TierPolicy
+{
+    uint32_t optimizeThreshold;
+    uint32_t nativeThreshold;
+    uint32_t traceThreshold;
+} TierPolicy;
+
+// What the interpreter does after a loop was looked at.
+typedef enum LoopAction
+{
+    LOOP_INTERPRET,
+    LOOP_RECORD,
+    LOOP_ENTER_NATIVE
+} LoopAction;
+
+void initTierPolicy(TierPolicy* policy);
+bool promoteFunction(struct VM* vm, FunctionObject* function);
+LoopAction promoteLoop(struct VM* vm, LoopCounter* loop, uint8_t** ip);
+const char* getTierName(Tier tier);
+void printCounters(ModuleObject* module);
+
+#endif
@@ -151,6 +151,7 @@ typedef struct Token
 void printToken(Token* token);
 bool isAssignmentToken(TokenType type);
 bool isTypeToken(TokenType type);
+TokenType getBinaryOperatorToken(TokenType type);
 bool isComparisonToken(TokenType type);
 bool isEqualityToken(TokenType type);
 bool isBoolOperatorToken(TokenType type);
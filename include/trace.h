@@ -0,0 +1,52 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "value.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TRACE_BACKOFF 1024
+#define TRACES_MAX 256
+#define TRACE_LENGTH_MAX 512
+#define TRACE_EXITS_MAX 64
+
+struct VM;
+
+// A compiled trace runs its loop from the header with the interpreter's
+// frame and stack pointers until a guard fails, then returns the index of
+// the exit it left through.
+typedef int (*trace_t)(Value* fp, Value* sp, struct VM* vm);
+
+// Where the interpreter resumes after an exit, and how many operands the
+// exit left on the stack above the one the trace was entered with.
+typedef struct TraceExit
+{
+    uint8_t* ip;
+    int depth;
+} TraceExit;
+
+typedef struct Trace
+{
+    trace_t code;
+    uint8_t* header;
+    TraceExit* exits;
+    int exitCount;
+} Trace;
+
+typedef struct Tracer
+{
+    Trace traces[TRACES_MAX];
+    int traceCount;
+    bool recording;
+    uint8_t* header;
+    Value* fp;
+    uint8_t* ips[TRACE_LENGTH_MAX];
+    int count;
+} Tracer;
+
+void initTracer(Tracer* tracer);
+void freeTracer(Tracer* tracer);
+void startRecording(Tracer* tracer, uint8_t* header, Value* fp);
+bool recordInstruction(struct VM* vm, uint8_t* ip, Value* fp);
+
+#endif
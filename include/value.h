@@ -3,24 +3,73 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
-#define BOOL_VALUE(value) ((Value){.boolValue = value})
-#define FLOAT_VALUE(value) ((Value){.floatValue = value})
-#define INT_VALUE(value) ((Value){.intValue = value})
-#define POINTER_VALUE(ptr) ((Value){.pointer = ptr})
+// A Value is a NaN-boxed 64-bit word. Doubles are stored as themselves;
+// everything else hides in the payload of a quiet NaN, told apart by the
+// top sixteen bits:
+//
+//   0x7ffd  int      the language's 32-bit int in the low half
+//   0x7ffe  bool     0 or 1 in the low bit
+//   0xfffc  pointer  a 48-bit address
+//
+// Native code computes ints in the low half of a register and ors INT_TAG
+// back in. NaNs produced by arithmetic are made canonical so that they
+// never look like a tag.
+//
+// The narrower integer types share the int tag, unsigned ones keeping
+// their bits in the low half, and float is kept as the double it widens
+// to. int64 and uint64 need all sixty-four bits and are not boxed at all:
+// the compiler knows which slots hold them, so nothing ever asks such a
+// value what it is.
 
-#define AS_BOOL(value) ((value).boolValue)
-#define AS_FLOAT(value) ((value).floatValue)
-#define AS_INT(value) ((value).intValue)
-#define AS_POINTER(value) ((value).pointer)
+#define SIGN_BIT ((uint64_t)0x8000000000000000)
+#define QNAN ((uint64_t)0x7ffc000000000000)
+#define TAG_MASK ((uint64_t)0xffff000000000000)
+#define CANONICAL_NAN ((uint64_t)0x7ff8000000000000)
 
-typedef union Value
+#define INT_TAG (QNAN | (uint64_t)0x0001000000000000)
+#define BOOL_TAG (QNAN | (uint64_t)0x0002000000000000)
+#define POINTER_TAG (SIGN_BIT | QNAN)
+
+#define BOOL_VALUE(value) (BOOL_TAG | (uint64_t)(bool)(value))
+#define FLOAT_VALUE(value) (doubleToValue(value))
+#define INT_VALUE(value) (INT_TAG | (uint32_t)(int32_t)(value))
+#define UINT_VALUE(value) (INT_TAG | (uint32_t)(value))
+#define I64_VALUE(value) ((Value)(int64_t)(value))
+#define POINTER_VALUE(ptr) (POINTER_TAG | (uint64_t)(uintptr_t)(ptr))
+
+#define AS_BOOL(value) ((bool)((value) & 1))
+#define AS_FLOAT(value) (valueToDouble(value))
+#define AS_INT(value) ((int32_t)(uint32_t)(value))
+#define AS_UINT(value) ((uint32_t)(value))
+#define AS_I64(value) ((int64_t)(value))
+#define AS_U64(value) ((uint64_t)(value))
+#define AS_POINTER(value) ((void*)(uintptr_t)((value) & ~POINTER_TAG))
+
+#define IS_BOOL(value) (((value) & TAG_MASK) == BOOL_TAG)
+#define IS_FLOAT(value) (((value) & QNAN) != QNAN)
+#define IS_INT(value) (((value) & TAG_MASK) == INT_TAG)
+#define IS_POINTER(value) (((value) & POINTER_TAG) == POINTER_TAG)
+
+typedef uint64_t Value;
+
+// The representations of the numeric types. conv packs the pair it
+// converts between into its operand, four bits each.
+typedef enum NumberKind
 {
-    bool boolValue;
-    float floatValue;
-    int intValue;
-    void* pointer;
-} Value;
+    NUMBER_I8,
+    NUMBER_I16,
+    NUMBER_I32,
+    NUMBER_I64,
+    NUMBER_U8,
+    NUMBER_U16,
+    NUMBER_U32,
+    NUMBER_U64,
+    NUMBER_F32,
+    NUMBER_F64
+} NumberKind;
 
 typedef struct ValueArray
 {
@@ -29,6 +78,28 @@ typedef struct ValueArray
     size_t count;
 } ValueArray;
 
+static inline Value doubleToValue(double number)
+{
+    Value value;
+
+    if (number != number) {
+        return CANONICAL_NAN;
+    }
+
+    memcpy(&value, &number, sizeof(value));
+
+    return value;
+}
+
+static inline double valueToDouble(Value value)
+{
+    double number;
+
+    memcpy(&number, &value, sizeof(number));
+
+    return number;
+}
+
 void initValueArray(ValueArray* array);
 void freeValueArray(ValueArray* array);
 size_t countValueArray(ValueArray* array);
@@ -37,5 +108,6 @@ void resizeValueArray(ValueArray* array, size_t size);
 size_t pushValue(ValueArray* array, Value value);
 void* getValueAsPointer(ValueArray* array, size_t index);
 void setValueAt(ValueArray* array, size_t index, Value item);
+Value convertNumber(Value value, NumberKind from, NumberKind to);
 
 #endif
@@ -1,16 +1,20 @@
 #ifndef VECTOR_H
 #define VECTOR_H
 
+#include "arena.h"
 #include <stddef.h>
 
+// A vector with an arena grows within it and goes with it.
 typedef struct Vector
 {
     void** data;
     size_t capacity;
     size_t count;
+    Arena* arena;
 } Vector;
 
 void initVector(Vector* vector);
+void initArenaVector(Vector* vector, Arena* arena);
 void freeVector(Vector* vector);
 size_t countVector(Vector* vector);
 void reserveVector(Vector* vector, size_t capacity);
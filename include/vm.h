@@ -1,28 +1,56 @@
 #ifndef VM_H
 #define VM_H
 
+#include "generator.h"
+#include "jit.h"
+#include "loop.h"
 #include "moduleobject.h"
+#include "profile.h"
 #include "service.h"
+#include "tier.h"
+#include "trace.h"
+#include "vector.h"
 #include <stdint.h>
 
 #define STACK_MAX 1024
 
-typedef Value (*service_t)(Value* args);
+// Where native code stopped when it handed its frame back to the
+// interpreter; operands, if any, lie between base and sp. ip is NULL
+// except between the exit and the resume.
+typedef struct Deopt
+{
+    uint8_t* ip;
+    Value* fp;
+    Value* sp;
+    Value* base;
+} Deopt;
 
 typedef struct VM
 {
     Value stack[STACK_MAX];
-    service_t service[SERVICES_MAX];
+    service_t* service;
     uint8_t* ip;
     Value* sp;
     Value* fp;
     ModuleObject* module;
     ValueArray globals;
+    uint64_t instructionCount;
+    Profile* profile;
+    Jit jit;
+    Tracer tracer;
+    TierPolicy policy;
+    Vector retiredCode;
+    Deopt deopt;
+    EventLoop loop;
+    GeneratorStack generators;
 } VM;
 
 void initVM(VM* vm, ModuleObject* module);
 void freeVM(VM* vm);
 void inspectStack(VM* vm);
 void interpret(VM* vm);
+Value* callFunction(VM* vm, Value* sp, FunctionObject* function);
+Value* resumeCall(VM* vm, Value* sp);
+void resumeTask(VM* vm, Task* task);
 
 #endif
@@ -0,0 +1,53 @@
+#ifndef WHEEL_H
+#define WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Six levels of 64 slots cover 2^36 ticks, more than any int32 delay.
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 6
+#define WHEEL_NONE UINT64_MAX
+
+// A timer is linked into the slot it waits in, by index, so that it can
+// be taken out without searching.
+typedef struct WheelTimer
+{
+    uint64_t deadline;
+    int future;
+    int prev;
+    int next;
+    uint8_t level;
+    uint8_t slot;
+} WheelTimer;
+
+// Timers hashed by deadline into levels of slots, each level counting
+// ticks 64 times coarser than the one below. A timer goes to the lowest
+// level where its deadline shares every higher digit with now, and moves
+// down a level whenever now reaches the start of its slot, so adding and
+// cancelling take constant time and a slot of level 0 holds exactly the
+// timers due at one tick. Which slots hold anything is kept in a bitmap
+// per level, so that runs of empty ticks are skipped.
+typedef struct TimerWheel
+{
+    WheelTimer* timers;
+    int capacity;
+    int freeTimer;
+    size_t count;
+    uint64_t now;
+    int slots[WHEEL_LEVELS][WHEEL_SIZE];
+    uint64_t occupied[WHEEL_LEVELS];
+} TimerWheel;
+
+// Called for each timer as it expires, with the future it was added with.
+typedef void (*expire_t)(void* context, int future);
+
+void initWheel(TimerWheel* wheel);
+void freeWheel(TimerWheel* wheel);
+int addTimer(TimerWheel* wheel, uint64_t deadline, int future);
+void cancelTimer(TimerWheel* wheel, int timer);
+uint64_t getNextTick(TimerWheel* wheel);
+void advanceWheel(TimerWheel* wheel, uint64_t tick, expire_t expire, void* context);
+
+#endif
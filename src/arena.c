@@ -0,0 +1,87 @@
+#include "arena.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ALIGN_SIZE(size) (((size) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+static const char* outOfMemoryError = "Error: Out of memory\n";
+
+void initArena(Arena* arena)
+{
+    arena->chunks = NULL;
+    arena->next = NULL;
+    arena->end = NULL;
+}
+
+void freeArena(Arena* arena)
+{
+    ArenaChunk* chunk = arena->chunks;
+
+    while (chunk) {
+        ArenaChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    initArena(arena);
+}
+
+static ArenaChunk* addChunk(Arena* arena, size_t size)
+{
+    ArenaChunk* chunk = malloc(sizeof(ArenaChunk) + size);
+
+    if (!chunk) {
+        fprintf(stderr, "%s", outOfMemoryError);
+        exit(1);
+    }
+
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+
+    return chunk;
+}
+
+void* allocateArena(Arena* arena, size_t size)
+{
+    size = ALIGN_SIZE(size);
+
+    if (size > ARENA_LARGE_SIZE) {
+        return addChunk(arena, size)->data;
+    }
+
+    if ((size_t)(arena->end - arena->next) < size) {
+        ArenaChunk* chunk = addChunk(arena, ARENA_CHUNK_SIZE);
+
+        arena->next = chunk->data;
+        arena->end = chunk->data + ARENA_CHUNK_SIZE;
+    }
+
+    void* pointer = arena->next;
+    arena->next += size;
+
+    return pointer;
+}
+
+// Grows pointer, of oldSize, in place when it was the last thing handed
+// out and there is room after it, and copies it otherwise, leaving the
+// old copy to go with the arena.
+void* reallocateArena(Arena* arena, void* pointer, size_t oldSize, size_t size)
+{
+    char* end = (char*)pointer + ALIGN_SIZE(oldSize);
+
+    if (pointer && size >= oldSize && end == arena->next
+        && ALIGN_SIZE(size) - ALIGN_SIZE(oldSize) <= (size_t)(arena->end - end)) {
+        arena->next = (char*)pointer + ALIGN_SIZE(size);
+        return pointer;
+    }
+
+    void* copy = allocateArena(arena, size);
+
+    if (pointer) {
+        memcpy(copy, pointer, oldSize < size ? oldSize : size);
+    }
+
+    return copy;
+}
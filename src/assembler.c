@@ -0,0 +1,424 @@
+#include "assembler.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GROW_CAPACITY(capacity) ((capacity) < 256 ? 256 : (capacity) * 2)
+
+#define REX_W 0x08
+#define REX_R 0x04
+#define REX_B 0x01
+
+void initAssembler(Assembler* as)
+{
+    as->data = NULL;
+    as->capacity = 0;
+    as->count = 0;
+}
+
+void freeAssembler(Assembler* as)
+{
+    free(as->data);
+}
+
+static void emitByte(Assembler* as, uint8_t byte)
+{
+    if (as->capacity == as->count) {
+        as->capacity = GROW_CAPACITY(as->capacity);
+        as->data = realloc(as->data, as->capacity);
+    }
+
+    as->data[as->count++] = byte;
+}
+
+static void emit32(Assembler* as, int32_t n)
+{
+    for (int i = 0; i < 4; i++) {
+        emitByte(as, (uint32_t)n >> (8 * i));
+    }
+}
+
+static void emit64(Assembler* as, uint64_t n)
+{
+    for (int i = 0; i < 8; i++) {
+        emitByte(as, n >> (8 * i));
+    }
+}
+
+static void emitRex(Assembler* as, bool wide, Register reg, Register rm)
+{
+    uint8_t rex = (wide ? REX_W : 0) | (reg >= R8 ? REX_R : 0) | (rm >= R8 ? REX_B : 0);
+
+    if (rex) {
+        emitByte(as, 0x40 | rex);
+    }
+}
+
+static void emitDirect(Assembler* as, int reg, Register rm)
+{
+    emitByte(as, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+// [base + disp] with a one byte displacement when it fits. rsp and r12 as
+// a base can only be encoded through a SIB byte.
+static void emitIndirect(Assembler* as, int reg, Register base, int32_t disp)
+{
+    bool shortDisp = disp >= INT8_MIN && disp <= INT8_MAX;
+
+    emitByte(as, (shortDisp ? 0x40 : 0x80) | (reg & 7) << 3 | (base & 7));
+
+    if ((base & 7) == RSP) {
+        emitByte(as, 0x24);
+    }
+
+    if (shortDisp) {
+        emitByte(as, disp);
+    } else {
+        emit32(as, disp);
+    }
+}
+
+void emitMov(Assembler* as, Register dst, Register src)
+{
+    emitRex(as, true, src, dst);
+    emitByte(as, 0x89);
+    emitDirect(as, src, dst);
+}
+
+void emitMovImm(Assembler* as, Register dst, int32_t imm)
+{
+    emitRex(as, false, RAX, dst);
+    emitByte(as, 0xB8 + (dst & 7));
+    emit32(as, imm);
+}
+
+void emitMovImm64(Assembler* as, Register dst, uint64_t imm)
+{
+    emitRex(as, true, RAX, dst);
+    emitByte(as, 0xB8 + (dst & 7));
+    emit64(as, imm);
+}
+
+void emitLoad(Assembler* as, Register dst, Register base, int32_t disp)
+{
+    emitRex(as, true, dst, base);
+    emitByte(as, 0x8B);
+    emitIndirect(as, dst, base, disp);
+}
+
+// Loads a one, two or four byte value into the low half of dst,
+// sign- or zero-extending it; the upper half is cleared either way.
+void emitLoadNarrow(Assembler* as, Register dst, Register base, int32_t disp, int size, bool sign)
+{
+    emitRex(as, false, dst, base);
+
+    if (size == 4) {
+        emitByte(as, 0x8B);
+    } else {
+        emitByte(as, 0x0F);
+        emitByte(as, (sign ? 0xBE : 0xB6) + (size == 2));
+    }
+
+    emitIndirect(as, dst, base, disp);
+}
+
+// movsd dst, [base + disp]
+void emitLoadDouble(Assembler* as, XmmRegister dst, Register base, int32_t disp)
+{
+    emitByte(as, 0xF2);
+    emitRex(as, false, RAX, base);
+    emitByte(as, 0x0F);
+    emitByte(as, 0x10);
+    emitIndirect(as, dst, base, disp);
+}
+
+// cvtsd2ss dst, [base + disp]: a float from the double in memory.
+void emitLoadFloat(Assembler* as, XmmRegister dst, Register base, int32_t disp)
+{
+    emitByte(as, 0xF2);
+    emitRex(as, false, RAX, base);
+    emitByte(as, 0x0F);
+    emitByte(as, 0x5A);
+    emitIndirect(as, dst, base, disp);
+}
+
+void emitStore(Assembler* as, Register base, int32_t disp, Register src)
+{
+    emitRex(as, true, src, base);
+    emitByte(as, 0x89);
+    emitIndirect(as, src, base, disp);
+}
+
+void emitStoreImm(Assembler* as, Register base, int32_t disp, int32_t imm)
+{
+    emitRex(as, true, RAX, base);
+    emitByte(as, 0xC7);
+    emitIndirect(as, 0, base, disp);
+    emit32(as, imm);
+}
+
+void emitLea(Assembler* as, Register dst, Register base, int32_t disp)
+{
+    emitRex(as, true, dst, base);
+    emitByte(as, 0x8D);
+    emitIndirect(as, dst, base, disp);
+}
+
+void emitAlu(Assembler* as, AluOp op, Register dst, Register src)
+{
+    emitRex(as, false, src, dst);
+    emitByte(as, 8 * op + 1);
+    emitDirect(as, src, dst);
+}
+
+static void emitGroupImm(Assembler* as, bool wide, AluOp op, Register dst, int32_t imm)
+{
+    emitRex(as, wide, RAX, dst);
+
+    if (imm >= INT8_MIN && imm <= INT8_MAX) {
+        emitByte(as, 0x83);
+        emitDirect(as, op, dst);
+        emitByte(as, imm);
+    } else {
+        emitByte(as, 0x81);
+        emitDirect(as, op, dst);
+        emit32(as, imm);
+    }
+}
+
+void emitAluImm(Assembler* as, AluOp op, Register dst, int32_t imm)
+{
+    emitGroupImm(as, false, op, dst, imm);
+}
+
+void emitAlu64(Assembler* as, AluOp op, Register dst, Register src)
+{
+    emitRex(as, true, src, dst);
+    emitByte(as, 8 * op + 1);
+    emitDirect(as, src, dst);
+}
+
+void emitAlu64Imm(Assembler* as, AluOp op, Register dst, int32_t imm)
+{
+    emitGroupImm(as, true, op, dst, imm);
+}
+
+void emitImul(Assembler* as, Register dst, Register src)
+{
+    emitRex(as, false, dst, src);
+    emitByte(as, 0x0F);
+    emitByte(as, 0xAF);
+    emitDirect(as, dst, src);
+}
+
+void emitImulImm(Assembler* as, Register dst, Register src, int32_t imm)
+{
+    emitRex(as, false, dst, src);
+    emitByte(as, 0x69);
+    emitDirect(as, dst, src);
+    emit32(as, imm);
+}
+
+void emitUnary(Assembler* as, UnaryOp op, Register reg)
+{
+    emitRex(as, false, RAX, reg);
+    emitByte(as, 0xF7);
+    emitDirect(as, op, reg);
+}
+
+void emitShift(Assembler* as, ShiftOp op, Register reg)
+{
+    emitRex(as, false, RAX, reg);
+    emitByte(as, 0xD3);
+    emitDirect(as, op, reg);
+}
+
+void emitShiftImm(Assembler* as, ShiftOp op, Register reg, uint8_t imm)
+{
+    emitRex(as, false, RAX, reg);
+    emitByte(as, 0xC1);
+    emitDirect(as, op, reg);
+    emitByte(as, imm & 31);
+}
+
+// Extends the low one, two or four bytes of src into the low half of dst.
+void emitExtend(Assembler* as, Register dst, Register src, int size, bool sign)
+{
+    emitRex(as, false, dst, src);
+
+    if (size == 4) {
+        emitByte(as, 0x8B);
+    } else {
+        emitByte(as, 0x0F);
+        emitByte(as, (sign ? 0xBE : 0xB6) + (size == 2));
+    }
+
+    emitDirect(as, dst, src);
+}
+
+// cvtss2sd reg, reg
+void emitWidenFloat(Assembler* as, XmmRegister reg)
+{
+    emitByte(as, 0xF3);
+    emitByte(as, 0x0F);
+    emitByte(as, 0x5A);
+    emitDirect(as, reg, (Register)reg);
+}
+
+// movq dst, src
+void emitMovFromXmm(Assembler* as, Register dst, XmmRegister src)
+{
+    emitByte(as, 0x66);
+    emitRex(as, true, RAX, dst);
+    emitByte(as, 0x0F);
+    emitByte(as, 0x7E);
+    emitDirect(as, src, dst);
+}
+
+// ucomisd a, b: sets PF when either is a NaN.
+void emitCompareDouble(Assembler* as, XmmRegister a, XmmRegister b)
+{
+    emitByte(as, 0x66);
+    emitByte(as, 0x0F);
+    emitByte(as, 0x2E);
+    emitDirect(as, a, (Register)b);
+}
+
+void emitCdq(Assembler* as)
+{
+    emitByte(as, 0x99);
+}
+
+void emitTest(Assembler* as, Register a, Register b)
+{
+    emitRex(as, false, b, a);
+    emitByte(as, 0x85);
+    emitDirect(as, b, a);
+}
+
+// setcc al; movzx dst, al. Moves do not touch the flags, so callers may
+// put spills between the comparison and this.
+void emitSetcc(Assembler* as, Condition cond, Register dst)
+{
+    emitByte(as, 0x0F);
+    emitByte(as, 0x90 + cond);
+    emitDirect(as, 0, RAX);
+    emitRex(as, false, dst, RAX);
+    emitByte(as, 0x0F);
+    emitByte(as, 0xB6);
+    emitDirect(as, dst, RAX);
+}
+
+// The 32-bit cmov clears the upper half of dst whether or not the
+// condition holds.
+void emitCmov(Assembler* as, Condition cond, Register dst, Register src)
+{
+    emitRex(as, false, dst, src);
+    emitByte(as, 0x0F);
+    emitByte(as, 0x40 + cond);
+    emitDirect(as, dst, src);
+}
+
+// Bit scans set ZF and leave dst undefined when src is zero.
+void emitBsf(Assembler* as, Register dst, Register src)
+{
+    emitRex(as, false, dst, src);
+    emitByte(as, 0x0F);
+    emitByte(as, 0xBC);
+    emitDirect(as, dst, src);
+}
+
+void emitBsr(Assembler* as, Register dst, Register src)
+{
+    emitRex(as, false, dst, src);
+    emitByte(as, 0x0F);
+    emitByte(as, 0xBD);
+    emitDirect(as, dst, src);
+}
+
+void emitPopcnt(Assembler* as, Register dst, Register src)
+{
+    emitByte(as, 0xF3);
+    emitRex(as, false, dst, src);
+    emitByte(as, 0x0F);
+    emitByte(as, 0xB8);
+    emitDirect(as, dst, src);
+}
+
+void emitBswap(Assembler* as, Register reg)
+{
+    emitRex(as, false, RAX, reg);
+    emitByte(as, 0x0F);
+    emitByte(as, 0xC8 + (reg & 7));
+}
+
+// Branches are emitted with a zero rel32 and return its offset so that
+// the target can be patched in once it is known.
+size_t emitJcc(Assembler* as, Condition cond)
+{
+    emitByte(as, 0x0F);
+    emitByte(as, 0x80 + cond);
+    emit32(as, 0);
+
+    return as->count - 4;
+}
+
+size_t emitJmp(Assembler* as)
+{
+    emitByte(as, 0xE9);
+    emit32(as, 0);
+
+    return as->count - 4;
+}
+
+void emitJmpTo(Assembler* as, size_t target)
+{
+    patchJumpTo(as, emitJmp(as), target);
+}
+
+void patchJumpTo(Assembler* as, size_t at, size_t target)
+{
+    int32_t distance = (int32_t)(target - (at + 4));
+
+    memcpy(as->data + at, &distance, sizeof(distance));
+}
+
+void emitCall(Assembler* as, void* function)
+{
+    emitMovImm64(as, RAX, (uintptr_t)function);
+    emitByte(as, 0xFF);
+    emitDirect(as, 2, RAX);
+}
+
+void emitCallRegister(Assembler* as, Register reg)
+{
+    emitRex(as, false, RAX, reg);
+    emitByte(as, 0xFF);
+    emitDirect(as, 2, reg);
+}
+
+void emitJmpRegister(Assembler* as, Register reg)
+{
+    emitRex(as, false, RAX, reg);
+    emitByte(as, 0xFF);
+    emitDirect(as, 4, reg);
+}
+
+void emitPush(Assembler* as, Register reg)
+{
+    emitRex(as, false, RAX, reg);
+    emitByte(as, 0x50 + (reg & 7));
+}
+
+void emitPop(Assembler* as, Register reg)
+{
+    emitRex(as, false, RAX, reg);
+    emitByte(as, 0x58 + (reg & 7));
+}
+
+void emitRet(Assembler* as)
+{
+    emitByte(as, 0xC3);
+}
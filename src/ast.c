@@ -1,4 +1,5 @@
 #include "ast.h"
+#include "arena.h"
 #include "scope.h"
 #include "service.h"
 #include "stringobject.h"
@@ -9,86 +10,43 @@
 #include <stdlib.h>
 #include <string.h>
 
-AST* createAST(ASTType type)
+// Nodes, and the vectors of nodes they hold, go with the arena.
+AST* createAST(Arena* arena, ASTType type)
 {
-    AST* ast = malloc(sizeof(AST));
+    AST* ast = allocateArena(arena, sizeof(AST));
     ast->type = type;
 
     switch (type) {
         case AST_COMPOUND:
-            initVector(&ast->compound.statements);
+            initArenaVector(&ast->compound.statements, arena);
             break;
-        case AST_FUNCTION_CALL:
-            initVector(&ast->functionCall.args);
-            break;
-        case AST_FUNCTION_DEFINITION:
-            initVector(&ast->functionDefinition.params);
-            break;
-        case AST_SERVICE_REQUEST:
-            initVector(&ast->serviceRequest.args);
-            break;
-        default:
-            break;
-    }
-    
-    return ast;
-}
-
-static void freeASTVector(Vector* nodes)
-{
-    size_t count = countVector(nodes);
-
-    for (size_t i = 0; i < count; i++) {
-        freeAST(nodes->data[i]);
-    }
-
-    freeVector(nodes);
-}
-
-void freeAST(AST* ast)
-{
-    if (!ast) {
-        return;
-    }
-
-    switch (ast->type) {
-        case AST_ASSIGNMENT:
-            freeAST(ast->assignment.expr);
-            break;
-        case AST_BINARY:
-            freeAST(ast->binary.leftExpr);
-            freeAST(ast->binary.rightExpr);
+        case AST_EXTERN_DEFINITION:
+            initArenaVector(&ast->externDefinition.params, arena);
             break;
-        case AST_COMPOUND:
-            freeScope(ast->compound.scope);
-            freeASTVector(&ast->compound.statements);
+        case AST_FOR:
+            initArenaVector(&ast->forStatement.body, arena);
             break;
         case AST_FUNCTION_CALL:
-            freeASTVector(&ast->functionCall.args);
+            initArenaVector(&ast->functionCall.args, arena);
             break;
         case AST_FUNCTION_DEFINITION:
-            freeStringObject(ast->functionDefinition.id);
-            freeASTVector(&ast->functionDefinition.params);
-            freeAST(ast->functionDefinition.body);
-            break;
-        case AST_PARAMETER:
-            freeStringObject(ast->parameter.id);
+            initArenaVector(&ast->functionDefinition.params, arena);
             break;
-        case AST_PREFIX:
-            freeAST(ast->prefix.expr);
+        case AST_IF:
+            initArenaVector(&ast->ifStatement.body, arena);
+            initArenaVector(&ast->ifStatement.elseBody, arena);
             break;
-        case AST_RETURN:
-            freeAST(ast->expression);
+        case AST_SERVICE_REQUEST:
+            initArenaVector(&ast->serviceRequest.args, arena);
             break;
-        case AST_VARIABLE_DEFINITION:
-            freeStringObject(ast->variableDefinition.id);
-            freeAST(ast->variableDefinition.expr);
+        case AST_WHILE:
+            initArenaVector(&ast->whileStatement.body, arena);
             break;
         default:
             break;
     }
-
-    free(ast);
+    
+    return ast;
 }
 
 Scope* getScope(AST* ast)
@@ -120,10 +78,14 @@ int getTypeId(AST* ast)
     }
 
     switch (ast->type) {
+        case AST_AWAIT:
+            return isAsyncCall(ast->expression) ? getTypeId(ast->expression->functionCall.symbol) : T_INT;
         case AST_BINARY:
             return ast->binary.typeId;
+        case AST_CONVERSION:
+            return ast->conversion.typeId;
         case AST_FUNCTION_CALL:
-            return getTypeId(ast->functionCall.symbol);
+            return isAsyncCall(ast) ? T_INT : getTypeId(ast->functionCall.symbol);
         case AST_FUNCTION_DEFINITION:
             return ast->functionDefinition.typeId;
         case AST_PARAMETER:
@@ -137,12 +99,33 @@ int getTypeId(AST* ast)
         case AST_PREFIX:
             return getTypeId(ast->prefix.expr);
         case AST_INTEGER:
-            return T_INT;
+            return ast->intValue == (int32_t)ast->intValue ? T_INT : T_INT64;
+        case AST_FLOAT:
+            return T_DOUBLE;
         default:
             return T_NONE;
     }
 }
 
+// int and uint are 32 bits wide. Anything else that is not a number, a
+// comparison's bool for one, is an int.
+NumberKind getNumberKind(int typeId)
+{
+    switch (typeId) {
+        case T_INT8:    return NUMBER_I8;
+        case T_INT16:   return NUMBER_I16;
+        case T_INT64:   return NUMBER_I64;
+        case T_UINT:
+        case T_UINT32:  return NUMBER_U32;
+        case T_UINT8:   return NUMBER_U8;
+        case T_UINT16:  return NUMBER_U16;
+        case T_UINT64:  return NUMBER_U64;
+        case T_FLOAT:   return NUMBER_F32;
+        case T_DOUBLE:  return NUMBER_F64;
+        default:        return NUMBER_I32;
+    }
+}
+
 bool isFunctionCall(AST* ast)
 {
     return ast->type == AST_FUNCTION_CALL;
@@ -153,6 +136,24 @@ bool isFunctionDefinition(AST* ast)
     return ast->type == AST_FUNCTION_DEFINITION;
 }
 
+// Calling an async function gives the int that names its future; what it
+// returns is the type of awaiting that.
+bool isAsyncCall(AST* ast)
+{
+    return ast->type == AST_FUNCTION_CALL && ast->functionCall.symbol->functionDefinition.async;
+}
+
+// A generator is only ever called to start a for.
+bool isGeneratorCall(AST* ast)
+{
+    return ast->type == AST_FUNCTION_CALL && ast->functionCall.symbol->functionDefinition.generator;
+}
+
+bool isLiteral(AST* ast)
+{
+    return ast->type == AST_INTEGER || ast->type == AST_FLOAT;
+}
+
 bool isParameter(AST* ast)
 {
     return ast->type == AST_PARAMETER;
@@ -167,7 +168,10 @@ bool isPrefixOperand(AST* ast)
 {
     switch (ast->type) {
         case AST_ASSIGNMENT:
+        case AST_AWAIT:
         case AST_BINARY:
+        case AST_CONVERSION:
+        case AST_FLOAT:
         case AST_FUNCTION_CALL:
         case AST_INTEGER:
         case AST_SERVICE_REQUEST:
@@ -7,15 +7,275 @@
 
 #define READ_INT16() (ptr += 2, (int16_t)((ptr[-2] << 8) | ptr[-1]))
 #define READ_INT8() ((int8_t)*(ptr++))
+#define READ_UINT8() (*(ptr++))
 
 static uint8_t* ptr;
 static const char* opcodeError = "Error: Unknown opcode %d\n";
 
-static int printInstruction(int8_t c)
+static const char* opcodeNames[] = {
+    [OP_HLT]      = "hlt",
+    [OP_REQS]     = "reqs",
+    [OP_LDC]      = "ldc",
+    [OP_REG]      = "reg",
+    [OP_LDG]      = "ldg",
+    [OP_STG]      = "stg",
+    [OP_LDL]      = "ldl",
+    [OP_LDL_0]    = "ldl_0",
+    [OP_LDL_1]    = "ldl_1",
+    [OP_LDL_2]    = "ldl_2",
+    [OP_LDL_3]    = "ldl_3",
+    [OP_STL]      = "stl",
+    [OP_STL_0]    = "stl_0",
+    [OP_STL_1]    = "stl_1",
+    [OP_STL_2]    = "stl_2",
+    [OP_STL_3]    = "stl_3",
+    [OP_PUSHB]    = "pushb",
+    [OP_PUSHH]    = "pushh",
+    [OP_PUSH_0]   = "push_0",
+    [OP_PUSH_1]   = "push_1",
+    [OP_PUSH_2]   = "push_2",
+    [OP_PUSH_3]   = "push_3",
+    [OP_POP]      = "pop",
+    [OP_DUP]      = "dup",
+    [OP_INC]      = "inc",
+    [OP_DEC]      = "dec",
+    [OP_ADD]      = "add",
+    [OP_SUB]      = "sub",
+    [OP_MUL]      = "mul",
+    [OP_DIV]      = "div",
+    [OP_REM]      = "rem",
+    [OP_POW]      = "pow",
+    [OP_BAND]     = "band",
+    [OP_BOR]      = "bor",
+    [OP_BXOR]     = "bxor",
+    [OP_BNOT]     = "bnot",
+    [OP_LSL]      = "lsl",
+    [OP_LSR]      = "lsr",
+    [OP_ASR]      = "asr",
+    [OP_NOT]      = "not",
+    [OP_NEG]      = "neg",
+    [OP_BEQ]      = "beq",
+    [OP_BLT]      = "blt",
+    [OP_BLE]      = "ble",
+    [OP_JMP]      = "jmp",
+    [OP_CALL]     = "call",
+    [OP_RET]      = "ret",
+    [OP_RETV]     = "retv",
+    [OP_ADDI]     = "addi",
+    [OP_SUBI]     = "subi",
+    [OP_MULI]     = "muli",
+    [OP_DIVI]     = "divi",
+    [OP_REMI]     = "remi",
+    [OP_LDL_ADD]  = "ldl_add",
+    [OP_LDL_SUB]  = "ldl_sub",
+    [OP_LDL_MUL]  = "ldl_mul",
+    [OP_LDL_LDL_ADD] = "ldl_ldl_add",
+    [OP_LDL_LDL_SUB] = "ldl_ldl_sub",
+    [OP_LDL_LDL_MUL] = "ldl_ldl_mul",
+    [OP_EQ]       = "eq",
+    [OP_NE]       = "ne",
+    [OP_LT]       = "lt",
+    [OP_LE]       = "le",
+    [OP_GT]       = "gt",
+    [OP_GE]       = "ge",
+    [OP_JZ]       = "jz",
+    [OP_LOOP]     = "loop",
+    [OP_TRACE]    = "trace",
+    [OP_CONV]     = "conv",
+    [OP_ADD_I64]  = "add_i64",
+    [OP_SUB_I64]  = "sub_i64",
+    [OP_MUL_I64]  = "mul_i64",
+    [OP_DIV_I64]  = "div_i64",
+    [OP_REM_I64]  = "rem_i64",
+    [OP_NEG_I64]  = "neg_i64",
+    [OP_BAND_I64] = "band_i64",
+    [OP_BOR_I64]  = "bor_i64",
+    [OP_BXOR_I64] = "bxor_i64",
+    [OP_BNOT_I64] = "bnot_i64",
+    [OP_LSL_I64]  = "lsl_i64",
+    [OP_LSR_I64]  = "lsr_i64",
+    [OP_EQ_I64]   = "eq_i64",
+    [OP_NE_I64]   = "ne_i64",
+    [OP_LT_I64]   = "lt_i64",
+    [OP_LE_I64]   = "le_i64",
+    [OP_GT_I64]   = "gt_i64",
+    [OP_GE_I64]   = "ge_i64",
+    [OP_DIV_U64]  = "div_u64",
+    [OP_REM_U64]  = "rem_u64",
+    [OP_LSR_U64]  = "lsr_u64",
+    [OP_LT_U64]   = "lt_u64",
+    [OP_LE_U64]   = "le_u64",
+    [OP_GT_U64]   = "gt_u64",
+    [OP_GE_U64]   = "ge_u64",
+    [OP_DIV_U32]  = "div_u32",
+    [OP_REM_U32]  = "rem_u32",
+    [OP_LSR_U32]  = "lsr_u32",
+    [OP_LT_U32]   = "lt_u32",
+    [OP_LE_U32]   = "le_u32",
+    [OP_GT_U32]   = "gt_u32",
+    [OP_GE_U32]   = "ge_u32",
+    [OP_ADD_F32]  = "add_f32",
+    [OP_SUB_F32]  = "sub_f32",
+    [OP_MUL_F32]  = "mul_f32",
+    [OP_DIV_F32]  = "div_f32",
+    [OP_ADD_F64]  = "add_f64",
+    [OP_SUB_F64]  = "sub_f64",
+    [OP_MUL_F64]  = "mul_f64",
+    [OP_DIV_F64]  = "div_f64",
+    [OP_NEG_F64]  = "neg_f64",
+    [OP_EQ_F64]   = "eq_f64",
+    [OP_NE_F64]   = "ne_f64",
+    [OP_LT_F64]   = "lt_f64",
+    [OP_LE_F64]   = "le_f64",
+    [OP_GT_F64]   = "gt_f64",
+    [OP_GE_F64]   = "ge_f64",
+    [OP_ABS]      = "abs",
+    [OP_MIN]      = "min",
+    [OP_MAX]      = "max",
+    [OP_CLAMP]    = "clamp",
+    [OP_POPCNT]   = "popcnt",
+    [OP_CLZ]      = "clz",
+    [OP_CTZ]      = "ctz",
+    [OP_ROTL]     = "rotl",
+    [OP_ROTR]     = "rotr",
+    [OP_BSWAP]    = "bswap",
+    [OP_ASYNC]    = "async",
+    [OP_AWAIT]    = "await",
+    [OP_RESOLVE]  = "resolve",
+    [OP_DETACH]   = "detach",
+    [OP_GENERATE] = "generate",
+    [OP_NEXT]     = "next",
+    [OP_YIELD]    = "yield",
+    [OP_FINISH]   = "finish",
+    [OP_CLOSE]    = "close",
+    [OP_LKG]      = "lkg",
+    [OP_ULG]      = "ulg",
+    [OP_JEQ]      = "jeq",
+    [OP_JNE]      = "jne",
+    [OP_JLT]      = "jlt",
+    [OP_JLE]      = "jle",
+    [OP_JGT]      = "jgt",
+    [OP_JGE]      = "jge",
+    [OP_INCL]     = "incl",
+};
+
+static const char* registerOpcodeNames[] = {
+    [ROP_HLT]     = "hlt",
+    [ROP_REQS]    = "reqs",
+    [ROP_LDC]     = "ldc",
+    [ROP_LDI]     = "ldi",
+    [ROP_REG]     = "reg",
+    [ROP_LDG]     = "ldg",
+    [ROP_STG]     = "stg",
+    [ROP_MOV]     = "mov",
+    [ROP_ADD]     = "add",
+    [ROP_SUB]     = "sub",
+    [ROP_MUL]     = "mul",
+    [ROP_DIV]     = "div",
+    [ROP_REM]     = "rem",
+    [ROP_POW]     = "pow",
+    [ROP_BAND]    = "band",
+    [ROP_BOR]     = "bor",
+    [ROP_BXOR]    = "bxor",
+    [ROP_LSL]     = "lsl",
+    [ROP_LSR]     = "lsr",
+    [ROP_BNOT]    = "bnot",
+    [ROP_NOT]     = "not",
+    [ROP_NEG]     = "neg",
+    [ROP_CALL]    = "call",
+    [ROP_RET]     = "ret",
+    [ROP_RETV]    = "retv",
+    [ROP_EQ]      = "eq",
+    [ROP_NE]      = "ne",
+    [ROP_LT]      = "lt",
+    [ROP_LE]      = "le",
+    [ROP_GT]      = "gt",
+    [ROP_GE]      = "ge",
+    [ROP_JZ]      = "jz",
+    [ROP_JMP]     = "jmp",
+    [ROP_LOOP]    = "loop",
+};
+
+// Instructions are one byte unless listed here.
+static const uint8_t opcodeLengths[] = {
+    [OP_REQS]        = 4,
+    [OP_LDC]         = 2,
+    [OP_LDG]         = 2,
+    [OP_STG]         = 2,
+    [OP_LKG]         = 2,
+    [OP_ULG]         = 2,
+    [OP_LDL]         = 2,
+    [OP_STL]         = 2,
+    [OP_PUSHB]       = 2,
+    [OP_PUSHH]       = 3,
+    [OP_BEQ]         = 3,
+    [OP_BLT]         = 3,
+    [OP_BLE]         = 3,
+    [OP_JMP]         = 3,
+    [OP_CALL]        = 3,
+    [OP_ADDI]        = 2,
+    [OP_SUBI]        = 2,
+    [OP_MULI]        = 2,
+    [OP_DIVI]        = 2,
+    [OP_REMI]        = 2,
+    [OP_LDL_ADD]     = 2,
+    [OP_LDL_SUB]     = 2,
+    [OP_LDL_MUL]     = 2,
+    [OP_LDL_LDL_ADD] = 3,
+    [OP_LDL_LDL_SUB] = 3,
+    [OP_LDL_LDL_MUL] = 3,
+    [OP_JZ]          = 3,
+    [OP_LOOP]        = 5,
+    [OP_TRACE]       = 5,
+    [OP_CONV]        = 2,
+    [OP_ASYNC]       = 3,
+    [OP_GENERATE]    = 3,
+    [OP_NEXT]        = 3,
+    [OP_JEQ]         = 3,
+    [OP_JNE]         = 3,
+    [OP_JLT]         = 3,
+    [OP_JLE]         = 3,
+    [OP_JGT]         = 3,
+    [OP_JGE]         = 3,
+    [OP_INCL]        = 3,
+};
+
+static int printOperandPair(const char* name)
+{
+    int8_t a = READ_INT8();
+    int8_t b = READ_INT8();
+
+    return printf("%s\t%d, %d\n", name, a, b);
+}
+
+static int printWidePair(const char* name)
+{
+    uint16_t a = READ_INT16();
+    uint16_t b = READ_INT16();
+
+    return printf("%s\t%u, %u\n", name, a, b);
+}
+
+static int printService()
+{
+    uint16_t service = READ_INT16();
+    uint8_t counts = READ_UINT8();
+
+    return printf("reqs\t%d, %d, %d\n", service, counts >> 4, counts & 15);
+}
+
+static int printConversion()
+{
+    uint8_t kinds = READ_UINT8();
+
+    return printf("conv\t%d, %d\n", kinds >> 4, kinds & 15);
+}
+
+static int printInstruction(uint8_t c)
 {
     switch (c) {
         case OP_HLT:        return printf("hlt\n");
-        case OP_REQS:       return printf("reqs\t%d\n", READ_INT8());
+        case OP_REQS:       return printService();
         case OP_LDC:        return printf("ldc\t%d\n", READ_INT8());
         case OP_REG:        return printf("reg\n");
         case OP_LDG:        return printf("ldg\t%d\n", READ_INT8());
@@ -62,6 +322,152 @@ static int printInstruction(int8_t c)
         case OP_CALL:       return printf("call\t%d\n", READ_INT16());
         case OP_RET:        return printf("ret\n");
         case OP_RETV:       return printf("retv\n");
+        case OP_ADDI:       return printf("addi\t%d\n", READ_INT8());
+        case OP_SUBI:       return printf("subi\t%d\n", READ_INT8());
+        case OP_MULI:       return printf("muli\t%d\n", READ_INT8());
+        case OP_DIVI:       return printf("divi\t%d\n", READ_INT8());
+        case OP_REMI:       return printf("remi\t%d\n", READ_INT8());
+        case OP_LDL_ADD:    return printf("ldl_add\t%d\n", READ_INT8());
+        case OP_LDL_SUB:    return printf("ldl_sub\t%d\n", READ_INT8());
+        case OP_LDL_MUL:    return printf("ldl_mul\t%d\n", READ_INT8());
+        case OP_LDL_LDL_ADD: return printOperandPair("ldl_ldl_add");
+        case OP_LDL_LDL_SUB: return printOperandPair("ldl_ldl_sub");
+        case OP_LDL_LDL_MUL: return printOperandPair("ldl_ldl_mul");
+        case OP_EQ:         return printf("eq\n");
+        case OP_NE:         return printf("ne\n");
+        case OP_LT:         return printf("lt\n");
+        case OP_LE:         return printf("le\n");
+        case OP_GT:         return printf("gt\n");
+        case OP_GE:         return printf("ge\n");
+        case OP_JZ:         return printf("jz\t%u\n", (uint16_t)READ_INT16());
+        case OP_LOOP:       return printWidePair("loop");
+        case OP_TRACE:      return printWidePair("trace");
+        case OP_CONV:       return printConversion();
+        case OP_ADD_I64:    return printf("add_i64\n");
+        case OP_SUB_I64:    return printf("sub_i64\n");
+        case OP_MUL_I64:    return printf("mul_i64\n");
+        case OP_DIV_I64:    return printf("div_i64\n");
+        case OP_REM_I64:    return printf("rem_i64\n");
+        case OP_NEG_I64:    return printf("neg_i64\n");
+        case OP_BAND_I64:   return printf("band_i64\n");
+        case OP_BOR_I64:    return printf("bor_i64\n");
+        case OP_BXOR_I64:   return printf("bxor_i64\n");
+        case OP_BNOT_I64:   return printf("bnot_i64\n");
+        case OP_LSL_I64:    return printf("lsl_i64\n");
+        case OP_LSR_I64:    return printf("lsr_i64\n");
+        case OP_EQ_I64:     return printf("eq_i64\n");
+        case OP_NE_I64:     return printf("ne_i64\n");
+        case OP_LT_I64:     return printf("lt_i64\n");
+        case OP_LE_I64:     return printf("le_i64\n");
+        case OP_GT_I64:     return printf("gt_i64\n");
+        case OP_GE_I64:     return printf("ge_i64\n");
+        case OP_DIV_U64:    return printf("div_u64\n");
+        case OP_REM_U64:    return printf("rem_u64\n");
+        case OP_LSR_U64:    return printf("lsr_u64\n");
+        case OP_LT_U64:     return printf("lt_u64\n");
+        case OP_LE_U64:     return printf("le_u64\n");
+        case OP_GT_U64:     return printf("gt_u64\n");
+        case OP_GE_U64:     return printf("ge_u64\n");
+        case OP_DIV_U32:    return printf("div_u32\n");
+        case OP_REM_U32:    return printf("rem_u32\n");
+        case OP_LSR_U32:    return printf("lsr_u32\n");
+        case OP_LT_U32:     return printf("lt_u32\n");
+        case OP_LE_U32:     return printf("le_u32\n");
+        case OP_GT_U32:     return printf("gt_u32\n");
+        case OP_GE_U32:     return printf("ge_u32\n");
+        case OP_ADD_F32:    return printf("add_f32\n");
+        case OP_SUB_F32:    return printf("sub_f32\n");
+        case OP_MUL_F32:    return printf("mul_f32\n");
+        case OP_DIV_F32:    return printf("div_f32\n");
+        case OP_ADD_F64:    return printf("add_f64\n");
+        case OP_SUB_F64:    return printf("sub_f64\n");
+        case OP_MUL_F64:    return printf("mul_f64\n");
+        case OP_DIV_F64:    return printf("div_f64\n");
+        case OP_NEG_F64:    return printf("neg_f64\n");
+        case OP_EQ_F64:     return printf("eq_f64\n");
+        case OP_NE_F64:     return printf("ne_f64\n");
+        case OP_LT_F64:     return printf("lt_f64\n");
+        case OP_LE_F64:     return printf("le_f64\n");
+        case OP_GT_F64:     return printf("gt_f64\n");
+        case OP_GE_F64:     return printf("ge_f64\n");
+        case OP_ABS:        return printf("abs\n");
+        case OP_MIN:        return printf("min\n");
+        case OP_MAX:        return printf("max\n");
+        case OP_CLAMP:      return printf("clamp\n");
+        case OP_POPCNT:     return printf("popcnt\n");
+        case OP_CLZ:        return printf("clz\n");
+        case OP_CTZ:        return printf("ctz\n");
+        case OP_ROTL:       return printf("rotl\n");
+        case OP_ROTR:       return printf("rotr\n");
+        case OP_BSWAP:      return printf("bswap\n");
+        case OP_ASYNC:      return printf("async\t%d\n", READ_INT16());
+        case OP_AWAIT:      return printf("await\n");
+        case OP_RESOLVE:    return printf("resolve\n");
+        case OP_DETACH:     return printf("detach\n");
+        case OP_GENERATE:   return printf("generate\t%d\n", READ_INT16());
+        case OP_NEXT:       return printf("next\t%u\n", (uint16_t)READ_INT16());
+        case OP_YIELD:      return printf("yield\n");
+        case OP_FINISH:     return printf("finish\n");
+        case OP_CLOSE:      return printf("close\n");
+        case OP_LKG:        return printf("lkg\t%d\n", READ_INT8());
+        case OP_ULG:        return printf("ulg\t%d\n", READ_INT8());
+        case OP_JEQ:        return printf("jeq\t%u\n", (uint16_t)READ_INT16());
+        case OP_JNE:        return printf("jne\t%u\n", (uint16_t)READ_INT16());
+        case OP_JLT:        return printf("jlt\t%u\n", (uint16_t)READ_INT16());
+        case OP_JLE:        return printf("jle\t%u\n", (uint16_t)READ_INT16());
+        case OP_JGT:        return printf("jgt\t%u\n", (uint16_t)READ_INT16());
+        case OP_JGE:        return printf("jge\t%u\n", (uint16_t)READ_INT16());
+        case OP_INCL:       return printOperandPair("incl");
+        default:
+            fprintf(stderr, opcodeError, c);
+            exit(1);
+    }
+}
+
+static int printRegisterInstruction(uint8_t c)
+{
+    uint8_t a = READ_UINT8();
+    uint8_t b = ptr[0];
+    uint8_t d = ptr[1];
+    int16_t imm = (int16_t)((b << 8) | d);
+
+    ptr += 2;
+
+    switch (c) {
+        case ROP_HLT:       return printf("hlt\n");
+        case ROP_REQS:      return printf("reqs\tr%d, %d\n", a, (uint16_t)imm);
+        case ROP_LDC:       return printf("ldc\tr%d, %d\n", a, (uint16_t)imm);
+        case ROP_LDI:       return printf("ldi\tr%d, %d\n", a, imm);
+        case ROP_REG:       return printf("reg\tr%d\n", a);
+        case ROP_LDG:       return printf("ldg\tr%d, %d\n", a, (uint16_t)imm);
+        case ROP_STG:       return printf("stg\tr%d, %d\n", a, (uint16_t)imm);
+        case ROP_MOV:       return printf("mov\tr%d, r%d\n", a, b);
+        case ROP_ADD:       return printf("add\tr%d, r%d, r%d\n", a, b, d);
+        case ROP_SUB:       return printf("sub\tr%d, r%d, r%d\n", a, b, d);
+        case ROP_MUL:       return printf("mul\tr%d, r%d, r%d\n", a, b, d);
+        case ROP_DIV:       return printf("div\tr%d, r%d, r%d\n", a, b, d);
+        case ROP_REM:       return printf("rem\tr%d, r%d, r%d\n", a, b, d);
+        case ROP_POW:       return printf("pow\tr%d, r%d, r%d\n", a, b, d);
+        case ROP_BAND:      return printf("band\tr%d, r%d, r%d\n", a, b, d);
+        case ROP_BOR:       return printf("bor\tr%d, r%d, r%d\n", a, b, d);
+        case ROP_BXOR:      return printf("bxor\tr%d, r%d, r%d\n", a, b, d);
+        case ROP_LSL:       return printf("lsl\tr%d, r%d, r%d\n", a, b, d);
+        case ROP_LSR:       return printf("lsr\tr%d, r%d, r%d\n", a, b, d);
+        case ROP_BNOT:      return printf("bnot\tr%d, r%d\n", a, b);
+        case ROP_NOT:       return printf("not\tr%d, r%d\n", a, b);
+        case ROP_NEG:       return printf("neg\tr%d, r%d\n", a, b);
+        case ROP_CALL:      return printf("call\tr%d, %d\n", a, (uint16_t)imm);
+        case ROP_RET:       return printf("ret\n");
+        case ROP_RETV:      return printf("retv\tr%d\n", a);
+        case ROP_EQ:        return printf("eq\tr%d, r%d, r%d\n", a, b, d);
+        case ROP_NE:        return printf("ne\tr%d, r%d, r%d\n", a, b, d);
+        case ROP_LT:        return printf("lt\tr%d, r%d, r%d\n", a, b, d);
+        case ROP_LE:        return printf("le\tr%d, r%d, r%d\n", a, b, d);
+        case ROP_GT:        return printf("gt\tr%d, r%d, r%d\n", a, b, d);
+        case ROP_GE:        return printf("ge\tr%d, r%d, r%d\n", a, b, d);
+        case ROP_JZ:        return printf("jz\tr%d, %u\n", a, (uint16_t)imm);
+        case ROP_JMP:       return printf("jmp\t%u\n", (uint16_t)imm);
+        case ROP_LOOP:      return printf("loop\t%u\n", (uint16_t)imm);
         default:
             fprintf(stderr, opcodeError, c);
             exit(1);
@@ -73,8 +479,46 @@ void disassemble(CodeObject* code)
     ptr = code->data;
 
     while (ptr != codeObjectEnd(code)) {
-        int8_t c = READ_INT8();
+        uint8_t c = READ_UINT8();
 
         printInstruction(c);
     }
 }
+
+void disassembleRegisters(CodeObject* code)
+{
+    ptr = code->data;
+
+    while (ptr != codeObjectEnd(code)) {
+        uint8_t c = READ_UINT8();
+
+        printRegisterInstruction(c);
+    }
+}
+
+const char* getOpcodeName(uint8_t opcode)
+{
+    if (opcode >= sizeof(opcodeNames) / sizeof(opcodeNames[0]) || !opcodeNames[opcode]) {
+        return "?";
+    }
+
+    return opcodeNames[opcode];
+}
+
+int getInstructionLength(uint8_t opcode)
+{
+    if (opcode >= sizeof(opcodeLengths) / sizeof(opcodeLengths[0]) || !opcodeLengths[opcode]) {
+        return 1;
+    }
+
+    return opcodeLengths[opcode];
+}
+
+const char* getRegisterOpcodeName(uint8_t opcode)
+{
+    if (opcode >= sizeof(registerOpcodeNames) / sizeof(registerOpcodeNames[0]) || !registerOpcodeNames[opcode]) {
+        return "?";
+    }
+
+    return registerOpcodeNames[opcode];
+}
@@ -0,0 +1,332 @@
+#include "channel.h"
+#include "loop.h"
+#include "value.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define GROW_CAPACITY(capacity) ((capacity) < 8 ? 8 : (capacity) * 2)
+
+static const char* channelLimitError = "Error: Too many channels\n";
+
+void initChannels(ChannelTable* table)
+{
+    for (int i = 0; i < CHANNEL_CHUNKS_MAX; i++) {
+        atomic_init(&table->chunks[i], NULL);
+    }
+
+    atomic_init(&table->count, 0);
+    table->freeChannel = -1;
+    table->freeChannelTail = -1;
+    table->liveCount = 0;
+    table->livePeak = 0;
+    pthread_mutex_init(&table->lock, NULL);
+}
+
+// Only called once no worker runs, when parked futures went with their
+// loops.
+void freeChannels(ChannelTable* table)
+{
+    int count = atomic_load(&table->count);
+
+    for (int i = 0; i < count; i++) {
+        Channel* channel = &table->chunks[i / CHANNEL_CHUNK_SIZE][i % CHANNEL_CHUNK_SIZE];
+
+        pthread_mutex_destroy(&channel->lock);
+        free(channel->buffer.items);
+        free(channel->senders.items);
+        free(channel->receivers.items);
+    }
+
+    for (int i = 0; i < CHANNEL_CHUNKS_MAX; i++) {
+        free(atomic_load(&table->chunks[i]));
+    }
+
+    pthread_mutex_destroy(&table->lock);
+}
+
+static void pushParked(ParkedQueue* queue, int future, Value value)
+{
+    if (queue->count == queue->capacity) {
+        int capacity = GROW_CAPACITY(queue->capacity);
+        Parked* items = malloc(sizeof(Parked) * capacity);
+
+        for (int i = 0; i < queue->count; i++) {
+            items[i] = queue->items[(queue->head + i) % queue->capacity];
+        }
+
+        free(queue->items);
+        queue->items = items;
+        queue->capacity = capacity;
+        queue->head = 0;
+    }
+
+    queue->items[(queue->head + queue->count) % queue->capacity] = (Parked){future, value};
+    queue->count++;
+}
+
+static Parked popParked(ParkedQueue* queue)
+{
+    Parked parked = queue->items[queue->head];
+
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+
+    return parked;
+}
+
+// A loop that is not a scheduler's gets its table once it first needs one.
+static ChannelTable* getTable(EventLoop* loop)
+{
+    if (!loop->channels) {
+        loop->channels = malloc(sizeof(ChannelTable));
+        initChannels(loop->channels);
+    }
+
+    return loop->channels;
+}
+
+static Channel* getSlot(ChannelTable* table, int id)
+{
+    Channel* chunk = atomic_load_explicit(&table->chunks[id / CHANNEL_CHUNK_SIZE], memory_order_acquire);
+
+    return &chunk[id % CHANNEL_CHUNK_SIZE];
+}
+
+static int getChannelId(Channel* channel, int index)
+{
+    uint32_t generation = channel->generation & ((1u << (31 - CHANNEL_INDEX_BITS)) - 1);
+
+    return (int)(generation << CHANNEL_INDEX_BITS) | index;
+}
+
+// Scripts only ever see channels as ints, so any int can come back here.
+// Returns the channel locked, or NULL when id does not name an open one.
+static Channel* lockChannel(EventLoop* loop, int id)
+{
+    ChannelTable* table = loop->channels;
+    int index = id & ((1 << CHANNEL_INDEX_BITS) - 1);
+
+    if (!table || id < 0 || index >= atomic_load_explicit(&table->count, memory_order_acquire)) {
+        return NULL;
+    }
+
+    Channel* channel = getSlot(table, index);
+
+    pthread_mutex_lock(&channel->lock);
+
+    if (!channel->open || getChannelId(channel, index) != id) {
+        pthread_mutex_unlock(&channel->lock);
+        return NULL;
+    }
+
+    return channel;
+}
+
+// Takes the index of a closed channel if there is one and a new one
+// otherwise, which is only counted once the channel in it is ready.
+// Returns the channel's id.
+static int allocateChannel(ChannelTable* table, int32_t capacity)
+{
+    int index = table->freeChannel;
+
+    if (index >= 0) {
+        Channel* channel = getSlot(table, index);
+
+        table->freeChannel = channel->next;
+
+        if (table->freeChannel < 0) {
+            table->freeChannelTail = -1;
+        }
+
+        pthread_mutex_lock(&channel->lock);
+        channel->open = true;
+        channel->capacity = capacity;
+        int id = getChannelId(channel, index);
+        pthread_mutex_unlock(&channel->lock);
+
+        return id;
+    }
+
+    index = atomic_load_explicit(&table->count, memory_order_relaxed);
+
+    int chunkIndex = index / CHANNEL_CHUNK_SIZE;
+
+    if (chunkIndex >= CHANNEL_CHUNKS_MAX) {
+        fprintf(stderr, "%s", channelLimitError);
+        exit(1);
+    }
+
+    Channel* chunk = atomic_load_explicit(&table->chunks[chunkIndex], memory_order_relaxed);
+
+    if (!chunk) {
+        chunk = calloc(CHANNEL_CHUNK_SIZE, sizeof(Channel));
+        atomic_store_explicit(&table->chunks[chunkIndex], chunk, memory_order_release);
+    }
+
+    Channel* channel = &chunk[index % CHANNEL_CHUNK_SIZE];
+
+    pthread_mutex_init(&channel->lock, NULL);
+    channel->open = true;
+    channel->capacity = capacity;
+    atomic_store_explicit(&table->count, index + 1, memory_order_release);
+
+    return getChannelId(channel, index);
+}
+
+// Channels with a capacity of 0 hand each value straight from a sender to
+// a receiver.
+int createChannel(EventLoop* loop, int32_t capacity)
+{
+    ChannelTable* table = getTable(loop);
+
+    pthread_mutex_lock(&table->lock);
+
+    int id = allocateChannel(table, capacity > 0 ? capacity : 0);
+
+    if (++table->liveCount > table->livePeak) {
+        table->livePeak = table->liveCount;
+    }
+
+    pthread_mutex_unlock(&table->lock);
+
+    return id;
+}
+
+// A parked receiver takes the value at once; otherwise it is buffered if
+// there is room and parked along with the sender if not. The sender's
+// future gives 0 once the value is on its way and -1 when id is not an
+// open channel.
+int sendChannel(EventLoop* loop, int id, Value value)
+{
+    int future = createFuture(loop);
+    Channel* channel = lockChannel(loop, id);
+    int receiver = -1;
+
+    if (!channel) {
+        completeFuture(loop, future, INT_VALUE(-1));
+        return future;
+    }
+
+    if (channel->receivers.count) {
+        receiver = popParked(&channel->receivers).future;
+    } else if (channel->buffer.count < channel->capacity) {
+        pushParked(&channel->buffer, -1, value);
+    } else {
+        pushParked(&channel->senders, future, value);
+        pthread_mutex_unlock(&channel->lock);
+
+        return future;
+    }
+
+    pthread_mutex_unlock(&channel->lock);
+
+    if (receiver >= 0) {
+        completeFuture(loop, receiver, value);
+    }
+
+    completeFuture(loop, future, INT_VALUE(0));
+
+    return future;
+}
+
+// Takes the oldest value, buffered or held by a parked sender, whose place
+// in the buffer goes to the next sender in line. With none the receiver
+// is parked. When id is not an open channel the future gives -1.
+int receiveChannel(EventLoop* loop, int id)
+{
+    int future = createFuture(loop);
+    Channel* channel = lockChannel(loop, id);
+    int sender = -1;
+    Value value;
+
+    if (!channel) {
+        completeFuture(loop, future, INT_VALUE(-1));
+        return future;
+    }
+
+    if (channel->buffer.count) {
+        value = popParked(&channel->buffer).value;
+
+        if (channel->senders.count) {
+            Parked parked = popParked(&channel->senders);
+
+            pushParked(&channel->buffer, -1, parked.value);
+            sender = parked.future;
+        }
+    } else if (channel->senders.count) {
+        Parked parked = popParked(&channel->senders);
+
+        value = parked.value;
+        sender = parked.future;
+    } else {
+        pushParked(&channel->receivers, future, INT_VALUE(0));
+        pthread_mutex_unlock(&channel->lock);
+
+        return future;
+    }
+
+    pthread_mutex_unlock(&channel->lock);
+
+    if (sender >= 0) {
+        completeFuture(loop, sender, INT_VALUE(0));
+    }
+
+    completeFuture(loop, future, value);
+
+    return future;
+}
+
+static void releaseParked(EventLoop* loop, ParkedQueue* queue)
+{
+    for (int i = 0; i < queue->count; i++) {
+        completeFuture(loop, queue->items[(queue->head + i) % queue->capacity].future, INT_VALUE(-1));
+    }
+
+    free(queue->items);
+}
+
+// Whoever is parked on the channel gets -1 and buffered values are
+// dropped. The index goes back to the table under a new generation, so
+// the old id names nothing. Returns false when id is not an open channel.
+bool closeChannel(EventLoop* loop, int id)
+{
+    ChannelTable* table = loop->channels;
+    Channel* channel = lockChannel(loop, id);
+
+    if (!channel) {
+        return false;
+    }
+
+    int index = id & ((1 << CHANNEL_INDEX_BITS) - 1);
+    ParkedQueue senders = channel->senders;
+    ParkedQueue receivers = channel->receivers;
+
+    free(channel->buffer.items);
+    channel->buffer = (ParkedQueue){NULL, 0, 0, 0};
+    channel->senders = (ParkedQueue){NULL, 0, 0, 0};
+    channel->receivers = (ParkedQueue){NULL, 0, 0, 0};
+    channel->open = false;
+    channel->generation++;
+    pthread_mutex_unlock(&channel->lock);
+
+    releaseParked(loop, &senders);
+    releaseParked(loop, &receivers);
+
+    pthread_mutex_lock(&table->lock);
+    channel->next = -1;
+
+    if (table->freeChannelTail >= 0) {
+        getSlot(table, table->freeChannelTail)->next = index;
+    } else {
+        table->freeChannel = index;
+    }
+
+    table->freeChannelTail = index;
+    table->liveCount--;
+    pthread_mutex_unlock(&table->lock);
+
+    return true;
+}
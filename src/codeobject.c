@@ -39,6 +39,13 @@ void resizeCodeObject(CodeObject* code, size_t size)
     code->count = size;
 }
 
+void truncateCodeObject(CodeObject* code, size_t size)
+{
+    if (size < code->count) {
+        code->count = size;
+    }
+}
+
 size_t pushByte(CodeObject* code, uint8_t byte)
 {
     if (code->capacity <= code->count) {
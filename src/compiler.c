@@ -6,281 +6,479 @@
 #include "opcode.h"
 #include "parser.h"
 #include "scope.h"
+#include "service.h"
 #include "token.h"
 #include "util.h"
 #include "value.h"
 #include "vector.h"
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
-static void expression(AST* ast);
-static void blocklevelStatements(Vector* nodes);
-static void toplevelStatements(Vector* nodes);
+static void expression(Compiler* compiler, AST* ast);
+static void blocklevelStatements(Compiler* compiler, Vector* nodes);
+static void toplevelStatements(Compiler* compiler, Vector* nodes);
 
-typedef struct Compiler
+static CodeObject* currentCodeObject(Compiler* compiler)
 {
-    Vector functionReferences;
-    ModuleObject* module;
-    FunctionObject* function;
-    AST* ast;
-    int stackCount;
-} Compiler;
+    return &compiler->function->code;
+}
+
+static void incStackCount(Compiler* compiler)
+{
+    if (++compiler->stackCount > compiler->function->maxStackCount) {
+        compiler->function->maxStackCount = compiler->stackCount;
+    }
+}
+
+static void decStackCount(Compiler* compiler)
+{
+    compiler->stackCount--;
+}
+
+static void write8(Compiler* compiler, uint8_t n)
+{
+    pushByte(currentCodeObject(compiler), n);
+}
+
+static void write16(Compiler* compiler, int16_t n)
+{
+    pushByte(currentCodeObject(compiler), (n >> 8) & 0xFF);
+    pushByte(currentCodeObject(compiler), n & 0xFF);
+}
+
+// Records the instruction so that later opcodes can be fused with it.
+// history[0] is the most recently emitted instruction.
+static void emit(Compiler* compiler, uint8_t opcode, int operand)
+{
+    for (int i = HISTORY_MAX - 1; i > 0; i--) {
+        compiler->history[i] = compiler->history[i - 1];
+    }
+
+    compiler->history[0].opcode = opcode;
+    compiler->history[0].operand = operand;
+    compiler->history[0].offset = countCodeObject(currentCodeObject(compiler));
+
+    if (compiler->historyCount < HISTORY_MAX) {
+        compiler->historyCount++;
+    }
+
+    write8(compiler, opcode);
+}
+
+static void dropInstructions(Compiler* compiler, int count)
+{
+    truncateCodeObject(currentCodeObject(compiler), compiler->history[count - 1].offset);
+
+    for (int i = 0; i + count < HISTORY_MAX; i++) {
+        compiler->history[i] = compiler->history[i + count];
+    }
+
+    compiler->historyCount -= count;
+}
+
+static void clearHistory(Compiler* compiler)
+{
+    compiler->historyCount = 0;
+}
+
+static bool isLoadLocal(Compiler* compiler, int index)
+{
+    if (index >= compiler->historyCount) {
+        return false;
+    }
 
-static Compiler compiler;
+    switch (compiler->history[index].opcode) {
+        case OP_LDL:
+        case OP_LDL_0:
+        case OP_LDL_1:
+        case OP_LDL_2:
+        case OP_LDL_3:
+            return true;
+        default:
+            return false;
+    }
+}
 
-static CodeObject* currentCodeObject()
+static bool isPushByte(Compiler* compiler, int index)
 {
-    return &compiler.function->code;
+    if (index >= compiler->historyCount) {
+        return false;
+    }
+
+    switch (compiler->history[index].opcode) {
+        case OP_PUSHB:
+        case OP_PUSH_0:
+        case OP_PUSH_1:
+        case OP_PUSH_2:
+        case OP_PUSH_3:
+            return true;
+        default:
+            return false;
+    }
 }
 
-static void incStackCount()
+static uint8_t getImmediateForm(uint8_t opcode)
 {
-    if (++compiler.stackCount > compiler.function->maxStackCount) {
-        compiler.function->maxStackCount = compiler.stackCount;
+    switch (opcode) {
+        case OP_ADD:
+            return OP_ADDI;
+        case OP_SUB:
+            return OP_SUBI;
+        case OP_MUL:
+            return OP_MULI;
+        case OP_DIV:
+            return OP_DIVI;
+        case OP_REM:
+            return OP_REMI;
+        default:
+            return OP_HLT;
     }
 }
 
-static void decStackCount()
+static uint8_t getLocalForm(uint8_t opcode)
 {
-    compiler.stackCount--;
+    switch (opcode) {
+        case OP_ADD:
+            return OP_LDL_ADD;
+        case OP_SUB:
+            return OP_LDL_SUB;
+        case OP_MUL:
+            return OP_LDL_MUL;
+        default:
+            return OP_HLT;
+    }
 }
 
-static void write8(uint8_t n)
+static uint8_t getLocalPairForm(uint8_t opcode)
 {
-    pushByte(currentCodeObject(), n);
+    switch (opcode) {
+        case OP_ADD:
+            return OP_LDL_LDL_ADD;
+        case OP_SUB:
+            return OP_LDL_LDL_SUB;
+        case OP_MUL:
+            return OP_LDL_LDL_MUL;
+        default:
+            return OP_HLT;
+    }
+}
+
+// Fuses the operand loads in front of a binary opcode into a single
+// superinstruction: push imm8; op => opi imm8, ldl a; op => ldl_op a,
+// ldl a; ldl b; op => ldl_ldl_op a, b.
+static void arithmetic(Compiler* compiler, uint8_t opcode)
+{
+    uint8_t immediate = getImmediateForm(opcode);
+    uint8_t local = getLocalForm(opcode);
+    uint8_t localPair = getLocalPairForm(opcode);
+
+    if (immediate != OP_HLT && isPushByte(compiler, 0)) {
+        int imm = compiler->history[0].operand;
+        dropInstructions(compiler, 1);
+        emit(compiler, immediate, imm);
+        write8(compiler, imm);
+    } else if (localPair != OP_HLT && isLoadLocal(compiler, 0) && isLoadLocal(compiler, 1)) {
+        int a = compiler->history[1].operand;
+        int b = compiler->history[0].operand;
+        dropInstructions(compiler, 2);
+        emit(compiler, localPair, a);
+        write8(compiler, a);
+        write8(compiler, b);
+    } else if (local != OP_HLT && isLoadLocal(compiler, 0)) {
+        int imm = compiler->history[0].operand;
+        dropInstructions(compiler, 1);
+        emit(compiler, local, imm);
+        write8(compiler, imm);
+    } else {
+        emit(compiler, opcode, 0);
+    }
 }
 
-static void write16(int16_t n)
+static void op_hlt(Compiler* compiler)
 {
-    pushByte(currentCodeObject(), (n >> 8) & 0xFF);
-    pushByte(currentCodeObject(), n & 0xFF);
+    emit(compiler, OP_HLT, 0);
 }
 
-static void op_hlt()
+// The second operand packs the argument and result counts, four bits each.
+static void op_reqs(Compiler* compiler, Service* service)
 {
-    write8(OP_HLT);
+    uint8_t counts = service->paramCount << 4 | service->resultCount;
+
+    compiler->stackCount -= service->paramCount;
+
+    for (int i = 0; i < service->resultCount; i++) {
+        incStackCount(compiler);
+    }
+
+    emit(compiler, OP_REQS, service->opcode);
+    write16(compiler, service->opcode);
+    write8(compiler, counts);
+}
+
+static void op_intrinsic(Compiler* compiler, uint8_t opcode, int paramCount)
+{
+    for (int i = 1; i < paramCount; i++) {
+        decStackCount(compiler);
+    }
+
+    emit(compiler, opcode, 0);
+}
+
+static void op_ldc(Compiler* compiler, uint8_t imm)
+{
+    incStackCount(compiler);
+    emit(compiler, OP_LDC, imm);
+    write8(compiler, imm);
 }
 
-static void op_reqs(uint8_t imm)
+static void op_reg(Compiler* compiler)
 {
-    write8(OP_REQS);
-    write8(imm);
+    decStackCount(compiler);
+    emit(compiler, OP_REG, 0);
 }
 
-static void op_ldc(uint8_t imm)
+static void op_ldg(Compiler* compiler, uint8_t imm)
 {
-    incStackCount();
-    write8(OP_LDC);
-    write8(imm);
+    incStackCount(compiler);
+    emit(compiler, OP_LDG, imm);
+    write8(compiler, imm);
 }
 
-static void op_reg()
+static void op_stg(Compiler* compiler, uint8_t imm)
 {
-    decStackCount();
-    write8(OP_REG);
+    decStackCount(compiler);
+    emit(compiler, OP_STG, imm);
+    write8(compiler, imm);
 }
 
-static void op_ldg(uint8_t imm)
+static void op_lkg(Compiler* compiler, uint8_t imm)
 {
-    incStackCount();
-    write8(OP_LDG);
-    write8(imm);
+    incStackCount(compiler);
+    emit(compiler, OP_LKG, imm);
+    write8(compiler, imm);
 }
 
-static void op_stg(uint8_t imm)
+static void op_ulg(Compiler* compiler, uint8_t imm)
 {
-    decStackCount();
-    write8(OP_STG);
-    write8(imm);
+    decStackCount(compiler);
+    emit(compiler, OP_ULG, imm);
+    write8(compiler, imm);
 }
 
-static void op_ldl(int8_t imm)
+static void op_ldl(Compiler* compiler, int8_t imm)
 {
-    incStackCount();
+    incStackCount(compiler);
 
     switch (imm) {
         case 0:
-            write8(OP_LDL_0);
+            emit(compiler, OP_LDL_0, 0);
             break;
         case 1:
-            write8(OP_LDL_1);
+            emit(compiler, OP_LDL_1, 1);
             break;
         case 2:
-            write8(OP_LDL_2);
+            emit(compiler, OP_LDL_2, 2);
             break;
         case 3:
-            write8(OP_LDL_3);
+            emit(compiler, OP_LDL_3, 3);
             break;
         default:
-            write8(OP_LDL);
-            write8(imm);
+            emit(compiler, OP_LDL, imm);
+            write8(compiler, imm);
             break;
     }
 }
 
-static void op_stl(int8_t imm)
+static void op_stl(Compiler* compiler, int8_t imm)
 {
-    decStackCount();
+    decStackCount(compiler);
 
     switch (imm) {
         case 0:
-            write8(OP_STL_0);
+            emit(compiler, OP_STL_0, 0);
             break;
         case 1:
-            write8(OP_STL_1);
+            emit(compiler, OP_STL_1, 1);
             break;
         case 2:
-            write8(OP_STL_2);
+            emit(compiler, OP_STL_2, 2);
             break;
         case 3:
-            write8(OP_STL_3);
+            emit(compiler, OP_STL_3, 3);
             break;
         default:
-            write8(OP_STL);
-            write8(imm);
+            emit(compiler, OP_STL, imm);
+            write8(compiler, imm);
             break;
     }
 }
 
-static void op_pushb(int8_t imm)
+static void op_pushb(Compiler* compiler, int8_t imm)
 {
-    incStackCount();
+    incStackCount(compiler);
 
     switch (imm) {
         case 0:
-            write8(OP_PUSH_0);
+            emit(compiler, OP_PUSH_0, 0);
             break;
         case 1:
-            write8(OP_PUSH_1);
+            emit(compiler, OP_PUSH_1, 1);
             break;
         case 2:
-            write8(OP_PUSH_2);
+            emit(compiler, OP_PUSH_2, 2);
             break;
         case 3:
-            write8(OP_PUSH_3);
+            emit(compiler, OP_PUSH_3, 3);
             break;
         default:
-            write8(OP_PUSHB);
-            write8(imm);
+            emit(compiler, OP_PUSHB, imm);
+            write8(compiler, imm);
             break;
     }
 }
 
-static void op_pushh(int16_t imm)
+static void op_pushh(Compiler* compiler, int16_t imm)
 {
-    incStackCount();
-    write8(OP_PUSHH);
-    write16(imm);
+    incStackCount(compiler);
+    emit(compiler, OP_PUSHH, imm);
+    write16(compiler, imm);
 }
 
-static void op_pop()
+static void op_pop(Compiler* compiler)
 {
-    decStackCount();
-    write8(OP_POP);
+    decStackCount(compiler);
+    emit(compiler, OP_POP, 0);
 }
 
-static void op_add()
+static void op_binary(Compiler* compiler, uint8_t opcode)
 {
-    decStackCount();
-    write8(OP_ADD);
+    decStackCount(compiler);
+    arithmetic(compiler, opcode);
 }
 
-static void op_sub()
+static void op_unary(Compiler* compiler, uint8_t opcode)
 {
-    decStackCount();
-    write8(OP_SUB);
+    emit(compiler, opcode, 0);
 }
 
-static void op_mul()
+static void op_conv(Compiler* compiler, NumberKind from, NumberKind to)
 {
-    decStackCount();
-    write8(OP_MUL);
+    uint8_t kinds = from << 4 | to;
+
+    emit(compiler, OP_CONV, kinds);
+    write8(compiler, kinds);
 }
 
-static void op_div()
+static void op_call(Compiler* compiler, uint16_t imm)
 {
-    decStackCount();
-    write8(OP_DIV);
+    emit(compiler, OP_CALL, imm);
+    write16(compiler, imm);
 }
 
-static void op_rem()
+static void op_async(Compiler* compiler, uint16_t imm)
 {
-    decStackCount();
-    write8(OP_REM);
+    emit(compiler, OP_ASYNC, imm);
+    write16(compiler, imm);
 }
 
-static void op_pow()
+static void op_await(Compiler* compiler)
 {
-    decStackCount();
-    write8(OP_POW);
+    emit(compiler, OP_AWAIT, 0);
 }
 
-static void op_band()
+static void op_resolve(Compiler* compiler)
 {
-    decStackCount();
-    write8(OP_BAND);
+    emit(compiler, OP_RESOLVE, 0);
 }
 
-static void op_bor()
+static void op_detach(Compiler* compiler)
 {
-    decStackCount();
-    write8(OP_BOR);
+    decStackCount(compiler);
+    emit(compiler, OP_DETACH, 0);
 }
 
-static void op_bxor()
+static void op_generate(Compiler* compiler, uint16_t imm)
 {
-    decStackCount();
-    write8(OP_BXOR);
+    emit(compiler, OP_GENERATE, imm);
+    write16(compiler, imm);
 }
 
-static void op_bnot()
+static size_t op_next(Compiler* compiler)
 {
-    decStackCount();
-    write8(OP_BNOT);
+    emit(compiler, OP_NEXT, 0);
+    write16(compiler, 0);
+
+    return countCodeObject(currentCodeObject(compiler));
 }
 
-static void op_lsl()
+static void op_yield(Compiler* compiler)
 {
-    decStackCount();
-    write8(OP_LSL);
+    decStackCount(compiler);
+    emit(compiler, OP_YIELD, 0);
 }
 
-static void op_lsr()
+static void op_finish(Compiler* compiler)
 {
-    decStackCount();
-    write8(OP_LSR);
+    emit(compiler, OP_FINISH, 0);
 }
 
-static void op_neg()
+static void op_close(Compiler* compiler)
 {
-    write8(OP_NEG);
+    decStackCount(compiler);
+    emit(compiler, OP_CLOSE, 0);
 }
 
-static void op_not()
+static void op_ret(Compiler* compiler)
 {
-    write8(OP_NOT);
+    incStackCount(compiler);
+    emit(compiler, OP_RET, 0);
 }
 
-static void op_call(uint16_t imm)
+static void op_retv(Compiler* compiler)
 {
-    write8(OP_CALL);
-    write16(imm);
+    emit(compiler, OP_RETV, 0);
 }
 
-static void op_ret()
+static size_t op_jz(Compiler* compiler)
 {
-    incStackCount();
-    write8(OP_RET);
+    decStackCount(compiler);
+    emit(compiler, OP_JZ, 0);
+    write16(compiler, 0);
+
+    return countCodeObject(currentCodeObject(compiler));
 }
 
-static void op_retv()
+static size_t op_jmp(Compiler* compiler)
 {
-    write8(OP_RETV);
+    emit(compiler, OP_JMP, 0);
+    write16(compiler, 0);
+
+    return countCodeObject(currentCodeObject(compiler));
 }
 
-static size_t makeConstant(Value value)
+static void op_loop(Compiler* compiler, size_t start)
 {
-    return pushValue(&compiler.module->constants, value) - 1;
+    emit(compiler, OP_LOOP, 0);
+    write16(compiler, countCodeObject(currentCodeObject(compiler)) + 4 - start);
+    write16(compiler, addLoop(compiler->module, compiler->function));
+}
+
+// Points the forward jump that ends at from to the next instruction, which
+// becomes a jump target and so must not be fused with what precedes it.
+static void patchJump(Compiler* compiler, size_t from)
+{
+    CodeObject* code = currentCodeObject(compiler);
+    size_t distance = countCodeObject(code) - from;
+
+    setByteAt(code, from - 2, (distance >> 8) & 0xFF);
+    setByteAt(code, from - 1, distance & 0xFF);
+    clearHistory(compiler);
+}
+
+static size_t makeConstant(Compiler* compiler, Value value)
+{
+    return pushValue(&compiler->module->constants, value) - 1;
 }
 
 static int getLocalPosition(AST* ast)
@@ -292,228 +490,323 @@ static int getLocalPosition(AST* ast)
     return ast->variableDefinition.position;
 }
 
-static void loadGlobalVariable(AST* ast)
+static void loadGlobalVariable(Compiler* compiler, AST* ast)
 {
     int position = getLocalPosition(ast);
 
-    op_ldg(position);
+    op_ldg(compiler, position);
 }
 
-static void loadLocalVariable(AST* ast)
+static void loadLocalVariable(Compiler* compiler, AST* ast)
 {
     int position = getLocalPosition(ast);
 
-    op_ldl(position);
+    op_ldl(compiler, position);
 }
 
-static void loadVariable(AST* ast)
+static void loadVariable(Compiler* compiler, AST* ast)
 {
     if (isTopLevel(ast->variableDefinition.scope)) {
-        loadGlobalVariable(ast);
+        loadGlobalVariable(compiler, ast);
     } else {
-        loadLocalVariable(ast);
+        loadLocalVariable(compiler, ast);
     }
 }
 
-static void storeGlobalVariable(AST* ast)
+static void storeGlobalVariable(Compiler* compiler, AST* ast)
 {
     int position = getLocalPosition(ast);
 
-    op_stg(position);
+    op_stg(compiler, position);
 }
 
-static void storeLocalVariable(AST* ast)
+static void storeLocalVariable(Compiler* compiler, AST* ast)
 {
     int position = getLocalPosition(ast);
 
-    op_stl(position);
+    op_stl(compiler, position);
 }
 
-static void storeVariable(AST* ast)
+static void storeVariable(Compiler* compiler, AST* ast)
 {
     if (isTopLevel(ast->variableDefinition.scope)) {
-        storeGlobalVariable(ast);
+        storeGlobalVariable(compiler, ast);
     } else {
-        storeLocalVariable(ast);
+        storeLocalVariable(compiler, ast);
     }
 }
 
-static void number(AST* ast)
+static NumberKind getKind(AST* ast)
 {
-    if (isLargerThan16BitSigned(ast->intValue)) {
-        size_t position = makeConstant(INT_VALUE(ast->intValue));
-        op_ldc(position);
-        pushVectorItem(&compiler.functionReferences, ast);
-    } else if (isLargerThan8BitSigned(ast->intValue)) {
-        op_pushh(ast->intValue);
+    return getNumberKind(getTypeId(ast));
+}
+
+// Whether values of the kind are boxed as ints, which the short push
+// forms and jz work with.
+static bool isIntKind(NumberKind kind)
+{
+    return kind != NUMBER_I64 && kind != NUMBER_U64 && kind != NUMBER_F32 && kind != NUMBER_F64;
+}
+
+// Whether every value of kind from already looks the way it would as a
+// value of kind to, so that converting it takes no code.
+static bool isSameRepresentation(NumberKind from, NumberKind to)
+{
+    if (from == to || (from == NUMBER_F32 && to == NUMBER_F64)) {
+        return true;
+    }
+
+    switch (to) {
+        case NUMBER_I32:
+        case NUMBER_U32:    return isIntKind(from);
+        case NUMBER_I16:    return from == NUMBER_I8 || from == NUMBER_U8;
+        case NUMBER_U16:    return from == NUMBER_U8;
+        default:            return false;
+    }
+}
+
+// Constants share their indices with the function references, so each
+// one takes a reference slot too.
+static void loadConstant(Compiler* compiler, Value value, AST* ast)
+{
+    size_t position = makeConstant(compiler, value);
+    op_ldc(compiler, position);
+    pushVectorItem(&compiler->functionReferences, ast);
+}
+
+static void pushNumber(Compiler* compiler, Value value, NumberKind kind, AST* ast)
+{
+    int32_t n = AS_INT(value);
+
+    if (!isIntKind(kind) || isLargerThan16BitSigned(n)) {
+        loadConstant(compiler, value, ast);
+    } else if (isLargerThan8BitSigned(n)) {
+        op_pushh(compiler, n);
     } else {
-        op_pushb(ast->intValue);
+        op_pushb(compiler, n);
+    }
+}
+
+static void pushZero(Compiler* compiler, NumberKind kind, AST* ast)
+{
+    pushNumber(compiler, convertNumber(INT_VALUE(0), NUMBER_I32, kind), kind, ast);
+}
+
+static Value getLiteral(AST* ast, NumberKind kind)
+{
+    if (ast->type == AST_FLOAT) {
+        return convertNumber(FLOAT_VALUE(ast->floatValue), NUMBER_F64, kind);
     }
+
+    return convertNumber(I64_VALUE(ast->intValue), NUMBER_I64, kind);
 }
 
-static void binary(AST* ast)
+static void number(Compiler* compiler, AST* ast)
 {
-    expression(ast->binary.leftExpr);
-    expression(ast->binary.rightExpr);
+    NumberKind kind = getKind(ast);
+
+    pushNumber(compiler, getLiteral(ast, kind), kind, ast);
+}
 
-    switch (ast->binary.operator.type) {
+// A literal is converted here rather than at run time.
+static void conversion(Compiler* compiler, AST* ast)
+{
+    AST* expr = ast->conversion.expr;
+    NumberKind from = getKind(expr);
+    NumberKind to = getNumberKind(ast->conversion.typeId);
+
+    if (isLiteral(expr)) {
+        return pushNumber(compiler, getLiteral(expr, to), to, ast);
+    }
+
+    expression(compiler, expr);
+
+    if (!isSameRepresentation(from, to)) {
+        op_conv(compiler, from, to);
+    }
+}
+
+// int8, int16, uint8 and uint16 are computed as 32-bit ints and cut back
+// down to size afterwards.
+static void narrow(Compiler* compiler, NumberKind kind)
+{
+    if (kind == NUMBER_I8 || kind == NUMBER_I16 || kind == NUMBER_U8 || kind == NUMBER_U16) {
+        op_conv(compiler, NUMBER_I32, kind);
+    }
+}
+
+// Picks the opcode for operands of the kind: signed or unsigned ints of
+// up to 32 bits, int64, uint64, float or double.
+static uint8_t selectOpcode(NumberKind kind, uint8_t i32, uint8_t u32, uint8_t i64,
+    uint8_t u64, uint8_t f32, uint8_t f64)
+{
+    switch (kind) {
+        case NUMBER_I8:
+        case NUMBER_I16:
+        case NUMBER_I32:    return i32;
+        case NUMBER_U8:
+        case NUMBER_U16:
+        case NUMBER_U32:    return u32;
+        case NUMBER_I64:    return i64;
+        case NUMBER_U64:    return u64;
+        case NUMBER_F32:    return f32;
+        default:            return f64;
+    }
+}
+
+// The parser has rejected the operators a type does not have.
+static uint8_t getBinaryOpcode(TokenType type, NumberKind kind)
+{
+    switch (type) {
         case T_PLUS:
-            return op_add();
+            return selectOpcode(kind, OP_ADD, OP_ADD, OP_ADD_I64, OP_ADD_I64, OP_ADD_F32, OP_ADD_F64);
         case T_MINUS:
-            return op_sub();
+            return selectOpcode(kind, OP_SUB, OP_SUB, OP_SUB_I64, OP_SUB_I64, OP_SUB_F32, OP_SUB_F64);
         case T_STAR:
-            return op_mul();
+            return selectOpcode(kind, OP_MUL, OP_MUL, OP_MUL_I64, OP_MUL_I64, OP_MUL_F32, OP_MUL_F64);
         case T_SLASH:
         case T_FLOOR:
-            return op_div();
+            return selectOpcode(kind, OP_DIV, OP_DIV_U32, OP_DIV_I64, OP_DIV_U64, OP_DIV_F32, OP_DIV_F64);
         case T_PERCENT:
-            return op_rem();
+            return selectOpcode(kind, OP_REM, OP_REM_U32, OP_REM_I64, OP_REM_U64, OP_HLT, OP_HLT);
         case T_POWER:
-            return op_pow();
+            return OP_POW;
         case T_AMPERSAND:
-            return op_band();
+            return selectOpcode(kind, OP_BAND, OP_BAND, OP_BAND_I64, OP_BAND_I64, OP_HLT, OP_HLT);
         case T_PIPE:
-            return op_bor();
+            return selectOpcode(kind, OP_BOR, OP_BOR, OP_BOR_I64, OP_BOR_I64, OP_HLT, OP_HLT);
         case T_CIRCUMFLEX:
-            return op_bxor();
+            return selectOpcode(kind, OP_BXOR, OP_BXOR, OP_BXOR_I64, OP_BXOR_I64, OP_HLT, OP_HLT);
         case T_LSHIFT:
-            return op_lsl();
+            return selectOpcode(kind, OP_LSL, OP_LSL, OP_LSL_I64, OP_LSL_I64, OP_HLT, OP_HLT);
         case T_RSHIFT:
-            return op_lsr();
+            return selectOpcode(kind, OP_LSR, OP_LSR_U32, OP_LSR_I64, OP_LSR_U64, OP_HLT, OP_HLT);
+        case T_EQUAL_EQUAL:
+            return selectOpcode(kind, OP_EQ, OP_EQ, OP_EQ_I64, OP_EQ_I64, OP_EQ_F64, OP_EQ_F64);
+        case T_NOT_EQUAL:
+            return selectOpcode(kind, OP_NE, OP_NE, OP_NE_I64, OP_NE_I64, OP_NE_F64, OP_NE_F64);
+        case T_LESS:
+            return selectOpcode(kind, OP_LT, OP_LT_U32, OP_LT_I64, OP_LT_U64, OP_LT_F64, OP_LT_F64);
+        case T_LESS_EQUAL:
+            return selectOpcode(kind, OP_LE, OP_LE_U32, OP_LE_I64, OP_LE_U64, OP_LE_F64, OP_LE_F64);
+        case T_GREATER:
+            return selectOpcode(kind, OP_GT, OP_GT_U32, OP_GT_I64, OP_GT_U64, OP_GT_F64, OP_GT_F64);
+        case T_GREATER_EQUAL:
+            return selectOpcode(kind, OP_GE, OP_GE_U32, OP_GE_I64, OP_GE_U64, OP_GE_F64, OP_GE_F64);
         default:
-            return;
+            return OP_HLT;
     }
 }
 
-static void bitNot(AST* ast)
-{
-    expression(ast->prefix.expr);
-    op_bnot();
-}
-
-static void logNot(AST* ast)
-{
-    expression(ast->prefix.expr);
-    op_not();
-}
-
-static void negate(AST* ast)
-{
-    expression(ast->prefix.expr);
-    op_neg();
-}
-
-static void prefix(AST* ast)
+static uint8_t getPrefixOpcode(TokenType type, NumberKind kind)
 {
-    switch (ast->prefix.operator.type) {
+    switch (type) {
         case T_EXCLAMATION:
-            return logNot(ast);
+            return OP_NOT;
         case T_TILDE:
-            return bitNot(ast);
+            return selectOpcode(kind, OP_BNOT, OP_BNOT, OP_BNOT_I64, OP_BNOT_I64, OP_HLT, OP_HLT);
         case T_MINUS:
-            return negate(ast);
+            return selectOpcode(kind, OP_NEG, OP_NEG, OP_NEG_I64, OP_NEG_I64, OP_NEG_F64, OP_NEG_F64);
         default:
-            return;
+            return OP_HLT;
     }
 }
 
-static void variable(AST* ast)
+// The operands have the same type, which the parser converted them to.
+static void binary(Compiler* compiler, AST* ast)
 {
-    loadVariable(ast->variable.symbol);
-}
+    TokenType type = ast->binary.operator.type;
+    NumberKind kind = getKind(ast->binary.leftExpr);
 
-static void additionAssignment(AST* ast)
-{
-    loadVariable(ast->assignment.symbol);
-    expression(ast->assignment.expr);
-    op_add();
-    storeVariable(ast->assignment.symbol);
-}
+    expression(compiler, ast->binary.leftExpr);
+    expression(compiler, ast->binary.rightExpr);
+    op_binary(compiler, getBinaryOpcode(type, kind));
 
-static void subtractionAssignment(AST* ast)
-{
-    loadVariable(ast->assignment.symbol);
-    expression(ast->assignment.expr);
-    op_sub();
-    storeVariable(ast->assignment.symbol);
+    if (!isBoolOperatorToken(type)) {
+        narrow(compiler, kind);
+    }
 }
 
-static void muliplicationAssignment(AST* ast)
+static void prefix(Compiler* compiler, AST* ast)
 {
-    loadVariable(ast->assignment.symbol);
-    expression(ast->assignment.expr);
-    op_mul();
-    storeVariable(ast->assignment.symbol);
+    TokenType type = ast->prefix.operator.type;
+    NumberKind kind = getKind(ast->prefix.expr);
+
+    expression(compiler, ast->prefix.expr);
+    op_unary(compiler, getPrefixOpcode(type, kind));
+
+    if (type != T_EXCLAMATION) {
+        narrow(compiler, kind);
+    }
 }
 
-static void divisionAssignment(AST* ast)
+static void variable(Compiler* compiler, AST* ast)
 {
-    loadVariable(ast->assignment.symbol);
-    expression(ast->assignment.expr);
-    op_div();
-    storeVariable(ast->assignment.symbol);
+    loadVariable(compiler, ast->variable.symbol);
 }
 
-static void remainderAssignment(AST* ast)
+// A global is loaded only once the right side is known, and stored before
+// anything else runs, so that a task on another worker cannot come in
+// between.
+static void globalCompoundAssignment(Compiler* compiler, AST* ast)
 {
-    loadVariable(ast->assignment.symbol);
-    expression(ast->assignment.expr);
-    op_rem();
-    storeVariable(ast->assignment.symbol);
+    TokenType type = getBinaryOperatorToken(ast->assignment.operator.type);
+    NumberKind kind = getKind(ast->assignment.symbol);
+    int position = getLocalPosition(ast->assignment.symbol);
+
+    expression(compiler, ast->assignment.expr);
+    op_lkg(compiler, position);
+    op_binary(compiler, getBinaryOpcode(type, kind));
+    narrow(compiler, kind);
+    op_ulg(compiler, position);
 }
 
-static void exponentiationAssignment(AST* ast)
+static void compoundAssignment(Compiler* compiler, AST* ast)
 {
-    loadVariable(ast->assignment.symbol);
-    expression(ast->assignment.expr);
-    op_pow();
-    storeVariable(ast->assignment.symbol);
+    TokenType type = getBinaryOperatorToken(ast->assignment.operator.type);
+    NumberKind kind = getKind(ast->assignment.symbol);
+
+    if (isTopLevel(ast->assignment.symbol->variableDefinition.scope)) {
+        return globalCompoundAssignment(compiler, ast);
+    }
+
+    loadVariable(compiler, ast->assignment.symbol);
+    expression(compiler, ast->assignment.expr);
+    op_binary(compiler, getBinaryOpcode(type, kind));
+    narrow(compiler, kind);
+    storeVariable(compiler, ast->assignment.symbol);
 }
 
-static void simpleAssignment(AST* ast)
+static void simpleAssignment(Compiler* compiler, AST* ast)
 {
-    expression(ast->assignment.expr);
-    storeVariable(ast->assignment.symbol);
+    expression(compiler, ast->assignment.expr);
+    storeVariable(compiler, ast->assignment.symbol);
 }
 
-static void assignment(AST* ast)
+static void assignment(Compiler* compiler, AST* ast)
 {
-    switch (ast->assignment.operator.type) {
-        case T_PLUS_EQUAL:
-            return additionAssignment(ast);
-        case T_MINUS_EQUAL:
-            return subtractionAssignment(ast);
-        case T_STAR_EQUAL:
-            return muliplicationAssignment(ast);
-        case T_FLOOR_EQUAL:
-        case T_SLASH_EQUAL:
-            return divisionAssignment(ast);
-        case T_PERCENT_EQUAL:
-            return remainderAssignment(ast);
-        case T_POWER_EQUAL:
-            return exponentiationAssignment(ast);
-        case T_EQUAL:
-            return simpleAssignment(ast);
-        default:
-            return;
+    if (ast->assignment.operator.type == T_EQUAL) {
+        return simpleAssignment(compiler, ast);
     }
+
+    compoundAssignment(compiler, ast);
 }
 
-static void arguments(Vector* args)
+static void arguments(Compiler* compiler, Vector* args)
 {
     size_t count = countVector(args);
 
     for (size_t i = 0; i < count; i++) {
-        expression(args->data[i]);
+        expression(compiler, args->data[i]);
     }
 }
 
-static int getFunctionPosition(AST* ast)
+static int getFunctionPosition(Compiler* compiler, AST* ast)
 {
-    size_t functionCount = countVector(&compiler.functionReferences);
+    size_t functionCount = countVector(&compiler->functionReferences);
     
     for (int i = 0; i < functionCount; i++) {
-        if (ast == compiler.functionReferences.data[i]) {
+        if (ast == compiler->functionReferences.data[i]) {
             return i;
         }
     }
@@ -521,173 +814,481 @@ static int getFunctionPosition(AST* ast)
     return -1;
 }
 
-static void functionCall(AST* ast)
+static void functionCall(Compiler* compiler, AST* ast)
+{
+    uint16_t position = getFunctionPosition(compiler, ast->functionCall.symbol);
+    arguments(compiler, &ast->functionCall.args);
+
+    if (isAsyncCall(ast)) {
+        op_async(compiler, position);
+    } else {
+        op_call(compiler, position);
+    }
+}
+
+static void awaitExpression(Compiler* compiler, AST* ast)
 {
-    uint16_t position = getFunctionPosition(ast->functionCall.symbol);
-    arguments(&ast->functionCall.args);
-    op_call(position);
+    expression(compiler, ast->expression);
+    op_await(compiler);
 }
 
-static void serviceRequest(AST* ast)
+static uint8_t getIntrinsic(int service)
 {
-    arguments(&ast->serviceRequest.args);
-    op_reqs(ast->serviceRequest.opcode);
+    switch (service) {
+        case SOP_ABS:       return OP_ABS;
+        case SOP_MIN:       return OP_MIN;
+        case SOP_MAX:       return OP_MAX;
+        case SOP_CLAMP:     return OP_CLAMP;
+        case SOP_POPCOUNT:  return OP_POPCNT;
+        case SOP_CLZ:       return OP_CLZ;
+        case SOP_CTZ:       return OP_CTZ;
+        case SOP_ROTL:      return OP_ROTL;
+        case SOP_ROTR:      return OP_ROTR;
+        case SOP_BSWAP:     return OP_BSWAP;
+        default:            return OP_HLT;
+    }
+}
+
+// Services that are a single operation on ints get an opcode of their own
+// instead of a call.
+static void serviceRequest(Compiler* compiler, AST* ast)
+{
+    Service* service = ast->serviceRequest.service;
+    uint8_t intrinsic = getIntrinsic(service->opcode);
+
+    arguments(compiler, &ast->serviceRequest.args);
+
+    if (intrinsic != OP_HLT) {
+        op_intrinsic(compiler, intrinsic, service->paramCount);
+    } else {
+        op_reqs(compiler, service);
+    }
+}
+
+// A service that returns nothing still reads as 0 where a value is needed.
+static void serviceValue(Compiler* compiler, AST* ast)
+{
+    serviceRequest(compiler, ast);
+
+    if (ast->serviceRequest.service->resultCount == 0) {
+        op_pushb(compiler, 0);
+    }
+}
+
+// ret returns the int 0, which is not the zero of the wider types. An
+// async function always returns through resolve, which takes a value, and
+// a generator through finish, which takes none.
+static void implicitReturn(Compiler* compiler, AST* ast)
+{
+    NumberKind kind = getKind(ast);
+
+    if (compiler->generator) {
+        return op_finish(compiler);
+    }
+
+    if (compiler->async) {
+        pushZero(compiler, kind, ast);
+        return op_resolve(compiler);
+    }
+
+    if (isIntKind(kind)) {
+        return op_ret(compiler);
+    }
+
+    pushZero(compiler, kind, ast);
+    op_retv(compiler);
 }
 
-static void functionDefinition(AST* ast)
+static void functionDefinition(Compiler* compiler, AST* ast)
 {
     AST* body = ast->functionDefinition.body;
-    FunctionObject* previousFunction = compiler.function;
-    FunctionObject* function = createFunctionObject();
+    FunctionObject* previousFunction = compiler->function;
+    bool previousAsync = compiler->async;
+    bool previousGenerator = compiler->generator;
+    AST* previousIteration = compiler->iteration;
+    FunctionObject* function = addFunction(compiler->module);
     function->paramCount = countVector(&ast->functionDefinition.params);
     function->localCount = body->compound.scope->localCount;
     function->maxStackCount = function->localCount + 3;
+    function->generator = ast->functionDefinition.generator;
     
-    compiler.stackCount = function->maxStackCount;
-    compiler.function = function;
-    makeConstant(POINTER_VALUE(function));
-    pushVectorItem(&compiler.functionReferences, ast);
-    blocklevelStatements(&body->compound.statements);
-
-    AST* last = vectorEnd(&body->compound.statements);
+    compiler->stackCount = function->maxStackCount;
+    compiler->function = function;
+    compiler->async = ast->functionDefinition.async;
+    compiler->generator = ast->functionDefinition.generator;
+    compiler->iteration = NULL;
+    clearHistory(compiler);
+    makeConstant(compiler, POINTER_VALUE(function));
+    pushVectorItem(&compiler->functionReferences, ast);
+    blocklevelStatements(compiler, &body->compound.statements);
+
+    size_t count = countVector(&body->compound.statements);
+    AST* last = count > 0 ? getVectorAt(&body->compound.statements, count - 1) : NULL;
 
     if (!last || last->type != AST_RETURN) {
-        op_ret();
+        implicitReturn(compiler, ast);
     }
     
-    compiler.function = previousFunction;
+    compiler->function = previousFunction;
+    compiler->async = previousAsync;
+    compiler->generator = previousGenerator;
+    compiler->iteration = previousIteration;
+    clearHistory(compiler);
 }
 
-static void ret(AST* ast)
+// Ending the outermost for a return leaves ends every generator inside it
+// too.
+static void closeIteration(Compiler* compiler)
 {
-    if (isNone(ast->expression)) {
-        return op_ret();
+    if (compiler->iteration) {
+        loadVariable(compiler, compiler->iteration->forStatement.generator);
+        op_close(compiler);
     }
+}
+
+// What a generator returns is worked out and dropped.
+static void ret(Compiler* compiler, AST* ast)
+{
+    bool none = isNone(ast->expression);
+
+    if (!none) {
+        expression(compiler, ast->expression);
+    }
+
+    if (compiler->generator) {
+        if (!none) {
+            op_pop(compiler);
+        }
+
+        return op_finish(compiler);
+    }
+
+    closeIteration(compiler);
 
-    expression(ast->expression);
-    op_retv();
+    if (compiler->async && none) {
+        pushZero(compiler, NUMBER_I32, ast);
+    }
+
+    if (compiler->async) {
+        return op_resolve(compiler);
+    }
+
+    if (none) {
+        return op_ret(compiler);
+    }
+
+    op_retv(compiler);
 }
 
-static void variableDefinitionUninitialized(AST* ast)
+static void yield(Compiler* compiler, AST* ast)
 {
-    op_pushb(0);
+    expression(compiler, ast->expression);
+    op_yield(compiler);
+}
 
-    if (isTopLevel(ast->variableDefinition.scope)) {
-        op_reg();
+static void defineVariable(Compiler* compiler, AST* ast)
+{
+    if (isTopLevel(ast->variableDefinition.scope) && compiler->blockDepth > 0) {
+        storeGlobalVariable(compiler, ast);
+    } else if (isTopLevel(ast->variableDefinition.scope)) {
+        op_reg(compiler);
+    } else {
+        storeLocalVariable(compiler, ast);
     }
 }
 
-static void variableDefinition(AST* ast)
+static void variableDefinitionUninitialized(Compiler* compiler, AST* ast)
+{
+    pushZero(compiler, getKind(ast), ast);
+    defineVariable(compiler, ast);
+}
+
+static void variableDefinition(Compiler* compiler, AST* ast)
 {
     if (isNone(ast->variableDefinition.expr)) {
-        return variableDefinitionUninitialized(ast);
+        return variableDefinitionUninitialized(compiler, ast);
     }
 
-    expression(ast->variableDefinition.expr);
+    expression(compiler, ast->variableDefinition.expr);
+    defineVariable(compiler, ast);
+}
+
+static void registerGlobals(Compiler* compiler, AST* ast);
 
-    if (isTopLevel(ast->variableDefinition.scope)) {
-        op_reg();
+static void registerGlobalsIn(Compiler* compiler, Vector* nodes)
+{
+    size_t count = countVector(nodes);
+
+    for (size_t i = 0; i < count; i++) {
+        registerGlobals(compiler, nodes->data[i]);
     }
 }
 
-static void expression(AST* ast)
+// Globals are registered in definition order, so those defined inside a
+// top-level block are registered once before it runs and only stored to
+// inside it.
+static void registerGlobals(Compiler* compiler, AST* ast)
 {
     switch (ast->type) {
+        case AST_IF:
+            registerGlobalsIn(compiler, &ast->ifStatement.body);
+            registerGlobalsIn(compiler, &ast->ifStatement.elseBody);
+            break;
+        case AST_FOR:
+            if (ast->forStatement.defines) {
+                registerGlobals(compiler, ast->forStatement.variable);
+            }
+
+            registerGlobals(compiler, ast->forStatement.generator);
+            registerGlobalsIn(compiler, &ast->forStatement.body);
+            break;
+        case AST_VARIABLE_DEFINITION:
+            if (isTopLevel(ast->variableDefinition.scope)) {
+                pushZero(compiler, getKind(ast), ast);
+                op_reg(compiler);
+            }
+            break;
+        case AST_WHILE:
+            registerGlobalsIn(compiler, &ast->whileStatement.body);
+            break;
+        default:
+            break;
+    }
+}
+
+static void block(Compiler* compiler, Vector* nodes)
+{
+    compiler->blockDepth++;
+    blocklevelStatements(compiler, nodes);
+    compiler->blockDepth--;
+}
+
+// jz tests an int, so conditions of wider types are compared with zero
+// first.
+static void condition(Compiler* compiler, AST* ast)
+{
+    NumberKind kind = getKind(ast);
+
+    expression(compiler, ast);
+
+    if (!isIntKind(kind)) {
+        pushZero(compiler, kind, ast);
+        op_binary(compiler, getBinaryOpcode(T_NOT_EQUAL, kind));
+    }
+}
+
+static void ifStatement(Compiler* compiler, AST* ast)
+{
+    condition(compiler, ast->ifStatement.condition);
+    size_t next = op_jz(compiler);
+    block(compiler, &ast->ifStatement.body);
+
+    if (countVector(&ast->ifStatement.elseBody) == 0) {
+        return patchJump(compiler, next);
+    }
+
+    size_t end = op_jmp(compiler);
+    patchJump(compiler, next);
+    block(compiler, &ast->ifStatement.elseBody);
+    patchJump(compiler, end);
+}
+
+static void whileStatement(Compiler* compiler, AST* ast)
+{
+    size_t start = countCodeObject(currentCodeObject(compiler));
+
+    clearHistory(compiler);
+    condition(compiler, ast->whileStatement.condition);
+    size_t exit = op_jz(compiler);
+    block(compiler, &ast->whileStatement.body);
+    op_loop(compiler, start);
+    patchJump(compiler, exit);
+}
+
+// generate starts the generator and next resumes it at the top of every
+// pass: what it yields goes to the loop variable, and when it finishes
+// instead it leaves the loop. A loop variable the for defines reads as
+// zero if nothing is ever yielded.
+static void forStatement(Compiler* compiler, AST* ast)
+{
+    AST* call = ast->forStatement.call;
+    AST* previousIteration = compiler->iteration;
+
+    if (ast->forStatement.defines) {
+        pushZero(compiler, getKind(ast->forStatement.variable), ast);
+        storeVariable(compiler, ast->forStatement.variable);
+    }
+
+    arguments(compiler, &call->functionCall.args);
+    op_generate(compiler, getFunctionPosition(compiler, call->functionCall.symbol));
+    storeVariable(compiler, ast->forStatement.generator);
+
+    size_t start = countCodeObject(currentCodeObject(compiler));
+
+    clearHistory(compiler);
+    loadVariable(compiler, ast->forStatement.generator);
+    size_t exit = op_next(compiler);
+    storeVariable(compiler, ast->forStatement.variable);
+
+    if (!compiler->iteration) {
+        compiler->iteration = ast;
+    }
+
+    block(compiler, &ast->forStatement.body);
+    compiler->iteration = previousIteration;
+    op_loop(compiler, start);
+    patchJump(compiler, exit);
+}
+
+static void blockStatement(Compiler* compiler, AST* ast)
+{
+    if (compiler->blockDepth == 0) {
+        registerGlobals(compiler, ast);
+    }
+
+    switch (ast->type) {
+        case AST_IF:
+            return ifStatement(compiler, ast);
+        case AST_WHILE:
+            return whileStatement(compiler, ast);
+        default:
+            return forStatement(compiler, ast);
+    }
+}
+
+static void expression(Compiler* compiler, AST* ast)
+{
+    switch (ast->type) {
+        case AST_AWAIT:
+            return awaitExpression(compiler, ast);
         case AST_BINARY:
-            return binary(ast);
-        case AST_FUNCTION_CALL:
-            return functionCall(ast);
+            return binary(compiler, ast);
+        case AST_CONVERSION:
+            return conversion(compiler, ast);
+        case AST_FLOAT:
         case AST_INTEGER:
-            return number(ast);
+            return number(compiler, ast);
+        case AST_FUNCTION_CALL:
+            return functionCall(compiler, ast);
         case AST_PREFIX:
-            return prefix(ast);
+            return prefix(compiler, ast);
         case AST_SERVICE_REQUEST:
-            return serviceRequest(ast);
+            return serviceValue(compiler, ast);
         case AST_VARIABLE:
-            return variable(ast);
+            return variable(compiler, ast);
         default:
             return;
     }
 }
 
-static void statement(AST* ast)
+static void statement(Compiler* compiler, AST* ast)
 {
     switch (ast->type) {
         case AST_ASSIGNMENT:
-            assignment(ast);
+            assignment(compiler, ast);
+            break;
+        case AST_EXTERN_DEFINITION:
             break;
         case AST_FUNCTION_CALL:
-            functionCall(ast);
-            op_pop();
+            functionCall(compiler, ast);
+
+            if (isAsyncCall(ast)) {
+                op_detach(compiler);
+            } else {
+                op_pop(compiler);
+            }
+
             break;
         case AST_FUNCTION_DEFINITION:
-            functionDefinition(ast);
+            functionDefinition(compiler, ast);
+            break;
+        case AST_FOR:
+        case AST_IF:
+        case AST_WHILE:
+            blockStatement(compiler, ast);
             break;
         case AST_RETURN:
-            ret(ast);
+            ret(compiler, ast);
+            break;
+        case AST_YIELD:
+            yield(compiler, ast);
             break;
         case AST_SERVICE_REQUEST:
-            serviceRequest(ast);
-            op_pop();
+            serviceRequest(compiler, ast);
+
+            if (ast->serviceRequest.service->future) {
+                op_detach(compiler);
+                break;
+            }
+
+            for (int i = 0; i < ast->serviceRequest.service->resultCount; i++) {
+                op_pop(compiler);
+            }
+
             break;
         case AST_VARIABLE_DEFINITION:
-            variableDefinition(ast);
+            variableDefinition(compiler, ast);
             break;
         default:
-            expression(ast);
-            op_pop();
+            expression(compiler, ast);
+            op_pop(compiler);
     }
 }
 
-static void blocklevelStatements(Vector* nodes)
+static void blocklevelStatements(Compiler* compiler, Vector* nodes)
 {
     size_t count = countVector(nodes);
 
     for (size_t i = 0; i < count; i++) {
-        statement(nodes->data[i]);
+        statement(compiler, nodes->data[i]);
     }
 }
 
-static void toplevelStatements(Vector* nodes)
+static void toplevelStatements(Compiler* compiler, Vector* nodes)
 {
-    static size_t i = 0;
     size_t count = countVector(nodes);
 
-    for (; i < count; i++) {
-        statement(nodes->data[i]);
+    for (; compiler->statementCount < count; compiler->statementCount++) {
+        statement(compiler, nodes->data[compiler->statementCount]);
     }
 }
 
-void initCompiler(ModuleObject* module)
+void initCompiler(Compiler* compiler, ModuleObject* module)
 {
-    initVector(&compiler.functionReferences);
-    pushVectorItem(&compiler.functionReferences, NULL);
+    initVector(&compiler->functionReferences);
+    pushVectorItem(&compiler->functionReferences, NULL);
 
-    AST* ast = createAST(AST_COMPOUND);
-    ast->compound.scope = createScope(NULL);
+    initParser(&compiler->parser);
 
-    initParser(ast);
+    AST* ast = compiler->parser.topLevel;
 
-    compiler.module = module;
-    compiler.function = AS_POINTER(module->constants.data[0]);
-    compiler.ast = ast;
-    compiler.stackCount = 0;
+    compiler->module = module;
+    compiler->function = AS_POINTER(module->constants.data[0]);
+    compiler->ast = ast;
+    compiler->statementCount = 0;
+    compiler->stackCount = 0;
+    compiler->historyCount = 0;
+    compiler->blockDepth = 0;
+    compiler->async = false;
+    compiler->generator = false;
+    compiler->iteration = NULL;
 }
 
-void freeCompiler()
+void freeCompiler(Compiler* compiler)
 {
-    freeVector(&compiler.functionReferences);
-    freeAST(compiler.ast);
+    freeVector(&compiler->functionReferences);
+    freeParser(&compiler->parser);
 }
 
-void compile(char* source)
+void compile(Compiler* compiler, char* source)
 {
-    if (!compiler.module) {
+    if (!compiler->module) {
         return;
     }
     
-    parse(source);
-    clearCodeObject(currentCodeObject());
-    toplevelStatements(&compiler.ast->compound.statements);
-    op_hlt();
+    parse(&compiler->parser, source);
+    clearCodeObject(currentCodeObject(compiler));
+    clearHistory(compiler);
+    toplevelStatements(compiler, &compiler->ast->compound.statements);
+    op_hlt(compiler);
 }
@@ -0,0 +1,302 @@
+#include "ffi.h"
+#include "assembler.h"
+#include "ast.h"
+#include "intern.h"
+#include "jit.h"
+#include "service.h"
+#include "stringobject.h"
+#include "table.h"
+#include "token.h"
+#include "value.h"
+#include "vector.h"
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+// An extern is called like any other service: with the VM and its
+// arguments, leaving its result in the first of them. What turns that into
+// a C call is a trampoline generated for the extern's signature. It loads
+// the arguments into the registers the System V ABI wants them in, calls
+// the function in r11 and boxes what comes back. Externs with the same
+// signature share one trampoline; each gets a stub of its own that puts
+// its address in r11 and jumps there.
+//
+// Symbols are looked up in the libraries opened so far, most recent
+// first, and then in the program itself. Scripts may be compiled on
+// several threads, so the libraries, the trampolines and the code they
+// live in are guarded by one lock.
+
+#define SIGNATURE_MAX (SERVICE_PARAMS_MAX + 2)
+
+// r11 is free to clobber across the stub's jump: it carries no argument.
+#define TARGET_REGISTER R11
+
+typedef struct Ffi
+{
+    Jit code;
+    Table trampolines;
+    Vector libraries;
+    void* program;
+    pthread_mutex_t lock;
+} Ffi;
+
+static Ffi ffi;
+
+static const Register intRegisters[FFI_INT_ARGS_MAX] = {RDI, RSI, RDX, RCX, R8, R9};
+
+void initFfi()
+{
+    initJit(&ffi.code, JIT_OFF);
+    initTable(&ffi.trampolines, 64);
+    initVector(&ffi.libraries);
+    ffi.program = dlopen(NULL, RTLD_NOW);
+    pthread_mutex_init(&ffi.lock, NULL);
+}
+
+void freeFfi()
+{
+    for (size_t i = 0; i < countVector(&ffi.libraries); i++) {
+        dlclose(ffi.libraries.data[i]);
+    }
+
+    if (ffi.program) {
+        dlclose(ffi.program);
+    }
+
+    freeTable(&ffi.trampolines);
+    freeVector(&ffi.libraries);
+    freeJit(&ffi.code);
+    pthread_mutex_destroy(&ffi.lock);
+}
+
+bool openLibrary(const char* path)
+{
+    void* library = dlopen(path, RTLD_NOW | RTLD_GLOBAL);
+
+    if (!library) {
+        return false;
+    }
+
+    pthread_mutex_lock(&ffi.lock);
+    pushVectorItem(&ffi.libraries, library);
+    pthread_mutex_unlock(&ffi.lock);
+
+    return true;
+}
+
+void* findSymbol(const char* name)
+{
+    void* symbol = NULL;
+
+    pthread_mutex_lock(&ffi.lock);
+
+    for (size_t i = countVector(&ffi.libraries); i > 0 && !symbol; i--) {
+        symbol = dlsym(ffi.libraries.data[i - 1], name);
+    }
+
+    if (!symbol && ffi.program) {
+        symbol = dlsym(ffi.program, name);
+    }
+
+    pthread_mutex_unlock(&ffi.lock);
+
+    return symbol;
+}
+
+// installCode makes the page it writes to writable for the copy, and a VM
+// on another thread may be running a stub already on that page, so each
+// piece of code starts on a page of its own.
+static void* installFfiCode(Assembler* as)
+{
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+
+    ffi.code.count = (ffi.code.count + pageSize - 1) & ~(pageSize - 1);
+
+    return installCode(&ffi.code, as->data, as->count);
+}
+
+static bool isFloatKind(NumberKind kind)
+{
+    return kind == NUMBER_F32 || kind == NUMBER_F64;
+}
+
+static int getKindSize(NumberKind kind)
+{
+    switch (kind) {
+        case NUMBER_I8: case NUMBER_U8:     return 1;
+        case NUMBER_I16: case NUMBER_U16:   return 2;
+        case NUMBER_I32: case NUMBER_U32:   return 4;
+        default:                            return 8;
+    }
+}
+
+static bool isSigned(NumberKind kind)
+{
+    return kind == NUMBER_I8 || kind == NUMBER_I16 || kind == NUMBER_I32;
+}
+
+// One character for the result, 'v' when there is none, and one for each
+// parameter. Returns false when the arguments do not fit in registers.
+static bool getSignature(char* signature, int typeId, int paramCount, const int* params)
+{
+    int intCount = 0;
+    int floatCount = 0;
+
+    signature[0] = typeId == T_NONE ? 'v' : 'a' + getNumberKind(typeId);
+
+    for (int i = 0; i < paramCount; i++) {
+        NumberKind kind = getNumberKind(params[i]);
+
+        if (isFloatKind(kind)) {
+            floatCount++;
+        } else {
+            intCount++;
+        }
+
+        signature[i + 1] = 'a' + kind;
+    }
+
+    signature[paramCount + 1] = '\0';
+
+    return intCount <= FFI_INT_ARGS_MAX && floatCount <= FFI_FLOAT_ARGS_MAX;
+}
+
+// The arguments are read through rbx, which the callee preserves, so that
+// the result can be stored over the first of them.
+static void emitArguments(Assembler* as, const char* signature)
+{
+    int intCount = 0;
+    int floatCount = 0;
+
+    for (int i = 0; signature[i + 1]; i++) {
+        NumberKind kind = signature[i + 1] - 'a';
+        int32_t disp = i * sizeof(Value);
+
+        if (kind == NUMBER_F64) {
+            emitLoadDouble(as, floatCount++, RBX, disp);
+        } else if (kind == NUMBER_F32) {
+            emitLoadFloat(as, floatCount++, RBX, disp);
+        } else if (getKindSize(kind) == 8) {
+            emitLoad(as, intRegisters[intCount++], RBX, disp);
+        } else {
+            emitLoadNarrow(as, intRegisters[intCount++], RBX, disp, getKindSize(kind), isSigned(kind));
+        }
+    }
+
+    // A variadic callee wants the number of vector registers used in al.
+    emitMovImm(as, RAX, floatCount);
+}
+
+// Narrow results are extended to thirty-two bits and tagged; a float is
+// widened to the double it is kept as, and a NaN made canonical.
+static void emitResult(Assembler* as, char result)
+{
+    if (result == 'v') {
+        return;
+    }
+
+    NumberKind kind = result - 'a';
+
+    if (isFloatKind(kind)) {
+        if (kind == NUMBER_F32) {
+            emitWidenFloat(as, XMM0);
+        }
+
+        emitMovFromXmm(as, RAX, XMM0);
+        emitCompareDouble(as, XMM0, XMM0);
+        size_t ordered = emitJcc(as, COND_NP);
+        emitMovImm64(as, RAX, CANONICAL_NAN);
+        patchJumpTo(as, ordered, as->count);
+    } else if (getKindSize(kind) < 8) {
+        emitExtend(as, RAX, RAX, getKindSize(kind), isSigned(kind));
+        emitMovImm64(as, RCX, INT_TAG);
+        emitAlu64(as, ALU_OR, RAX, RCX);
+    }
+
+    emitStore(as, RBX, 0, RAX);
+}
+
+static void* createTrampoline(const char* signature)
+{
+    Assembler as;
+
+    initAssembler(&as);
+    emitPush(&as, RBX);
+    emitMov(&as, RBX, RSI);
+    emitArguments(&as, signature);
+    emitCallRegister(&as, TARGET_REGISTER);
+    emitResult(&as, signature[0]);
+    emitPop(&as, RBX);
+    emitRet(&as);
+
+    void* trampoline = installFfiCode(&as);
+    freeAssembler(&as);
+
+    return trampoline;
+}
+
+static void* getTrampoline(const char* signature)
+{
+    StringObject* key = internString(signature, strlen(signature));
+    void* trampoline = getTableAt(&ffi.trampolines, key);
+
+    if (trampoline) {
+        return trampoline;
+    }
+
+    trampoline = createTrampoline(signature);
+
+    if (!trampoline) {
+        return NULL;
+    }
+
+    setTableAt(&ffi.trampolines, key, trampoline);
+
+    return trampoline;
+}
+
+static void* createStub(void* symbol, void* trampoline)
+{
+    Assembler as;
+
+    initAssembler(&as);
+    emitMovImm64(&as, TARGET_REGISTER, (uintptr_t)symbol);
+    emitMovImm64(&as, RAX, (uintptr_t)trampoline);
+    emitJmpRegister(&as, RAX);
+
+    void* stub = installFfiCode(&as);
+    freeAssembler(&as);
+
+    return stub;
+}
+
+// Registers the C function at symbol as a service. Returns NULL when its
+// signature cannot be called this way, the name is taken or there is no
+// native code on this platform.
+Service* registerExtern(const char* name, void* symbol, int typeId, int paramCount, const int* params)
+{
+    char signature[SIGNATURE_MAX];
+
+    if (paramCount > SERVICE_PARAMS_MAX || !getSignature(signature, typeId, paramCount, params)) {
+        return NULL;
+    }
+
+    if (getServiceByName(internString(name, strlen(name)))) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&ffi.lock);
+    void* trampoline = getTrampoline(signature);
+    void* stub = trampoline ? createStub(symbol, trampoline) : NULL;
+    pthread_mutex_unlock(&ffi.lock);
+
+    if (!stub) {
+        return NULL;
+    }
+
+    return registerService(name, (service_t)stub, typeId, paramCount, params);
+}
@@ -9,6 +9,13 @@ FunctionObject* createFunctionObject()
     function->paramCount = 0;
     function->localCount = 0;
     function->maxStackCount = 0;
+    function->registerCount = 0;
+    function->callCount = 0;
+    function->loopCount = 0;
+    function->nextTier = 0;
+    function->tier = TIER_INTERPRETED;
+    function->native = NULL;
+    function->generator = false;
     
     initCodeObject(&function->code);
 
@@ -18,5 +25,5 @@ FunctionObject* createFunctionObject()
 void freeFunctionObject(FunctionObject* function)
 {
     freeCodeObject(&function->code);
-    free(function);
+    FREE_OBJECT(FunctionObject, function);
 }
@@ -0,0 +1,69 @@
+#include "generator.h"
+#include "functionobject.h"
+#include "value.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+void initGenerators(GeneratorStack* stack)
+{
+    stack->top = NULL;
+    stack->spare = NULL;
+}
+
+static void freeGeneratorList(Generator* generator)
+{
+    while (generator) {
+        Generator* below = generator->below;
+        free(generator);
+        generator = below;
+    }
+}
+
+void freeGenerators(GeneratorStack* stack)
+{
+    freeGeneratorList(stack->top);
+    freeGeneratorList(stack->spare);
+}
+
+// Copies the arguments, which end at args, into the frame, whose return
+// link starts out naming the generator itself.
+Generator* startGenerator(GeneratorStack* stack, FunctionObject* function, Value* args)
+{
+    size_t size = function->paramCount + 3 + function->localCount;
+    Generator* generator = stack->spare;
+
+    if (generator) {
+        stack->spare = generator->below;
+    }
+
+    if (!generator || generator->capacity < size) {
+        generator = realloc(generator, sizeof(Generator) + sizeof(Value) * size);
+        generator->capacity = size;
+    }
+
+    memcpy(generator->frame, args, sizeof(Value) * function->paramCount);
+    generator->frame[function->paramCount] = POINTER_VALUE(generator);
+    generator->function = function;
+    generator->ip = function->code.data;
+    generator->fp = generator->frame + function->paramCount + 3;
+    generator->sp = NULL;
+    generator->below = stack->top;
+    stack->top = generator;
+
+    return generator;
+}
+
+// Ends generator along with any started after it that are still live,
+// which were left early by a return.
+void endGenerator(GeneratorStack* stack, Generator* generator)
+{
+    Generator* top;
+
+    do {
+        top = stack->top;
+        stack->top = top->below;
+        top->below = stack->spare;
+        stack->spare = top;
+    } while (top != generator);
+}
@@ -0,0 +1,89 @@
+#include "intern.h"
+#include "stringobject.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+static InternTable internTable;
+
+void initInterning()
+{
+    internTable.capacity = INTERN_INITIAL_CAPACITY;
+    internTable.strings = calloc(internTable.capacity, sizeof(StringObject*));
+    internTable.count = 0;
+    pthread_mutex_init(&internTable.lock, NULL);
+}
+
+// Only called at exit, once nothing refers to the strings any more.
+void freeInterning()
+{
+    for (size_t i = 0; i < internTable.capacity; i++) {
+        if (internTable.strings[i]) {
+            freeStringObject(internTable.strings[i]);
+        }
+    }
+
+    free(internTable.strings);
+    pthread_mutex_destroy(&internTable.lock);
+}
+
+static size_t findSlot(StringObject** strings, size_t capacity, const char* chars, size_t length, size_t hash)
+{
+    size_t index = hash & (capacity - 1);
+
+    while (strings[index]) {
+        StringObject* string = strings[index];
+
+        if (string->hash == hash && string->length == length && memcmp(string->chars, chars, length) == 0) {
+            break;
+        }
+
+        index = (index + 1) & (capacity - 1);
+    }
+
+    return index;
+}
+
+static void growInternTable()
+{
+    size_t capacity = internTable.capacity * 2;
+    StringObject** strings = calloc(capacity, sizeof(StringObject*));
+
+    for (size_t i = 0; i < internTable.capacity; i++) {
+        StringObject* string = internTable.strings[i];
+
+        if (string) {
+            strings[findSlot(strings, capacity, string->chars, string->length, string->hash)] = string;
+        }
+    }
+
+    free(internTable.strings);
+    internTable.strings = strings;
+    internTable.capacity = capacity;
+}
+
+// Returns the one string with these chars, made the first time they are
+// asked for. Callers never free it.
+StringObject* internString(const char* chars, size_t length)
+{
+    size_t hash = hashStringObject(chars, length);
+
+    pthread_mutex_lock(&internTable.lock);
+
+    size_t index = findSlot(internTable.strings, internTable.capacity, chars, length, hash);
+    StringObject* string = internTable.strings[index];
+
+    if (!string) {
+        string = createStringObject(strndup(chars, length), length, hash);
+        internTable.strings[index] = string;
+
+        if (++internTable.count * 4 > internTable.capacity * 3) {
+            growInternTable();
+        }
+    }
+
+    pthread_mutex_unlock(&internTable.lock);
+
+    return string;
+}
@@ -0,0 +1,1042 @@
+#include "jit.h"
+#include "bytecode.h"
+#include "codeobject.h"
+#include "functionobject.h"
+#include "opcode.h"
+#include "service.h"
+#include "value.h"
+#include "vector.h"
+#include "vm.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef JIT_SUPPORTED
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define STENCIL_HOLES_MAX 8
+#define STENCIL(code, ...) \
+    {(const uint8_t*)(code), sizeof(code) - 1, {__VA_ARGS__}}
+
+// Registers used by the stencils: r14 holds the VM, rbx the frame pointer,
+// r15 the operand stack pointer and r13 the int tag. Values are eight bytes
+// wide and ints live in their low four bytes: arithmetic works on the low
+// half and ors the tag back in before storing the whole value. int64 and
+// double use all eight bytes as they are; from canonical operands SSE only
+// produces the canonical NaN or its negation, and neither looks like a tag.
+
+typedef enum HoleKind
+{
+    HOLE_NONE,
+    HOLE_PARAMS,        // imm32: parameter count
+    HOLE_LOCALS,        // disp32: size of the locals
+    HOLE_ARGUMENT,      // imm64: helper argument
+    HOLE_HELPER,        // imm64: helper address
+    HOLE_NATIVE,        // disp32: offset of the native entry in a function
+    HOLE_FRAME,         // disp32: stack a callee may use
+    HOLE_STACK_END,     // disp32: offset of the end of the stack in the VM
+    HOLE_RESULT,        // disp32: stack adjustment after a call
+    HOLE_ARGUMENTS,     // disp32: offset of the first argument of a service
+    HOLE_SERVICE,       // imm64: address of a service
+    HOLE_CONSTANT,      // imm64: constant value
+    HOLE_GLOBALS,       // disp32: offset of the globals in the VM
+    HOLE_GLOBAL,        // disp32: offset of a global
+    HOLE_LOCAL_A,       // disp32: offset of the first local operand
+    HOLE_LOCAL_B,       // disp32: offset of the second local operand
+    HOLE_IMMEDIATE,     // imm32: immediate operand
+    HOLE_INT_TAG,       // imm64: tag of an int value
+    HOLE_TARGET,        // rel32: branch target
+    HOLE_DEOPT,         // disp32: offset of the deoptimization state in the VM
+    HOLE_RESUME,        // imm64: bytecode address the interpreter resumes at
+    HOLE_RESUME_CALL    // imm64: address of resumeCall
+} HoleKind;
+
+typedef struct Hole
+{
+    uint8_t offset;
+    uint8_t kind;
+} Hole;
+
+typedef struct Stencil
+{
+    const uint8_t* code;
+    uint8_t size;
+    Hole holes[STENCIL_HOLES_MAX];
+} Stencil;
+
+typedef struct Emitter
+{
+    VM* vm;
+    FunctionObject* function;
+    uint8_t* start;
+    size_t* offsets;
+} Emitter;
+
+// Builds the frame: the three link slots the interpreter would push, the
+// frame pointer above them and the operand stack above the locals.
+static const Stencil prologue =
+    // push rbp; mov rbp, rsp; push rbx; push r13; push r14; push r15; mov r13, H0;
+    // mov r14, rdi; lea rbx, [rsi + 24]; lea rax, [r13 + H1]; mov [rsi], rax;
+    // mov qword [rsi + 8], 0; mov qword [rsi + 16], 0; lea r15, [rbx + H2]
+    STENCIL(
+        "\x55\x48\x89\xe5\x53\x41\x55\x41\x56\x41\x57\x49\xbd\x00\x00\x00"
+        "\x00\x00\x00\x00\x00\x49\x89\xfe\x48\x8d\x5e\x18\x49\x8d\x85\x00"
+        "\x00\x00\x00\x48\x89\x06\x48\xc7\x46\x08\x00\x00\x00\x00\x48\xc7"
+        "\x46\x10\x00\x00\x00\x00\x4c\x8d\xbb\x00\x00\x00\x00", {13, HOLE_INT_TAG}, {31, HOLE_PARAMS}, {57, HOLE_LOCALS});
+
+// Machine code for each stack opcode, assembled once from the listing in
+// the comment above it; make stencils checks that the two agree. Holes
+// are left zeroed and patched when a stencil is copied.
+static const Stencil stencils[] = {
+    // mov rdi, r14; lea rsi, [r15 + H0]; mov rax, H1; call rax; lea r15, [r15 + H2]
+    [OP_REQS] = STENCIL(
+        "\x4c\x89\xf7\x49\x8d\xb7\x00\x00\x00\x00\x48\xb8\x00\x00\x00\x00"
+        "\x00\x00\x00\x00\xff\xd0\x4d\x8d\xbf\x00\x00\x00\x00", {6, HOLE_ARGUMENTS}, {12, HOLE_SERVICE}, {25, HOLE_RESULT}),
+    // mov rax, H0; mov [r15], rax; add r15, 8
+    [OP_LDC] = STENCIL(
+        "\x48\xb8\x00\x00\x00\x00\x00\x00\x00\x00\x49\x89\x07\x49\x83\xc7"
+        "\x08", {2, HOLE_CONSTANT}),
+    // mov rdi, r14; mov rsi, r15; mov rdx, H0; mov rax, H1; call rax; mov r15, rax
+    [OP_REG] = STENCIL(
+        "\x4c\x89\xf7\x4c\x89\xfe\x48\xba\x00\x00\x00\x00\x00\x00\x00\x00"
+        "\x48\xb8\x00\x00\x00\x00\x00\x00\x00\x00\xff\xd0\x49\x89\xc7", {8, HOLE_ARGUMENT}, {18, HOLE_HELPER}),
+    // mov rax, [r14 + H0]; mov rax, [rax + H1]; mov [r15], rax; add r15, 8
+    [OP_LDG] = STENCIL(
+        "\x49\x8b\x86\x00\x00\x00\x00\x48\x8b\x80\x00\x00\x00\x00\x49\x89"
+        "\x07\x49\x83\xc7\x08", {3, HOLE_GLOBALS}, {10, HOLE_GLOBAL}),
+    // sub r15, 8; mov rcx, [r14 + H0]; mov rax, [r15]; mov [rcx + H1], rax
+    [OP_STG] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x8e\x00\x00\x00\x00\x49\x8b\x07\x48\x89"
+        "\x81\x00\x00\x00\x00", {7, HOLE_GLOBALS}, {17, HOLE_GLOBAL}),
+    // Native code only runs without workers, so nothing else can take the
+    // globals.
+    // mov rcx, [r14 + H0]; mov rax, [rcx + H1]; mov rdx, [r15 - 8]; mov [r15 - 8], rax;
+    // mov [r15], rdx; add r15, 8
+    [OP_LKG] = STENCIL(
+        "\x49\x8b\x8e\x00\x00\x00\x00\x48\x8b\x81\x00\x00\x00\x00\x49\x8b"
+        "\x57\xf8\x49\x89\x47\xf8\x49\x89\x17\x49\x83\xc7\x08", {3, HOLE_GLOBALS}, {10, HOLE_GLOBAL}),
+    // sub r15, 8; mov rcx, [r14 + H0]; mov rax, [r15]; mov [rcx + H1], rax
+    [OP_ULG] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x8e\x00\x00\x00\x00\x49\x8b\x07\x48\x89"
+        "\x81\x00\x00\x00\x00", {7, HOLE_GLOBALS}, {17, HOLE_GLOBAL}),
+    // mov rax, [rbx + H0]; mov [r15], rax; add r15, 8
+    [OP_LDL] = STENCIL("\x48\x8b\x83\x00\x00\x00\x00\x49\x89\x07\x49\x83\xc7\x08", {3, HOLE_LOCAL_A}),
+    // mov rax, [rbx + 0]; mov [r15], rax; add r15, 8
+    [OP_LDL_0] = STENCIL("\x48\x8b\x03\x49\x89\x07\x49\x83\xc7\x08"),
+    // mov rax, [rbx + 8]; mov [r15], rax; add r15, 8
+    [OP_LDL_1] = STENCIL("\x48\x8b\x43\x08\x49\x89\x07\x49\x83\xc7\x08"),
+    // mov rax, [rbx + 16]; mov [r15], rax; add r15, 8
+    [OP_LDL_2] = STENCIL("\x48\x8b\x43\x10\x49\x89\x07\x49\x83\xc7\x08"),
+    // mov rax, [rbx + 24]; mov [r15], rax; add r15, 8
+    [OP_LDL_3] = STENCIL("\x48\x8b\x43\x18\x49\x89\x07\x49\x83\xc7\x08"),
+    // sub r15, 8; mov rax, [r15]; mov [rbx + H0], rax
+    [OP_STL] = STENCIL("\x49\x83\xef\x08\x49\x8b\x07\x48\x89\x83\x00\x00\x00\x00", {10, HOLE_LOCAL_A}),
+    // sub r15, 8; mov rax, [r15]; mov [rbx + 0], rax
+    [OP_STL_0] = STENCIL("\x49\x83\xef\x08\x49\x8b\x07\x48\x89\x03"),
+    // sub r15, 8; mov rax, [r15]; mov [rbx + 8], rax
+    [OP_STL_1] = STENCIL("\x49\x83\xef\x08\x49\x8b\x07\x48\x89\x43\x08"),
+    // sub r15, 8; mov rax, [r15]; mov [rbx + 16], rax
+    [OP_STL_2] = STENCIL("\x49\x83\xef\x08\x49\x8b\x07\x48\x89\x43\x10"),
+    // sub r15, 8; mov rax, [r15]; mov [rbx + 24], rax
+    [OP_STL_3] = STENCIL("\x49\x83\xef\x08\x49\x8b\x07\x48\x89\x43\x18"),
+    // mov eax, H0; or rax, r13; mov [r15], rax; add r15, 8
+    [OP_PUSHB] = STENCIL("\xb8\x00\x00\x00\x00\x4c\x09\xe8\x49\x89\x07\x49\x83\xc7\x08", {1, HOLE_IMMEDIATE}),
+    // mov eax, H0; or rax, r13; mov [r15], rax; add r15, 8
+    [OP_PUSHH] = STENCIL("\xb8\x00\x00\x00\x00\x4c\x09\xe8\x49\x89\x07\x49\x83\xc7\x08", {1, HOLE_IMMEDIATE}),
+    // lea rax, [r13 + 0]; mov [r15], rax; add r15, 8
+    [OP_PUSH_0] = STENCIL("\x49\x8d\x45\x00\x49\x89\x07\x49\x83\xc7\x08"),
+    // lea rax, [r13 + 1]; mov [r15], rax; add r15, 8
+    [OP_PUSH_1] = STENCIL("\x49\x8d\x45\x01\x49\x89\x07\x49\x83\xc7\x08"),
+    // lea rax, [r13 + 2]; mov [r15], rax; add r15, 8
+    [OP_PUSH_2] = STENCIL("\x49\x8d\x45\x02\x49\x89\x07\x49\x83\xc7\x08"),
+    // lea rax, [r13 + 3]; mov [r15], rax; add r15, 8
+    [OP_PUSH_3] = STENCIL("\x49\x8d\x45\x03\x49\x89\x07\x49\x83\xc7\x08"),
+    // sub r15, 8
+    [OP_POP] = STENCIL("\x49\x83\xef\x08"),
+    // mov rax, [r15 - 8]; mov [r15], rax; add r15, 8
+    [OP_DUP] = STENCIL("\x49\x8b\x47\xf8\x49\x89\x07\x49\x83\xc7\x08"),
+    // mov eax, [r15 - 8]; add eax, 1; or rax, r13; mov [r15 - 8], rax
+    [OP_INC] = STENCIL("\x41\x8b\x47\xf8\x83\xc0\x01\x4c\x09\xe8\x49\x89\x47\xf8"),
+    // mov eax, [r15 - 8]; sub eax, 1; or rax, r13; mov [r15 - 8], rax
+    [OP_DEC] = STENCIL("\x41\x8b\x47\xf8\x83\xe8\x01\x4c\x09\xe8\x49\x89\x47\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; add eax, [r15]; or rax, r13;
+    // mov [r15 - 8], rax
+    [OP_ADD] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x41\x03\x07\x4c\x09\xe8\x49\x89"
+        "\x47\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; sub eax, [r15]; or rax, r13;
+    // mov [r15 - 8], rax
+    [OP_SUB] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x41\x2b\x07\x4c\x09\xe8\x49\x89"
+        "\x47\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; imul eax, [r15]; or rax, r13;
+    // mov [r15 - 8], rax
+    [OP_MUL] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x41\x0f\xaf\x07\x4c\x09\xe8\x49"
+        "\x89\x47\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; cdq; idiv dword [r15]; or rax, r13;
+    // mov [r15 - 8], rax
+    [OP_DIV] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x99\x41\xf7\x3f\x4c\x09\xe8\x49"
+        "\x89\x47\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; cdq; idiv dword [r15]; or rdx, r13;
+    // mov [r15 - 8], rdx
+    [OP_REM] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x99\x41\xf7\x3f\x4c\x09\xea\x49"
+        "\x89\x57\xf8"),
+    // mov rdi, r14; mov rsi, r15; mov rdx, H0; mov rax, H1; call rax; mov r15, rax
+    [OP_POW] = STENCIL(
+        "\x4c\x89\xf7\x4c\x89\xfe\x48\xba\x00\x00\x00\x00\x00\x00\x00\x00"
+        "\x48\xb8\x00\x00\x00\x00\x00\x00\x00\x00\xff\xd0\x49\x89\xc7", {8, HOLE_ARGUMENT}, {18, HOLE_HELPER}),
+    // sub r15, 8; mov eax, [r15 - 8]; and eax, [r15]; or rax, r13;
+    // mov [r15 - 8], rax
+    [OP_BAND] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x41\x23\x07\x4c\x09\xe8\x49\x89"
+        "\x47\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; or eax, [r15]; or rax, r13; mov [r15 - 8], rax
+    [OP_BOR] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x41\x0b\x07\x4c\x09\xe8\x49\x89"
+        "\x47\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; xor eax, [r15]; or rax, r13;
+    // mov [r15 - 8], rax
+    [OP_BXOR] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x41\x33\x07\x4c\x09\xe8\x49\x89"
+        "\x47\xf8"),
+    // mov eax, [r15 - 8]; not eax; or rax, r13; mov [r15 - 8], rax
+    [OP_BNOT] = STENCIL("\x41\x8b\x47\xf8\xf7\xd0\x4c\x09\xe8\x49\x89\x47\xf8"),
+    // sub r15, 8; mov ecx, [r15]; mov eax, [r15 - 8]; shl eax, cl; or rax, r13;
+    // mov [r15 - 8], rax
+    [OP_LSL] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x0f\x41\x8b\x47\xf8\xd3\xe0\x4c\x09\xe8"
+        "\x49\x89\x47\xf8"),
+    // sub r15, 8; mov ecx, [r15]; mov eax, [r15 - 8]; sar eax, cl; or rax, r13;
+    // mov [r15 - 8], rax
+    [OP_LSR] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x0f\x41\x8b\x47\xf8\xd3\xf8\x4c\x09\xe8"
+        "\x49\x89\x47\xf8"),
+    // sub r15, 8; mov ecx, [r15]; mov eax, [r15 - 8]; sar eax, cl; or rax, r13;
+    // mov [r15 - 8], rax
+    [OP_ASR] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x0f\x41\x8b\x47\xf8\xd3\xf8\x4c\x09\xe8"
+        "\x49\x89\x47\xf8"),
+    // xor eax, eax; cmp dword [r15 - 8], 0; sete al; or rax, r13; mov [r15 - 8], rax
+    [OP_NOT] = STENCIL(
+        "\x31\xc0\x41\x83\x7f\xf8\x00\x0f\x94\xc0\x4c\x09\xe8\x49\x89\x47"
+        "\xf8"),
+    // mov eax, [r15 - 8]; neg eax; or rax, r13; mov [r15 - 8], rax
+    [OP_NEG] = STENCIL("\x41\x8b\x47\xf8\xf7\xd8\x4c\x09\xe8\x49\x89\x47\xf8"),
+    // mov eax, [r15 - 16]; cmp eax, [r15 - 8]; .byte 0x0f, 0x84; .long H0
+    [OP_BEQ] = STENCIL("\x41\x8b\x47\xf0\x41\x3b\x47\xf8\x0f\x84\x00\x00\x00\x00", {10, HOLE_TARGET}),
+    // mov eax, [r15 - 16]; cmp eax, [r15 - 8]; .byte 0x0f, 0x8c; .long H0
+    [OP_BLT] = STENCIL("\x41\x8b\x47\xf0\x41\x3b\x47\xf8\x0f\x8c\x00\x00\x00\x00", {10, HOLE_TARGET}),
+    // mov eax, [r15 - 16]; cmp eax, [r15 - 8]; .byte 0x0f, 0x8e; .long H0
+    [OP_BLE] = STENCIL("\x41\x8b\x47\xf0\x41\x3b\x47\xf8\x0f\x8e\x00\x00\x00\x00", {10, HOLE_TARGET}),
+    // .byte 0xe9; .long H0
+    [OP_JMP] = STENCIL("\xe9\x00\x00\x00\x00", {1, HOLE_TARGET}),
+    // mov rax, H0; mov rcx, [rax + H1]; test rcx, rcx; jz 1f;
+    // lea rdx, [r15 + H2]; lea rsi, [r14 + H3]; cmp rdx, rsi; ja 1f;
+    // mov rdi, r14; mov rsi, r15; call rcx; cmp qword [r14 + H4], 0; jne 3f;
+    // lea r15, [r15 + H5]; mov [r15 - 8], rax; jmp 2f;
+    // 3: mov rdi, r14; mov rsi, r15; mov rax, H6; call rax; mov r15, rax; jmp 2f;
+    // 1: mov rdi, r14; mov rsi, r15; mov rdx, rax; mov rax, H7; call rax; mov r15, rax; 2:
+    [OP_CALL] = STENCIL(
+        "\x48\xb8\x00\x00\x00\x00\x00\x00\x00\x00\x48\x8b\x88\x00\x00\x00"
+        "\x00\x48\x85\xc9\x74\x49\x49\x8d\x97\x00\x00\x00\x00\x49\x8d\xb6"
+        "\x00\x00\x00\x00\x48\x39\xf2\x77\x36\x4c\x89\xf7\x4c\x89\xfe\xff"
+        "\xd1\x49\x83\xbe\x00\x00\x00\x00\x00\x75\x0d\x4d\x8d\xbf\x00\x00"
+        "\x00\x00\x49\x89\x47\xf8\xeb\x2f\x4c\x89\xf7\x4c\x89\xfe\x48\xb8"
+        "\x00\x00\x00\x00\x00\x00\x00\x00\xff\xd0\x49\x89\xc7\xeb\x18\x4c"
+        "\x89\xf7\x4c\x89\xfe\x48\x89\xc2\x48\xb8\x00\x00\x00\x00\x00\x00"
+        "\x00\x00\xff\xd0\x49\x89\xc7",
+        {2, HOLE_ARGUMENT}, {13, HOLE_NATIVE}, {25, HOLE_FRAME}, {32, HOLE_STACK_END},
+        {52, HOLE_DEOPT}, {62, HOLE_RESULT}, {80, HOLE_RESUME_CALL}, {106, HOLE_HELPER}),
+    // mov rax, r13; pop r15; pop r14; pop r13; pop rbx; pop rbp; ret
+    [OP_RET] = STENCIL("\x4c\x89\xe8\x41\x5f\x41\x5e\x41\x5d\x5b\x5d\xc3"),
+    // mov rax, [r15 - 8]; pop r15; pop r14; pop r13; pop rbx; pop rbp; ret
+    [OP_RETV] = STENCIL("\x49\x8b\x47\xf8\x41\x5f\x41\x5e\x41\x5d\x5b\x5d\xc3"),
+    // mov eax, [r15 - 8]; add eax, H0; or rax, r13; mov [r15 - 8], rax
+    [OP_ADDI] = STENCIL("\x41\x8b\x47\xf8\x05\x00\x00\x00\x00\x4c\x09\xe8\x49\x89\x47\xf8", {5, HOLE_IMMEDIATE}),
+    // mov eax, [r15 - 8]; sub eax, H0; or rax, r13; mov [r15 - 8], rax
+    [OP_SUBI] = STENCIL("\x41\x8b\x47\xf8\x2d\x00\x00\x00\x00\x4c\x09\xe8\x49\x89\x47\xf8", {5, HOLE_IMMEDIATE}),
+    // imul eax, [r15 - 8], H0; or rax, r13; mov [r15 - 8], rax
+    [OP_MULI] = STENCIL("\x41\x69\x47\xf8\x00\x00\x00\x00\x4c\x09\xe8\x49\x89\x47\xf8", {4, HOLE_IMMEDIATE}),
+    // mov eax, [r15 - 8]; mov ecx, H0; cdq; idiv ecx; or rax, r13;
+    // mov [r15 - 8], rax
+    [OP_DIVI] = STENCIL(
+        "\x41\x8b\x47\xf8\xb9\x00\x00\x00\x00\x99\xf7\xf9\x4c\x09\xe8\x49"
+        "\x89\x47\xf8", {5, HOLE_IMMEDIATE}),
+    // mov eax, [r15 - 8]; mov ecx, H0; cdq; idiv ecx; or rdx, r13;
+    // mov [r15 - 8], rdx
+    [OP_REMI] = STENCIL(
+        "\x41\x8b\x47\xf8\xb9\x00\x00\x00\x00\x99\xf7\xf9\x4c\x09\xea\x49"
+        "\x89\x57\xf8", {5, HOLE_IMMEDIATE}),
+    // mov eax, [r15 - 8]; add eax, [rbx + H0]; or rax, r13; mov [r15 - 8], rax
+    [OP_LDL_ADD] = STENCIL(
+        "\x41\x8b\x47\xf8\x03\x83\x00\x00\x00\x00\x4c\x09\xe8\x49\x89\x47"
+        "\xf8", {6, HOLE_LOCAL_A}),
+    // mov eax, [r15 - 8]; sub eax, [rbx + H0]; or rax, r13; mov [r15 - 8], rax
+    [OP_LDL_SUB] = STENCIL(
+        "\x41\x8b\x47\xf8\x2b\x83\x00\x00\x00\x00\x4c\x09\xe8\x49\x89\x47"
+        "\xf8", {6, HOLE_LOCAL_A}),
+    // mov eax, [r15 - 8]; imul eax, [rbx + H0]; or rax, r13; mov [r15 - 8], rax
+    [OP_LDL_MUL] = STENCIL(
+        "\x41\x8b\x47\xf8\x0f\xaf\x83\x00\x00\x00\x00\x4c\x09\xe8\x49\x89"
+        "\x47\xf8", {7, HOLE_LOCAL_A}),
+    // mov eax, [rbx + H0]; add eax, [rbx + H1]; or rax, r13; mov [r15], rax;
+    // add r15, 8
+    [OP_LDL_LDL_ADD] = STENCIL(
+        "\x8b\x83\x00\x00\x00\x00\x03\x83\x00\x00\x00\x00\x4c\x09\xe8\x49"
+        "\x89\x07\x49\x83\xc7\x08", {2, HOLE_LOCAL_A}, {8, HOLE_LOCAL_B}),
+    // mov eax, [rbx + H0]; sub eax, [rbx + H1]; or rax, r13; mov [r15], rax;
+    // add r15, 8
+    [OP_LDL_LDL_SUB] = STENCIL(
+        "\x8b\x83\x00\x00\x00\x00\x2b\x83\x00\x00\x00\x00\x4c\x09\xe8\x49"
+        "\x89\x07\x49\x83\xc7\x08", {2, HOLE_LOCAL_A}, {8, HOLE_LOCAL_B}),
+    // mov eax, [rbx + H0]; imul eax, [rbx + H1]; or rax, r13; mov [r15], rax;
+    // add r15, 8
+    [OP_LDL_LDL_MUL] = STENCIL(
+        "\x8b\x83\x00\x00\x00\x00\x0f\xaf\x83\x00\x00\x00\x00\x4c\x09\xe8"
+        "\x49\x89\x07\x49\x83\xc7\x08", {2, HOLE_LOCAL_A}, {9, HOLE_LOCAL_B}),
+    // sub r15, 8; mov eax, [r15 - 8]; xor ecx, ecx; cmp eax, [r15]; sete cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_EQ] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x31\xc9\x41\x3b\x07\x0f\x94\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; xor ecx, ecx; cmp eax, [r15]; setne cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_NE] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x31\xc9\x41\x3b\x07\x0f\x95\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; xor ecx, ecx; cmp eax, [r15]; setl cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_LT] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x31\xc9\x41\x3b\x07\x0f\x9c\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; xor ecx, ecx; cmp eax, [r15]; setle cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_LE] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x31\xc9\x41\x3b\x07\x0f\x9e\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; xor ecx, ecx; cmp eax, [r15]; setg cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_GT] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x31\xc9\x41\x3b\x07\x0f\x9f\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; xor ecx, ecx; cmp eax, [r15]; setge cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_GE] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x31\xc9\x41\x3b\x07\x0f\x9d\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; cmp dword [r15], 0; .byte 0x0f, 0x84; .long H0
+    [OP_JZ] = STENCIL("\x49\x83\xef\x08\x41\x83\x3f\x00\x0f\x84\x00\x00\x00\x00", {10, HOLE_TARGET}),
+    // .byte 0xe9; .long H0
+    [OP_LOOP] = STENCIL("\xe9\x00\x00\x00\x00", {1, HOLE_TARGET}),
+    // mov rdi, r14; mov rsi, r15; mov rdx, H0; mov rax, H1; call rax; mov r15, rax
+    [OP_CONV] = STENCIL(
+        "\x4c\x89\xf7\x4c\x89\xfe\x48\xba\x00\x00\x00\x00\x00\x00\x00\x00"
+        "\x48\xb8\x00\x00\x00\x00\x00\x00\x00\x00\xff\xd0\x49\x89\xc7", {8, HOLE_ARGUMENT}, {18, HOLE_HELPER}),
+    // sub r15, 8; mov rax, [r15 - 8]; add rax, [r15]; mov [r15 - 8], rax
+    [OP_ADD_I64] = STENCIL("\x49\x83\xef\x08\x49\x8b\x47\xf8\x49\x03\x07\x49\x89\x47\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; sub rax, [r15]; mov [r15 - 8], rax
+    [OP_SUB_I64] = STENCIL("\x49\x83\xef\x08\x49\x8b\x47\xf8\x49\x2b\x07\x49\x89\x47\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; imul rax, [r15]; mov [r15 - 8], rax
+    [OP_MUL_I64] = STENCIL("\x49\x83\xef\x08\x49\x8b\x47\xf8\x49\x0f\xaf\x07\x49\x89\x47\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; cqo; idiv qword [r15]; mov [r15 - 8], rax
+    [OP_DIV_I64] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x47\xf8\x48\x99\x49\xf7\x3f\x49\x89\x47"
+        "\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; cqo; idiv qword [r15]; mov [r15 - 8], rdx
+    [OP_REM_I64] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x47\xf8\x48\x99\x49\xf7\x3f\x49\x89\x57"
+        "\xf8"),
+    // neg qword [r15 - 8]
+    [OP_NEG_I64] = STENCIL("\x49\xf7\x5f\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; and rax, [r15]; mov [r15 - 8], rax
+    [OP_BAND_I64] = STENCIL("\x49\x83\xef\x08\x49\x8b\x47\xf8\x49\x23\x07\x49\x89\x47\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; or rax, [r15]; mov [r15 - 8], rax
+    [OP_BOR_I64] = STENCIL("\x49\x83\xef\x08\x49\x8b\x47\xf8\x49\x0b\x07\x49\x89\x47\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; xor rax, [r15]; mov [r15 - 8], rax
+    [OP_BXOR_I64] = STENCIL("\x49\x83\xef\x08\x49\x8b\x47\xf8\x49\x33\x07\x49\x89\x47\xf8"),
+    // not qword [r15 - 8]
+    [OP_BNOT_I64] = STENCIL("\x49\xf7\x57\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; mov rcx, [r15]; shl rax, cl;
+    // mov [r15 - 8], rax
+    [OP_LSL_I64] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x47\xf8\x49\x8b\x0f\x48\xd3\xe0\x49\x89"
+        "\x47\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; mov rcx, [r15]; sar rax, cl;
+    // mov [r15 - 8], rax
+    [OP_LSR_I64] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x47\xf8\x49\x8b\x0f\x48\xd3\xf8\x49\x89"
+        "\x47\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; xor ecx, ecx; cmp rax, [r15]; sete cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_EQ_I64] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x47\xf8\x31\xc9\x49\x3b\x07\x0f\x94\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; xor ecx, ecx; cmp rax, [r15]; setne cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_NE_I64] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x47\xf8\x31\xc9\x49\x3b\x07\x0f\x95\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; xor ecx, ecx; cmp rax, [r15]; setl cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_LT_I64] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x47\xf8\x31\xc9\x49\x3b\x07\x0f\x9c\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; xor ecx, ecx; cmp rax, [r15]; setle cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_LE_I64] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x47\xf8\x31\xc9\x49\x3b\x07\x0f\x9e\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; xor ecx, ecx; cmp rax, [r15]; setg cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_GT_I64] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x47\xf8\x31\xc9\x49\x3b\x07\x0f\x9f\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; xor ecx, ecx; cmp rax, [r15]; setge cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_GE_I64] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x47\xf8\x31\xc9\x49\x3b\x07\x0f\x9d\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; xor edx, edx; div qword [r15];
+    // mov [r15 - 8], rax
+    [OP_DIV_U64] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x47\xf8\x31\xd2\x49\xf7\x37\x49\x89\x47"
+        "\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; xor edx, edx; div qword [r15];
+    // mov [r15 - 8], rdx
+    [OP_REM_U64] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x47\xf8\x31\xd2\x49\xf7\x37\x49\x89\x57"
+        "\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; mov rcx, [r15]; shr rax, cl;
+    // mov [r15 - 8], rax
+    [OP_LSR_U64] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x47\xf8\x49\x8b\x0f\x48\xd3\xe8\x49\x89"
+        "\x47\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; xor ecx, ecx; cmp rax, [r15]; setb cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_LT_U64] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x47\xf8\x31\xc9\x49\x3b\x07\x0f\x92\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; xor ecx, ecx; cmp rax, [r15]; setbe cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_LE_U64] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x47\xf8\x31\xc9\x49\x3b\x07\x0f\x96\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; xor ecx, ecx; cmp rax, [r15]; seta cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_GT_U64] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x47\xf8\x31\xc9\x49\x3b\x07\x0f\x97\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; mov rax, [r15 - 8]; xor ecx, ecx; cmp rax, [r15]; setae cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_GE_U64] = STENCIL(
+        "\x49\x83\xef\x08\x49\x8b\x47\xf8\x31\xc9\x49\x3b\x07\x0f\x93\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; xor edx, edx; div dword [r15]; or rax, r13;
+    // mov [r15 - 8], rax
+    [OP_DIV_U32] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x31\xd2\x41\xf7\x37\x4c\x09\xe8"
+        "\x49\x89\x47\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; xor edx, edx; div dword [r15]; or rdx, r13;
+    // mov [r15 - 8], rdx
+    [OP_REM_U32] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x31\xd2\x41\xf7\x37\x4c\x09\xea"
+        "\x49\x89\x57\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; mov ecx, [r15]; shr eax, cl; or rax, r13;
+    // mov [r15 - 8], rax
+    [OP_LSR_U32] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x41\x8b\x0f\xd3\xe8\x4c\x09\xe8"
+        "\x49\x89\x47\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; xor ecx, ecx; cmp eax, [r15]; setb cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_LT_U32] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x31\xc9\x41\x3b\x07\x0f\x92\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; xor ecx, ecx; cmp eax, [r15]; setbe cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_LE_U32] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x31\xc9\x41\x3b\x07\x0f\x96\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; xor ecx, ecx; cmp eax, [r15]; seta cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_GT_U32] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x31\xc9\x41\x3b\x07\x0f\x97\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; xor ecx, ecx; cmp eax, [r15]; setae cl;
+    // or rcx, r13; mov [r15 - 8], rcx
+    [OP_GE_U32] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x31\xc9\x41\x3b\x07\x0f\x93\xc1"
+        "\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; cvtsd2ss xmm0, qword [r15 - 8]; cvtsd2ss xmm1, qword [r15];
+    // addss xmm0, xmm1; cvtss2sd xmm0, xmm0; movsd qword [r15 - 8], xmm0
+    [OP_ADD_F32] = STENCIL(
+        "\x49\x83\xef\x08\xf2\x41\x0f\x5a\x47\xf8\xf2\x41\x0f\x5a\x0f\xf3"
+        "\x0f\x58\xc1\xf3\x0f\x5a\xc0\xf2\x41\x0f\x11\x47\xf8"),
+    // sub r15, 8; cvtsd2ss xmm0, qword [r15 - 8]; cvtsd2ss xmm1, qword [r15];
+    // subss xmm0, xmm1; cvtss2sd xmm0, xmm0; movsd qword [r15 - 8], xmm0
+    [OP_SUB_F32] = STENCIL(
+        "\x49\x83\xef\x08\xf2\x41\x0f\x5a\x47\xf8\xf2\x41\x0f\x5a\x0f\xf3"
+        "\x0f\x5c\xc1\xf3\x0f\x5a\xc0\xf2\x41\x0f\x11\x47\xf8"),
+    // sub r15, 8; cvtsd2ss xmm0, qword [r15 - 8]; cvtsd2ss xmm1, qword [r15];
+    // mulss xmm0, xmm1; cvtss2sd xmm0, xmm0; movsd qword [r15 - 8], xmm0
+    [OP_MUL_F32] = STENCIL(
+        "\x49\x83\xef\x08\xf2\x41\x0f\x5a\x47\xf8\xf2\x41\x0f\x5a\x0f\xf3"
+        "\x0f\x59\xc1\xf3\x0f\x5a\xc0\xf2\x41\x0f\x11\x47\xf8"),
+    // sub r15, 8; cvtsd2ss xmm0, qword [r15 - 8]; cvtsd2ss xmm1, qword [r15];
+    // divss xmm0, xmm1; cvtss2sd xmm0, xmm0; movsd qword [r15 - 8], xmm0
+    [OP_DIV_F32] = STENCIL(
+        "\x49\x83\xef\x08\xf2\x41\x0f\x5a\x47\xf8\xf2\x41\x0f\x5a\x0f\xf3"
+        "\x0f\x5e\xc1\xf3\x0f\x5a\xc0\xf2\x41\x0f\x11\x47\xf8"),
+    // sub r15, 8; movsd xmm0, qword [r15 - 8]; addsd xmm0, qword [r15];
+    // movsd qword [r15 - 8], xmm0
+    [OP_ADD_F64] = STENCIL(
+        "\x49\x83\xef\x08\xf2\x41\x0f\x10\x47\xf8\xf2\x41\x0f\x58\x07\xf2"
+        "\x41\x0f\x11\x47\xf8"),
+    // sub r15, 8; movsd xmm0, qword [r15 - 8]; subsd xmm0, qword [r15];
+    // movsd qword [r15 - 8], xmm0
+    [OP_SUB_F64] = STENCIL(
+        "\x49\x83\xef\x08\xf2\x41\x0f\x10\x47\xf8\xf2\x41\x0f\x5c\x07\xf2"
+        "\x41\x0f\x11\x47\xf8"),
+    // sub r15, 8; movsd xmm0, qword [r15 - 8]; mulsd xmm0, qword [r15];
+    // movsd qword [r15 - 8], xmm0
+    [OP_MUL_F64] = STENCIL(
+        "\x49\x83\xef\x08\xf2\x41\x0f\x10\x47\xf8\xf2\x41\x0f\x59\x07\xf2"
+        "\x41\x0f\x11\x47\xf8"),
+    // sub r15, 8; movsd xmm0, qword [r15 - 8]; divsd xmm0, qword [r15];
+    // movsd qword [r15 - 8], xmm0
+    [OP_DIV_F64] = STENCIL(
+        "\x49\x83\xef\x08\xf2\x41\x0f\x10\x47\xf8\xf2\x41\x0f\x5e\x07\xf2"
+        "\x41\x0f\x11\x47\xf8"),
+    // btc qword [r15 - 8], 63
+    [OP_NEG_F64] = STENCIL("\x49\x0f\xba\x7f\xf8\x3f"),
+    // sub r15, 8; movsd xmm0, qword [r15 - 8]; xor ecx, ecx; xor edx, edx;
+    // ucomisd xmm0, qword [r15]; sete cl; setnp dl; and ecx, edx; or rcx, r13;
+    // mov [r15 - 8], rcx
+    [OP_EQ_F64] = STENCIL(
+        "\x49\x83\xef\x08\xf2\x41\x0f\x10\x47\xf8\x31\xc9\x31\xd2\x66\x41"
+        "\x0f\x2e\x07\x0f\x94\xc1\x0f\x9b\xc2\x21\xd1\x4c\x09\xe9\x49\x89"
+        "\x4f\xf8"),
+    // sub r15, 8; movsd xmm0, qword [r15 - 8]; xor ecx, ecx; xor edx, edx;
+    // ucomisd xmm0, qword [r15]; setne cl; setp dl; or ecx, edx; or rcx, r13;
+    // mov [r15 - 8], rcx
+    [OP_NE_F64] = STENCIL(
+        "\x49\x83\xef\x08\xf2\x41\x0f\x10\x47\xf8\x31\xc9\x31\xd2\x66\x41"
+        "\x0f\x2e\x07\x0f\x95\xc1\x0f\x9a\xc2\x09\xd1\x4c\x09\xe9\x49\x89"
+        "\x4f\xf8"),
+    // sub r15, 8; movsd xmm0, qword [r15]; xor ecx, ecx;
+    // ucomisd xmm0, qword [r15 - 8]; seta cl; or rcx, r13; mov [r15 - 8], rcx
+    [OP_LT_F64] = STENCIL(
+        "\x49\x83\xef\x08\xf2\x41\x0f\x10\x07\x31\xc9\x66\x41\x0f\x2e\x47"
+        "\xf8\x0f\x97\xc1\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; movsd xmm0, qword [r15]; xor ecx, ecx;
+    // ucomisd xmm0, qword [r15 - 8]; setae cl; or rcx, r13; mov [r15 - 8], rcx
+    [OP_LE_F64] = STENCIL(
+        "\x49\x83\xef\x08\xf2\x41\x0f\x10\x07\x31\xc9\x66\x41\x0f\x2e\x47"
+        "\xf8\x0f\x93\xc1\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; movsd xmm0, qword [r15 - 8]; xor ecx, ecx;
+    // ucomisd xmm0, qword [r15]; seta cl; or rcx, r13; mov [r15 - 8], rcx
+    [OP_GT_F64] = STENCIL(
+        "\x49\x83\xef\x08\xf2\x41\x0f\x10\x47\xf8\x31\xc9\x66\x41\x0f\x2e"
+        "\x07\x0f\x97\xc1\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // sub r15, 8; movsd xmm0, qword [r15 - 8]; xor ecx, ecx;
+    // ucomisd xmm0, qword [r15]; setae cl; or rcx, r13; mov [r15 - 8], rcx
+    [OP_GE_F64] = STENCIL(
+        "\x49\x83\xef\x08\xf2\x41\x0f\x10\x47\xf8\x31\xc9\x66\x41\x0f\x2e"
+        "\x07\x0f\x93\xc1\x4c\x09\xe9\x49\x89\x4f\xf8"),
+    // mov eax, [r15 - 8]; mov ecx, eax; neg ecx; cmovs ecx, eax; or rcx, r13;
+    // mov [r15 - 8], rcx
+    [OP_ABS] = STENCIL(
+        "\x41\x8b\x47\xf8\x89\xc1\xf7\xd9\x0f\x48\xc8\x4c\x09\xe9\x49\x89"
+        "\x4f\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; mov ecx, [r15]; cmp eax, ecx; cmovg eax, ecx;
+    // or rax, r13; mov [r15 - 8], rax
+    [OP_MIN] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x41\x8b\x0f\x39\xc8\x0f\x4f\xc1"
+        "\x4c\x09\xe8\x49\x89\x47\xf8"),
+    // sub r15, 8; mov eax, [r15 - 8]; mov ecx, [r15]; cmp eax, ecx; cmovl eax, ecx;
+    // or rax, r13; mov [r15 - 8], rax
+    [OP_MAX] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x47\xf8\x41\x8b\x0f\x39\xc8\x0f\x4c\xc1"
+        "\x4c\x09\xe8\x49\x89\x47\xf8"),
+    // sub r15, 16; mov eax, [r15 - 8]; mov ecx, [r15 + 8]; cmp eax, ecx;
+    // cmovg eax, ecx; mov ecx, [r15]; cmp [r15 - 8], ecx; cmovl eax, ecx;
+    // or rax, r13; mov [r15 - 8], rax
+    [OP_CLAMP] = STENCIL(
+        "\x49\x83\xef\x10\x41\x8b\x47\xf8\x41\x8b\x4f\x08\x39\xc8\x0f\x4f"
+        "\xc1\x41\x8b\x0f\x41\x39\x4f\xf8\x0f\x4c\xc1\x4c\x09\xe8\x49\x89"
+        "\x47\xf8"),
+    // mov eax, [r15 - 8]; popcnt eax, eax; or rax, r13; mov [r15 - 8], rax
+    [OP_POPCNT] = STENCIL("\x41\x8b\x47\xf8\xf3\x0f\xb8\xc0\x4c\x09\xe8\x49\x89\x47\xf8"),
+    // mov eax, [r15 - 8]; mov ecx, 63; bsr eax, eax; cmovz eax, ecx; xor eax, 31;
+    // or rax, r13; mov [r15 - 8], rax
+    [OP_CLZ] = STENCIL(
+        "\x41\x8b\x47\xf8\xb9\x3f\x00\x00\x00\x0f\xbd\xc0\x0f\x44\xc1\x83"
+        "\xf0\x1f\x4c\x09\xe8\x49\x89\x47\xf8"),
+    // mov eax, [r15 - 8]; mov ecx, 32; bsf eax, eax; cmovz eax, ecx; or rax, r13;
+    // mov [r15 - 8], rax
+    [OP_CTZ] = STENCIL(
+        "\x41\x8b\x47\xf8\xb9\x20\x00\x00\x00\x0f\xbc\xc0\x0f\x44\xc1\x4c"
+        "\x09\xe8\x49\x89\x47\xf8"),
+    // sub r15, 8; mov ecx, [r15]; mov eax, [r15 - 8]; rol eax, cl; or rax, r13;
+    // mov [r15 - 8], rax
+    [OP_ROTL] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x0f\x41\x8b\x47\xf8\xd3\xc0\x4c\x09\xe8"
+        "\x49\x89\x47\xf8"),
+    // sub r15, 8; mov ecx, [r15]; mov eax, [r15 - 8]; ror eax, cl; or rax, r13;
+    // mov [r15 - 8], rax
+    [OP_ROTR] = STENCIL(
+        "\x49\x83\xef\x08\x41\x8b\x0f\x41\x8b\x47\xf8\xd3\xc8\x4c\x09\xe8"
+        "\x49\x89\x47\xf8"),
+    // mov eax, [r15 - 8]; bswap eax; or rax, r13; mov [r15 - 8], rax
+    [OP_BSWAP] = STENCIL("\x41\x8b\x47\xf8\x0f\xc8\x4c\x09\xe8\x49\x89\x47\xf8"),
+    // sub r15, 16; mov eax, [r15]; cmp eax, [r15 + 8]; .byte 0x0f, 0x84; .long H0
+    [OP_JEQ] = STENCIL(
+        "\x49\x83\xef\x10\x41\x8b\x07\x41\x3b\x47\x08\x0f\x84\x00\x00\x00"
+        "\x00", {13, HOLE_TARGET}),
+    // sub r15, 16; mov eax, [r15]; cmp eax, [r15 + 8]; .byte 0x0f, 0x85; .long H0
+    [OP_JNE] = STENCIL(
+        "\x49\x83\xef\x10\x41\x8b\x07\x41\x3b\x47\x08\x0f\x85\x00\x00\x00"
+        "\x00", {13, HOLE_TARGET}),
+    // sub r15, 16; mov eax, [r15]; cmp eax, [r15 + 8]; .byte 0x0f, 0x8c; .long H0
+    [OP_JLT] = STENCIL(
+        "\x49\x83\xef\x10\x41\x8b\x07\x41\x3b\x47\x08\x0f\x8c\x00\x00\x00"
+        "\x00", {13, HOLE_TARGET}),
+    // sub r15, 16; mov eax, [r15]; cmp eax, [r15 + 8]; .byte 0x0f, 0x8e; .long H0
+    [OP_JLE] = STENCIL(
+        "\x49\x83\xef\x10\x41\x8b\x07\x41\x3b\x47\x08\x0f\x8e\x00\x00\x00"
+        "\x00", {13, HOLE_TARGET}),
+    // sub r15, 16; mov eax, [r15]; cmp eax, [r15 + 8]; .byte 0x0f, 0x8f; .long H0
+    [OP_JGT] = STENCIL(
+        "\x49\x83\xef\x10\x41\x8b\x07\x41\x3b\x47\x08\x0f\x8f\x00\x00\x00"
+        "\x00", {13, HOLE_TARGET}),
+    // sub r15, 16; mov eax, [r15]; cmp eax, [r15 + 8]; .byte 0x0f, 0x8d; .long H0
+    [OP_JGE] = STENCIL(
+        "\x49\x83\xef\x10\x41\x8b\x07\x41\x3b\x47\x08\x0f\x8d\x00\x00\x00"
+        "\x00", {13, HOLE_TARGET}),
+    // mov eax, [rbx + H0]; add eax, H1; or rax, r13; mov [rbx + H2], rax
+    [OP_INCL] = STENCIL(
+        "\x8b\x83\x00\x00\x00\x00\x05\x00\x00\x00\x00\x4c\x09\xe8\x48\x89"
+        "\x83\x00\x00\x00\x00", {2, HOLE_LOCAL_A}, {7, HOLE_IMMEDIATE}, {17, HOLE_LOCAL_A}),
+};
+
+// Instructions without a stencil, and loops that belong to the tracer,
+// leave native code: the frame is already the interpreter's, so recording
+// where to resume is enough for the interpreter to take over.
+static const Stencil deopt =
+    // mov rax, H0; lea rcx, [r14 + H1]; mov [rcx], rax; mov [rcx + 8], rbx;
+    // mov [rcx + 16], r15; lea rax, [rbx + H2]; mov [rcx + 24], rax; xor eax, eax;
+    // pop r15; pop r14; pop r13; pop rbx; pop rbp; ret
+    STENCIL(
+        "\x48\xb8\x00\x00\x00\x00\x00\x00\x00\x00\x49\x8d\x8e\x00\x00\x00"
+        "\x00\x48\x89\x01\x48\x89\x59\x08\x4c\x89\x79\x10\x48\x8d\x83\x00"
+        "\x00\x00\x00\x48\x89\x41\x18\x31\xc0\x41\x5f\x41\x5e\x41\x5d\x5b"
+        "\x5d\xc3", {2, HOLE_RESUME}, {13, HOLE_DEOPT}, {31, HOLE_LOCALS});
+
+// Enters native code in the middle of a function whose frame the
+// interpreter built: saves what the prologue saves, takes the frame and
+// stack pointers as they are and jumps to the entry.
+static const Stencil osrPrologue =
+    // push rbp; mov rbp, rsp; push rbx; push r13; push r14; push r15; mov r13, H0;
+    // mov r14, rdi; mov rbx, rsi; mov r15, rdx; jmp rcx
+    STENCIL(
+        "\x55\x48\x89\xe5\x53\x41\x55\x41\x56\x41\x57\x49\xbd\x00\x00\x00"
+        "\x00\x00\x00\x00\x00\x49\x89\xfe\x48\x89\xf3\x49\x89\xd7\xff\xe1", {13, HOLE_INT_TAG});
+
+#define STENCILS_COUNT (sizeof(stencils) / sizeof(stencils[0]))
+#define ALIGN_CODE(size) (((size) + 15) & ~(size_t)15)
+
+Value* jitRegister(VM* vm, Value* sp, intptr_t x)
+{
+    (void)x;
+
+    pushValue(&vm->globals, sp[-1]);
+
+    return sp - 1;
+}
+
+Value* jitConvert(VM* vm, Value* sp, intptr_t x)
+{
+    (void)vm;
+
+    sp[-1] = convertNumber(sp[-1], x >> 4, x & 15);
+
+    return sp;
+}
+
+Value* jitPower(VM* vm, Value* sp, intptr_t x)
+{
+    (void)vm;
+    (void)x;
+
+    int32_t a = AS_INT(sp[-2]);
+    int32_t b = AS_INT(sp[-1]);
+    int32_t n = pow(a, b);
+
+    sp[-2] = INT_VALUE(n);
+
+    return sp - 1;
+}
+
+static void* getHelper(uint8_t opcode)
+{
+    switch (opcode) {
+        case OP_REG:    return jitRegister;
+        case OP_POW:    return jitPower;
+        case OP_CONV:   return jitConvert;
+        case OP_CALL:   return callFunction;
+        default:        return NULL;
+    }
+}
+
+static FunctionObject* getCallee(Emitter* emitter, uint8_t* ip)
+{
+    ValueArray* constants = &emitter->vm->module->constants;
+
+    return AS_POINTER(constants->data[(ip[1] << 8) | ip[2]]);
+}
+
+static uint64_t getArgument(Emitter* emitter, uint8_t* ip)
+{
+    switch (ip[0]) {
+        case OP_CONV:   return ip[1];
+        case OP_CALL:   return (uintptr_t)getCallee(emitter, ip);
+        default:        return 0;
+    }
+}
+
+// How far the stack pointer moves over a call: the arguments are replaced
+// by the results.
+static int32_t getResult(Emitter* emitter, uint8_t* ip)
+{
+    if (ip[0] == OP_REQS) {
+        return (ip[3] & 15) - (ip[3] >> 4);
+    }
+
+    return 1 - getCallee(emitter, ip)->paramCount;
+}
+
+static uint64_t getConstant(Emitter* emitter, uint8_t* ip)
+{
+    Value value = emitter->vm->module->constants.data[ip[1]];
+    uint64_t bits = 0;
+
+    memcpy(&bits, &value, sizeof(value));
+
+    return bits;
+}
+
+static int32_t getImmediate(uint8_t* ip)
+{
+    if (ip[0] == OP_PUSHH) {
+        return (int16_t)((ip[1] << 8) | ip[2]);
+    }
+
+    if (ip[0] == OP_INCL) {
+        return (int8_t)ip[2];
+    }
+
+    return (int8_t)ip[1];
+}
+
+static int32_t getTarget(Emitter* emitter, uint8_t* ip, uint8_t* hole)
+{
+    CodeObject* code = &emitter->function->code;
+    size_t next = ip - code->data + getInstructionLength(ip[0]);
+    size_t distance = (ip[1] << 8) | ip[2];
+    size_t target = emitter->offsets[ip[0] == OP_LOOP ? next - distance : next + distance];
+
+    return target - (hole + 4 - emitter->start);
+}
+
+static void patch32(uint8_t* hole, int32_t n)
+{
+    memcpy(hole, &n, sizeof(n));
+}
+
+static void patch64(uint8_t* hole, uint64_t n)
+{
+    memcpy(hole, &n, sizeof(n));
+}
+
+static void patchHole(Emitter* emitter, uint8_t* ip, uint8_t* dst, const Hole* hole)
+{
+    FunctionObject* function = emitter->function;
+    uint8_t* at = dst + hole->offset;
+
+    switch (hole->kind) {
+        case HOLE_PARAMS:       return patch32(at, function->paramCount);
+        case HOLE_LOCALS:       return patch32(at, function->localCount * sizeof(Value));
+        case HOLE_ARGUMENT:     return patch64(at, getArgument(emitter, ip));
+        case HOLE_HELPER:       return patch64(at, (uintptr_t)getHelper(ip[0]));
+        case HOLE_NATIVE:       return patch32(at, offsetof(FunctionObject, native));
+        case HOLE_FRAME:        return patch32(at, (getCallee(emitter, ip)->maxStackCount + 1) * sizeof(Value));
+        case HOLE_STACK_END:    return patch32(at, offsetof(VM, stack) + STACK_MAX * sizeof(Value));
+        case HOLE_RESULT:       return patch32(at, getResult(emitter, ip) * (int32_t)sizeof(Value));
+        case HOLE_ARGUMENTS:    return patch32(at, -(ip[3] >> 4) * (int32_t)sizeof(Value));
+        case HOLE_SERVICE:      return patch64(at, (uintptr_t)emitter->vm->service[(ip[1] << 8) | ip[2]]);
+        case HOLE_CONSTANT:     return patch64(at, getConstant(emitter, ip));
+        case HOLE_GLOBALS:      return patch32(at, offsetof(VM, globals.data));
+        case HOLE_GLOBAL:       return patch32(at, ip[1] * sizeof(Value));
+        case HOLE_LOCAL_A:      return patch32(at, (int8_t)ip[1] * (int32_t)sizeof(Value));
+        case HOLE_LOCAL_B:      return patch32(at, (int8_t)ip[2] * (int32_t)sizeof(Value));
+        case HOLE_IMMEDIATE:    return patch32(at, getImmediate(ip));
+        case HOLE_INT_TAG:      return patch64(at, INT_TAG);
+        case HOLE_TARGET:       return patch32(at, getTarget(emitter, ip, at));
+        case HOLE_DEOPT:        return patch32(at, offsetof(VM, deopt));
+        case HOLE_RESUME:       return patch64(at, (uintptr_t)ip);
+        case HOLE_RESUME_CALL:  return patch64(at, (uintptr_t)resumeCall);
+    }
+}
+
+static uint8_t* copyStencil(Emitter* emitter, uint8_t* ip, uint8_t* dst, const Stencil* stencil)
+{
+    memcpy(dst, stencil->code, stencil->size);
+
+    for (int i = 0; i < STENCIL_HOLES_MAX && stencil->holes[i].kind != HOLE_NONE; i++) {
+        patchHole(emitter, ip, dst, &stencil->holes[i]);
+    }
+
+    return dst + stencil->size;
+}
+
+// popcnt is the one instruction the stencils use that not every x86-64
+// has.
+bool hasPopcount(void)
+{
+#ifdef JIT_SUPPORTED
+    return __builtin_cpu_supports("popcnt");
+#else
+    return false;
+#endif
+}
+
+static const Stencil* getStencil(Jit* jit, uint8_t opcode)
+{
+    // Loops are left to the interpreter so that the tracer sees them.
+    if (opcode == OP_LOOP && jit->mode == JIT_TRACE) {
+        return &deopt;
+    }
+
+    if (opcode >= STENCILS_COUNT || !stencils[opcode].code
+        || (opcode == OP_POPCNT && !hasPopcount())) {
+        return &deopt;
+    }
+
+    return &stencils[opcode];
+}
+
+// Maps every instruction start, and the end of the code, to its offset in
+// the native code so branches can be patched in a single copying pass.
+static size_t layoutNative(Jit* jit, CodeObject* code, size_t* offsets)
+{
+    size_t size = prologue.size;
+    size_t i = 0;
+
+    while (i < code->count) {
+        uint8_t opcode = code->data[i];
+
+        offsets[i] = size;
+        size += getStencil(jit, opcode)->size;
+        i += getInstructionLength(opcode);
+    }
+
+    offsets[code->count] = size;
+
+    return size;
+}
+
+static bool isBranchStencil(const Stencil* stencil)
+{
+    for (int i = 0; i < STENCIL_HOLES_MAX; i++) {
+        if (stencil->holes[i].kind == HOLE_TARGET) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Whether native code entered at header leaves again before it can
+// branch, as a for does at the next that resumes its generator: every
+// pass would then go in and straight back out.
+static bool isLeftAtOnce(Jit* jit, CodeObject* code, size_t header)
+{
+    size_t i = header;
+
+    while (i < code->count) {
+        const Stencil* stencil = getStencil(jit, code->data[i]);
+
+        if (stencil == &deopt) {
+            return true;
+        }
+
+        if (isBranchStencil(stencil)) {
+            return false;
+        }
+
+        i += getInstructionLength(code->data[i]);
+    }
+
+    return false;
+}
+
+// Loops compiled to native code can be entered from the interpreter at
+// their header, unless they would leave it at once.
+static void setLoopEntries(Emitter* emitter)
+{
+    CodeObject* code = &emitter->function->code;
+    Vector* loops = &emitter->vm->module->loops;
+    size_t i = 0;
+
+    while (i < code->count) {
+        uint8_t* ip = code->data + i;
+
+        if (ip[0] == OP_LOOP) {
+            LoopCounter* loop = loops->data[(ip[3] << 8) | ip[4]];
+            size_t header = i + 5 - ((ip[1] << 8) | ip[2]);
+
+            if (!isLeftAtOnce(&emitter->vm->jit, code, header)) {
+                loop->entry = emitter->start + emitter->offsets[header];
+            }
+        }
+
+        i += getInstructionLength(ip[0]);
+    }
+}
+
+#ifdef JIT_SUPPORTED
+static bool reserveJit(Jit* jit, size_t size)
+{
+    if (!jit->data) {
+        jit->data = mmap(NULL, JIT_CODE_MAX, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+        if (jit->data == MAP_FAILED) {
+            jit->data = NULL;
+            return false;
+        }
+
+        jit->capacity = JIT_CODE_MAX;
+    }
+
+    return jit->count + ALIGN_CODE(size) <= jit->capacity;
+}
+
+// Code pages are never writable and executable at once: the pages being
+// filled are made writable for the copy and executable again afterwards.
+static void protectJit(uint8_t* start, size_t size, int protection)
+{
+    uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = (uintptr_t)start & ~(pageSize - 1);
+    uintptr_t end = (uintptr_t)start + size;
+
+    mprotect((void*)begin, end - begin, protection);
+}
+#endif
+
+void initJit(Jit* jit, JitMode mode)
+{
+    jit->mode = mode;
+    jit->data = NULL;
+    jit->capacity = 0;
+    jit->count = 0;
+    jit->osrEntry = NULL;
+}
+
+void freeJit(Jit* jit)
+{
+#ifdef JIT_SUPPORTED
+    if (jit->data) {
+        munmap(jit->data, jit->capacity);
+    }
+#endif
+}
+
+bool compileNative(VM* vm, FunctionObject* function)
+{
+#ifdef JIT_SUPPORTED
+    Jit* jit = &vm->jit;
+    CodeObject* code = &function->code;
+    size_t* offsets = malloc(sizeof(size_t) * (code->count + 1));
+    size_t size = layoutNative(jit, code, offsets);
+
+    if (!reserveJit(jit, size)) {
+        free(offsets);
+        return false;
+    }
+
+    Emitter emitter = {vm, function, jit->data + jit->count, offsets};
+    uint8_t* dst = emitter.start;
+    uint8_t* ip = code->data;
+
+    protectJit(emitter.start, size, PROT_READ | PROT_WRITE);
+    dst = copyStencil(&emitter, ip, dst, &prologue);
+
+    while (ip < code->data + code->count) {
+        dst = copyStencil(&emitter, ip, dst, getStencil(jit, ip[0]));
+        ip += getInstructionLength(ip[0]);
+    }
+
+    protectJit(emitter.start, size, PROT_READ | PROT_EXEC);
+    jit->count += ALIGN_CODE(size);
+    function->native = emitter.start;
+
+    if (jit->mode == JIT_BASELINE && !jit->osrEntry) {
+        uint8_t entry[UINT8_MAX];
+
+        copyStencil(&emitter, NULL, entry, &osrPrologue);
+        jit->osrEntry = installCode(jit, entry, osrPrologue.size);
+    }
+
+    if (jit->mode == JIT_BASELINE && jit->osrEntry) {
+        setLoopEntries(&emitter);
+    }
+
+    free(offsets);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Continues the interpreter frame at fp in native code from entry, a loop
+// header. Returns like native code does: with the function's result, or
+// with the VM's deoptimization state set.
+Value enterNative(VM* vm, Value* fp, Value* sp, void* entry)
+{
+#ifdef JIT_SUPPORTED
+    return ((osr_t)vm->jit.osrEntry)(vm, fp, sp, entry);
+#else
+    return INT_VALUE(0);
+#endif
+}
+
+// Copies code generated elsewhere into the code area and returns its
+// address, or NULL when the area is full.
+void* installCode(Jit* jit, const uint8_t* code, size_t size)
+{
+#ifdef JIT_SUPPORTED
+    if (!reserveJit(jit, size)) {
+        return NULL;
+    }
+
+    uint8_t* start = jit->data + jit->count;
+
+    protectJit(start, size, PROT_READ | PROT_WRITE);
+    memcpy(start, code, size);
+    protectJit(start, size, PROT_READ | PROT_EXEC);
+    jit->count += ALIGN_CODE(size);
+
+    return start;
+#else
+    return NULL;
+#endif
+}
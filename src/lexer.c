@@ -5,83 +5,68 @@
 #include <stdlib.h>
 #include <string.h>
 
-typedef struct Position
-{
-    char* chars;
-    int line;
-    int column;
-} Position;
-
-typedef struct Lexer
-{
-    Position current;
-    Position start;
-} Lexer;
-
-static Lexer lexer;
-
 static const char* characterError = "Error: Missing terminating %c character";
 static const char* commentError = "Error: Unterminated comment";
 
-static void error(const char* message, const char c)
+static void error(Lexer* lexer, const char* message, const char c)
 {
     fprintf(stderr, message, c);
-    fprintf(stderr, " on line %d:%d\n", lexer.start.line, lexer.start.column);
+    fprintf(stderr, " on line %d:%d\n", lexer->start.line, lexer->start.column);
     exit(1);
 }
 
-static char peek()
+static char peek(Lexer* lexer)
 {
-    return *lexer.current.chars;
+    return *lexer->current.chars;
 }
 
-static char prev()
+static char prev(Lexer* lexer)
 {
-    return lexer.current.chars[-1];
+    return lexer->current.chars[-1];
 }
 
-static char next()
+static char next(Lexer* lexer)
 {
-    return lexer.current.chars[1];
+    return lexer->current.chars[1];
 }
 
-static char advance()
+static char advance(Lexer* lexer)
 {
-    lexer.current.column++;
+    lexer->current.column++;
     
-    if (*lexer.current.chars == '\n') {
-        lexer.current.line++;
-        lexer.current.column = 1;
+    if (*lexer->current.chars == '\n') {
+        lexer->current.line++;
+        lexer->current.column = 1;
     }
 
-    lexer.current.chars++;
-    return lexer.current.chars[-1];
+    lexer->current.chars++;
+    return lexer->current.chars[-1];
 }
 
-static bool isEof()
+static bool isEof(Lexer* lexer)
 {
-    return *lexer.current.chars == '\0';
+    return *lexer->current.chars == '\0';
 }
 
-static bool match(char c)
+static bool match(Lexer* lexer, char c)
 {
-    if (*lexer.current.chars != c) {
+    if (*lexer->current.chars != c) {
         return false;
     }
 
-    advance();
+    advance(lexer);
     
     return true;
 }
 
-static Token makeToken(TokenType type)
+static Token makeToken(Lexer* lexer, TokenType type)
 {
     Token token;
     token.type = type;
-    token.length = lexer.current.chars - lexer.start.chars;
-    token.chars = lexer.start.chars;
-    token.line = lexer.start.line;
-    token.column = lexer.start.column;
+    token.length = lexer->current.chars - lexer->start.chars;
+    token.chars = lexer->start.chars;
+    token.line = lexer->start.line;
+    token.column = lexer->start.column;
 
     return token;
 }
@@ -111,52 +96,52 @@ static bool isBDigit(char c)
     return c == '0' || c == '1';
 }
 
-static void skipCommentSingle()
+static void skipCommentSingle(Lexer* lexer)
 {
-    advance();
+    advance(lexer);
     
-    while (!isEof() && peek() != '\n') {
-        advance();
+    while (!isEof(lexer) && peek(lexer) != '\n') {
+        advance(lexer);
     }
 }
 
-static void skipCommentMulti()
+static void skipCommentMulti(Lexer* lexer)
 {
-    advance();
-    advance();
+    advance(lexer);
+    advance(lexer);
 
-    while (!isEof()) {
-        if (peek() == '#' && next() == '#') {
-            advance();
-            advance();
+    while (!isEof(lexer)) {
+        if (peek(lexer) == '#' && next(lexer) == '#') {
+            advance(lexer);
+            advance(lexer);
             return;
         }
         
-        advance();
+        advance(lexer);
     }
 
-    error(commentError, 0);
+    error(lexer, commentError, 0);
 }
 
-static void skipComment()
+static void skipComment(Lexer* lexer)
 {
-    lexer.start.chars = lexer.current.chars;
-    lexer.start.line = lexer.current.line;
-    lexer.start.column = lexer.current.column;
+    lexer->start.chars = lexer->current.chars;
+    lexer->start.line = lexer->current.line;
+    lexer->start.column = lexer->current.column;
     
-    if (next() == '#') {
-        return skipCommentMulti();
+    if (next(lexer) == '#') {
+        return skipCommentMulti(lexer);
     }
 
-    skipCommentSingle();
+    skipCommentSingle(lexer);
 }
 
-static void skipWhitespace()
+static void skipWhitespace(Lexer* lexer)
 {
     while (1) {
-        switch (peek()) {
+        switch (peek(lexer)) {
             case '#':
-                skipComment();
+                skipComment(lexer);
                 break;
             case ' ':
             case '\t':
@@ -164,7 +149,7 @@ static void skipWhitespace()
             case '\n':
             case '\f':
             case '\v':
-                advance();
+                advance(lexer);
                 break;
             default:
                 return;
@@ -172,112 +157,112 @@ static void skipWhitespace()
     }
 }
 
-static int checkKeyword(int chars, size_t len, const char* rest)
+static int checkKeyword(Lexer* lexer, int chars, size_t len, const char* rest)
 {
-    if (lexer.current.chars - lexer.start.chars != chars + len) {
+    if (lexer->current.chars - lexer->start.chars != chars + len) {
         return 0;
     }
 
-    return memcmp(lexer.start.chars + chars, rest, len) == 0;
+    return memcmp(lexer->start.chars + chars, rest, len) == 0;
 }
 
-static TokenType getIdentifierType()
+static TokenType getIdentifierType(Lexer* lexer)
 {
-    char c =* lexer.start.chars;
+    char c =* lexer->start.chars;
 
     switch (c) {
         case 'a':
-            if (checkKeyword(1, 1, "s")) return T_AS;
-            if (checkKeyword(1, 4, "sync")) return T_ASYNC;
-            if (checkKeyword(1, 4, "wait")) return T_AWAIT;
+            if (checkKeyword(lexer, 1, 1, "s")) return T_AS;
+            if (checkKeyword(lexer, 1, 4, "sync")) return T_ASYNC;
+            if (checkKeyword(lexer, 1, 4, "wait")) return T_AWAIT;
             break;
         case 'b':
-            if (checkKeyword(1, 3, "ool")) return T_BOOL;
-            if (checkKeyword(1, 4, "reak")) return T_BREAK;
+            if (checkKeyword(lexer, 1, 3, "ool")) return T_BOOL;
+            if (checkKeyword(lexer, 1, 4, "reak")) return T_BREAK;
             break;
         case 'c':
-            if (checkKeyword(1, 4, "atch")) return T_CATCH;
-            if (checkKeyword(1, 3, "har")) return T_CHAR;
-            if (checkKeyword(1, 4, "lass")) return T_CLASS;
-            if (checkKeyword(1, 4, "onst")) return T_CONST;
-            if (checkKeyword(1, 8, "onstruct")) return T_CONSTRUCT;
-            if (checkKeyword(1, 7, "ontinue")) return T_CONTINUE;
+            if (checkKeyword(lexer, 1, 4, "atch")) return T_CATCH;
+            if (checkKeyword(lexer, 1, 3, "har")) return T_CHAR;
+            if (checkKeyword(lexer, 1, 4, "lass")) return T_CLASS;
+            if (checkKeyword(lexer, 1, 4, "onst")) return T_CONST;
+            if (checkKeyword(lexer, 1, 8, "onstruct")) return T_CONSTRUCT;
+            if (checkKeyword(lexer, 1, 7, "ontinue")) return T_CONTINUE;
             break;
         case 'd':
-            if (checkKeyword(1, 5, "ouble")) return T_DOUBLE;
-            if (checkKeyword(1, 4, "efer")) return T_DEFER;
-            if (checkKeyword(1, 5, "elete")) return T_DELETE;
-            if (checkKeyword(1, 7, "estruct")) return T_DESTRUCT;
+            if (checkKeyword(lexer, 1, 5, "ouble")) return T_DOUBLE;
+            if (checkKeyword(lexer, 1, 4, "efer")) return T_DEFER;
+            if (checkKeyword(lexer, 1, 5, "elete")) return T_DELETE;
+            if (checkKeyword(lexer, 1, 7, "estruct")) return T_DESTRUCT;
             break;
         case 'e':
-            if (checkKeyword(1, 3, "lse")) return T_ELSE;
-            if (checkKeyword(1, 3, "num")) return T_ENUM;
-            if (checkKeyword(1, 3, "xtends")) return T_EXTENDS;
-            if (checkKeyword(1, 8, "xtension")) return T_EXTENSION;
-            if (checkKeyword(1, 5, "xtern")) return T_EXTERN;
+            if (checkKeyword(lexer, 1, 3, "lse")) return T_ELSE;
+            if (checkKeyword(lexer, 1, 3, "num")) return T_ENUM;
+            if (checkKeyword(lexer, 1, 3, "xtends")) return T_EXTENDS;
+            if (checkKeyword(lexer, 1, 8, "xtension")) return T_EXTENSION;
+            if (checkKeyword(lexer, 1, 5, "xtern")) return T_EXTERN;
             break;
         case 'f':
-            if (checkKeyword(1, 4, "alse")) return T_FALSE;
-            if (checkKeyword(1, 6, "inally")) return T_FINALLY;
-            if (checkKeyword(1, 4, "loat")) return T_FLOAT;
-            if (checkKeyword(1, 2, "or")) return T_FOR;
-            if (checkKeyword(1, 3, "unc")) return T_FUNC;
+            if (checkKeyword(lexer, 1, 4, "alse")) return T_FALSE;
+            if (checkKeyword(lexer, 1, 6, "inally")) return T_FINALLY;
+            if (checkKeyword(lexer, 1, 4, "loat")) return T_FLOAT;
+            if (checkKeyword(lexer, 1, 2, "or")) return T_FOR;
+            if (checkKeyword(lexer, 1, 3, "unc")) return T_FUNC;
             break;
         case 'h':
-            if (checkKeyword(1, 2, "as")) return T_HAS;
+            if (checkKeyword(lexer, 1, 2, "as")) return T_HAS;
             break;
         case 'i':
-            if (checkKeyword(1, 1, "f")) return T_IF;
-            if (checkKeyword(1, 1, "n")) return T_IN;
-            if (checkKeyword(1, 9, "nstanceof")) return T_INSTANCEOF;
-            if (checkKeyword(1, 2, "nt")) return T_INT;
-            if (checkKeyword(1, 3, "nt8")) return T_INT8;
-            if (checkKeyword(1, 4, "nt16")) return T_INT16;
-            if (checkKeyword(1, 4, "nt32")) return T_INT32;
-            if (checkKeyword(1, 4, "nt64")) return T_INT64;
-            if (checkKeyword(1, 1, "s")) return T_IS;
+            if (checkKeyword(lexer, 1, 1, "f")) return T_IF;
+            if (checkKeyword(lexer, 1, 1, "n")) return T_IN;
+            if (checkKeyword(lexer, 1, 9, "nstanceof")) return T_INSTANCEOF;
+            if (checkKeyword(lexer, 1, 2, "nt")) return T_INT;
+            if (checkKeyword(lexer, 1, 3, "nt8")) return T_INT8;
+            if (checkKeyword(lexer, 1, 4, "nt16")) return T_INT16;
+            if (checkKeyword(lexer, 1, 4, "nt32")) return T_INT32;
+            if (checkKeyword(lexer, 1, 4, "nt64")) return T_INT64;
+            if (checkKeyword(lexer, 1, 1, "s")) return T_IS;
             break;
         case 'm':
-            if (checkKeyword(1, 4, "atch")) return T_MATCH;
+            if (checkKeyword(lexer, 1, 4, "atch")) return T_MATCH;
             break;
         case 'p':
-            if (checkKeyword(1, 7, "rotocol")) return T_PROTOCOL;
-            if (checkKeyword(1, 5, "ublic")) return T_PUBLIC;
+            if (checkKeyword(lexer, 1, 7, "rotocol")) return T_PROTOCOL;
+            if (checkKeyword(lexer, 1, 5, "ublic")) return T_PUBLIC;
             break;
         case 'r':
-            if (checkKeyword(1, 5, "eturn")) return T_RETURN;
+            if (checkKeyword(lexer, 1, 5, "eturn")) return T_RETURN;
             break;
         case 's':
-            if (checkKeyword(1, 3, "elf")) return T_SELF;
-            if (checkKeyword(1, 5, "izeof")) return T_SIZEOF;
-            if (checkKeyword(1, 5, "tatic")) return T_STATIC;
-            if (checkKeyword(1, 5, "truct")) return T_STRUCT;
+            if (checkKeyword(lexer, 1, 3, "elf")) return T_SELF;
+            if (checkKeyword(lexer, 1, 5, "izeof")) return T_SIZEOF;
+            if (checkKeyword(lexer, 1, 5, "tatic")) return T_STATIC;
+            if (checkKeyword(lexer, 1, 5, "truct")) return T_STRUCT;
             break;
         case 't':
-            if (checkKeyword(1, 4, "hrow")) return T_THROW;
-            if (checkKeyword(1, 4, "rait")) return T_TRAIT;
-            if (checkKeyword(1, 3, "rue")) return T_TRUE;
-            if (checkKeyword(1, 2, "ry")) return T_TRY;
-            if (checkKeyword(1, 3, "ype")) return T_TYPE;
-            if (checkKeyword(1, 5, "ypeof")) return T_TYPEOF;
+            if (checkKeyword(lexer, 1, 4, "hrow")) return T_THROW;
+            if (checkKeyword(lexer, 1, 4, "rait")) return T_TRAIT;
+            if (checkKeyword(lexer, 1, 3, "rue")) return T_TRUE;
+            if (checkKeyword(lexer, 1, 2, "ry")) return T_TRY;
+            if (checkKeyword(lexer, 1, 3, "ype")) return T_TYPE;
+            if (checkKeyword(lexer, 1, 5, "ypeof")) return T_TYPEOF;
             break;
         case 'u':
-            if (checkKeyword(1, 3, "int")) return T_UINT;
-            if (checkKeyword(1, 4, "int8")) return T_UINT8;
-            if (checkKeyword(1, 5, "int16")) return T_UINT16;
-            if (checkKeyword(1, 5, "int32")) return T_UINT32;
-            if (checkKeyword(1, 5, "int64")) return T_UINT64;
-            if (checkKeyword(1, 2, "se")) return T_USE;
+            if (checkKeyword(lexer, 1, 3, "int")) return T_UINT;
+            if (checkKeyword(lexer, 1, 4, "int8")) return T_UINT8;
+            if (checkKeyword(lexer, 1, 5, "int16")) return T_UINT16;
+            if (checkKeyword(lexer, 1, 5, "int32")) return T_UINT32;
+            if (checkKeyword(lexer, 1, 5, "int64")) return T_UINT64;
+            if (checkKeyword(lexer, 1, 2, "se")) return T_USE;
             break;
         case 'v':
-            if (checkKeyword(1, 2, "ar")) return T_VAR;
+            if (checkKeyword(lexer, 1, 2, "ar")) return T_VAR;
             break;
         case 'w':
-            if (checkKeyword(1, 4, "here")) return T_WHERE;
-            if (checkKeyword(1, 4, "hile")) return T_WHILE;
+            if (checkKeyword(lexer, 1, 4, "here")) return T_WHERE;
+            if (checkKeyword(lexer, 1, 4, "hile")) return T_WHILE;
             break;
         case 'y':
-            if (checkKeyword(1, 4, "ield")) return T_YIELD;
+            if (checkKeyword(lexer, 1, 4, "ield")) return T_YIELD;
             break;
         default:
             break;
@@ -286,224 +271,224 @@ static TokenType getIdentifierType()
     return T_IDENTIFIER;
 }
 
-static Token floatLiteral()
+static Token floatLiteral(Lexer* lexer)
 {
-    while (isDigit(peek()) || (peek() == '_' && isDigit(next()))) {
-        advance();
+    while (isDigit(peek(lexer)) || (peek(lexer) == '_' && isDigit(next(lexer)))) {
+        advance(lexer);
     }
 
-    if (peek() == '.' && next() != '.') {
-        advance();
+    if (peek(lexer) == '.' && next(lexer) != '.') {
+        advance(lexer);
 
-        while (isDigit(peek()) || (peek() == '_' && isDigit(next()))) {
-            advance();
+        while (isDigit(peek(lexer)) || (peek(lexer) == '_' && isDigit(next(lexer)))) {
+            advance(lexer);
         }
     }
 
-    return makeToken(T_FLOAT_LITERAL);
+    return makeToken(lexer, T_FLOAT_LITERAL);
 }
 
-static Token integerLiteral()
+static Token integerLiteral(Lexer* lexer)
 {
-    while (isDigit(peek()) || (peek() == '_' && isDigit(next()))) {
-        advance();
+    while (isDigit(peek(lexer)) || (peek(lexer) == '_' && isDigit(next(lexer)))) {
+        advance(lexer);
     }
 
-    if (peek() == '.' && next() != '.') {
-        return floatLiteral();
+    if (peek(lexer) == '.' && next(lexer) != '.') {
+        return floatLiteral(lexer);
     }
 
-    return makeToken(T_INTEGER_LITERAL);
+    return makeToken(lexer, T_INTEGER_LITERAL);
 }
 
-static Token hexadecimalLiteral()
+static Token hexadecimalLiteral(Lexer* lexer)
 {
-    while (isXDigit(peek()) || (peek() == '_' && isXDigit(next()))) {
-        advance();
+    while (isXDigit(peek(lexer)) || (peek(lexer) == '_' && isXDigit(next(lexer)))) {
+        advance(lexer);
     }
 
-    return makeToken(T_HEXADECIMAL_LITERAL);
+    return makeToken(lexer, T_HEXADECIMAL_LITERAL);
 }
 
-static Token octalLiteral()
+static Token octalLiteral(Lexer* lexer)
 {
-    while (isODigit(peek()) || (peek() == '_' && isODigit(next()))) {
-        advance();
+    while (isODigit(peek(lexer)) || (peek(lexer) == '_' && isODigit(next(lexer)))) {
+        advance(lexer);
     }
 
-    return makeToken(T_OCTAL_LITERAL);
+    return makeToken(lexer, T_OCTAL_LITERAL);
 }
 
-static Token binaryLiteral()
+static Token binaryLiteral(Lexer* lexer)
 {
-    while (isBDigit(peek()) || (peek() == '_' && isBDigit(next()))) {
-        advance();
+    while (isBDigit(peek(lexer)) || (peek(lexer) == '_' && isBDigit(next(lexer)))) {
+        advance(lexer);
     }
 
-    return makeToken(T_BINARY_LITERAL);
+    return makeToken(lexer, T_BINARY_LITERAL);
 }
 
-static Token characterLiteral()
+static Token characterLiteral(Lexer* lexer)
 {
-    while (!isEof()) {
-        if (peek() == '\'' && prev() != '\\') {
-            advance();
-            return makeToken(T_CHARACTER_LITERAL);
+    while (!isEof(lexer)) {
+        if (peek(lexer) == '\'' && prev(lexer) != '\\') {
+            advance(lexer);
+            return makeToken(lexer, T_CHARACTER_LITERAL);
         }
 
-        advance();
+        advance(lexer);
     }
 
-    error(characterError, '\'');
+    error(lexer, characterError, '\'');
 }
 
-static Token stringLiteral(char c)
+static Token stringLiteral(Lexer* lexer, char c)
 {
-    while (!isEof()) {
-        if (peek() == c && prev() != '\\') {
-            advance();
-            return makeToken(T_STRING_LITERAL);
+    while (!isEof(lexer)) {
+        if (peek(lexer) == c && prev(lexer) != '\\') {
+            advance(lexer);
+            return makeToken(lexer, T_STRING_LITERAL);
         }
 
-        advance();
+        advance(lexer);
     }
 
-    error(characterError, c);
+    error(lexer, characterError, c);
 }
 
-static Token identifier()
+static Token identifier(Lexer* lexer)
 {
-    while (isAlpha(peek()) || isDigit(peek())) {
-        advance();
+    while (isAlpha(peek(lexer)) || isDigit(peek(lexer))) {
+        advance(lexer);
     }
 
-    return makeToken(getIdentifierType());
+    return makeToken(lexer, getIdentifierType(lexer));
 }
 
-void initLexer(char* source)
+void initLexer(Lexer* lexer, char* source)
 {
-    lexer.current.chars = source;
-    lexer.current.line = 1;
-    lexer.current.column = 1;
+    lexer->current.chars = source;
+    lexer->current.line = 1;
+    lexer->current.column = 1;
 }
 
-Token scanToken()
+Token scanToken(Lexer* lexer)
 {
-    skipWhitespace();
+    skipWhitespace(lexer);
 
-    lexer.start.chars = lexer.current.chars;
-    lexer.start.line = lexer.current.line;
-    lexer.start.column = lexer.current.column;
+    lexer->start.chars = lexer->current.chars;
+    lexer->start.line = lexer->current.line;
+    lexer->start.column = lexer->current.column;
 
-    if (isEof()) {
-        return makeToken(T_EOF);
+    if (isEof(lexer)) {
+        return makeToken(lexer, T_EOF);
     }
 
-    char c = advance();
+    char c = advance(lexer);
 
     if (isAlpha(c)) {
-        return identifier();
+        return identifier(lexer);
     }
 
     if (c == '0') {
-        if (isXDigit(next()) && (match('x') || match('X'))) return hexadecimalLiteral();
-        if (isODigit(next()) && (match('o') || match('O'))) return octalLiteral();
-        if (isBDigit(next()) && (match('b') || match('B'))) return binaryLiteral();
+        if (isXDigit(next(lexer)) && (match(lexer, 'x') || match(lexer, 'X'))) return hexadecimalLiteral(lexer);
+        if (isODigit(next(lexer)) && (match(lexer, 'o') || match(lexer, 'O'))) return octalLiteral(lexer);
+        if (isBDigit(next(lexer)) && (match(lexer, 'b') || match(lexer, 'B'))) return binaryLiteral(lexer);
 
-        return integerLiteral();
+        return integerLiteral(lexer);
     }
 
     if (isDigit(c)) {
-        return integerLiteral();
+        return integerLiteral(lexer);
     }
 
     switch (c) {
         case '"':
-        case '`':   return stringLiteral(c);
-        case '\'':  return characterLiteral();
-        case '(':   return makeToken(T_LPAREN);
-        case ')':   return makeToken(T_RPAREN);
-        case '[':   return makeToken(T_LBRACE);
-        case ']':   return makeToken(T_RBRACE);
-        case '{':   return makeToken(T_LBRACE);
-        case '}':   return makeToken(T_RBRACE);
-        case ';':   return makeToken(T_SEMICOLON);
-        case ',':   return makeToken(T_COMMA);
-        case '$':   return makeToken(T_DOLLAR);
-        case '~':   return makeToken(T_TILDE);
-        case ':':   return makeToken(T_COLON);
+        case '`':   return stringLiteral(lexer, c);
+        case '\'':  return characterLiteral(lexer);
+        case '(':   return makeToken(lexer, T_LPAREN);
+        case ')':   return makeToken(lexer, T_RPAREN);
+        case '[':   return makeToken(lexer, T_LBRACE);
+        case ']':   return makeToken(lexer, T_RBRACE);
+        case '{':   return makeToken(lexer, T_LBRACE);
+        case '}':   return makeToken(lexer, T_RBRACE);
+        case ';':   return makeToken(lexer, T_SEMICOLON);
+        case ',':   return makeToken(lexer, T_COMMA);
+        case '$':   return makeToken(lexer, T_DOLLAR);
+        case '~':   return makeToken(lexer, T_TILDE);
+        case ':':   return makeToken(lexer, T_COLON);
         case '%':
-            return makeToken(
-                match('=') ? T_PERCENT_EQUAL : T_PERCENT);
+            return makeToken(lexer, 
+                match(lexer, '=') ? T_PERCENT_EQUAL : T_PERCENT);
         case '!':
-            return makeToken(
-                match('~') ? T_NOT_TILDE :
-                match('=') ? T_NOT_EQUAL : T_EXCLAMATION);
+            return makeToken(lexer, 
+                match(lexer, '~') ? T_NOT_TILDE :
+                match(lexer, '=') ? T_NOT_EQUAL : T_EXCLAMATION);
         case '&':
-            return makeToken(
-                match('&') ? T_BOOLEAN_AND :
-                match('=') ? T_AND_EQUAL : T_AMPERSAND);
+            return makeToken(lexer, 
+                match(lexer, '&') ? T_BOOLEAN_AND :
+                match(lexer, '=') ? T_AND_EQUAL : T_AMPERSAND);
         case '|':
-            return makeToken(
-                match('|') ? T_BOOLEAN_OR :
-                match('>') ? T_PIPE_FORWARD :
-                match('=') ? T_OR_EQUAL : T_PIPE);
+            return makeToken(lexer, 
+                match(lexer, '|') ? T_BOOLEAN_OR :
+                match(lexer, '>') ? T_PIPE_FORWARD :
+                match(lexer, '=') ? T_OR_EQUAL : T_PIPE);
         case '^':
-            return makeToken(
-                match('=') ? T_CIRCUMFLEX_EQUAL : T_CIRCUMFLEX);
+            return makeToken(lexer, 
+                match(lexer, '=') ? T_CIRCUMFLEX_EQUAL : T_CIRCUMFLEX);
         case '+':
-            return makeToken(
-                match('=') ? T_PLUS_EQUAL : T_PLUS);
+            return makeToken(lexer, 
+                match(lexer, '=') ? T_PLUS_EQUAL : T_PLUS);
         case '-':
-            if (isDigit(peek()) || peek() == '.') {
-                return integerLiteral();
+            if (isDigit(peek(lexer)) || peek(lexer) == '.') {
+                return integerLiteral(lexer);
             }
-            return makeToken(
-                match('=') ? T_MINUS_EQUAL : T_MINUS);
+            return makeToken(lexer, 
+                match(lexer, '=') ? T_MINUS_EQUAL : T_MINUS);
         case '*':
-            return makeToken(
-                match('*') ?
-                match('=') ? T_POWER_EQUAL : T_POWER :
-                match('=') ? T_STAR_EQUAL : T_STAR);
+            return makeToken(lexer, 
+                match(lexer, '*') ?
+                match(lexer, '=') ? T_POWER_EQUAL : T_POWER :
+                match(lexer, '=') ? T_STAR_EQUAL : T_STAR);
         case '/':
-            return makeToken(
-                match('/') ?
-                match('=') ? T_FLOOR_EQUAL : T_FLOOR :
-                match('=') ? T_SLASH_EQUAL : T_SLASH);
+            return makeToken(lexer, 
+                match(lexer, '/') ?
+                match(lexer, '=') ? T_FLOOR_EQUAL : T_FLOOR :
+                match(lexer, '=') ? T_SLASH_EQUAL : T_SLASH);
         case '<':
-            return makeToken(
-                match('<') ?
-                match('=') ? T_LSHIFT_EQUAL : T_LSHIFT :
-                match('|') ? T_PIPE_BACKWARD :
-                match('=') ?
-                match('>') ? T_SPACESHIP : T_LESS_EQUAL : T_LESS);
+            return makeToken(lexer, 
+                match(lexer, '<') ?
+                match(lexer, '=') ? T_LSHIFT_EQUAL : T_LSHIFT :
+                match(lexer, '|') ? T_PIPE_BACKWARD :
+                match(lexer, '=') ?
+                match(lexer, '>') ? T_SPACESHIP : T_LESS_EQUAL : T_LESS);
         case '>':
-            return makeToken(
-                match('>') ?
-                match('=') ? T_RSHIFT_EQUAL : T_RSHIFT :
-                match('=') ? T_GREATER_EQUAL : T_GREATER);
+            return makeToken(lexer, 
+                match(lexer, '>') ?
+                match(lexer, '=') ? T_RSHIFT_EQUAL : T_RSHIFT :
+                match(lexer, '=') ? T_GREATER_EQUAL : T_GREATER);
         case '=':
-            return makeToken(
-                match('=') ? T_EQUAL_EQUAL :
-                match('~') ? T_EQUAL_TILDE :
-                match('>') ? T_LAMBDA : T_EQUAL);
+            return makeToken(lexer, 
+                match(lexer, '=') ? T_EQUAL_EQUAL :
+                match(lexer, '~') ? T_EQUAL_TILDE :
+                match(lexer, '>') ? T_LAMBDA : T_EQUAL);
         case '?':
-            return makeToken(
-                match('?') ?
-                match('=') ? T_COALESCE_EQUAL : T_COALESCE :
-                match(':') ? T_TERNARY :
-                match('.') ? T_SAFE_ACCESS : T_QUESTION);
+            return makeToken(lexer, 
+                match(lexer, '?') ?
+                match(lexer, '=') ? T_COALESCE_EQUAL : T_COALESCE :
+                match(lexer, ':') ? T_TERNARY :
+                match(lexer, '.') ? T_SAFE_ACCESS : T_QUESTION);
         case '.':
-            if (isDigit(peek())) {
-                return floatLiteral();
+            if (isDigit(peek(lexer))) {
+                return floatLiteral(lexer);
             }
-            return makeToken(
-                match('.') ?
-                match('.') ? T_SPREAD :
-                match('^') ? T_RANGE_FROM_END : T_RANGE : T_DOT);
+            return makeToken(lexer, 
+                match(lexer, '.') ?
+                match(lexer, '.') ? T_SPREAD :
+                match(lexer, '^') ? T_RANGE_FROM_END : T_RANGE : T_DOT);
         case '@':
-            return makeToken(T_AT);
+            return makeToken(lexer, T_AT);
         default:
-            return makeToken(T_UNKNOWN);      
+            return makeToken(lexer, T_UNKNOWN);      
     }
 }
@@ -0,0 +1,810 @@
+#include "loop.h"
+#include "channel.h"
+#include "functionobject.h"
+#include "scheduler.h"
+#include "value.h"
+#include "vm.h"
+#include "wheel.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define GROW_CAPACITY(capacity) ((capacity) < 64 ? 64 : (capacity) * 2)
+
+static const char* invalidFutureError = "Error: Invalid future %d\n";
+static const char* awaitedFutureError = "Error: Future %d is already awaited\n";
+static const char* futureLimitError = "Error: Too many futures\n";
+
+static uint64_t getMilliseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t getNanoseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void initLoop(EventLoop* loop)
+{
+    loop->futures = NULL;
+    loop->futureCapacity = 0;
+    loop->freeFuture = -1;
+    loop->freeFutureTail = -1;
+    loop->futureCount = 0;
+    loop->futurePeak = 0;
+    loop->current = NULL;
+    loop->readyHead = NULL;
+    loop->readyTail = NULL;
+    loop->suspendedCount = 0;
+    initWheel(&loop->wheel);
+    loop->epoch = getMilliseconds();
+    loop->watches = NULL;
+    loop->watchCapacity = 0;
+    loop->watchCount = 0;
+    loop->epoll = -1;
+    loop->resuming = false;
+    loop->scheduler = NULL;
+    loop->worker = 0;
+    loop->workerCount = 1;
+    loop->wakeup = -1;
+    loop->channels = NULL;
+    memset(&loop->pauses, 0, sizeof(Pauses));
+}
+
+void freeTask(Task* task)
+{
+    free(task->frame);
+    free(task);
+}
+
+// Tasks still suspended when the VM goes away are waiting for something
+// that can no longer happen.
+void freeLoop(EventLoop* loop)
+{
+    for (int i = 0; i < loop->futureCapacity; i++) {
+        if (loop->futures[i].state == FUTURE_PENDING && loop->futures[i].waiter) {
+            freeTask(loop->futures[i].waiter);
+        }
+    }
+
+    while (loop->readyHead) {
+        Task* task = loop->readyHead;
+        loop->readyHead = task->next;
+        freeTask(task);
+    }
+
+    if (loop->epoll >= 0) {
+        close(loop->epoll);
+    }
+
+    if (loop->wakeup >= 0) {
+        close(loop->wakeup);
+    }
+
+    // A scheduler's channels are its own.
+    if (loop->channels && !loop->scheduler) {
+        freeChannels(loop->channels);
+        free(loop->channels);
+    }
+
+    freeWheel(&loop->wheel);
+    free(loop->futures);
+    free(loop->watches);
+}
+
+// Free futures are chained through next and reused oldest first, which
+// keeps a stale id from meeting its index's generation again for long.
+static void growFutures(EventLoop* loop)
+{
+    if (loop->futureCapacity == FUTURES_MAX) {
+        fprintf(stderr, "%s", futureLimitError);
+        exit(1);
+    }
+
+    int capacity = GROW_CAPACITY(loop->futureCapacity);
+
+    if (capacity > FUTURES_MAX) {
+        capacity = FUTURES_MAX;
+    }
+
+    loop->futures = realloc(loop->futures, sizeof(Future) * capacity);
+
+    for (int i = loop->futureCapacity; i < capacity; i++) {
+        loop->futures[i].state = FUTURE_FREE;
+        loop->futures[i].generation = 0;
+        loop->futures[i].next = i + 1 < capacity ? i + 1 : -1;
+    }
+
+    loop->freeFuture = loop->futureCapacity;
+    loop->freeFutureTail = capacity - 1;
+    loop->futureCapacity = capacity;
+}
+
+static int allocateFuture(EventLoop* loop)
+{
+    if (loop->freeFuture < 0) {
+        growFutures(loop);
+    }
+
+    int index = loop->freeFuture;
+    Future* future = &loop->futures[index];
+
+    loop->freeFuture = future->next;
+
+    if (loop->freeFuture < 0) {
+        loop->freeFutureTail = -1;
+    }
+
+    loop->futureCount++;
+
+    if (loop->futureCount > loop->futurePeak) {
+        loop->futurePeak = loop->futureCount;
+    }
+
+    future->state = FUTURE_PENDING;
+    future->detached = false;
+    future->result = INT_VALUE(0);
+    future->waiter = NULL;
+    future->timer = -1;
+
+    return index;
+}
+
+static void releaseFuture(EventLoop* loop, int index)
+{
+    Future* future = &loop->futures[index];
+
+    future->state = FUTURE_FREE;
+    future->generation++;
+    future->next = -1;
+
+    if (loop->freeFutureTail >= 0) {
+        loop->futures[loop->freeFutureTail].next = index;
+    } else {
+        loop->freeFuture = index;
+    }
+
+    loop->freeFutureTail = index;
+    loop->futureCount--;
+}
+
+// Ids stay below 2^31 whatever the number of workers, so the more there
+// are, the fewer generations an id can tell apart.
+static int getFutureId(EventLoop* loop, int index)
+{
+    int generations = (1u << 31) / ((unsigned)FUTURES_MAX * loop->workerCount);
+    int generation = loop->futures[index].generation % generations;
+
+    return ((generation << FUTURE_INDEX_BITS) | index) * loop->workerCount + loop->worker;
+}
+
+int createFuture(EventLoop* loop)
+{
+    return getFutureId(loop, allocateFuture(loop));
+}
+
+// Whether future belongs to the loop of another worker. Ids below zero
+// belong to none and are left for findIndex to refuse.
+static bool isRemote(EventLoop* loop, int future)
+{
+    return future >= 0 && future % loop->workerCount != loop->worker;
+}
+
+// Scripts only ever see futures as ints, so any int can come back here.
+// Returns -1 unless future is one of this loop's that is still in use.
+static int findIndex(EventLoop* loop, int future)
+{
+    if (future < 0 || isRemote(loop, future)) {
+        return -1;
+    }
+
+    int index = (future / loop->workerCount) & (FUTURES_MAX - 1);
+
+    if (index >= loop->futureCapacity || loop->futures[index].state == FUTURE_FREE
+        || getFutureId(loop, index) != future) {
+        return -1;
+    }
+
+    return index;
+}
+
+static int getIndex(EventLoop* loop, int future)
+{
+    int index = findIndex(loop, future);
+
+    if (index < 0) {
+        fprintf(stderr, invalidFutureError, future);
+        exit(1);
+    }
+
+    return index;
+}
+
+// Hands what is to be done to future over to the worker it belongs to.
+static void sendMessage(EventLoop* loop, MessageType type, int future, Value value, Task* task)
+{
+    Message* message = malloc(sizeof(Message));
+
+    message->type = type;
+    message->future = future;
+    message->value = value;
+    message->task = task;
+    postMessage(loop->scheduler, future % loop->workerCount, message);
+}
+
+static void pushReady(EventLoop* loop, Task* task)
+{
+    if (loop->scheduler) {
+        return scheduleTask(loop->scheduler, loop->worker, task);
+    }
+
+    task->next = NULL;
+
+    if (loop->readyTail) {
+        loop->readyTail->next = task;
+    } else {
+        loop->readyHead = task;
+    }
+
+    loop->readyTail = task;
+}
+
+static Task* popReady(EventLoop* loop)
+{
+    Task* task = loop->readyHead;
+
+    loop->readyHead = task->next;
+
+    if (!loop->readyHead) {
+        loop->readyTail = NULL;
+    }
+
+    return task;
+}
+
+// A waiting task takes the value and is queued to run; with nobody
+// waiting the future keeps it for whoever awaits it later.
+static void resolveFuture(EventLoop* loop, int index, Value value)
+{
+    Future* future = &loop->futures[index];
+    Task* waiter = future->waiter;
+
+    if (waiter) {
+        waiter->value = value;
+        releaseFuture(loop, index);
+        pushReady(loop, waiter);
+    } else if (future->detached) {
+        releaseFuture(loop, index);
+    } else {
+        future->state = FUTURE_DONE;
+        future->result = value;
+    }
+}
+
+// Any loop can finish a future, whichever it belongs to.
+void completeFuture(EventLoop* loop, int future, Value value)
+{
+    if (isRemote(loop, future)) {
+        return sendMessage(loop, MESSAGE_RESOLVE, future, value, NULL);
+    }
+
+    resolveFuture(loop, getIndex(loop, future), value);
+}
+
+// Starts a task for an async function about to be called from the
+// current one.
+void startTask(EventLoop* loop)
+{
+    Task* task = malloc(sizeof(Task));
+
+    task->future = createFuture(loop);
+    task->frame = NULL;
+    task->size = 0;
+    task->started = true;
+    task->caller = loop->current;
+    task->next = NULL;
+    loop->current = task;
+}
+
+// Starts a task for function that any worker may run, and returns its
+// future.
+int spawnTask(EventLoop* loop, FunctionObject* function, Value* args)
+{
+    Task* task = malloc(sizeof(Task));
+    size_t fp = function->paramCount + 3;
+
+    task->future = createFuture(loop);
+    task->ip = function->code.data;
+    task->size = fp + function->localCount;
+    task->frame = malloc(sizeof(Value) * task->size);
+    task->fp = fp;
+    task->started = false;
+    task->caller = NULL;
+    task->next = NULL;
+
+    memcpy(task->frame, args, sizeof(Value) * function->paramCount);
+    task->frame[function->paramCount] = INT_VALUE(function->paramCount);
+
+    int future = task->future;
+
+    addTask(loop->scheduler, loop->worker, task);
+
+    return future;
+}
+
+bool isDone(EventLoop* loop, int future)
+{
+    // Another worker's future is awaited by a message, done or not.
+    if (isRemote(loop, future)) {
+        return false;
+    }
+
+    return loop->futures[getIndex(loop, future)].state == FUTURE_DONE;
+}
+
+Value takeResult(EventLoop* loop, int future)
+{
+    int index = getIndex(loop, future);
+    Value result = loop->futures[index].result;
+
+    releaseFuture(loop, index);
+
+    return result;
+}
+
+// Suspends the current task until future is done and returns the task's
+// own future. Once another worker may wake it, the task is not touched.
+int suspendTask(EventLoop* loop, int future, uint8_t* ip, Value* fp, Value* sp)
+{
+    Future* awaited = NULL;
+    Task* task = loop->current;
+
+    if (!isRemote(loop, future)) {
+        awaited = &loop->futures[getIndex(loop, future)];
+
+        if (awaited->waiter) {
+            fprintf(stderr, awaitedFutureError, future);
+            exit(1);
+        }
+    }
+
+    // Below fp lie the return link and the arguments, their count first.
+    Value* frame = fp - 3 - AS_INT(fp[-3]);
+
+    task->size = sp - frame;
+    task->frame = realloc(task->frame, sizeof(Value) * task->size);
+    memcpy(task->frame, frame, sizeof(Value) * task->size);
+    task->fp = fp - frame;
+    task->ip = ip;
+
+    int own = task->future;
+
+    loop->current = task->caller;
+    loop->suspendedCount++;
+
+    if (awaited) {
+        awaited->waiter = task;
+    } else {
+        sendMessage(loop, MESSAGE_AWAIT, future, INT_VALUE(0), task);
+    }
+
+    return own;
+}
+
+// Ends the current task with value and returns its future.
+int resolveTask(EventLoop* loop, Value value)
+{
+    Task* task = loop->current;
+    int future = task->future;
+
+    loop->current = task->caller;
+    freeTask(task);
+    completeFuture(loop, future, value);
+
+    if (loop->scheduler) {
+        finishTask(loop->scheduler);
+    }
+
+    return future;
+}
+
+// Nobody will await future: it is freed once done.
+void detachFuture(EventLoop* loop, int future)
+{
+    if (isRemote(loop, future)) {
+        return sendMessage(loop, MESSAGE_DETACH, future, INT_VALUE(0), NULL);
+    }
+
+    int index = getIndex(loop, future);
+    Future* detached = &loop->futures[index];
+
+    if (detached->state == FUTURE_DONE) {
+        releaseFuture(loop, index);
+    } else {
+        detached->detached = true;
+    }
+}
+
+static uint64_t getTick(EventLoop* loop)
+{
+    return getMilliseconds() - loop->epoch;
+}
+
+// The wheel and the watches name futures by their index.
+int createTimer(EventLoop* loop, int32_t milliseconds)
+{
+    int index = allocateFuture(loop);
+    uint64_t deadline = getTick(loop) + (milliseconds > 0 ? milliseconds : 0);
+
+    loop->futures[index].timer = addTimer(&loop->wheel, deadline, index);
+
+    return getFutureId(loop, index);
+}
+
+// Stops a pending timer, whose waiter gets -1. Another worker's timer can
+// only be asked to stop.
+bool cancelFuture(EventLoop* loop, int future)
+{
+    if (isRemote(loop, future)) {
+        sendMessage(loop, MESSAGE_CANCEL, future, INT_VALUE(0), NULL);
+        return true;
+    }
+
+    int index = findIndex(loop, future);
+
+    if (index < 0) {
+        return false;
+    }
+
+    Future* cancelled = &loop->futures[index];
+
+    if (cancelled->state != FUTURE_PENDING || cancelled->timer < 0) {
+        return false;
+    }
+
+    cancelTimer(&loop->wheel, cancelled->timer);
+    cancelled->timer = -1;
+    resolveFuture(loop, index, INT_VALUE(-1));
+
+    return true;
+}
+
+static void expireTimer(void* context, int index)
+{
+    EventLoop* loop = context;
+
+    loop->futures[index].timer = -1;
+    resolveFuture(loop, index, INT_VALUE(0));
+}
+
+static void fireTimers(EventLoop* loop)
+{
+    advanceWheel(&loop->wheel, getTick(loop), expireTimer, loop);
+}
+
+static bool reserveWatch(EventLoop* loop, int fd)
+{
+    if (loop->epoll < 0) {
+        loop->epoll = epoll_create1(EPOLL_CLOEXEC);
+
+        if (loop->epoll < 0) {
+            return false;
+        }
+    }
+
+    if (fd < loop->watchCapacity) {
+        return true;
+    }
+
+    int capacity = loop->watchCapacity;
+
+    while (capacity <= fd) {
+        capacity = GROW_CAPACITY(capacity);
+    }
+
+    loop->watches = realloc(loop->watches, sizeof(Watch) * capacity);
+
+    for (int i = loop->watchCapacity; i < capacity; i++) {
+        loop->watches[i] = (Watch){-1, -1, false};
+    }
+
+    loop->watchCapacity = capacity;
+
+    return true;
+}
+
+// Tells epoll what fd is still awaited for, which is nothing once both
+// its futures are gone.
+static bool updateWatch(EventLoop* loop, int fd)
+{
+    Watch* watch = &loop->watches[fd];
+    struct epoll_event event = {0};
+
+    event.events = (watch->reader >= 0 ? EPOLLIN : 0) | (watch->writer >= 0 ? EPOLLOUT : 0);
+    event.data.fd = fd;
+
+    if (!event.events) {
+        if (watch->registered) {
+            epoll_ctl(loop->epoll, EPOLL_CTL_DEL, fd, NULL);
+            watch->registered = false;
+            loop->watchCount--;
+        }
+
+        return true;
+    }
+
+    if (epoll_ctl(loop->epoll, watch->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event) < 0) {
+        return false;
+    }
+
+    if (!watch->registered) {
+        watch->registered = true;
+        loop->watchCount++;
+    }
+
+    return true;
+}
+
+// Returns a future that gives fd once it is ready, or -1 if it cannot be
+// waited for. Regular files, which epoll refuses, are always ready.
+int watchDescriptor(EventLoop* loop, int fd, bool write)
+{
+    int index = allocateFuture(loop);
+    int future = getFutureId(loop, index);
+
+    if (fd < 0 || !reserveWatch(loop, fd)) {
+        resolveFuture(loop, index, INT_VALUE(-1));
+        return future;
+    }
+
+    Watch* watch = &loop->watches[fd];
+    int* slot = write ? &watch->writer : &watch->reader;
+
+    if (*slot >= 0) {
+        resolveFuture(loop, index, INT_VALUE(-1));
+        return future;
+    }
+
+    *slot = index;
+
+    if (!updateWatch(loop, fd)) {
+        *slot = -1;
+        resolveFuture(loop, index, INT_VALUE(errno == EPERM ? fd : -1));
+    }
+
+    return future;
+}
+
+// Anything on this worker awaiting fd gets -1 before it is closed.
+void closeDescriptor(EventLoop* loop, int fd)
+{
+    if (fd < 0 || fd >= loop->watchCapacity) {
+        return;
+    }
+
+    Watch* watch = &loop->watches[fd];
+    int reader = watch->reader;
+    int writer = watch->writer;
+
+    watch->reader = -1;
+    watch->writer = -1;
+    updateWatch(loop, fd);
+
+    if (reader >= 0) {
+        resolveFuture(loop, reader, INT_VALUE(-1));
+    }
+
+    if (writer >= 0) {
+        resolveFuture(loop, writer, INT_VALUE(-1));
+    }
+}
+
+// Hangups and errors wake both directions, so that whoever is waiting
+// finds out from the call that follows.
+static void waitEvents(EventLoop* loop, int timeout)
+{
+    struct epoll_event events[LOOP_EVENTS_MAX];
+
+    if (loop->epoll < 0) {
+        loop->epoll = epoll_create1(EPOLL_CLOEXEC);
+    }
+
+    int count = epoll_wait(loop->epoll, events, LOOP_EVENTS_MAX, timeout);
+
+    for (int i = 0; i < count; i++) {
+        int fd = events[i].data.fd;
+        uint32_t ready = events[i].events;
+        eventfd_t wakes;
+
+        // All a wakeup asks for is that the loop goes round again.
+        if (fd == loop->wakeup) {
+            eventfd_read(fd, &wakes);
+            continue;
+        }
+
+        Watch* watch = &loop->watches[fd];
+        int reader = -1;
+        int writer = -1;
+
+        if (ready & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            reader = watch->reader;
+            watch->reader = -1;
+        }
+
+        if (ready & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+            writer = watch->writer;
+            watch->writer = -1;
+        }
+
+        updateWatch(loop, fd);
+
+        if (reader >= 0) {
+            resolveFuture(loop, reader, INT_VALUE(fd));
+        }
+
+        if (writer >= 0) {
+            resolveFuture(loop, writer, INT_VALUE(fd));
+        }
+    }
+}
+
+static int getTimeout(EventLoop* loop)
+{
+    uint64_t next = getNextTick(&loop->wheel);
+    uint64_t now = getTick(loop);
+
+    if (next == WHEEL_NONE) {
+        return -1;
+    }
+
+    if (next <= now) {
+        return 0;
+    }
+
+    return next - now < INT_MAX ? (int)(next - now) : INT_MAX;
+}
+
+// Does what another worker asked of one of this loop's futures.
+void handleMessage(EventLoop* loop, Message* message)
+{
+    int future = message->future;
+    int index;
+
+    switch (message->type) {
+    case MESSAGE_AWAIT:
+        index = getIndex(loop, future);
+
+        if (loop->futures[index].waiter) {
+            fprintf(stderr, awaitedFutureError, future);
+            exit(1);
+        }
+
+        if (loop->futures[index].state == FUTURE_DONE) {
+            message->task->value = loop->futures[index].result;
+            releaseFuture(loop, index);
+            pushReady(loop, message->task);
+        } else {
+            loop->futures[index].waiter = message->task;
+        }
+
+        break;
+    case MESSAGE_RESOLVE:
+        resolveFuture(loop, getIndex(loop, future), message->value);
+        break;
+    case MESSAGE_DETACH:
+        detachFuture(loop, future);
+        break;
+    case MESSAGE_CANCEL:
+        cancelFuture(loop, future);
+        break;
+    }
+}
+
+// Waits for descriptors, until the next timer when wait is set and not at
+// all otherwise, then fires the timers that are due.
+void pollLoop(EventLoop* loop, bool wait)
+{
+    if (wait || loop->watchCount) {
+        waitEvents(loop, wait ? getTimeout(loop) : 0);
+    }
+
+    fireTimers(loop);
+}
+
+// Returns 0 when pauses are not timed.
+uint64_t startPause(EventLoop* loop)
+{
+    return loop->pauses.enabled ? getNanoseconds() : 0;
+}
+
+bool isPauseOver(EventLoop* loop, uint64_t start)
+{
+    return loop->pauses.target && getNanoseconds() - start >= loop->pauses.target;
+}
+
+void endPause(EventLoop* loop, uint64_t start)
+{
+    Pauses* pauses = &loop->pauses;
+
+    if (!pauses->enabled) {
+        return;
+    }
+
+    uint64_t pause = getNanoseconds() - start;
+    uint64_t microseconds = pause / 1000;
+    int bucket = microseconds ? 64 - __builtin_clzll(microseconds) : 0;
+
+    pauses->counts[bucket < LOOP_PAUSE_BUCKETS ? bucket : LOOP_PAUSE_BUCKETS - 1]++;
+    pauses->count++;
+    pauses->total += pause;
+
+    if (pause > pauses->max) {
+        pauses->max = pause;
+    }
+
+    if (pauses->target && pause > pauses->target) {
+        pauses->over++;
+    }
+}
+
+void addPauses(Pauses* pauses, const Pauses* other)
+{
+    for (int i = 0; i < LOOP_PAUSE_BUCKETS; i++) {
+        pauses->counts[i] += other->counts[i];
+    }
+
+    pauses->count += other->count;
+    pauses->total += other->total;
+    pauses->over += other->over;
+
+    if (other->max > pauses->max) {
+        pauses->max = other->max;
+    }
+}
+
+// Runs the suspended tasks until none are left or nothing could wake
+// them, polling whenever the ready ones run out or a pause is over.
+void runLoop(VM* vm)
+{
+    EventLoop* loop = &vm->loop;
+
+    if (loop->scheduler) {
+        return runScheduler(loop->scheduler);
+    }
+
+    while (1) {
+        if (loop->readyHead) {
+            uint64_t start = startPause(loop);
+
+            do {
+                loop->suspendedCount--;
+                resumeTask(vm, popReady(loop));
+            } while (loop->readyHead && !isPauseOver(loop, start));
+
+            endPause(loop, start);
+        }
+
+        if (!loop->readyHead
+            && (loop->suspendedCount == 0 || (loop->wheel.count == 0 && loop->watchCount == 0))) {
+            break;
+        }
+
+        pollLoop(loop, !loop->readyHead);
+    }
+}
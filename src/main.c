@@ -1,12 +1,28 @@
 #include "buffer.h"
+#include "bytecode.h"
+#include "channel.h"
 #include "compiler.h"
+#include "ffi.h"
+#include "intern.h"
 #include "moduleobject.h"
+#include "object.h"
 #include "options.h"
+#include "pool.h"
+#include "profile.h"
 #include "program.h"
+#include "regcompiler.h"
+#include "scheduler.h"
+#include "slab.h"
+#include "tier.h"
 #include "vm.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <sched.h>
 #include <stdlib.h>
+#include <time.h>
+
+#define PROFILE_LIMIT 20
 
 static void repl()
 {
@@ -14,9 +30,10 @@ static void repl()
     size_t size = 0;
     size_t len;
     ModuleObject* module = createModuleObject();
+    Compiler compiler;
     VM vm;
     
-    initCompiler(module);
+    initCompiler(&compiler, module);
     initVM(&vm, module);
 
     while (1) {
@@ -29,16 +46,103 @@ static void repl()
             break;
         }
 
-        compile(source);
+        compile(&compiler, source);
         interpret(&vm);
     }
 
     freeVM(&vm);
-    freeCompiler();
+    freeCompiler(&compiler);
     freeModuleObject(module);
     free(source);
 }
 
+static double getSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Each line has the pauses up to twice as long as the line before's.
+static void printPauses(Pauses* pauses)
+{
+    int last = LOOP_PAUSE_BUCKETS - 1;
+
+    fprintf(stderr, "pauses: %llu, mean %.3f us, max %.3f us",
+        (unsigned long long)pauses->count, pauses->total / 1e3 / pauses->count, pauses->max / 1e3);
+
+    if (pauses->target) {
+        fprintf(stderr, ", %llu over %.3f us", (unsigned long long)pauses->over, pauses->target / 1e3);
+    }
+
+    fprintf(stderr, "\n");
+
+    while (last > 0 && pauses->counts[last] == 0) {
+        last--;
+    }
+
+    for (int i = 0; i <= last; i++) {
+        fprintf(stderr, "  < %llu us: %llu\n", 1ull << i, (unsigned long long)pauses->counts[i]);
+    }
+}
+
+// Counts every object allocated so far, the compiler's included.
+static void printAllocations()
+{
+    const char* separator = "";
+
+    fprintf(stderr, "objects:");
+
+    for (int i = 0; i < OBJ_TYPE_COUNT; i++) {
+        size_t count = getAllocationCount(i);
+
+        if (count) {
+            fprintf(stderr, "%s %s %zu", separator, getObjectTypeName(i), count);
+            separator = ",";
+        }
+    }
+
+    fprintf(stderr, "\n");
+}
+
+// Live futures were never awaited and live channels never closed.
+static void printStatistics(VM* vm, double seconds)
+{
+    fprintf(stderr, "time: %.6f s\n", seconds);
+    printAllocations();
+
+    if (vm->loop.futurePeak) {
+        fprintf(stderr, "futures: %zu live, %zu peak\n", vm->loop.futureCount, vm->loop.futurePeak);
+    }
+
+    if (vm->loop.channels && vm->loop.channels->livePeak) {
+        fprintf(stderr, "channels: %zu live, %zu peak\n", vm->loop.channels->liveCount, vm->loop.channels->livePeak);
+    }
+
+    if (vm->loop.pauses.count) {
+        printPauses(&vm->loop.pauses);
+    }
+
+    if (vm->instructionCount == 0) {
+        return;
+    }
+
+    fprintf(stderr, "instructions: %llu\n", (unsigned long long)vm->instructionCount);
+    fprintf(stderr, "rate: %.0f instructions/s\n", vm->instructionCount / seconds);
+}
+
+static void printOpcodeProfile(VM* vm)
+{
+    opcode_name_t name = getOpcodeName;
+
+    if (vm->module->backend == BACKEND_REGISTER) {
+        name = getRegisterOpcodeName;
+    }
+
+    printProfile(vm->profile, name, PROFILE_LIMIT);
+}
+
 static void runFile(Options* options)
 {
     char* source = getFileContents(options->filename);
@@ -49,19 +153,133 @@ static void runFile(Options* options)
     }
 
     ModuleObject* module = createModuleObject();
+    RegisterCompiler registerCompiler;
+    Compiler compiler;
+    Scheduler* scheduler = NULL;
     VM vm;
     
-    initCompiler(module);
-    compile(source);
+    if (options->backend == BACKEND_REGISTER) {
+        initRegisterCompiler(&registerCompiler, module);
+        compileRegisters(&registerCompiler, source);
+    } else {
+        initCompiler(&compiler, module);
+        compile(&compiler, source);
+    }
 
     if (options->disassemble) {
         return disassembleModule(module);
     }
 
     initVM(&vm, module);
+    vm.jit.mode = options->jit;
+    vm.policy = options->policy;
+    // The target is in microseconds.
+    vm.loop.pauses.enabled = options->statistics || options->pauseTarget;
+    vm.loop.pauses.target = (uint64_t)options->pauseTarget * 1000;
+
+    // Workers run interpreted, like isolates, since they share the bytecode.
+    if (options->workers) {
+        scheduler = aligned_alloc(CACHE_LINE, sizeof(Scheduler));
+
+        if (!initScheduler(scheduler, &vm, options->workers)) {
+            fprintf(stderr, "Error: Could not start %u workers\n", options->workers);
+            exit(1);
+        }
+
+        vm.jit.mode = JIT_OFF;
+        vm.policy = (TierPolicy){0, 0, 0};
+    }
+
+    if (options->profile) {
+        vm.profile = createProfile();
+    }
+
+    double start = getSeconds();
     interpret(&vm);
+
+    if (options->statistics) {
+        printStatistics(&vm, getSeconds() - start);
+    }
+
+    if (options->profile) {
+        printOpcodeProfile(&vm);
+        freeProfile(vm.profile);
+    }
+
+    if (options->counters) {
+        printCounters(module);
+    }
+
+    if (scheduler) {
+        freeScheduler(scheduler);
+        free(scheduler);
+    }
+
     freeVM(&vm);
-    freeCompiler();
+
+    if (options->backend == BACKEND_REGISTER) {
+        freeRegisterCompiler(&registerCompiler);
+    } else {
+        freeCompiler(&compiler);
+    }
+
+    freeModuleObject(module);
+    free(source);
+}
+
+// Compiles the file once and runs it options->jobs times on a pool of
+// options->isolates threads, reporting the latencies instead of statistics.
+static void runPool(Options* options)
+{
+    char* source = getFileContents(options->filename);
+
+    if (!source) {
+        fprintf(stderr, "Error: Could not read file %s\n", options->filename);
+        printUsage();
+    }
+
+    ModuleObject* module = createModuleObject();
+    RegisterCompiler registerCompiler;
+    Compiler compiler;
+
+    if (options->backend == BACKEND_REGISTER) {
+        initRegisterCompiler(&registerCompiler, module);
+        compileRegisters(&registerCompiler, source);
+    } else {
+        initCompiler(&compiler, module);
+        compile(&compiler, source);
+    }
+
+    Pool* pool = malloc(sizeof(Pool));
+    Job* jobs = malloc(sizeof(Job) * options->jobs);
+
+    if (!initPool(pool, options->isolates)) {
+        fprintf(stderr, "Error: Could not start %u isolates\n", options->isolates);
+        exit(1);
+    }
+
+    double start = getSeconds();
+
+    for (uint32_t i = 0; i < options->jobs; i++) {
+        jobs[i].module = module;
+
+        while (!submitJob(pool, &jobs[i])) {
+            sched_yield();
+        }
+    }
+
+    waitPool(pool);
+    printLatencies(jobs, options->jobs, getSeconds() - start);
+    freePool(pool);
+    free(pool);
+    free(jobs);
+
+    if (options->backend == BACKEND_REGISTER) {
+        freeRegisterCompiler(&registerCompiler);
+    } else {
+        freeCompiler(&compiler);
+    }
+
     freeModuleObject(module);
     free(source);
 }
@@ -71,12 +289,29 @@ int main(int argc, char* argv[])
     Options options;
 
     initOptions(&options, argc, argv);
+    initInterning();
+    initServices();
+    initFfi();
+
+    for (int i = 0; i < options.libraryCount; i++) {
+        if (!openLibrary(options.libraries[i])) {
+            fprintf(stderr, "Error: Could not load library %s\n", options.libraries[i]);
+            printUsage();
+        }
+    }
 
     if (argc == 1) {
         repl();
+    } else if (options.isolates) {
+        runPool(&options);
     } else {
         runFile(&options);
     }
 
+    freeFfi();
+    freeServices();
+    freeInterning();
+    freeSlabs();
+
     return 0;
 }
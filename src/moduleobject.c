@@ -3,34 +3,145 @@
 #include "functionobject.h"
 #include "object.h"
 #include "value.h"
+#include "vector.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 ModuleObject* createModuleObject()
 {
     ModuleObject* module = ALLOCATE_OBJECT(ModuleObject, OBJ_MODULE);
-    FunctionObject* function = createFunctionObject();
+
+    module->backend = BACKEND_STACK;
+    module->shared = NULL;
 
     initValueArray(&module->constants);
-    pushValue(&module->constants, POINTER_VALUE(function));
+    initVector(&module->functions);
+    initVector(&module->loops);
+    pushValue(&module->constants, POINTER_VALUE(addFunction(module)));
 
     return module;
 }
 
+static FunctionObject* copyFunction(FunctionObject* function)
+{
+    FunctionObject* copy = ALLOCATE_OBJECT(FunctionObject, OBJ_FUNCTION);
+
+    *copy = *function;
+    copy->callCount = 0;
+    copy->loopCount = 0;
+    copy->nextTier = 0;
+    copy->native = NULL;
+
+    return copy;
+}
+
+static FunctionObject* findCopy(ModuleObject* isolate, FunctionObject* function)
+{
+    ModuleObject* module = isolate->shared;
+
+    for (size_t i = 0; i < countVector(&module->functions); i++) {
+        if (module->functions.data[i] == function) {
+            return isolate->functions.data[i];
+        }
+    }
+
+    return NULL;
+}
+
+// A module for one isolate to run module in. Its functions are copies that
+// point at the same bytecode, and the constants naming them are redirected
+// to the copies. As long as the isolate never tiers up, which would replace
+// or patch that bytecode, it writes nothing that another isolate reads.
+ModuleObject* createIsolateModule(ModuleObject* module)
+{
+    ModuleObject* isolate = ALLOCATE_OBJECT(ModuleObject, OBJ_MODULE);
+    size_t functionCount = countVector(&module->functions);
+    size_t constantCount = countValueArray(&module->constants);
+
+    isolate->backend = module->backend;
+    isolate->shared = module;
+
+    initValueArray(&isolate->constants);
+    initVector(&isolate->functions);
+    initVector(&isolate->loops);
+
+    for (size_t i = 0; i < functionCount; i++) {
+        pushVectorItem(&isolate->functions, copyFunction(module->functions.data[i]));
+    }
+
+    for (size_t i = 0; i < constantCount; i++) {
+        Value value = module->constants.data[i];
+        FunctionObject* copy = IS_POINTER(value) ? findCopy(isolate, AS_POINTER(value)) : NULL;
+
+        pushValue(&isolate->constants, copy ? POINTER_VALUE(copy) : value);
+    }
+
+    for (size_t i = 0; i < countVector(&module->loops); i++) {
+        LoopCounter* loop = module->loops.data[i];
+
+        addLoop(isolate, findCopy(isolate, loop->function));
+    }
+
+    return isolate;
+}
+
 void freeModuleObject(ModuleObject* module)
 {
+    for (size_t i = 0; i < countVector(&module->functions); i++) {
+        if (module->shared) {
+            FREE_OBJECT(FunctionObject, module->functions.data[i]);
+        } else {
+            freeFunctionObject(module->functions.data[i]);
+        }
+    }
+
+    for (size_t i = 0; i < countVector(&module->loops); i++) {
+        free(module->loops.data[i]);
+    }
+
     freeValueArray(&module->constants);
-    free(module);
+    freeVector(&module->functions);
+    freeVector(&module->loops);
+    FREE_OBJECT(ModuleObject, module);
+}
+
+// Creates a function owned by the module. The caller decides whether it
+// is also reachable through a constant.
+FunctionObject* addFunction(ModuleObject* module)
+{
+    FunctionObject* function = createFunctionObject();
+
+    pushVectorItem(&module->functions, function);
+
+    return function;
+}
+
+// Creates the counter for a loop in function and returns its index.
+size_t addLoop(ModuleObject* module, FunctionObject* function)
+{
+    LoopCounter* loop = malloc(sizeof(LoopCounter));
+
+    loop->function = function;
+    loop->count = 0;
+    loop->threshold = 0;
+    loop->entry = NULL;
+
+    return pushVectorItem(&module->loops, loop) - 1;
 }
 
 void disassembleModule(ModuleObject* module)
 {
-    size_t functionCount = countValueArray(&module->constants);
+    size_t functionCount = countVector(&module->functions);
     FunctionObject* function;
 
-    for (int i = 0; i < functionCount; i++) {
-        function = AS_POINTER(module->constants.data[i]);
-        disassemble(&function->code);
+    for (size_t i = 0; i < functionCount; i++) {
+        function = module->functions.data[i];
+        if (module->backend == BACKEND_REGISTER) {
+            disassembleRegisters(&function->code);
+        } else {
+            disassemble(&function->code);
+        }
 
         if (i < functionCount - 1) {
             printf("\n");
@@ -1,68 +1,254 @@
 #include "native.h"
+#include "channel.h"
+#include "loop.h"
 #include "value.h"
+#include "vm.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
-Value __exit(Value* args)
+// Results are written over the arguments, starting at args[0].
+
+void __exit(VM* vm, Value* args)
 {
+    (void)vm;
+    (void)args;
+
     exit(0);
 }
 
-Value __print(Value* args)
+void __print(VM* vm, Value* args)
 {
+    (void)vm;
+
     int32_t n = AS_INT(args[0]);
     
     printf("%d\n", n);
-
-    return INT_VALUE(0);
 }
 
-Value __clamp(Value* args)
+void __clamp(VM* vm, Value* args)
 {
-    int32_t num = AS_INT(args[0]);
-    int32_t min = AS_INT(args[1]);
-    int32_t max = AS_INT(args[2]);
+    (void)vm;
 
-    if (num < min) {
-        return INT_VALUE(min);
-    } else if (num > max) {
-        return INT_VALUE(max);
-    } else {
-        return INT_VALUE(num);
-    }
+    args[0] = INT_VALUE(clampInt(AS_INT(args[0]), AS_INT(args[1]), AS_INT(args[2])));
 }
 
-Value __abs(Value* args)
+void __abs(VM* vm, Value* args)
 {
-    int32_t n = AS_INT(args[0]);
-    int32_t x = n < 0 ? -n : n;
-    
-    return INT_VALUE(x);
+    (void)vm;
+
+    args[0] = INT_VALUE(absInt(AS_INT(args[0])));
 }
 
-Value __min(Value* args)
+void __min(VM* vm, Value* args)
 {
-    int32_t a = AS_INT(args[0]);
-    int32_t b = AS_INT(args[1]);
-    int32_t x = a < b ? a : b;
-    
-    return INT_VALUE(x);
+    (void)vm;
+
+    args[0] = INT_VALUE(minInt(AS_INT(args[0]), AS_INT(args[1])));
 }
 
-Value __max(Value* args)
+void __max(VM* vm, Value* args)
 {
-    int32_t a = AS_INT(args[0]);
-    int32_t b = AS_INT(args[1]);
-    int32_t x = a > b ? a : b;
-    
-    return INT_VALUE(x);
+    (void)vm;
+
+    args[0] = INT_VALUE(maxInt(AS_INT(args[0]), AS_INT(args[1])));
 }
 
-Value __byteorder(Value* args)
+void __byteorder(VM* vm, Value* args)
 {
+    (void)vm;
+
     int32_t i = 1;
     char* c = (char*)&i;
     
-    return INT_VALUE(*c == 0);
+    args[0] = INT_VALUE(*c == 0);
+}
+
+void __popcount(VM* vm, Value* args)
+{
+    (void)vm;
+
+    args[0] = INT_VALUE(popcountInt(AS_INT(args[0])));
+}
+
+void __clz(VM* vm, Value* args)
+{
+    (void)vm;
+
+    args[0] = INT_VALUE(clzInt(AS_INT(args[0])));
+}
+
+void __ctz(VM* vm, Value* args)
+{
+    (void)vm;
+
+    args[0] = INT_VALUE(ctzInt(AS_INT(args[0])));
+}
+
+void __rotl(VM* vm, Value* args)
+{
+    (void)vm;
+
+    args[0] = INT_VALUE(rotlInt(AS_INT(args[0]), AS_INT(args[1])));
+}
+
+void __rotr(VM* vm, Value* args)
+{
+    (void)vm;
+
+    args[0] = INT_VALUE(rotrInt(AS_INT(args[0]), AS_INT(args[1])));
+}
+
+void __bswap(VM* vm, Value* args)
+{
+    (void)vm;
+
+    args[0] = INT_VALUE(bswapInt(AS_INT(args[0])));
+}
+
+// timer, readable and writable return futures for an async function to
+// await. A timer counts milliseconds and gives 0, or -1 when cancel stops
+// it first; the others give the descriptor once it is ready, or -1.
+
+void __timer(VM* vm, Value* args)
+{
+    args[0] = INT_VALUE(createTimer(&vm->loop, AS_INT(args[0])));
+}
+
+void __cancel(VM* vm, Value* args)
+{
+    args[0] = INT_VALUE(cancelFuture(&vm->loop, AS_INT(args[0])));
+}
+
+void __readable(VM* vm, Value* args)
+{
+    args[0] = INT_VALUE(watchDescriptor(&vm->loop, AS_INT(args[0]), false));
+}
+
+void __writable(VM* vm, Value* args)
+{
+    args[0] = INT_VALUE(watchDescriptor(&vm->loop, AS_INT(args[0]), true));
+}
+
+// TCP sockets on the loopback interface. None of them blocks: a script
+// awaits readable or writable first, and a call that would have to wait
+// returns -1 instead. An int is sent as four bytes in host order.
+
+static struct sockaddr_in getLoopbackAddress(int32_t port)
+{
+    struct sockaddr_in address = {0};
+
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    return address;
+}
+
+static int openSocket()
+{
+    return socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+}
+
+void __tcplisten(VM* vm, Value* args)
+{
+    (void)vm;
+
+    struct sockaddr_in address = getLoopbackAddress(AS_INT(args[0]));
+    int fd = openSocket();
+    int on = 1;
+
+    if (fd >= 0 && (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0
+        || bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0
+        || listen(fd, SOMAXCONN) < 0)) {
+        close(fd);
+        fd = -1;
+    }
+
+    args[0] = INT_VALUE(fd);
+}
+
+void __tcpaccept(VM* vm, Value* args)
+{
+    (void)vm;
+
+    int fd = accept(AS_INT(args[0]), NULL, NULL);
+
+    if (fd >= 0 && fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+        close(fd);
+        fd = -1;
+    }
+
+    args[0] = INT_VALUE(fd);
+}
+
+// The connection is usually still under way: the socket becomes writable
+// once it is made.
+void __tcpconnect(VM* vm, Value* args)
+{
+    (void)vm;
+
+    struct sockaddr_in address = getLoopbackAddress(AS_INT(args[0]));
+    int fd = openSocket();
+
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        fd = -1;
+    }
+
+    args[0] = INT_VALUE(fd);
+}
+
+void __tcpsend(VM* vm, Value* args)
+{
+    (void)vm;
+
+    int32_t n = AS_INT(args[1]);
+    ssize_t sent = send(AS_INT(args[0]), &n, sizeof(n), MSG_NOSIGNAL);
+
+    args[0] = INT_VALUE(sent == sizeof(n) ? 0 : -1);
+}
+
+void __tcprecv(VM* vm, Value* args)
+{
+    (void)vm;
+
+    int32_t n;
+    ssize_t received = recv(AS_INT(args[0]), &n, sizeof(n), 0);
+
+    args[0] = INT_VALUE(received == sizeof(n) ? n : -1);
+}
+
+void __closefd(VM* vm, Value* args)
+{
+    int fd = AS_INT(args[0]);
+
+    closeDescriptor(&vm->loop, fd);
+    args[0] = INT_VALUE(close(fd));
+}
+
+void __channew(VM* vm, Value* args)
+{
+    args[0] = INT_VALUE(createChannel(&vm->loop, AS_INT(args[0])));
+}
+
+void __chansend(VM* vm, Value* args)
+{
+    args[0] = INT_VALUE(sendChannel(&vm->loop, AS_INT(args[0]), args[1]));
+}
+
+void __chanrecv(VM* vm, Value* args)
+{
+    args[0] = INT_VALUE(receiveChannel(&vm->loop, AS_INT(args[0])));
+}
+
+void __chanclose(VM* vm, Value* args)
+{
+    args[0] = INT_VALUE(closeChannel(&vm->loop, AS_INT(args[0])) ? 0 : -1);
 }
@@ -1,10 +1,45 @@
 #include "object.h"
+#include "slab.h"
+#include <stdatomic.h>
+#include <stddef.h>
 #include <stdlib.h>
 
+// Objects of every type are counted as they are allocated, by whichever
+// thread allocates them.
+static atomic_size_t allocationCounts[OBJ_TYPE_COUNT];
+
+static const char* objectTypeNames[] = {
+    [OBJ_BOOL]     = "bool",
+    [OBJ_CODE]     = "code",
+    [OBJ_FLOAT]    = "float",
+    [OBJ_INT]      = "int",
+    [OBJ_FUNCTION] = "function",
+    [OBJ_MODULE]   = "module",
+    [OBJ_STRING]   = "string",
+};
+
 Object* allocateObject(size_t size, ObjectType type)
 {
-    Object* object = (Object*)malloc(size);
+    Object* object = allocateSlab(size);
     object->type = type;
+
+    atomic_fetch_add_explicit(&allocationCounts[type], 1, memory_order_relaxed);
     
     return object;
 }
+
+// size is that of the object's type, as with allocateObject.
+void freeObject(Object* object, size_t size)
+{
+    freeSlab(object, size);
+}
+
+size_t getAllocationCount(ObjectType type)
+{
+    return atomic_load_explicit(&allocationCounts[type], memory_order_relaxed);
+}
+
+const char* getObjectTypeName(ObjectType type)
+{
+    return objectTypeNames[type];
+}
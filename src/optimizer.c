@@ -0,0 +1,271 @@
+#include "optimizer.h"
+#include "bytecode.h"
+#include "codeobject.h"
+#include "functionobject.h"
+#include "opcode.h"
+#include "vector.h"
+#include "vm.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// The optimized tier rewrites a warm function's bytecode: a comparison
+// followed by jz becomes one conditional jump, and loading a local,
+// adding a small constant and storing it back becomes incl. A fused
+// sequence never spans a jump target. The old code is retired rather than
+// freed because suspended frames and traces may still point into it.
+
+typedef struct Branch
+{
+    size_t at;
+    size_t target;
+} Branch;
+
+typedef struct Rewriter
+{
+    CodeObject* code;
+    CodeObject output;
+    size_t* offsets;
+    bool* targets;
+    Branch* branches;
+    size_t branchCount;
+    bool changed;
+} Rewriter;
+
+static uint16_t getOperand16(uint8_t* ip)
+{
+    return (ip[1] << 8) | ip[2];
+}
+
+static bool isForwardBranch(uint8_t opcode)
+{
+    switch (opcode) {
+        case OP_BEQ: case OP_BLT: case OP_BLE: case OP_JMP: case OP_JZ:
+        case OP_JEQ: case OP_JNE: case OP_JLT: case OP_JLE: case OP_JGT: case OP_JGE:
+        case OP_NEXT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isBranch(uint8_t opcode)
+{
+    return isForwardBranch(opcode) || opcode == OP_LOOP;
+}
+
+static size_t getBranchTarget(uint8_t* code, size_t i)
+{
+    size_t next = i + getInstructionLength(code[i]);
+
+    if (code[i] == OP_LOOP) {
+        return next - getOperand16(code + i);
+    }
+
+    return next + getOperand16(code + i);
+}
+
+// Marks every branch target. Loops that already run as a trace have lost
+// their distance, so functions containing them are left alone.
+static bool findTargets(Rewriter* rw)
+{
+    uint8_t* code = rw->code->data;
+    size_t i = 0;
+
+    while (i < rw->code->count) {
+        if (code[i] == OP_TRACE) {
+            return false;
+        }
+
+        if (isBranch(code[i])) {
+            rw->targets[getBranchTarget(code, i)] = true;
+        }
+
+        i += getInstructionLength(code[i]);
+    }
+
+    return true;
+}
+
+static int getLocalIndex(uint8_t* ip, uint8_t first)
+{
+    return ip[0] == first ? (int8_t)ip[1] : ip[0] - first - 1;
+}
+
+static bool isLoadLocal(uint8_t opcode)
+{
+    return opcode >= OP_LDL && opcode <= OP_LDL_3;
+}
+
+static bool isStoreLocal(uint8_t opcode)
+{
+    return opcode >= OP_STL && opcode <= OP_STL_3;
+}
+
+static uint8_t getFusedJump(uint8_t opcode)
+{
+    switch (opcode) {
+        case OP_EQ:     return OP_JNE;
+        case OP_NE:     return OP_JEQ;
+        case OP_LT:     return OP_JGE;
+        case OP_LE:     return OP_JGT;
+        case OP_GT:     return OP_JLE;
+        default:        return OP_JLT;
+    }
+}
+
+static void emitBranch(Rewriter* rw, uint8_t opcode, size_t target, int length)
+{
+    rw->branches[rw->branchCount++] = (Branch){countCodeObject(&rw->output), target};
+    pushByte(&rw->output, opcode);
+
+    for (int i = 1; i < length; i++) {
+        pushByte(&rw->output, 0);
+    }
+}
+
+// lt; jz becomes jge: the fused jump is taken when the comparison fails.
+static size_t fuseCompare(Rewriter* rw, size_t i)
+{
+    uint8_t* code = rw->code->data;
+    size_t j = i + 1;
+
+    if (code[i] < OP_EQ || code[i] > OP_GE || j >= rw->code->count
+        || code[j] != OP_JZ || rw->targets[j]) {
+        return 0;
+    }
+
+    emitBranch(rw, getFusedJump(code[i]), getBranchTarget(code, j), 3);
+
+    return j + 3;
+}
+
+// ldl x; addi k; stl x becomes incl x, k, and subi k becomes incl x, -k.
+static size_t fuseIncrement(Rewriter* rw, size_t i)
+{
+    uint8_t* code = rw->code->data;
+    size_t j = i + getInstructionLength(code[i]);
+    size_t k = j + 2;
+
+    if (!isLoadLocal(code[i]) || k >= rw->code->count || rw->targets[j] || rw->targets[k]
+        || (code[j] != OP_ADDI && code[j] != OP_SUBI) || !isStoreLocal(code[k])) {
+        return 0;
+    }
+
+    int local = getLocalIndex(code + i, OP_LDL);
+    int step = code[j] == OP_ADDI ? (int8_t)code[j + 1] : -(int8_t)code[j + 1];
+
+    if (local != getLocalIndex(code + k, OP_STL) || step > INT8_MAX) {
+        return 0;
+    }
+
+    pushByte(&rw->output, OP_INCL);
+    pushByte(&rw->output, (uint8_t)local);
+    pushByte(&rw->output, (uint8_t)step);
+
+    return k + getInstructionLength(code[k]);
+}
+
+static void copyInstruction(Rewriter* rw, size_t i)
+{
+    uint8_t* code = rw->code->data;
+    int length = getInstructionLength(code[i]);
+
+    if (isBranch(code[i])) {
+        emitBranch(rw, code[i], getBranchTarget(code, i), length);
+
+        // A loop keeps its counter.
+        if (code[i] == OP_LOOP) {
+            setByteAt(&rw->output, rw->output.count - 2, code[i + 3]);
+            setByteAt(&rw->output, rw->output.count - 1, code[i + 4]);
+        }
+
+        return;
+    }
+
+    for (int n = 0; n < length; n++) {
+        pushByte(&rw->output, code[i + n]);
+    }
+}
+
+static void patchBranches(Rewriter* rw)
+{
+    uint8_t* code = rw->output.data;
+
+    for (size_t i = 0; i < rw->branchCount; i++) {
+        Branch* branch = &rw->branches[i];
+        size_t next = branch->at + getInstructionLength(code[branch->at]);
+        size_t target = rw->offsets[branch->target];
+        size_t distance = code[branch->at] == OP_LOOP ? next - target : target - next;
+
+        code[branch->at + 1] = (distance >> 8) & 0xFF;
+        code[branch->at + 2] = distance & 0xFF;
+    }
+}
+
+static void rewrite(Rewriter* rw)
+{
+    size_t i = 0;
+
+    while (i < rw->code->count) {
+        size_t next;
+
+        rw->offsets[i] = countCodeObject(&rw->output);
+
+        if ((next = fuseCompare(rw, i)) || (next = fuseIncrement(rw, i))) {
+            rw->changed = true;
+        } else {
+            copyInstruction(rw, i);
+            next = i + getInstructionLength(rw->code->data[i]);
+        }
+
+        i = next;
+    }
+
+    rw->offsets[rw->code->count] = countCodeObject(&rw->output);
+    patchBranches(rw);
+}
+
+// Returns whether the function may run as optimized bytecode, which it
+// does unchanged when there is nothing to fuse. When ip is given it must
+// point at a jump target in the current code; it is moved to the same
+// instruction in the new code so that a running frame can carry on there.
+bool optimizeFunction(VM* vm, FunctionObject* function, uint8_t** ip)
+{
+    CodeObject* code = &function->code;
+    Rewriter rw;
+
+    rw.code = code;
+    rw.offsets = malloc(sizeof(size_t) * (code->count + 1));
+    rw.targets = calloc(code->count + 1, sizeof(bool));
+    rw.branches = malloc(sizeof(Branch) * code->count);
+    rw.branchCount = 0;
+    rw.changed = false;
+    initCodeObject(&rw.output);
+
+    bool optimized = findTargets(&rw);
+
+    if (optimized) {
+        rewrite(&rw);
+    }
+
+    if (rw.changed) {
+        if (ip) {
+            *ip = rw.output.data + rw.offsets[*ip - code->data];
+        }
+
+        pushVectorItem(&vm->retiredCode, code->data);
+        code->data = rw.output.data;
+        code->capacity = rw.output.capacity;
+        code->count = rw.output.count;
+    } else {
+        freeCodeObject(&rw.output);
+    }
+
+    free(rw.offsets);
+    free(rw.targets);
+    free(rw.branches);
+
+    return optimized;
+}
@@ -2,7 +2,9 @@
 #include "program.h"
 #include "string.h"
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 static void printUnknownOption(char* arg)
 {
@@ -10,6 +12,52 @@ static void printUnknownOption(char* arg)
     printUsage();
 }
 
+static void parseBackend(Options* options, char* arg)
+{
+    if (strcmp(arg, "stack") == 0) {
+        options->backend = BACKEND_STACK;
+    } else if (strcmp(arg, "register") == 0) {
+        options->backend = BACKEND_REGISTER;
+    } else {
+        printUnknownOption(arg);
+    }
+}
+
+static void parseJit(Options* options, char* arg)
+{
+    if (strcmp(arg, "off") == 0) {
+        options->jit = JIT_OFF;
+    } else if (strcmp(arg, "baseline") == 0) {
+        options->jit = JIT_BASELINE;
+    } else if (strcmp(arg, "trace") == 0) {
+        options->jit = JIT_TRACE;
+    } else {
+        printUnknownOption(arg);
+    }
+}
+
+static void parseNumber(uint32_t* number, char* arg)
+{
+    char* end;
+    unsigned long n = strtoul(arg, &end, 10);
+
+    if (*arg == '\0' || *end != '\0' || n > UINT32_MAX) {
+        printUnknownOption(arg);
+    }
+
+    *number = n;
+}
+
+static void parseLibrary(Options* options, char* arg)
+{
+    if (options->libraryCount == OPTIONS_LIBRARIES_MAX) {
+        fprintf(stderr, "Too many libraries: %s\n", arg);
+        printUsage();
+    }
+
+    options->libraries[options->libraryCount++] = arg;
+}
+
 static void parseOption(Options* options, char* arg)
 {
     if (strcmp(arg, "--version") == 0) {
@@ -18,6 +66,32 @@ static void parseOption(Options* options, char* arg)
     
     if (strcmp(arg, "-d") == 0) {
         options->disassemble = true;
+    } else if (strcmp(arg, "-s") == 0) {
+        options->statistics = true;
+    } else if (strcmp(arg, "-p") == 0) {
+        options->profile = true;
+    } else if (strcmp(arg, "--counters") == 0) {
+        options->counters = true;
+    } else if (strncmp(arg, "--backend=", 10) == 0) {
+        parseBackend(options, arg + 10);
+    } else if (strncmp(arg, "--jit=", 6) == 0) {
+        parseJit(options, arg + 6);
+    } else if (strncmp(arg, "--tier-optimize=", 16) == 0) {
+        parseNumber(&options->policy.optimizeThreshold, arg + 16);
+    } else if (strncmp(arg, "--tier-native=", 14) == 0) {
+        parseNumber(&options->policy.nativeThreshold, arg + 14);
+    } else if (strncmp(arg, "--tier-trace=", 13) == 0) {
+        parseNumber(&options->policy.traceThreshold, arg + 13);
+    } else if (strncmp(arg, "--isolates=", 11) == 0) {
+        parseNumber(&options->isolates, arg + 11);
+    } else if (strncmp(arg, "--jobs=", 7) == 0) {
+        parseNumber(&options->jobs, arg + 7);
+    } else if (strncmp(arg, "--workers=", 10) == 0) {
+        parseNumber(&options->workers, arg + 10);
+    } else if (strncmp(arg, "--pause-target=", 15) == 0) {
+        parseNumber(&options->pauseTarget, arg + 15);
+    } else if (strncmp(arg, "--library=", 10) == 0) {
+        parseLibrary(options, arg + 10);
     } else {
         printUnknownOption(arg);
     }
@@ -25,6 +99,20 @@ static void parseOption(Options* options, char* arg)
 
 void initOptions(Options* options, int argc, char* argv[])
 {
+    options->disassemble = false;
+    options->statistics = false;
+    options->profile = false;
+    options->counters = false;
+    options->backend = BACKEND_STACK;
+    options->jit = JIT_OFF;
+    options->libraryCount = 0;
+    options->isolates = 0;
+    options->jobs = 0;
+    options->workers = 0;
+    options->pauseTarget = 0;
+    options->filename = NULL;
+    initTierPolicy(&options->policy);
+
     for (int i = 1; i < argc; i++) {
         if (argv[i][0] == '-') {
             parseOption(options, argv[i]);
@@ -32,4 +120,8 @@ void initOptions(Options* options, int argc, char* argv[])
             options->filename = argv[i];
         }
     }
+
+    if (options->isolates && !options->jobs) {
+        options->jobs = options->isolates;
+    }
 }
@@ -1,6 +1,9 @@
 #include "parser.h"
 #include "ast.h"
+#include "arena.h"
 #include "conversion.h"
+#include "ffi.h"
+#include "intern.h"
 #include "lexer.h"
 #include "scope.h"
 #include "service.h"
@@ -8,33 +11,34 @@
 #include "token.h"
 #include "vector.h"
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-static AST* expression();
-static AST* identifier();
-static AST* prefix();
-static bool blocklevelStatements(Vector* nodes);
-
-typedef struct Parser
-{
-    Token currentToken;
-    Token prevToken;
-    Scope* currentScope;
-    AST* topLevel;
-} Parser;
-
-static Parser parser;
+static AST* expression(Parser* parser);
+static AST* identifier(Parser* parser);
+static AST* prefix(Parser* parser);
+static bool blocklevelStatements(Parser* parser, Vector* nodes);
 
+static const char* awaitError = "Error: %.*s outside async function";
+static const char* generatorCallError = "Error: Generator %.*s called outside for";
+static const char* generatorError = "Error: %.*s is not a generator";
 static const char* invalidArgsError = "Error: Invalid arguments to function %.*s";
+static const char* invalidConversionError = "Error: Invalid conversion to %.*s";
+static const char* invalidOperandError = "Error: Invalid operand to %.*s";
 static const char* invalidOperandsError = "Error: Invalid operands to binary %.*s";
+static const char* invalidReturnError = "Error: Invalid type for %.*s value";
 static const char* invalidTypeError = "Error: Invalid type for variable %.*s";
+static const char* iterationError = "Error: %.*s inside for";
 static const char* redefinitionError = "Error: Redefinition of %.*s";
+static const char* unresolvedError = "Error: Unresolved symbol %.*s";
+static const char* unsupportedExternError = "Error: Unsupported signature for extern %.*s";
 static const char* unsupportedOperatorError = "Error: Unsupported operator %.*s";
 static const char* undefinedError = "Error: %.*s is undefined";
 static const char* unexpectedEndError = "Error: Unexpected end of input";
 static const char* unexpectedTokenError = "Error: Unexpected %.*s";
 static const char* uninitializedError = "Error: %.*s is uninitialized";
+static const char* yieldError = "Error: %.*s inside async function";
 
 static void error(const char* message, Token token)
 {
@@ -43,113 +47,270 @@ static void error(const char* message, Token token)
     exit(1);
 }
 
-static void advance()
+static void advance(Parser* parser)
 {
-    parser.prevToken = parser.currentToken;
-    parser.currentToken = scanToken();
+    parser->prevToken = parser->currentToken;
+    parser->currentToken = scanToken(&parser->lexer);
 }
 
-static void consume(TokenType type)
+static void consume(Parser* parser, TokenType type)
 {
-    if (parser.currentToken.type != type) {
-        error(unexpectedTokenError, parser.currentToken);
+    if (parser->currentToken.type != type) {
+        error(unexpectedTokenError, parser->currentToken);
     }
     
-    advance();
+    advance(parser);
 }
 
-static void consumeType()
+static void consumeType(Parser* parser)
 {
-    if (!isTypeToken(parser.currentToken.type)) {
-        error(unexpectedTokenError, parser.currentToken);
+    if (!isTypeToken(parser->currentToken.type)) {
+        error(unexpectedTokenError, parser->currentToken);
     }
 
-    consume(parser.currentToken.type);
+    consume(parser, parser->currentToken.type);
 }
 
-static bool isEof()
+static bool isEof(Parser* parser)
 {
-    return parser.currentToken.type == T_EOF;
+    return parser->currentToken.type == T_EOF;
 }
 
-static AST* integerLiteral(Token token)
+static AST* integerLiteral(Parser* parser, Token token)
 {
-    AST* ast = createAST(AST_INTEGER);
+    AST* ast = createAST(&parser->arena, AST_INTEGER);
     ast->intValue = integerLiteralToValue(token.chars, token.length);
-    consume(token.type);
+    consume(parser, token.type);
 
     return ast;
 }
 
-static AST* binaryLiteral(Token token)
+static AST* binaryLiteral(Parser* parser, Token token)
 {
-    AST* ast = createAST(AST_INTEGER);
+    AST* ast = createAST(&parser->arena, AST_INTEGER);
     ast->intValue = binaryLiteralToValue(token.chars, token.length);
-    consume(token.type);
+    consume(parser, token.type);
 
     return ast;
 }
 
-static AST* hexadecimalLiteral(Token token)
+static AST* hexadecimalLiteral(Parser* parser, Token token)
 {
-    AST* ast = createAST(AST_INTEGER);
+    AST* ast = createAST(&parser->arena, AST_INTEGER);
     ast->intValue = hexadecimalLiteralToValue(token.chars, token.length);
-    consume(token.type);
+    consume(parser, token.type);
 
     return ast;
 }
 
-static AST* octalLiteral(Token token)
+static AST* octalLiteral(Parser* parser, Token token)
 {
-    AST* ast = createAST(AST_INTEGER);
+    AST* ast = createAST(&parser->arena, AST_INTEGER);
     ast->intValue = octalLiteralToValue(token.chars, token.length);
-    consume(token.type);
+    consume(parser, token.type);
 
     return ast;
 }
 
-static AST* groupExpression()
+static AST* floatLiteral(Parser* parser, Token token)
 {
-    consume(T_LPAREN);
-    AST* ast = expression();
+    AST* ast = createAST(&parser->arena, AST_FLOAT);
+    ast->floatValue = floatLiteralToValue(token.chars, token.length);
+    consume(parser, token.type);
 
-    if (!ast && parser.currentToken.type == T_RPAREN) {
-        error(unexpectedTokenError, parser.currentToken);
+    return ast;
+}
+
+static AST* groupExpression(Parser* parser)
+{
+    consume(parser, T_LPAREN);
+    AST* ast = expression(parser);
+
+    if (!ast && parser->currentToken.type == T_RPAREN) {
+        error(unexpectedTokenError, parser->currentToken);
     }
     
-    if (!ast || isEof()) {
-        freeAST(ast);
+    if (!ast || isEof(parser)) {
         return NULL;
     }
 
-    consume(T_RPAREN);
+    consume(parser, T_RPAREN);
+
+    return ast;
+}
+
+static bool isFloatType(int typeId)
+{
+    NumberKind kind = getNumberKind(typeId);
+
+    return kind == NUMBER_F32 || kind == NUMBER_F64;
+}
+
+static bool isSignedType(int typeId)
+{
+    NumberKind kind = getNumberKind(typeId);
+
+    return kind <= NUMBER_I64 || isFloatType(typeId);
+}
+
+static int getTypeWidth(int typeId)
+{
+    switch (getNumberKind(typeId)) {
+        case NUMBER_I8:
+        case NUMBER_U8:     return 8;
+        case NUMBER_I16:
+        case NUMBER_U16:    return 16;
+        case NUMBER_I64:
+        case NUMBER_U64:
+        case NUMBER_F64:    return 64;
+        default:            return 32;
+    }
+}
+
+// Conversions that lose nothing happen without being asked for: to an
+// integer at least as wide and of the same signedness, from unsigned to a
+// wider signed integer and from float to double.
+static bool isImplicitConversion(int from, int to)
+{
+    int a = getTypeWidth(from);
+    int b = getTypeWidth(to);
+
+    if (isFloatType(from) || isFloatType(to)) {
+        return isFloatType(from) && isFloatType(to) && a <= b;
+    }
+
+    if (isSignedType(from) == isSignedType(to)) {
+        return a <= b;
+    }
+
+    return isSignedType(to) && a < b;
+}
+
+// Whether value is one of the integer type's values. Literals have at most
+// 64 bits, so every one of them fits a signed 64-bit type.
+static bool isInRange(int64_t value, int typeId)
+{
+    int width = getTypeWidth(typeId);
+
+    if (isSignedType(typeId)) {
+        return width == 64 || (value >= -(INT64_C(1) << (width - 1)) && value < INT64_C(1) << (width - 1));
+    }
+
+    return value >= 0 && (width == 64 || value < INT64_C(1) << width);
+}
+
+// A literal takes whatever type its context asks for, as long as its value
+// is one of that type's, except that a float literal stays floating-point.
+static bool isConvertible(AST* expr, int from, int to)
+{
+    if (expr->type == AST_INTEGER) {
+        return to == T_BOOL || (isTypeToken(to) && (isFloatType(to) || isInRange(expr->intValue, to)));
+    }
+
+    if (expr->type == AST_FLOAT) {
+        return isFloatType(to);
+    }
+
+    return isImplicitConversion(from, to);
+}
+
+// Returns expr as a value of the given type, or fails with message if it
+// cannot become one implicitly.
+static AST* convert(Parser* parser, AST* expr, int typeId, const char* message, Token token)
+{
+    int from = getTypeId(expr);
+
+    if (from == typeId) {
+        return expr;
+    }
+
+    if (from == T_NONE || !isConvertible(expr, from, typeId)) {
+        error(message, token);
+    }
+
+    AST* ast = createAST(&parser->arena, AST_CONVERSION);
+    ast->conversion.expr = expr;
+    ast->conversion.typeId = typeId;
 
     return ast;
 }
 
-static AST* binary(AST* leftExpr, AST* rightExpr, Token token)
+// The type both operands of a binary operator are converted to.
+static int getOperandType(AST* leftExpr, AST* rightExpr, Token token)
+{
+    int a = getTypeId(leftExpr);
+    int b = getTypeId(rightExpr);
+
+    if (a == b || (isLiteral(rightExpr) && !isLiteral(leftExpr))) {
+        return a;
+    }
+
+    if (isLiteral(leftExpr) && !isLiteral(rightExpr)) {
+        return b;
+    }
+
+    if (isLiteral(leftExpr)) {
+        return leftExpr->type == AST_FLOAT || rightExpr->type == AST_FLOAT ? T_DOUBLE : T_INT64;
+    }
+
+    if (isImplicitConversion(b, a)) {
+        return a;
+    }
+
+    if (!isImplicitConversion(a, b)) {
+        error(invalidOperandsError, token);
+    }
+
+    return b;
+}
+
+// Floating-point types have no bitwise or integer-only operators, and
+// exponentiation exists only for signed ints up to 32 bits.
+static bool isSupportedOperator(TokenType type, int typeId)
+{
+    switch (type) {
+        case T_POWER:
+            return isSignedType(typeId) && getTypeWidth(typeId) <= 32 && !isFloatType(typeId);
+        case T_FLOOR:
+        case T_PERCENT:
+        case T_AMPERSAND:
+        case T_PIPE:
+        case T_CIRCUMFLEX:
+        case T_LSHIFT:
+        case T_RSHIFT:
+        case T_TILDE:
+            return !isFloatType(typeId);
+        case T_EXCLAMATION:
+            return getTypeWidth(typeId) <= 32 && !isFloatType(typeId);
+        default:
+            return true;
+    }
+}
+
+static AST* binary(Parser* parser, AST* leftExpr, AST* rightExpr, Token token)
 {
     if (!rightExpr) {
         return NULL;
     }
 
-    if (isComparisonToken(token.type) ||
-        isEqualityToken(token.type) ||
+    if (token.type == T_SPACESHIP ||
         token.type == T_BOOLEAN_AND ||
         token.type == T_BOOLEAN_OR) {
         error(unsupportedOperatorError, token);
     }
 
-    int a = getTypeId(leftExpr);
-    int b = getTypeId(rightExpr);
+    int operandType = getOperandType(leftExpr, rightExpr, token);
 
-    if (a != b) {
-        error(invalidOperandsError, token);
+    if (!isSupportedOperator(token.type, operandType)) {
+        error(unsupportedOperatorError, token);
     }
 
-    int typeId = isBoolOperatorToken(token.type) ? T_BOOL : a;
+    leftExpr = convert(parser, leftExpr, operandType, invalidOperandsError, token);
+    rightExpr = convert(parser, rightExpr, operandType, invalidOperandsError, token);
+
+    int typeId = isBoolOperatorToken(token.type) ? T_BOOL : operandType;
     
-    AST* ast = createAST(AST_BINARY);
+    AST* ast = createAST(&parser->arena, AST_BINARY);
     ast->binary.leftExpr = leftExpr;
     ast->binary.operator = token;
     ast->binary.rightExpr = rightExpr;
@@ -158,18 +319,16 @@ static AST* binary(AST* leftExpr, AST* rightExpr, Token token)
     return ast;
 }
 
-static AST* variable()
+static AST* variable(Parser* parser)
 {
-    Token token = parser.prevToken;
-    StringObject* id = copyStringObject(token.chars, token.length);
-    AST* symbol = getLocalSymbol(parser.currentScope, id);
+    Token token = parser->prevToken;
+    StringObject* id = internString(token.chars, token.length);
+    AST* symbol = getLocalSymbol(parser->currentScope, id);
 
     if (!symbol) {
-        symbol = getLocalSymbol(parser.topLevel->compound.scope, id);
+        symbol = getLocalSymbol(parser->topLevel->compound.scope, id);
     }
 
-    freeStringObject(id);
-
     if (!symbol || !isVariableType(symbol)) {
         error(undefinedError, token);
     }
@@ -178,74 +337,141 @@ static AST* variable()
         error(uninitializedError, token);
     }
 
-    AST* ast = createAST(AST_VARIABLE);
-    ast->variable.scope = parser.currentScope;
+    AST* ast = createAST(&parser->arena, AST_VARIABLE);
+    ast->variable.scope = parser->currentScope;
     ast->variable.symbol = symbol;
 
     return ast;
 }
 
-static AST* parameter()
+static AST* parameter(Parser* parser)
 {
-    if (isEof()) {
+    if (isEof(parser)) {
         return NULL;
     }
     
-    Token token = parser.currentToken;
-    StringObject* id = copyStringObject(token.chars, token.length);
-    AST* symbol = getLocalSymbol(parser.currentScope, id);
+    Token token = parser->currentToken;
+    StringObject* id = internString(token.chars, token.length);
+    AST* symbol = getLocalSymbol(parser->currentScope, id);
 
     if (symbol) {
         error(redefinitionError, token);
     }
     
-    consume(T_IDENTIFIER);
+    consume(parser, T_IDENTIFIER);
 
-    AST* ast = createAST(AST_PARAMETER);
-    ast->parameter.scope = parser.currentScope;
+    AST* ast = createAST(&parser->arena, AST_PARAMETER);
+    ast->parameter.scope = parser->currentScope;
     ast->parameter.id = id;
     ast->parameter.typeId = T_INT;
 
-    if (isTypeToken(parser.currentToken.type)) {
-        ast->parameter.typeId = parser.currentToken.type;
-        consumeType();
+    if (isTypeToken(parser->currentToken.type)) {
+        ast->parameter.typeId = parser->currentToken.type;
+        consumeType(parser);
+    }
+
+    setLocalSymbol(parser->currentScope, id, ast);
+
+    return ast;
+}
+
+// int64(x) converts x to int64, whatever numeric type it has.
+static AST* conversion(Parser* parser)
+{
+    Token token = parser->currentToken;
+    consumeType(parser);
+
+    if (isEof(parser)) {
+        return NULL;
+    }
+
+    AST* expr = groupExpression(parser);
+
+    if (!expr) {
+        return NULL;
+    }
+
+    if (getTypeId(expr) == T_NONE) {
+        error(invalidConversionError, token);
+    }
+
+    AST* ast = createAST(&parser->arena, AST_CONVERSION);
+    ast->conversion.expr = expr;
+    ast->conversion.typeId = token.type;
+
+    return ast;
+}
+
+// await takes the int an async call or a service like timer returns and
+// suspends the function until the future it names is done. A for cannot
+// be suspended with its generator, so there is no await inside one.
+static AST* awaitExpression(Parser* parser)
+{
+    Token token = parser->currentToken;
+    consume(parser, T_AWAIT);
+
+    if (!parser->currentFunction || !parser->currentFunction->functionDefinition.async) {
+        error(awaitError, token);
+    }
+
+    if (parser->forDepth > 0) {
+        error(iterationError, token);
     }
 
-    setLocalSymbol(parser.currentScope, id, ast);
+    AST* expr = prefix(parser);
+
+    if (!expr) {
+        return NULL;
+    }
+
+    if (getNumberKind(getTypeId(expr)) != NUMBER_I32) {
+        error(invalidOperandError, token);
+    }
+
+    AST* ast = createAST(&parser->arena, AST_AWAIT);
+    ast->expression = expr;
 
     return ast;
 }
 
-static AST* primary()
+static AST* primary(Parser* parser)
 {
-    switch (parser.currentToken.type) {
+    if (isTypeToken(parser->currentToken.type)) {
+        return conversion(parser);
+    }
+
+    switch (parser->currentToken.type) {
         case T_INTEGER_LITERAL:
-            return integerLiteral(parser.currentToken);
+            return integerLiteral(parser, parser->currentToken);
         case T_BINARY_LITERAL:
-            return binaryLiteral(parser.currentToken);
+            return binaryLiteral(parser, parser->currentToken);
         case T_HEXADECIMAL_LITERAL:
-            return hexadecimalLiteral(parser.currentToken);
+            return hexadecimalLiteral(parser, parser->currentToken);
         case T_OCTAL_LITERAL:
-            return octalLiteral(parser.currentToken);
+            return octalLiteral(parser, parser->currentToken);
+        case T_FLOAT_LITERAL:
+            return floatLiteral(parser, parser->currentToken);
         case T_LPAREN:
-            return groupExpression();
+            return groupExpression(parser);
+        case T_AWAIT:
+            return awaitExpression(parser);
         case T_IDENTIFIER:
-            return identifier();
+            return identifier(parser);
         case T_EOF:
             return NULL;
         default:
-            error(unexpectedTokenError, parser.currentToken);
+            error(unexpectedTokenError, parser->currentToken);
     }
 }
 
-static AST* prefixOperand()
+static AST* prefixOperand(Parser* parser)
 {
-    if (isPrefixToken(parser.currentToken.type)) {
-        return prefix();
+    if (isPrefixToken(parser->currentToken.type)) {
+        return prefix(parser);
     }
 
-    Token token = parser.currentToken;
-    AST* expr = primary();
+    Token token = parser->currentToken;
+    AST* expr = primary(parser);
     
     if (!expr) {
         return NULL;
@@ -258,206 +484,225 @@ static AST* prefixOperand()
     return expr;
 }
 
-static AST* prefix()
+static AST* prefix(Parser* parser)
 {
-    if (!isPrefixToken(parser.currentToken.type)) {
-        return primary();
+    if (!isPrefixToken(parser->currentToken.type)) {
+        return primary(parser);
     }
 
-    Token token = parser.currentToken;
-    consume(token.type);
-    AST* expr = prefixOperand();
+    Token token = parser->currentToken;
+    consume(parser, token.type);
+    AST* expr = prefixOperand(parser);
     
     if (!expr) {
         return NULL;
     }
 
-    AST* ast = createAST(AST_PREFIX);
+    if (!isSupportedOperator(token.type, getTypeId(expr))) {
+        error(unsupportedOperatorError, token);
+    }
+
+    // A negative literal is a literal, so that it can still take the type
+    // its context asks for.
+    if (token.type == T_MINUS && expr->type == AST_INTEGER) {
+        expr->intValue = -expr->intValue;
+        return expr;
+    }
+
+    if (token.type == T_MINUS && expr->type == AST_FLOAT) {
+        expr->floatValue = -expr->floatValue;
+        return expr;
+    }
+
+    AST* ast = createAST(&parser->arena, AST_PREFIX);
     ast->prefix.expr = expr;
     ast->prefix.operator = token;
 
     return ast;
 }
 
-static AST* exponent()
+static AST* exponent(Parser* parser)
 {
-    AST* expr = prefix();
-    Token token = parser.currentToken;
+    AST* expr = prefix(parser);
+    Token token = parser->currentToken;
 
     while (token.type == T_POWER) {
-        consume(token.type);
-        expr = binary(expr, prefix(), token);
-        token = parser.currentToken;
+        consume(parser, token.type);
+        expr = binary(parser, expr, prefix(parser), token);
+        token = parser->currentToken;
     }
 
     return expr;
 }
 
-static AST* factor()
+static AST* factor(Parser* parser)
 {
-    AST* expr = exponent();
-    Token token = parser.currentToken;
+    AST* expr = exponent(parser);
+    Token token = parser->currentToken;
 
     while (isFactorToken(token.type)) {
-        consume(token.type);
-        expr = binary(expr, exponent(), token);
-        token = parser.currentToken;
+        consume(parser, token.type);
+        expr = binary(parser, expr, exponent(parser), token);
+        token = parser->currentToken;
     }
 
     return expr;
 }
 
-static AST* term()
+static AST* term(Parser* parser)
 {
-    AST* expr = factor();
-    Token token = parser.currentToken;
+    AST* expr = factor(parser);
+    Token token = parser->currentToken;
 
     while (isTermToken(token.type)) {
-        consume(token.type);
-        expr = binary(expr, factor(), token);
-        token = parser.currentToken;
+        consume(parser, token.type);
+        expr = binary(parser, expr, factor(parser), token);
+        token = parser->currentToken;
     }
 
     return expr;
 }
 
-static AST* shift()
+static AST* shift(Parser* parser)
 {
-    AST* expr = term();
-    Token token = parser.currentToken;
+    AST* expr = term(parser);
+    Token token = parser->currentToken;
 
     while (isShiftToken(token.type)) {
-        consume(token.type);
-        expr = binary(expr, term(), token);
-        token = parser.currentToken;
+        consume(parser, token.type);
+        expr = binary(parser, expr, term(parser), token);
+        token = parser->currentToken;
     }
 
     return expr;
 }
 
-static AST* comparison()
+static AST* comparison(Parser* parser)
 {
-    AST* expr = shift();
-    Token token = parser.currentToken;
+    AST* expr = shift(parser);
+    Token token = parser->currentToken;
 
     while (isComparisonToken(token.type)) {
-        consume(token.type);
-        expr = binary(expr, shift(), token);
-        token = parser.currentToken;
+        consume(parser, token.type);
+        expr = binary(parser, expr, shift(parser), token);
+        token = parser->currentToken;
     }
 
     return expr;
 }
 
-static AST* equality()
+static AST* equality(Parser* parser)
 {
-    AST* expr = comparison();
-    Token token = parser.currentToken;
+    AST* expr = comparison(parser);
+    Token token = parser->currentToken;
 
     while (isEqualityToken(token.type)) {
-        consume(token.type);
-        expr = binary(expr, comparison(), token);
-        token = parser.currentToken;
+        consume(parser, token.type);
+        expr = binary(parser, expr, comparison(parser), token);
+        token = parser->currentToken;
     }
 
     return expr;
 }
 
-static AST* bitwiseAND()
+static AST* bitwiseAND(Parser* parser)
 {
-    AST* expr = equality();
-    Token token = parser.currentToken;
+    AST* expr = equality(parser);
+    Token token = parser->currentToken;
 
     while (token.type == T_AMPERSAND) {
-        consume(token.type);
-        expr = binary(expr, equality(), token);
-        token = parser.currentToken;
+        consume(parser, token.type);
+        expr = binary(parser, expr, equality(parser), token);
+        token = parser->currentToken;
     }
 
     return expr;
 }
 
-static AST* bitwiseXOR()
+static AST* bitwiseXOR(Parser* parser)
 {
-    AST* expr = bitwiseAND();
-    Token token = parser.currentToken;
+    AST* expr = bitwiseAND(parser);
+    Token token = parser->currentToken;
 
     while (token.type == T_CIRCUMFLEX) {
-        consume(token.type);
-        expr = binary(expr, bitwiseAND(), token);
-        token = parser.currentToken;
+        consume(parser, token.type);
+        expr = binary(parser, expr, bitwiseAND(parser), token);
+        token = parser->currentToken;
     }
 
     return expr;
 }
 
-static AST* bitwiseOR()
+static AST* bitwiseOR(Parser* parser)
 {
-    AST* expr = bitwiseXOR();
-    Token token = parser.currentToken;
+    AST* expr = bitwiseXOR(parser);
+    Token token = parser->currentToken;
 
     while (token.type == T_PIPE) {
-        consume(token.type);
-        expr = binary(expr, bitwiseXOR(), token);
-        token = parser.currentToken;
+        consume(parser, token.type);
+        expr = binary(parser, expr, bitwiseXOR(parser), token);
+        token = parser->currentToken;
     }
 
     return expr;
 }
 
-static AST* booleanAND()
+static AST* booleanAND(Parser* parser)
 {
-    AST* expr = bitwiseOR();
-    Token token = parser.currentToken;
+    AST* expr = bitwiseOR(parser);
+    Token token = parser->currentToken;
 
     while (token.type == T_BOOLEAN_AND) {
-        consume(token.type);
-        expr = binary(expr, bitwiseOR(), token);
-        token = parser.currentToken;
+        consume(parser, token.type);
+        expr = binary(parser, expr, bitwiseOR(parser), token);
+        token = parser->currentToken;
     }
 
     return expr;
 }
 
-static AST* booleanOR()
+static AST* booleanOR(Parser* parser)
 {
-    AST* expr = booleanAND();
-    Token token = parser.currentToken;
+    AST* expr = booleanAND(parser);
+    Token token = parser->currentToken;
 
     while (token.type == T_BOOLEAN_OR) {
-        consume(token.type);
-        expr = binary(expr, booleanAND(), token);
-        token = parser.currentToken;
+        consume(parser, token.type);
+        expr = binary(parser, expr, booleanAND(parser), token);
+        token = parser->currentToken;
     }
 
     return expr;
 }
 
-static AST* expression()
+static AST* expression(Parser* parser)
 {
-    return booleanOR();
+    return booleanOR(parser);
 }
 
-static AST* returnStatement()
+static AST* returnStatement(Parser* parser)
 {
-    if (parser.currentScope->level < 2) {
-        error(unexpectedTokenError, parser.currentToken);
+    if (parser->currentScope->level < 2) {
+        error(unexpectedTokenError, parser->currentToken);
     }
 
-    consume(T_RETURN);
-    AST* expr = expression();
+    Token token = parser->currentToken;
+    consume(parser, T_RETURN);
+    AST* expr = expression(parser);
 
     if (!expr) {
         return NULL;
     }
 
-    AST* ast = createAST(AST_RETURN);
-    ast->expression = expr;
+    int typeId = parser->currentFunction->functionDefinition.typeId;
+
+    AST* ast = createAST(&parser->arena, AST_RETURN);
+    ast->expression = convert(parser, expr, typeId, invalidReturnError, token);
 
     return ast;
 }
 
-static void compareFunctionSignature(AST* caller, AST* callee, Token token)
+static void compareFunctionSignature(Parser* parser, AST* caller, AST* callee, Token token)
 {
     size_t argCount = countVector(&caller->functionCall.args);
     size_t paramCount = countVector(&callee->functionDefinition.params);
@@ -469,15 +714,12 @@ static void compareFunctionSignature(AST* caller, AST* callee, Token token)
     for (int i = 0; i < argCount; i++) {
         AST* a = getVectorAt(&caller->functionCall.args, i);
         AST* b = getVectorAt(&callee->functionDefinition.params, i);
-        int typeId = getTypeId(a);
 
-        if (typeId != b->parameter.typeId) {
-            error(invalidArgsError, token);
-        }
+        caller->functionCall.args.data[i] = convert(parser, a, b->parameter.typeId, invalidArgsError, token);
     }
 }
 
-static void compareServiceSignature(AST* caller, Service* service, Token token)
+static void compareServiceSignature(Parser* parser, AST* caller, Service* service, Token token)
 {
     size_t argCount = countVector(&caller->serviceRequest.args);
 
@@ -487,27 +729,24 @@ static void compareServiceSignature(AST* caller, Service* service, Token token)
 
     for (int i = 0; i < argCount; i++) {
         AST* expr = getVectorAt(&caller->serviceRequest.args, i);
-        int typeId = getTypeId(expr);
 
-        if (typeId != service->params[i]) {
-            error(invalidArgsError, token);
-        }
+        caller->serviceRequest.args.data[i] = convert(parser, expr, service->params[i], invalidArgsError, token);
     }
 }
 
-static bool arguments(Vector* args)
+static bool arguments(Parser* parser, Vector* args)
 {
-    consume(T_LPAREN);
+    consume(parser, T_LPAREN);
 
-    if (isEof()) {
+    if (isEof(parser)) {
         return false;
     }
 
-    while (parser.currentToken.type != T_RPAREN) {
-        AST* expr = expression();
+    while (parser->currentToken.type != T_RPAREN) {
+        AST* expr = expression(parser);
 
-        if (!expr && (parser.currentToken.type == T_COMMA || parser.currentToken.type == T_RPAREN)) {
-            error(unexpectedTokenError, parser.currentToken);
+        if (!expr && (parser->currentToken.type == T_COMMA || parser->currentToken.type == T_RPAREN)) {
+            error(unexpectedTokenError, parser->currentToken);
         }
 
         if (!expr) {
@@ -516,33 +755,33 @@ static bool arguments(Vector* args)
 
         pushVectorItem(args, expr);
 
-        if (parser.currentToken.type == T_COMMA) {
-            consume(T_COMMA);
+        if (parser->currentToken.type == T_COMMA) {
+            consume(parser, T_COMMA);
         }
     }
 
-    if (isEof()) {
+    if (isEof(parser)) {
         return false;
     }
 
-    consume(T_RPAREN);
+    consume(parser, T_RPAREN);
 
     return true;
 }
 
-static bool parameters(Vector* params)
+static bool parameters(Parser* parser, Vector* params)
 {
-    consume(T_LPAREN);
+    consume(parser, T_LPAREN);
 
-    if (isEof()) {
+    if (isEof(parser)) {
         return false;
     }
 
-    while (parser.currentToken.type != T_RPAREN) {
-        AST* expr = parameter();
+    while (parser->currentToken.type != T_RPAREN) {
+        AST* expr = parameter(parser);
 
-        if (!expr && (parser.currentToken.type == T_COMMA || parser.currentToken.type == T_RPAREN)) {
-            error(unexpectedTokenError, parser.currentToken);
+        if (!expr && (parser->currentToken.type == T_COMMA || parser->currentToken.type == T_RPAREN)) {
+            error(unexpectedTokenError, parser->currentToken);
         }
 
         if (!expr) {
@@ -551,16 +790,16 @@ static bool parameters(Vector* params)
 
         pushVectorItem(params, expr);
 
-        if (parser.currentToken.type == T_COMMA) {
-            consume(T_COMMA);
+        if (parser->currentToken.type == T_COMMA) {
+            consume(parser, T_COMMA);
         }
     }
 
-    if (isEof()) {
+    if (isEof(parser)) {
         return false;
     }
     
-    consume(T_RPAREN);
+    consume(parser, T_RPAREN);
 
     size_t count = countVector(params);
 
@@ -572,314 +811,614 @@ static bool parameters(Vector* params)
     return true;
 }
 
-static AST* serviceRequest(Token token)
+static AST* serviceRequest(Parser* parser, Token token)
 {
-    StringObject* id = copyStringObject(token.chars, token.length);
-    Service* service = getServiceByName(id->chars);
+    StringObject* id = internString(token.chars, token.length);
+    Service* service = getServiceByName(id);
 
     if (!service) {
         error(undefinedError, token);
     }
 
-    freeStringObject(id);
-
-    AST* ast = createAST(AST_SERVICE_REQUEST);
+    AST* ast = createAST(&parser->arena, AST_SERVICE_REQUEST);
     ast->serviceRequest.opcode = service->opcode;
     ast->serviceRequest.service = service;
 
-    if (!arguments(&ast->serviceRequest.args)) {
-        freeAST(ast);
+    if (!arguments(parser, &ast->serviceRequest.args)) {
         return NULL;
     }
 
-    compareServiceSignature(ast, service, token);
+    compareServiceSignature(parser, ast, service, token);
 
     return ast;
 }
 
-static AST* functionCall()
+static AST* functionCall(Parser* parser)
 {
-    Token token = parser.prevToken;
-    StringObject* id = copyStringObject(token.chars, token.length);
-    AST* symbol = getLocalSymbol(parser.currentScope, id);
+    Token token = parser->prevToken;
+    StringObject* id = internString(token.chars, token.length);
+    AST* symbol = getLocalSymbol(parser->currentScope, id);
 
     if (!symbol) {
-        symbol = getLocalSymbol(parser.topLevel->compound.scope, id);
+        symbol = getLocalSymbol(parser->topLevel->compound.scope, id);
     }
     
-    freeStringObject(id);
-    
     if (!symbol) {
-        return serviceRequest(token);
+        return serviceRequest(parser, token);
     }
 
     if (!symbol || !isFunctionDefinition(symbol)) {
         error(undefinedError, token);
     }
 
-    AST* ast = createAST(AST_FUNCTION_CALL);
-    ast->functionCall.scope = parser.currentScope;
+    if (symbol->functionDefinition.generator && !parser->iterating) {
+        error(generatorCallError, token);
+    }
+
+    parser->iterating = false;
+
+    AST* ast = createAST(&parser->arena, AST_FUNCTION_CALL);
+    ast->functionCall.scope = parser->currentScope;
     ast->functionCall.symbol = symbol;
 
-    if (!arguments(&ast->functionCall.args)) {
-        freeAST(ast);
+    if (!arguments(parser, &ast->functionCall.args)) {
         return NULL;
     }
 
-    compareFunctionSignature(ast, symbol, token);
+    compareFunctionSignature(parser, ast, symbol, token);
 
     return ast;
 }
 
-static AST* functionDefinition()
+static AST* functionDefinition(Parser* parser, bool async)
 {
-    consume(T_FUNC);
+    consume(parser, T_FUNC);
 
-    if (isEof()) {
+    if (isEof(parser)) {
         return NULL;
     }
 
-    Token token = parser.currentToken;
-    StringObject* id = copyStringObject(token.chars, token.length);
-    AST* symbol = getLocalSymbol(parser.currentScope, id);
+    Token token = parser->currentToken;
+    StringObject* id = internString(token.chars, token.length);
+    AST* symbol = getLocalSymbol(parser->currentScope, id);
 
     if (symbol) {
         error(redefinitionError, token);
     }
 
-    if (parser.currentToken.type != T_IDENTIFIER) {
-        error(unexpectedTokenError, parser.currentToken);
+    if (parser->currentToken.type != T_IDENTIFIER) {
+        error(unexpectedTokenError, parser->currentToken);
     }
 
-    consume(T_IDENTIFIER);
+    consume(parser, T_IDENTIFIER);
 
-    if (isEof()) {
+    if (isEof(parser)) {
         return NULL;
     }
 
-    AST* ast = createAST(AST_FUNCTION_DEFINITION);
-    ast->functionDefinition.scope = createScope(parser.currentScope);
+    AST* ast = createAST(&parser->arena, AST_FUNCTION_DEFINITION);
+    ast->functionDefinition.scope = createScope(&parser->arena, parser->currentScope);
     ast->functionDefinition.id = id;
     ast->functionDefinition.typeId = T_INT;
     ast->functionDefinition.body = NULL;
-
-    parser.currentScope = ast->functionDefinition.scope;
+    ast->functionDefinition.async = async;
+    ast->functionDefinition.generator = false;
+
+    AST* previousFunction = parser->currentFunction;
+    int previousForDepth = parser->forDepth;
+    parser->currentScope = ast->functionDefinition.scope;
+    parser->currentFunction = ast;
+    parser->forDepth = 0;
     
-    if (!parameters(&ast->functionDefinition.params)) {
-        freeAST(ast);
+    if (!parameters(parser, &ast->functionDefinition.params)) {
         return NULL;
     }
 
-    if (isTypeToken(parser.currentToken.type)) {
-        ast->functionDefinition.typeId = parser.currentToken.type;
-        consumeType();
+    if (isTypeToken(parser->currentToken.type)) {
+        ast->functionDefinition.typeId = parser->currentToken.type;
+        consumeType(parser);
     }
 
-    if (isEof()) {
-        freeAST(ast);
+    if (isEof(parser)) {
         return NULL;
     }
 
-    consume(T_LBRACE);
+    consume(parser, T_LBRACE);
 
-    AST* body = createAST(AST_COMPOUND);
-    body->compound.scope = parser.currentScope;
+    AST* body = createAST(&parser->arena, AST_COMPOUND);
+    body->compound.scope = parser->currentScope;
 
-    if (!blocklevelStatements(&body->compound.statements)) {
-        freeAST(ast);
+    if (!blocklevelStatements(parser, &body->compound.statements)) {
         return NULL;
     }
 
     ast->functionDefinition.body = body;
-    consume(T_RBRACE);
-    parser.currentScope = parser.currentScope->parent;
-    setLocalSymbol(parser.currentScope, id, ast);
+    consume(parser, T_RBRACE);
+    parser->currentScope = parser->currentScope->parent;
+    parser->currentFunction = previousFunction;
+    parser->forDepth = previousForDepth;
+    setLocalSymbol(parser->currentScope, id, ast);
 
     return ast;
 }
 
-static AST* assignment()
+// extern func name(params) type makes the C function name a service. It is
+// resolved and its call trampoline built here, before anything runs.
+static AST* externDefinition(Parser* parser)
 {
-    Token operator = parser.currentToken;
-    Token token = parser.prevToken;
-    StringObject* id = copyStringObject(token.chars, token.length);
-    AST* symbol = getLocalSymbol(parser.currentScope, id);
+    consume(parser, T_EXTERN);
+    consume(parser, T_FUNC);
+
+    if (isEof(parser)) {
+        return NULL;
+    }
+
+    Token token = parser->currentToken;
+    consume(parser, T_IDENTIFIER);
+
+    if (isEof(parser)) {
+        return NULL;
+    }
+
+    AST* ast = createAST(&parser->arena, AST_EXTERN_DEFINITION);
+    ast->externDefinition.scope = createScope(&parser->arena, parser->currentScope);
+    ast->externDefinition.id = internString(token.chars, token.length);
+    ast->externDefinition.typeId = T_INT;
+    ast->externDefinition.service = NULL;
+
+    parser->currentScope = ast->externDefinition.scope;
+    bool parsed = parameters(parser, &ast->externDefinition.params);
+    parser->currentScope = parser->currentScope->parent;
+
+    if (!parsed) {
+        return NULL;
+    }
+
+    if (isTypeToken(parser->currentToken.type)) {
+        ast->externDefinition.typeId = parser->currentToken.type;
+        consumeType(parser);
+    }
+
+    Vector* params = &ast->externDefinition.params;
+    int paramCount = countVector(params);
+    int types[SERVICE_PARAMS_MAX];
+
+    if (paramCount > SERVICE_PARAMS_MAX) {
+        error(unsupportedExternError, token);
+    }
+
+    for (int i = 0; i < paramCount; i++) {
+        types[i] = getTypeId(getVectorAt(params, i));
+    }
+
+    const char* name = ast->externDefinition.id->chars;
+    void* symbol = findSymbol(name);
 
     if (!symbol) {
-        symbol = getLocalSymbol(parser.topLevel->compound.scope, id);
+        error(unresolvedError, token);
     }
 
-    freeStringObject(id);
+    if (getServiceByName(ast->externDefinition.id)) {
+        error(redefinitionError, token);
+    }
+
+    ast->externDefinition.service = registerExtern(name, symbol, ast->externDefinition.typeId, paramCount, types);
+
+    if (!ast->externDefinition.service) {
+        error(unsupportedExternError, token);
+    }
+
+    return ast;
+}
+
+static AST* assignment(Parser* parser)
+{
+    Token operator = parser->currentToken;
+    Token token = parser->prevToken;
+    StringObject* id = internString(token.chars, token.length);
+    AST* symbol = getLocalSymbol(parser->currentScope, id);
+
+    if (!symbol) {
+        symbol = getLocalSymbol(parser->topLevel->compound.scope, id);
+    }
 
     if (!symbol) {
         error(undefinedError, token);
     }
 
-    if (parser.currentScope != getScope(symbol) && !isInitialized(symbol)) {
+    if (parser->currentScope != getScope(symbol) && !isInitialized(symbol)) {
         error(uninitializedError, token);
     }
     
-    consume(operator.type);
-    AST* expr = expression();
+    int typeId = getTypeId(symbol);
+
+    if (!isSupportedOperator(getBinaryOperatorToken(operator.type), typeId)) {
+        error(unsupportedOperatorError, operator);
+    }
+
+    consume(parser, operator.type);
+    AST* expr = expression(parser);
 
     if (!expr) {
         return NULL;
     }
 
-    AST* ast = createAST(AST_ASSIGNMENT);
-    ast->assignment.scope = parser.currentScope;
+    AST* ast = createAST(&parser->arena, AST_ASSIGNMENT);
+    ast->assignment.scope = parser->currentScope;
     ast->assignment.operator = operator;
     ast->assignment.symbol = symbol;
-    ast->assignment.expr = expr;
+    ast->assignment.expr = convert(parser, expr, typeId, invalidTypeError, token);
 
     initialize(symbol);
 
     return ast;
 }
 
-static AST* variableDefinition()
+static AST* variableDefinition(Parser* parser)
 {
-    consume(T_VAR);
+    consume(parser, T_VAR);
 
-    if (isEof()) {
+    if (isEof(parser)) {
         return NULL;
     }
 
-    Token token = parser.currentToken;
-    StringObject* id = copyStringObject(token.chars, token.length);
-    AST* symbol = getLocalSymbol(parser.currentScope, id);
+    Token token = parser->currentToken;
+    StringObject* id = internString(token.chars, token.length);
+    AST* symbol = getLocalSymbol(parser->currentScope, id);
 
     if (symbol) {
         error(redefinitionError, token);
     }
 
-    consume(T_IDENTIFIER);
+    consume(parser, T_IDENTIFIER);
 
-    if (isEof()) {
+    if (isEof(parser)) {
         return NULL;
     }
 
-    AST* ast = createAST(AST_VARIABLE_DEFINITION);
-    ast->variableDefinition.scope = parser.currentScope;
+    AST* ast = createAST(&parser->arena, AST_VARIABLE_DEFINITION);
+    ast->variableDefinition.scope = parser->currentScope;
     ast->variableDefinition.id = id;
-    ast->variableDefinition.position = getLocalCount(parser.currentScope);
+    ast->variableDefinition.position = getLocalCount(parser->currentScope);
     ast->variableDefinition.expr = NULL;
+    ast->variableDefinition.typeId = T_NONE;
 
-    if (isTypeToken(parser.currentToken.type)) {
-        ast->variableDefinition.typeId = parser.currentToken.type;
-        consumeType();
-    } else if (parser.currentToken.type != T_EQUAL) {
-        error(unexpectedTokenError, parser.currentToken);
+    if (isTypeToken(parser->currentToken.type)) {
+        ast->variableDefinition.typeId = parser->currentToken.type;
+        consumeType(parser);
+    } else if (parser->currentToken.type != T_EQUAL) {
+        error(unexpectedTokenError, parser->currentToken);
     }
     
-    if (parser.currentToken.type != T_EQUAL) {
-        ast->variableDefinition.expr = createAST(AST_NONE);
-        ast->variableDefinition.typeId = T_INT;
-        setLocalVariableSymbol(parser.currentScope, id, ast);
+    if (parser->currentToken.type != T_EQUAL) {
+        ast->variableDefinition.expr = createAST(&parser->arena, AST_NONE);
+        setLocalVariableSymbol(parser->currentScope, id, ast);
 
         return ast;
     }
     
-    consume(T_EQUAL);
-    AST* expr = expression();
+    consume(parser, T_EQUAL);
+    AST* expr = expression(parser);
     
     if (!expr) {
-        freeAST(ast);
         return NULL;
     }
 
-    ast->variableDefinition.typeId = getTypeId(expr);
-    ast->variableDefinition.expr = expr;
+    if (ast->variableDefinition.typeId == T_NONE) {
+        ast->variableDefinition.typeId = getTypeId(expr);
+    }
 
     if (ast->variableDefinition.typeId == T_NONE) {
         error(invalidTypeError, token);
     }
 
-    setLocalVariableSymbol(parser.currentScope, id, ast);
+    ast->variableDefinition.expr = convert(parser, expr, ast->variableDefinition.typeId, invalidTypeError, token);
+
+    setLocalVariableSymbol(parser->currentScope, id, ast);
     initialize(ast);
 
     return ast;
 }
 
-static AST* identifier()
+static bool block(Parser* parser, Vector* nodes)
 {
-    consume(T_IDENTIFIER);
-    
-    if (isAssignmentToken(parser.currentToken.type)) {
-        return assignment();
-    } else if (parser.currentToken.type == T_AND_EQUAL ||
-               parser.currentToken.type == T_OR_EQUAL ||
-               parser.currentToken.type == T_CIRCUMFLEX_EQUAL ||
-               parser.currentToken.type == T_LSHIFT_EQUAL ||
-               parser.currentToken.type == T_RSHIFT_EQUAL) {
-        error(unsupportedOperatorError, parser.currentToken);
-    } else if (parser.currentToken.type == T_LPAREN) {
-        return functionCall();
+    if (isEof(parser)) {
+        return false;
+    }
+
+    consume(parser, T_LBRACE);
+
+    if (!blocklevelStatements(parser, nodes)) {
+        return false;
     }
 
-    return variable();
+    consume(parser, T_RBRACE);
+
+    return true;
 }
 
-static AST* statement()
+static AST* ifStatement(Parser* parser)
 {
-    switch (parser.currentToken.type) {
+    consume(parser, T_IF);
+    AST* condition = expression(parser);
+
+    if (!condition) {
+        return NULL;
+    }
+
+    AST* ast = createAST(&parser->arena, AST_IF);
+    ast->ifStatement.condition = condition;
+
+    if (!block(parser, &ast->ifStatement.body)) {
+        return NULL;
+    }
+
+    if (parser->currentToken.type != T_ELSE) {
+        return ast;
+    }
+
+    consume(parser, T_ELSE);
+
+    if (parser->currentToken.type == T_IF) {
+        AST* elseIf = ifStatement(parser);
+
+        if (!elseIf) {
+            return NULL;
+        }
+
+        pushVectorItem(&ast->ifStatement.elseBody, elseIf);
+    } else if (!block(parser, &ast->ifStatement.elseBody)) {
+        return NULL;
+    }
+
+    return ast;
+}
+
+static AST* whileStatement(Parser* parser)
+{
+    consume(parser, T_WHILE);
+    AST* condition = expression(parser);
+
+    if (!condition) {
+        return NULL;
+    }
+
+    AST* ast = createAST(&parser->arena, AST_WHILE);
+    ast->whileStatement.condition = condition;
+
+    if (!block(parser, &ast->whileStatement.body)) {
+        return NULL;
+    }
+
+    return ast;
+}
+
+// The loop variable of a for is a variable of the enclosing function, one
+// it defines or one of the same type that it reuses.
+static AST* loopVariable(Parser* parser, AST* ast, Token token, int typeId)
+{
+    StringObject* id = internString(token.chars, token.length);
+    AST* symbol = getLocalSymbol(parser->currentScope, id);
+
+    if (symbol) {
+        if (!isVariableType(symbol) || getTypeId(symbol) != typeId) {
+            error(invalidTypeError, token);
+        }
+
+        initialize(symbol);
+        ast->forStatement.defines = false;
+
+        return symbol;
+    }
+
+    symbol = createAST(&parser->arena, AST_VARIABLE_DEFINITION);
+    symbol->variableDefinition.scope = parser->currentScope;
+    symbol->variableDefinition.id = id;
+    symbol->variableDefinition.position = getLocalCount(parser->currentScope);
+    symbol->variableDefinition.expr = NULL;
+    symbol->variableDefinition.typeId = typeId;
+    setLocalVariableSymbol(parser->currentScope, id, symbol);
+    initialize(symbol);
+    ast->forStatement.defines = true;
+
+    return symbol;
+}
+
+// The variable a for keeps its generator in, which the program cannot
+// name.
+static AST* generatorVariable(Parser* parser)
+{
+    AST* ast = createAST(&parser->arena, AST_VARIABLE_DEFINITION);
+    ast->variableDefinition.scope = parser->currentScope;
+    ast->variableDefinition.id = NULL;
+    ast->variableDefinition.initialized = true;
+    ast->variableDefinition.typeId = T_INT;
+    ast->variableDefinition.position = reserveLocal(parser->currentScope);
+    ast->variableDefinition.expr = NULL;
+
+    return ast;
+}
+
+// for name in generator(args) runs its body once for every value the
+// generator yields, with name holding it.
+static AST* forStatement(Parser* parser)
+{
+    consume(parser, T_FOR);
+
+    if (isEof(parser)) {
+        return NULL;
+    }
+
+    Token token = parser->currentToken;
+    consume(parser, T_IDENTIFIER);
+    consume(parser, T_IN);
+
+    Token callToken = parser->currentToken;
+    parser->iterating = true;
+    AST* call = expression(parser);
+    parser->iterating = false;
+
+    if (!call) {
+        return NULL;
+    }
+
+    if (!isGeneratorCall(call)) {
+        error(generatorError, callToken);
+    }
+
+    AST* ast = createAST(&parser->arena, AST_FOR);
+    ast->forStatement.call = call;
+    ast->forStatement.variable = loopVariable(parser, ast, token, getTypeId(call->functionCall.symbol));
+    ast->forStatement.generator = generatorVariable(parser);
+
+    parser->forDepth++;
+
+    if (!block(parser, &ast->forStatement.body)) {
+        return NULL;
+    }
+
+    parser->forDepth--;
+
+    return ast;
+}
+
+// yield hands a value to the for running the generator and suspends the
+// generator until the for wants the next one. Any function that yields
+// is a generator.
+static AST* yieldStatement(Parser* parser)
+{
+    AST* function = parser->currentFunction;
+    Token token = parser->currentToken;
+
+    if (!function) {
+        error(unexpectedTokenError, token);
+    }
+
+    if (function->functionDefinition.async) {
+        error(yieldError, token);
+    }
+
+    consume(parser, T_YIELD);
+    AST* expr = expression(parser);
+
+    if (!expr) {
+        return NULL;
+    }
+
+    function->functionDefinition.generator = true;
+
+    AST* ast = createAST(&parser->arena, AST_YIELD);
+    ast->expression = convert(parser, expr, function->functionDefinition.typeId, invalidReturnError, token);
+
+    return ast;
+}
+
+static AST* identifier(Parser* parser)
+{
+    consume(parser, T_IDENTIFIER);
+    
+    if (isAssignmentToken(parser->currentToken.type)) {
+        return assignment(parser);
+    } else if (parser->currentToken.type == T_AND_EQUAL ||
+               parser->currentToken.type == T_OR_EQUAL ||
+               parser->currentToken.type == T_CIRCUMFLEX_EQUAL ||
+               parser->currentToken.type == T_LSHIFT_EQUAL ||
+               parser->currentToken.type == T_RSHIFT_EQUAL) {
+        error(unsupportedOperatorError, parser->currentToken);
+    } else if (parser->currentToken.type == T_LPAREN) {
+        return functionCall(parser);
+    }
+
+    return variable(parser);
+}
+
+static AST* statement(Parser* parser)
+{
+    switch (parser->currentToken.type) {
+        case T_EXTERN:
+            return externDefinition(parser);
+        case T_ASYNC:
+            consume(parser, T_ASYNC);
+            return functionDefinition(parser, true);
         case T_FUNC:
-            return functionDefinition();
+            return functionDefinition(parser, false);
         case T_VAR:
-            return variableDefinition();
+            return variableDefinition(parser);
         case T_RETURN:
-            return returnStatement();
+            return returnStatement(parser);
+        case T_IF:
+            return ifStatement(parser);
+        case T_WHILE:
+            return whileStatement(parser);
+        case T_FOR:
+            return forStatement(parser);
+        case T_YIELD:
+            return yieldStatement(parser);
         default:
-            return expression();
+            return expression(parser);
     }
 }
 
-static bool statements(Vector* nodes, TokenType type)
+static bool statements(Parser* parser, Vector* nodes, TokenType type)
 {
-    Token token = parser.currentToken;
+    Token token = parser->currentToken;
 
     while (token.type != type) {
-        AST* stmt = statement();
+        AST* stmt = statement(parser);
         if (!stmt) {
             return false;
         }
         
-        if (!isEof() && 
-            parser.currentToken.line == token.line &&
-            parser.currentToken.type != type &&
-            parser.prevToken.type != T_RBRACE) {
-            consume(T_SEMICOLON);
+        if (!isEof(parser) && 
+            parser->currentToken.line == token.line &&
+            parser->currentToken.type != type &&
+            parser->prevToken.type != T_RBRACE) {
+            consume(parser, T_SEMICOLON);
         }
 
         pushVectorItem(nodes, stmt);
-        token = parser.currentToken;
+        token = parser->currentToken;
     }
 
     return true;
 }
 
-static bool blocklevelStatements(Vector* nodes)
+static bool blocklevelStatements(Parser* parser, Vector* nodes)
+{
+    return statements(parser, nodes, T_RBRACE);
+}
+
+static bool toplevelStatements(Parser* parser)
 {
-    return statements(nodes, T_RBRACE);
+    return statements(parser, &parser->topLevel->compound.statements, T_EOF);
 }
 
-static bool toplevelStatements()
+void initParser(Parser* parser)
 {
-    return statements(&parser.topLevel->compound.statements, T_EOF);
+    initArena(&parser->arena);
+
+    AST* ast = createAST(&parser->arena, AST_COMPOUND);
+    ast->compound.scope = createScope(&parser->arena, NULL);
+
+    parser->currentScope = ast->compound.scope;
+    parser->currentFunction = NULL;
+    parser->topLevel = ast;
+    parser->iterating = false;
+    parser->forDepth = 0;
 }
 
-void initParser(AST* ast)
+// Everything the parser built goes at once.
+void freeParser(Parser* parser)
 {
-    parser.currentScope = ast->compound.scope;
-    parser.topLevel = ast;
+    freeArena(&parser->arena);
 }
 
-void parse(char* source)
+void parse(Parser* parser, char* source)
 {
-    initLexer(source);
-    advance();
+    initLexer(&parser->lexer, source);
+    advance(parser);
 
-    if (!toplevelStatements()) {
-        error(unexpectedEndError, parser.currentToken);
+    if (!toplevelStatements(parser)) {
+        error(unexpectedEndError, parser->currentToken);
     }
 }
@@ -0,0 +1,251 @@
+#include "pool.h"
+#include "moduleobject.h"
+#include "tier.h"
+#include "vm.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define QUEUE_MASK (POOL_QUEUE_SIZE - 1)
+
+static double getSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void initJobQueue(JobQueue* queue)
+{
+    for (size_t i = 0; i < POOL_QUEUE_SIZE; i++) {
+        atomic_init(&queue->slots[i].sequence, i);
+        queue->slots[i].job = NULL;
+    }
+
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+}
+
+// A producer claims the slot at tail once the slot's sequence says it was
+// emptied in the previous lap, then publishes the job by moving the
+// sequence on by one. Returns false when the queue is full.
+static bool pushJob(JobQueue* queue, Job* job)
+{
+    size_t position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    JobSlot* slot;
+
+    while (1) {
+        slot = &queue->slots[position & QUEUE_MASK];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->tail, &position, position + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+
+    slot->job = job;
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+
+    return true;
+}
+
+// The mirror image of pushJob: the slot at head is ready once its job was
+// published, and is handed back to producers a lap ahead. Returns NULL
+// when the queue is empty.
+static Job* popJob(JobQueue* queue)
+{
+    size_t position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    JobSlot* slot;
+
+    while (1) {
+        slot = &queue->slots[position & QUEUE_MASK];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &position, position + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            return NULL;
+        } else {
+            position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+
+    Job* job = slot->job;
+    atomic_store_explicit(&slot->sequence, position + POOL_QUEUE_SIZE, memory_order_release);
+
+    return job;
+}
+
+// Every job gets a fresh VM and its own view of the module, so nothing one
+// job leaves behind is seen by the next.
+static void runJob(Job* job)
+{
+    ModuleObject* isolate = createIsolateModule(job->module);
+    VM vm;
+
+    initVM(&vm, isolate);
+    vm.policy = (TierPolicy){0, 0, 0};
+    interpret(&vm);
+    freeVM(&vm);
+    freeModuleObject(isolate);
+}
+
+// Threads sleep on pending, which is posted once for every job and once
+// for every thread when the pool stops.
+static void* work(void* arg)
+{
+    Pool* pool = arg;
+
+    while (1) {
+        sem_wait(&pool->pending);
+        Job* job = popJob(&pool->queue);
+
+        if (!job) {
+            if (atomic_load(&pool->stopping)) {
+                break;
+            }
+
+            continue;
+        }
+
+        job->started = getSeconds();
+        runJob(job);
+        job->finished = getSeconds();
+
+        atomic_fetch_add(&pool->finished, 1);
+        sem_post(&pool->done);
+    }
+
+    return NULL;
+}
+
+bool initPool(Pool* pool, int threadCount)
+{
+    if (threadCount < 1 || threadCount > POOL_THREADS_MAX) {
+        return false;
+    }
+
+    initJobQueue(&pool->queue);
+    sem_init(&pool->pending, 0, 0);
+    sem_init(&pool->done, 0, 0);
+    atomic_init(&pool->submitted, 0);
+    atomic_init(&pool->finished, 0);
+    atomic_init(&pool->stopping, false);
+    pool->threadCount = 0;
+
+    for (int i = 0; i < threadCount; i++) {
+        if (pthread_create(&pool->threads[i], NULL, work, pool) != 0) {
+            freePool(pool);
+            return false;
+        }
+
+        pool->threadCount++;
+    }
+
+    return true;
+}
+
+// Runs what is still queued and stops the threads.
+void freePool(Pool* pool)
+{
+    atomic_store(&pool->stopping, true);
+
+    for (int i = 0; i < pool->threadCount; i++) {
+        sem_post(&pool->pending);
+    }
+
+    for (int i = 0; i < pool->threadCount; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    sem_destroy(&pool->pending);
+    sem_destroy(&pool->done);
+}
+
+// Queues job from any thread. Returns false when the queue is full, in
+// which case the job was not taken and may be submitted again.
+bool submitJob(Pool* pool, Job* job)
+{
+    job->submitted = getSeconds();
+    job->started = 0;
+    job->finished = 0;
+
+    if (!pushJob(&pool->queue, job)) {
+        return false;
+    }
+
+    atomic_fetch_add(&pool->submitted, 1);
+    sem_post(&pool->pending);
+
+    return true;
+}
+
+// Waits until every job submitted so far has finished.
+void waitPool(Pool* pool)
+{
+    while (atomic_load(&pool->finished) < atomic_load(&pool->submitted)) {
+        sem_wait(&pool->done);
+    }
+}
+
+static int compareDoubles(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+
+    return (x > y) - (x < y);
+}
+
+static double getPercentile(double* sorted, size_t count, int percent)
+{
+    return sorted[(count - 1) * percent / 100];
+}
+
+// A job's latency runs from its submission to its end, time spent queued
+// included.
+void printLatencies(Job* jobs, size_t count, double seconds)
+{
+    if (count == 0) {
+        return;
+    }
+
+    double* latencies = malloc(sizeof(double) * count);
+    double total = 0;
+    double queued = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        latencies[i] = jobs[i].finished - jobs[i].submitted;
+        total += latencies[i];
+        queued += jobs[i].started - jobs[i].submitted;
+    }
+
+    qsort(latencies, count, sizeof(double), compareDoubles);
+
+    fprintf(stderr, "jobs: %zu\n", count);
+    fprintf(stderr, "time: %.6f s\n", seconds);
+    fprintf(stderr, "throughput: %.0f jobs/s\n", count / seconds);
+    fprintf(stderr, "latency: mean %.3f ms, queued %.3f ms\n", total / count * 1e3, queued / count * 1e3);
+    fprintf(stderr, "latency: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+        getPercentile(latencies, count, 50) * 1e3, getPercentile(latencies, count, 90) * 1e3,
+        getPercentile(latencies, count, 99) * 1e3, latencies[count - 1] * 1e3);
+
+    free(latencies);
+}
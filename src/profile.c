@@ -0,0 +1,143 @@
+#include "profile.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TRIPLE_KEY(history, opcode) ((((history) & 0xFFFF) << 8) | (opcode))
+#define TRIPLE_EMPTY UINT32_MAX
+
+typedef struct ProfileEntry
+{
+    uint32_t key;
+    uint64_t count;
+} ProfileEntry;
+
+Profile* createProfile()
+{
+    Profile* profile = calloc(1, sizeof(Profile));
+
+    for (size_t i = 0; i < PROFILE_TRIPLES_MAX; i++) {
+        profile->tripleKeys[i] = TRIPLE_EMPTY;
+    }
+
+    return profile;
+}
+
+void freeProfile(Profile* profile)
+{
+    free(profile);
+}
+
+static void recordTriple(Profile* profile, uint32_t key)
+{
+    size_t index = (key * 2654435761u) % PROFILE_TRIPLES_MAX;
+
+    for (size_t i = 0; i < PROFILE_TRIPLES_MAX; i++) {
+        uint32_t current = profile->tripleKeys[index];
+
+        if (current == key || current == TRIPLE_EMPTY) {
+            profile->tripleKeys[index] = key;
+            profile->tripleCounts[index]++;
+            return;
+        }
+
+        index = (index + 1) % PROFILE_TRIPLES_MAX;
+    }
+}
+
+void recordOpcode(Profile* profile, uint8_t opcode)
+{
+    uint8_t previous = profile->history & 0xFF;
+
+    if (profile->historyCount >= 1) {
+        profile->pairs[previous][opcode]++;
+    }
+
+    if (profile->historyCount >= 2) {
+        recordTriple(profile, TRIPLE_KEY(profile->history, opcode));
+    } else {
+        profile->historyCount++;
+    }
+
+    profile->history = (profile->history << 8) | opcode;
+    profile->total++;
+}
+
+static int compareEntries(const void* a, const void* b)
+{
+    const ProfileEntry* x = a;
+    const ProfileEntry* y = b;
+
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+static void printEntries(ProfileEntry* entries, size_t count, size_t limit, size_t width, opcode_name_t name, uint64_t total)
+{
+    qsort(entries, count, sizeof(ProfileEntry), compareEntries);
+
+    for (size_t i = 0; i < count && i < limit; i++) {
+        ProfileEntry* entry = &entries[i];
+
+        fprintf(stderr, "%12llu %6.2f%%  ", (unsigned long long)entry->count, 100.0 * entry->count / total);
+
+        for (size_t j = width; j > 0; j--) {
+            uint8_t opcode = (entry->key >> ((j - 1) * 8)) & 0xFF;
+            fprintf(stderr, j > 1 ? "%s; " : "%s\n", name(opcode));
+        }
+    }
+}
+
+static size_t collectPairs(Profile* profile, ProfileEntry* entries)
+{
+    size_t count = 0;
+
+    for (uint32_t a = 0; a < PROFILE_OPCODES_MAX; a++) {
+        for (uint32_t b = 0; b < PROFILE_OPCODES_MAX; b++) {
+            if (profile->pairs[a][b]) {
+                entries[count].key = (a << 8) | b;
+                entries[count].count = profile->pairs[a][b];
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+static size_t collectTriples(Profile* profile, ProfileEntry* entries)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < PROFILE_TRIPLES_MAX; i++) {
+        if (profile->tripleKeys[i] != TRIPLE_EMPTY) {
+            entries[count].key = profile->tripleKeys[i];
+            entries[count].count = profile->tripleCounts[i];
+            count++;
+        }
+    }
+
+    return count;
+}
+
+void printProfile(Profile* profile, opcode_name_t name, size_t limit)
+{
+    if (profile->total == 0) {
+        fprintf(stderr, "Profile is empty; build with STATS=1 to record opcodes\n");
+        return;
+    }
+
+    size_t size = PROFILE_OPCODES_MAX * PROFILE_OPCODES_MAX;
+    ProfileEntry* entries = malloc(sizeof(ProfileEntry) * size);
+    size_t count = collectPairs(profile, entries);
+
+    fprintf(stderr, "opcode pairs:\n");
+    printEntries(entries, count, limit, 2, name, profile->total);
+
+    count = collectTriples(profile, entries);
+
+    fprintf(stderr, "opcode triples:\n");
+    printEntries(entries, count, limit, 3, name, profile->total);
+
+    free(entries);
+}
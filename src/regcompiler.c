@@ -0,0 +1,664 @@
+#include "regcompiler.h"
+#include "ast.h"
+#include "codeobject.h"
+#include "functionobject.h"
+#include "moduleobject.h"
+#include "opcode.h"
+#include "parser.h"
+#include "scope.h"
+#include "token.h"
+#include "util.h"
+#include "value.h"
+#include "vector.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define REGISTERS_MAX 256
+
+static int expression(RegisterCompiler* compiler, AST* ast);
+static void expressionTo(RegisterCompiler* compiler, AST* ast, int dst);
+static void blocklevelStatements(RegisterCompiler* compiler, Vector* nodes);
+
+static const char* registerError = "Error: Function requires more than %d registers\n";
+static const char* typeError = "Error: The register backend only supports int values\n";
+static const char* asyncError = "Error: The register backend does not support async functions\n";
+static const char* generatorError = "Error: The register backend does not support generators\n";
+
+static CodeObject* currentCodeObject(RegisterCompiler* compiler)
+{
+    return &compiler->function->code;
+}
+
+static int allocateRegister(RegisterCompiler* compiler)
+{
+    int reg = compiler->registerTop++;
+
+    if (compiler->registerTop > REGISTERS_MAX) {
+        fprintf(stderr, registerError, REGISTERS_MAX);
+        exit(1);
+    }
+
+    if (compiler->registerTop > compiler->function->registerCount) {
+        compiler->function->registerCount = compiler->registerTop;
+    }
+
+    return reg;
+}
+
+static void freeRegisters(RegisterCompiler* compiler, int top)
+{
+    compiler->registerTop = top;
+}
+
+static void emit(RegisterCompiler* compiler, uint8_t opcode, uint8_t a, uint8_t b, uint8_t c)
+{
+    pushByte(currentCodeObject(compiler), opcode);
+    pushByte(currentCodeObject(compiler), a);
+    pushByte(currentCodeObject(compiler), b);
+    pushByte(currentCodeObject(compiler), c);
+}
+
+static void emit16(RegisterCompiler* compiler, uint8_t opcode, uint8_t a, int16_t imm)
+{
+    emit(compiler, opcode, a, (imm >> 8) & 0xFF, imm & 0xFF);
+}
+
+// Emits a forward jump and returns the offset it is relative to.
+static size_t emitJump(RegisterCompiler* compiler, uint8_t opcode, uint8_t a)
+{
+    emit16(compiler, opcode, a, 0);
+
+    return countCodeObject(currentCodeObject(compiler));
+}
+
+static void patchJump(RegisterCompiler* compiler, size_t from)
+{
+    CodeObject* code = currentCodeObject(compiler);
+    size_t distance = countCodeObject(code) - from;
+
+    setByteAt(code, from - 2, (distance >> 8) & 0xFF);
+    setByteAt(code, from - 1, distance & 0xFF);
+}
+
+static void emitLoop(RegisterCompiler* compiler, size_t start)
+{
+    emit16(compiler, ROP_LOOP, 0, countCodeObject(currentCodeObject(compiler)) + 4 - start);
+}
+
+static size_t makeConstant(RegisterCompiler* compiler, Value value, AST* ast)
+{
+    pushVectorItem(&compiler->functionReferences, ast);
+
+    return pushValue(&compiler->module->constants, value) - 1;
+}
+
+static int getLocalRegister(RegisterCompiler* compiler, AST* ast)
+{
+    if (isParameter(ast)) {
+        return compiler->function->paramCount - ast->parameter.position - 1;
+    }
+
+    return compiler->function->paramCount + ast->variableDefinition.position;
+}
+
+static bool isGlobal(AST* ast)
+{
+    return isVariableDefinition(ast) && isTopLevel(ast->variableDefinition.scope);
+}
+
+// Register instructions have no typed forms, so only ints are compiled.
+static void requireInt(AST* ast)
+{
+    if (getNumberKind(getTypeId(ast)) != NUMBER_I32) {
+        fprintf(stderr, typeError);
+        exit(1);
+    }
+}
+
+static void loadInt(RegisterCompiler* compiler, int32_t n, AST* ast, int dst)
+{
+    if (isLargerThan16BitSigned(n)) {
+        size_t position = makeConstant(compiler, INT_VALUE(n), ast);
+        emit16(compiler, ROP_LDC, dst, position);
+    } else {
+        emit16(compiler, ROP_LDI, dst, n);
+    }
+}
+
+static void number(RegisterCompiler* compiler, AST* ast, int dst)
+{
+    loadInt(compiler, ast->intValue, ast, dst);
+}
+
+// What reaches here converts between types that are both ints, which
+// takes no code, or is a literal.
+static void conversion(RegisterCompiler* compiler, AST* ast, int dst)
+{
+    AST* expr = ast->conversion.expr;
+
+    if (expr->type == AST_INTEGER) {
+        return loadInt(compiler, expr->intValue, ast, dst);
+    }
+
+    expressionTo(compiler, expr, dst);
+}
+
+static uint8_t binaryOpcode(TokenType type)
+{
+    switch (type) {
+        case T_PLUS:
+            return ROP_ADD;
+        case T_MINUS:
+            return ROP_SUB;
+        case T_STAR:
+            return ROP_MUL;
+        case T_SLASH:
+        case T_FLOOR:
+            return ROP_DIV;
+        case T_PERCENT:
+            return ROP_REM;
+        case T_POWER:
+            return ROP_POW;
+        case T_AMPERSAND:
+            return ROP_BAND;
+        case T_PIPE:
+            return ROP_BOR;
+        case T_CIRCUMFLEX:
+            return ROP_BXOR;
+        case T_LSHIFT:
+            return ROP_LSL;
+        case T_RSHIFT:
+            return ROP_LSR;
+        case T_EQUAL_EQUAL:
+            return ROP_EQ;
+        case T_NOT_EQUAL:
+            return ROP_NE;
+        case T_LESS:
+            return ROP_LT;
+        case T_LESS_EQUAL:
+            return ROP_LE;
+        case T_GREATER:
+            return ROP_GT;
+        case T_GREATER_EQUAL:
+            return ROP_GE;
+        default:
+            return ROP_HLT;
+    }
+}
+
+static uint8_t assignmentOpcode(TokenType type)
+{
+    switch (type) {
+        case T_PLUS_EQUAL:
+            return ROP_ADD;
+        case T_MINUS_EQUAL:
+            return ROP_SUB;
+        case T_STAR_EQUAL:
+            return ROP_MUL;
+        case T_FLOOR_EQUAL:
+        case T_SLASH_EQUAL:
+            return ROP_DIV;
+        case T_PERCENT_EQUAL:
+            return ROP_REM;
+        case T_POWER_EQUAL:
+            return ROP_POW;
+        default:
+            return ROP_HLT;
+    }
+}
+
+static uint8_t prefixOpcode(TokenType type)
+{
+    switch (type) {
+        case T_EXCLAMATION:
+            return ROP_NOT;
+        case T_TILDE:
+            return ROP_BNOT;
+        case T_MINUS:
+            return ROP_NEG;
+        default:
+            return ROP_HLT;
+    }
+}
+
+static void binary(RegisterCompiler* compiler, AST* ast, int dst)
+{
+    uint8_t opcode = binaryOpcode(ast->binary.operator.type);
+    int a = expression(compiler, ast->binary.leftExpr);
+    int b = expression(compiler, ast->binary.rightExpr);
+
+    emit(compiler, opcode, dst, a, b);
+}
+
+static void prefix(RegisterCompiler* compiler, AST* ast, int dst)
+{
+    uint8_t opcode = prefixOpcode(ast->prefix.operator.type);
+    int a = expression(compiler, ast->prefix.expr);
+
+    emit(compiler, opcode, dst, a, 0);
+}
+
+static void variable(RegisterCompiler* compiler, AST* ast, int dst)
+{
+    AST* symbol = ast->variable.symbol;
+
+    if (isGlobal(symbol)) {
+        return emit16(compiler, ROP_LDG, dst, symbol->variableDefinition.position);
+    }
+
+    int reg = getLocalRegister(compiler, symbol);
+
+    if (reg != dst) {
+        emit(compiler, ROP_MOV, dst, reg, 0);
+    }
+}
+
+static bool isLastTemporary(RegisterCompiler* compiler, int reg)
+{
+    return reg >= compiler->temporaryBase && reg == compiler->registerTop - 1;
+}
+
+// Arguments are evaluated into consecutive registers starting at the
+// returned base, which becomes register 0 of the callee.
+static int arguments(RegisterCompiler* compiler, Vector* args, int dst)
+{
+    size_t count = countVector(args);
+    int base = isLastTemporary(compiler, dst) ? dst : allocateRegister(compiler);
+
+    for (size_t i = 0; i < count; i++) {
+        int reg = i == 0 ? base : allocateRegister(compiler);
+        expressionTo(compiler, args->data[i], reg);
+    }
+
+    return base;
+}
+
+static int getFunctionPosition(RegisterCompiler* compiler, AST* ast)
+{
+    size_t functionCount = countVector(&compiler->functionReferences);
+    
+    for (int i = 0; i < functionCount; i++) {
+        if (ast == compiler->functionReferences.data[i]) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void functionCall(RegisterCompiler* compiler, AST* ast, int dst)
+{
+    uint16_t position = getFunctionPosition(compiler, ast->functionCall.symbol);
+    int base = arguments(compiler, &ast->functionCall.args, dst);
+
+    emit16(compiler, ROP_CALL, base, position);
+
+    if (base != dst) {
+        emit(compiler, ROP_MOV, dst, base, 0);
+    }
+}
+
+static void serviceRequest(RegisterCompiler* compiler, AST* ast, int dst)
+{
+    int base = arguments(compiler, &ast->serviceRequest.args, dst);
+
+    emit16(compiler, ROP_REQS, base, ast->serviceRequest.opcode);
+
+    if (base != dst) {
+        emit(compiler, ROP_MOV, dst, base, 0);
+    }
+}
+
+static void expressionTo(RegisterCompiler* compiler, AST* ast, int dst)
+{
+    int top = compiler->registerTop;
+
+    requireInt(ast);
+
+    switch (ast->type) {
+        case AST_BINARY:
+            binary(compiler, ast, dst);
+            break;
+        case AST_CONVERSION:
+            conversion(compiler, ast, dst);
+            break;
+        case AST_FUNCTION_CALL:
+            functionCall(compiler, ast, dst);
+            break;
+        case AST_INTEGER:
+            number(compiler, ast, dst);
+            break;
+        case AST_PREFIX:
+            prefix(compiler, ast, dst);
+            break;
+        case AST_SERVICE_REQUEST:
+            serviceRequest(compiler, ast, dst);
+            break;
+        case AST_VARIABLE:
+            variable(compiler, ast, dst);
+            break;
+        default:
+            break;
+    }
+
+    freeRegisters(compiler, top);
+}
+
+// Returns the register holding the value of the expression. Local variables
+// are read in place; everything else is evaluated into a new temporary.
+static int expression(RegisterCompiler* compiler, AST* ast)
+{
+    requireInt(ast);
+
+    if (ast->type == AST_VARIABLE && !isGlobal(ast->variable.symbol)) {
+        return getLocalRegister(compiler, ast->variable.symbol);
+    }
+
+    int dst = allocateRegister(compiler);
+    expressionTo(compiler, ast, dst);
+
+    return dst;
+}
+
+static void globalAssignment(RegisterCompiler* compiler, AST* ast, uint8_t opcode)
+{
+    int top = compiler->registerTop;
+    int position = ast->assignment.symbol->variableDefinition.position;
+    int dst = allocateRegister(compiler);
+
+    if (opcode == ROP_HLT) {
+        expressionTo(compiler, ast->assignment.expr, dst);
+    } else {
+        int src = expression(compiler, ast->assignment.expr);
+
+        emit16(compiler, ROP_LDG, dst, position);
+        emit(compiler, opcode, dst, dst, src);
+    }
+
+    emit16(compiler, ROP_STG, dst, position);
+    freeRegisters(compiler, top);
+}
+
+static void assignment(RegisterCompiler* compiler, AST* ast)
+{
+    uint8_t opcode = assignmentOpcode(ast->assignment.operator.type);
+
+    if (isGlobal(ast->assignment.symbol)) {
+        return globalAssignment(compiler, ast, opcode);
+    }
+
+    int top = compiler->registerTop;
+    int dst = getLocalRegister(compiler, ast->assignment.symbol);
+
+    if (opcode == ROP_HLT) {
+        expressionTo(compiler, ast->assignment.expr, dst);
+    } else {
+        emit(compiler, opcode, dst, dst, expression(compiler, ast->assignment.expr));
+    }
+
+    freeRegisters(compiler, top);
+}
+
+static void functionDefinition(RegisterCompiler* compiler, AST* ast)
+{
+    if (ast->functionDefinition.async) {
+        fprintf(stderr, asyncError);
+        exit(1);
+    }
+
+    if (ast->functionDefinition.generator) {
+        fprintf(stderr, generatorError);
+        exit(1);
+    }
+
+    AST* body = ast->functionDefinition.body;
+    FunctionObject* previousFunction = compiler->function;
+    int previousBase = compiler->temporaryBase;
+    int previousTop = compiler->registerTop;
+    FunctionObject* function = addFunction(compiler->module);
+    function->paramCount = countVector(&ast->functionDefinition.params);
+    function->localCount = body->compound.scope->localCount;
+    function->registerCount = function->paramCount + function->localCount;
+
+    compiler->function = function;
+    compiler->temporaryBase = function->registerCount;
+    compiler->registerTop = function->registerCount;
+    makeConstant(compiler, POINTER_VALUE(function), ast);
+    blocklevelStatements(compiler, &body->compound.statements);
+
+    size_t count = countVector(&body->compound.statements);
+    AST* last = count > 0 ? getVectorAt(&body->compound.statements, count - 1) : NULL;
+
+    if (!last || last->type != AST_RETURN) {
+        emit(compiler, ROP_RET, 0, 0, 0);
+    }
+
+    compiler->function = previousFunction;
+    compiler->temporaryBase = previousBase;
+    compiler->registerTop = previousTop;
+}
+
+static void ret(RegisterCompiler* compiler, AST* ast)
+{
+    if (isNone(ast->expression)) {
+        return emit(compiler, ROP_RET, 0, 0, 0);
+    }
+
+    int top = compiler->registerTop;
+
+    emit(compiler, ROP_RETV, expression(compiler, ast->expression), 0, 0);
+    freeRegisters(compiler, top);
+}
+
+static void globalVariableDefinition(RegisterCompiler* compiler, AST* ast)
+{
+    int top = compiler->registerTop;
+    int dst = allocateRegister(compiler);
+
+    if (isNone(ast->variableDefinition.expr)) {
+        emit16(compiler, ROP_LDI, dst, 0);
+    } else {
+        expressionTo(compiler, ast->variableDefinition.expr, dst);
+    }
+
+    if (compiler->blockDepth > 0) {
+        emit16(compiler, ROP_STG, dst, ast->variableDefinition.position);
+    } else {
+        emit(compiler, ROP_REG, dst, 0, 0);
+    }
+
+    freeRegisters(compiler, top);
+}
+
+static void variableDefinition(RegisterCompiler* compiler, AST* ast)
+{
+    if (isTopLevel(ast->variableDefinition.scope)) {
+        return globalVariableDefinition(compiler, ast);
+    }
+
+    int dst = getLocalRegister(compiler, ast);
+
+    if (isNone(ast->variableDefinition.expr)) {
+        return emit16(compiler, ROP_LDI, dst, 0);
+    }
+
+    expressionTo(compiler, ast->variableDefinition.expr, dst);
+}
+
+static void registerGlobals(RegisterCompiler* compiler, AST* ast);
+
+static void registerGlobalsIn(RegisterCompiler* compiler, Vector* nodes)
+{
+    size_t count = countVector(nodes);
+
+    for (size_t i = 0; i < count; i++) {
+        registerGlobals(compiler, nodes->data[i]);
+    }
+}
+
+// Globals defined inside a top-level block are registered before it runs,
+// in definition order, and only stored to inside it.
+static void registerGlobals(RegisterCompiler* compiler, AST* ast)
+{
+    int top = compiler->registerTop;
+    int dst;
+
+    switch (ast->type) {
+        case AST_IF:
+            registerGlobalsIn(compiler, &ast->ifStatement.body);
+            registerGlobalsIn(compiler, &ast->ifStatement.elseBody);
+            break;
+        case AST_VARIABLE_DEFINITION:
+            if (isTopLevel(ast->variableDefinition.scope)) {
+                dst = allocateRegister(compiler);
+                emit16(compiler, ROP_LDI, dst, 0);
+                emit(compiler, ROP_REG, dst, 0, 0);
+                freeRegisters(compiler, top);
+            }
+            break;
+        case AST_WHILE:
+            registerGlobalsIn(compiler, &ast->whileStatement.body);
+            break;
+        default:
+            break;
+    }
+}
+
+static void block(RegisterCompiler* compiler, Vector* nodes)
+{
+    compiler->blockDepth++;
+    blocklevelStatements(compiler, nodes);
+    compiler->blockDepth--;
+}
+
+static void ifStatement(RegisterCompiler* compiler, AST* ast)
+{
+    int top = compiler->registerTop;
+    size_t next = emitJump(compiler, ROP_JZ, expression(compiler, ast->ifStatement.condition));
+
+    freeRegisters(compiler, top);
+    block(compiler, &ast->ifStatement.body);
+
+    if (countVector(&ast->ifStatement.elseBody) == 0) {
+        return patchJump(compiler, next);
+    }
+
+    size_t end = emitJump(compiler, ROP_JMP, 0);
+    patchJump(compiler, next);
+    block(compiler, &ast->ifStatement.elseBody);
+    patchJump(compiler, end);
+}
+
+static void whileStatement(RegisterCompiler* compiler, AST* ast)
+{
+    int top = compiler->registerTop;
+    size_t start = countCodeObject(currentCodeObject(compiler));
+    size_t exit = emitJump(compiler, ROP_JZ, expression(compiler, ast->whileStatement.condition));
+
+    freeRegisters(compiler, top);
+    block(compiler, &ast->whileStatement.body);
+    emitLoop(compiler, start);
+    patchJump(compiler, exit);
+}
+
+static void blockStatement(RegisterCompiler* compiler, AST* ast)
+{
+    if (compiler->blockDepth == 0) {
+        registerGlobals(compiler, ast);
+    }
+
+    if (ast->type == AST_IF) {
+        ifStatement(compiler, ast);
+    } else {
+        whileStatement(compiler, ast);
+    }
+}
+
+static void statement(RegisterCompiler* compiler, AST* ast)
+{
+    int top = compiler->registerTop;
+
+    switch (ast->type) {
+        case AST_ASSIGNMENT:
+            assignment(compiler, ast);
+            break;
+        case AST_EXTERN_DEFINITION:
+            break;
+        case AST_FUNCTION_DEFINITION:
+            functionDefinition(compiler, ast);
+            break;
+        case AST_IF:
+        case AST_WHILE:
+            blockStatement(compiler, ast);
+            break;
+        case AST_RETURN:
+            ret(compiler, ast);
+            break;
+        case AST_VARIABLE_DEFINITION:
+            variableDefinition(compiler, ast);
+            break;
+        default:
+            expressionTo(compiler, ast, allocateRegister(compiler));
+            break;
+    }
+
+    freeRegisters(compiler, top);
+}
+
+static void blocklevelStatements(RegisterCompiler* compiler, Vector* nodes)
+{
+    size_t count = countVector(nodes);
+
+    for (size_t i = 0; i < count; i++) {
+        statement(compiler, nodes->data[i]);
+    }
+}
+
+static void toplevelStatements(RegisterCompiler* compiler, Vector* nodes)
+{
+    size_t count = countVector(nodes);
+
+    for (; compiler->statementCount < count; compiler->statementCount++) {
+        statement(compiler, nodes->data[compiler->statementCount]);
+    }
+}
+
+void initRegisterCompiler(RegisterCompiler* compiler, ModuleObject* module)
+{
+    initVector(&compiler->functionReferences);
+    pushVectorItem(&compiler->functionReferences, NULL);
+
+    initParser(&compiler->parser);
+
+    AST* ast = compiler->parser.topLevel;
+
+    module->backend = BACKEND_REGISTER;
+
+    compiler->module = module;
+    compiler->function = AS_POINTER(module->constants.data[0]);
+    compiler->ast = ast;
+    compiler->statementCount = 0;
+    compiler->temporaryBase = 0;
+    compiler->registerTop = 0;
+    compiler->blockDepth = 0;
+}
+
+void freeRegisterCompiler(RegisterCompiler* compiler)
+{
+    freeVector(&compiler->functionReferences);
+    freeParser(&compiler->parser);
+}
+
+void compileRegisters(RegisterCompiler* compiler, char* source)
+{
+    if (!compiler->module) {
+        return;
+    }
+
+    parse(&compiler->parser, source);
+    clearCodeObject(currentCodeObject(compiler));
+    toplevelStatements(compiler, &compiler->ast->compound.statements);
+    emit(compiler, ROP_HLT, 0, 0, 0);
+}
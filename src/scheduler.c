@@ -0,0 +1,544 @@
+#include "scheduler.h"
+#include "channel.h"
+#include "loop.h"
+#include "moduleobject.h"
+#include "tier.h"
+#include "vm.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+static DequeArray* createDequeArray(int64_t size)
+{
+    DequeArray* array = malloc(sizeof(DequeArray) + sizeof(Task*) * size);
+
+    array->size = size;
+    array->retired = NULL;
+
+    return array;
+}
+
+static void initDeque(Deque* deque)
+{
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    atomic_init(&deque->array, createDequeArray(DEQUE_SIZE));
+}
+
+// Frees the tasks that never ran along with every array the deque had.
+static void freeDeque(Deque* deque)
+{
+    DequeArray* array = atomic_load(&deque->array);
+    int64_t bottom = atomic_load(&deque->bottom);
+
+    for (int64_t i = atomic_load(&deque->top); i < bottom; i++) {
+        freeTask(atomic_load(&array->tasks[i & (array->size - 1)]));
+    }
+
+    while (array) {
+        DequeArray* retired = array->retired;
+        free(array);
+        array = retired;
+    }
+}
+
+static DequeArray* growDeque(Deque* deque, DequeArray* array, int64_t top, int64_t bottom)
+{
+    DequeArray* grown = createDequeArray(array->size * 2);
+
+    for (int64_t i = top; i < bottom; i++) {
+        Task* task = atomic_load_explicit(&array->tasks[i & (array->size - 1)], memory_order_relaxed);
+        atomic_store_explicit(&grown->tasks[i & (grown->size - 1)], task, memory_order_relaxed);
+    }
+
+    grown->retired = array;
+    atomic_store_explicit(&deque->array, grown, memory_order_release);
+
+    return grown;
+}
+
+// Only the owner pushes. Publishing bottom with release hands the task,
+// and everything written to it, to whichever thread steals it.
+static void pushDeque(Deque* deque, Task* task)
+{
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    DequeArray* array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+
+    if (bottom - top > array->size - 1) {
+        array = growDeque(deque, array, top, bottom);
+    }
+
+    atomic_store_explicit(&array->tasks[bottom & (array->size - 1)], task, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+}
+
+// Only the owner pops. It takes bottom back before it reads top, with a
+// full fence in between, so that a thief either sees the task gone or has
+// already moved top past it; the last task goes to whoever moves top.
+static Task* popDeque(Deque* deque)
+{
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    DequeArray* array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+    Task* task = NULL;
+
+    if (top <= bottom) {
+        task = atomic_load_explicit(&array->tasks[bottom & (array->size - 1)], memory_order_relaxed);
+
+        if (top == bottom) {
+            if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                    memory_order_seq_cst, memory_order_relaxed)) {
+                task = NULL;
+            }
+
+            atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        }
+    } else {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+
+    return task;
+}
+
+// Any thread steals. Returns NULL when the deque is empty and when
+// another thread took the task at top first.
+static Task* stealDeque(Deque* deque)
+{
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (top >= bottom) {
+        return NULL;
+    }
+
+    DequeArray* array = atomic_load_explicit(&deque->array, memory_order_acquire);
+    Task* task = atomic_load_explicit(&array->tasks[top & (array->size - 1)], memory_order_relaxed);
+
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+            memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+
+    return task;
+}
+
+static bool isDequeEmpty(Deque* deque)
+{
+    return atomic_load(&deque->top) >= atomic_load(&deque->bottom);
+}
+
+static uint32_t nextRandom(Worker* worker)
+{
+    uint32_t x = worker->seed;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    worker->seed = x;
+
+    return x;
+}
+
+bool initScheduler(Scheduler* scheduler, VM* vm, int workerCount)
+{
+    if (workerCount < 1 || workerCount > SCHEDULER_WORKERS_MAX) {
+        return false;
+    }
+
+    scheduler->workers = aligned_alloc(CACHE_LINE, sizeof(Worker) * workerCount);
+    scheduler->workerCount = workerCount;
+    initChannels(&scheduler->channels);
+    pthread_mutex_init(&scheduler->globals, NULL);
+    atomic_init(&scheduler->live, 0);
+    atomic_init(&scheduler->messages, 0);
+    atomic_init(&scheduler->sleeping, 0);
+    atomic_init(&scheduler->blocked, 0);
+    atomic_init(&scheduler->stopping, false);
+
+    for (int i = 0; i < workerCount; i++) {
+        Worker* worker = &scheduler->workers[i];
+
+        if (i == 0) {
+            worker->vm = vm;
+            worker->isolate = NULL;
+        } else {
+            worker->isolate = createIsolateModule(vm->module);
+            worker->vm = malloc(sizeof(VM));
+            initVM(worker->vm, worker->isolate);
+            worker->vm->policy = (TierPolicy){0, 0, 0};
+            worker->vm->loop.pauses.enabled = vm->loop.pauses.enabled;
+            worker->vm->loop.pauses.target = vm->loop.pauses.target;
+        }
+
+        initDeque(&worker->deque);
+        atomic_init(&worker->inbox, NULL);
+        atomic_init(&worker->state, WORKER_RUNNING);
+        worker->seed = (uint32_t)i * 2654435761u + 1;
+        worker->turns = 0;
+        worker->scheduler = scheduler;
+
+        EventLoop* loop = &worker->vm->loop;
+        struct epoll_event event = {0};
+
+        loop->scheduler = scheduler;
+        loop->worker = i;
+        loop->workerCount = workerCount;
+        loop->channels = &scheduler->channels;
+        loop->epoll = epoll_create1(EPOLL_CLOEXEC);
+        loop->wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        event.events = EPOLLIN;
+        event.data.fd = loop->wakeup;
+
+        if (loop->epoll < 0 || loop->wakeup < 0 || epoll_ctl(loop->epoll, EPOLL_CTL_ADD, loop->wakeup, &event) < 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Frees what never ran, the VMs of the workers and the channels. Worker
+// 0's VM is the caller's.
+void freeScheduler(Scheduler* scheduler)
+{
+    for (int i = 0; i < scheduler->workerCount; i++) {
+        Worker* worker = &scheduler->workers[i];
+        Message* message = atomic_load(&worker->inbox);
+
+        while (message) {
+            Message* next = message->next;
+
+            if (message->task) {
+                freeTask(message->task);
+            }
+
+            free(message);
+            message = next;
+        }
+
+        freeDeque(&worker->deque);
+
+        if (i > 0) {
+            // The globals are worker 0's.
+            initValueArray(&worker->vm->globals);
+            freeVM(worker->vm);
+            free(worker->vm);
+            freeModuleObject(worker->isolate);
+        }
+    }
+
+    freeChannels(&scheduler->channels);
+    pthread_mutex_destroy(&scheduler->globals);
+    free(scheduler->workers);
+}
+
+// Moves worker from sleeping to running, along with the counts, and
+// returns whether it was this call that did.
+static bool claimWorker(Scheduler* scheduler, Worker* worker)
+{
+    int state = atomic_load(&worker->state);
+
+    while (state != WORKER_RUNNING) {
+        if (atomic_compare_exchange_weak(&worker->state, &state, WORKER_RUNNING)) {
+            atomic_fetch_sub(&scheduler->sleeping, 1);
+
+            if (state == WORKER_BLOCKED) {
+                atomic_fetch_sub(&scheduler->blocked, 1);
+            }
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void wakeWorker(Scheduler* scheduler, Worker* worker)
+{
+    if (claimWorker(scheduler, worker)) {
+        eventfd_write(worker->vm->loop.wakeup, 1);
+    }
+}
+
+// Wakes one sleeping worker, if there is one, to steal a task just pushed.
+// The fence orders the push before the look at sleeping, just as a worker
+// going to sleep counts itself before it looks at the deques.
+static void wakeThief(Scheduler* scheduler, Worker* self)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (atomic_load_explicit(&scheduler->sleeping, memory_order_relaxed) == 0) {
+        return;
+    }
+
+    int count = scheduler->workerCount;
+    int start = nextRandom(self) % count;
+
+    for (int i = 0; i < count; i++) {
+        Worker* worker = &scheduler->workers[(start + i) % count];
+
+        if (worker != self && claimWorker(scheduler, worker)) {
+            eventfd_write(worker->vm->loop.wakeup, 1);
+            return;
+        }
+    }
+}
+
+static void stopScheduler(Scheduler* scheduler)
+{
+    atomic_store(&scheduler->stopping, true);
+
+    for (int i = 0; i < scheduler->workerCount; i++) {
+        eventfd_write(scheduler->workers[i].vm->loop.wakeup, 1);
+    }
+}
+
+// Queues a task that became ready on worker, which is the calling thread.
+void scheduleTask(Scheduler* scheduler, int worker, Task* task)
+{
+    Worker* self = &scheduler->workers[worker];
+
+    pushDeque(&self->deque, task);
+    wakeThief(scheduler, self);
+}
+
+void addTask(Scheduler* scheduler, int worker, Task* task)
+{
+    atomic_fetch_add_explicit(&scheduler->live, 1, memory_order_relaxed);
+    scheduleTask(scheduler, worker, task);
+}
+
+void finishTask(Scheduler* scheduler)
+{
+    if (atomic_fetch_sub(&scheduler->live, 1) == 1) {
+        stopScheduler(scheduler);
+    }
+}
+
+// Any thread posts. A message is counted before it is pushed and until it
+// has been handled, so that it is never missed by a worker deciding that
+// nothing can happen any more.
+void postMessage(Scheduler* scheduler, int worker, Message* message)
+{
+    Worker* target = &scheduler->workers[worker];
+    Message* head = atomic_load_explicit(&target->inbox, memory_order_relaxed);
+
+    atomic_fetch_add(&scheduler->messages, 1);
+
+    do {
+        message->next = head;
+    } while (!atomic_compare_exchange_weak(&target->inbox, &head, message));
+
+    wakeWorker(scheduler, target);
+}
+
+// The inbox is taken newest first and handled in the order it was posted.
+static void handleMessages(Scheduler* scheduler, Worker* worker)
+{
+    if (!atomic_load_explicit(&worker->inbox, memory_order_relaxed)) {
+        return;
+    }
+
+    Message* message = atomic_exchange_explicit(&worker->inbox, NULL, memory_order_acquire);
+    Message* ordered = NULL;
+
+    while (message) {
+        Message* next = message->next;
+        message->next = ordered;
+        ordered = message;
+        message = next;
+    }
+
+    while (ordered) {
+        Message* next = ordered->next;
+
+        handleMessage(&worker->vm->loop, ordered);
+        free(ordered);
+        atomic_fetch_sub(&scheduler->messages, 1);
+        ordered = next;
+    }
+}
+
+// Tries every other worker once, starting from one picked at random.
+static Task* stealTask(Scheduler* scheduler, Worker* thief)
+{
+    int count = scheduler->workerCount;
+    int start = nextRandom(thief) % count;
+
+    for (int i = 0; i < count; i++) {
+        Worker* victim = &scheduler->workers[(start + i) % count];
+
+        if (victim == thief) {
+            continue;
+        }
+
+        Task* task = stealDeque(&victim->deque);
+
+        if (task) {
+            return task;
+        }
+    }
+
+    return NULL;
+}
+
+static bool hasWork(Scheduler* scheduler, Worker* worker)
+{
+    if (atomic_load(&worker->inbox)) {
+        return true;
+    }
+
+    for (int i = 0; i < scheduler->workerCount; i++) {
+        if (!isDequeEmpty(&scheduler->workers[i].deque)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Sleeps in epoll until another worker wakes this one or the loop has
+// something of its own. Work that turned up before the worker said it was
+// sleeping would not have woken it, so it looks once more first; the last
+// worker to block with nothing left anywhere stops the scheduler.
+static void sleepWorker(Scheduler* scheduler, Worker* worker)
+{
+    EventLoop* loop = &worker->vm->loop;
+    bool blocked = loop->wheel.count == 0 && loop->watchCount == 0;
+
+    atomic_store(&worker->state, blocked ? WORKER_BLOCKED : WORKER_SLEEPING);
+    atomic_fetch_add(&scheduler->sleeping, 1);
+
+    if (blocked) {
+        atomic_fetch_add(&scheduler->blocked, 1);
+    }
+
+    if (!hasWork(scheduler, worker) && !atomic_load(&scheduler->stopping)) {
+        if (atomic_load(&scheduler->blocked) == scheduler->workerCount && atomic_load(&scheduler->messages) == 0) {
+            stopScheduler(scheduler);
+        } else {
+            pollLoop(loop, true);
+        }
+    }
+
+    claimWorker(scheduler, worker);
+}
+
+// A pause runs from the first task after a poll to the next poll, which
+// comes after SCHEDULER_POLL_INTERVAL turns or once the pause reaches the
+// loop's target, whichever is first.
+static void runWorker(Worker* worker)
+{
+    Scheduler* scheduler = worker->scheduler;
+    EventLoop* loop = &worker->vm->loop;
+    bool pausing = false;
+    uint64_t start = 0;
+
+    while (!atomic_load_explicit(&scheduler->stopping, memory_order_acquire)) {
+        handleMessages(scheduler, worker);
+
+        Task* task = popDeque(&worker->deque);
+
+        if (!task) {
+            task = stealTask(scheduler, worker);
+        }
+
+        if (task) {
+            if (!pausing) {
+                start = startPause(loop);
+                pausing = true;
+            }
+
+            resumeTask(worker->vm, task);
+
+            if (++worker->turns % SCHEDULER_POLL_INTERVAL == 0 || isPauseOver(loop, start)) {
+                endPause(loop, start);
+                pausing = false;
+                pollLoop(loop, false);
+            }
+
+            continue;
+        }
+
+        if (pausing) {
+            endPause(loop, start);
+            pausing = false;
+        }
+
+        pollLoop(loop, false);
+
+        if (isDequeEmpty(&worker->deque)) {
+            sleepWorker(scheduler, worker);
+        }
+    }
+
+    if (pausing) {
+        endPause(loop, start);
+    }
+}
+
+static void* work(void* arg)
+{
+    runWorker(arg);
+
+    return NULL;
+}
+
+// Runs the tasks the script spawned, on the calling thread as worker 0 and
+// on a thread of its own for each of the others, until the scheduler
+// stops. The script has run by now, so its globals are all there are.
+void runScheduler(Scheduler* scheduler)
+{
+    Worker* main = &scheduler->workers[0];
+
+    if (atomic_load(&scheduler->live) == 0) {
+        return;
+    }
+
+    for (int i = 1; i < scheduler->workerCount; i++) {
+        Worker* worker = &scheduler->workers[i];
+
+        worker->vm->globals = main->vm->globals;
+
+        if (pthread_create(&worker->thread, NULL, work, worker) != 0) {
+            fprintf(stderr, "Error: Could not start worker %d\n", i);
+            exit(1);
+        }
+    }
+
+    runWorker(main);
+
+    // Statistics are worker 0's, so they take in what the others ran. The
+    // peaks of the workers need not coincide, so their sum is a bound.
+    for (int i = 1; i < scheduler->workerCount; i++) {
+        VM* vm = scheduler->workers[i].vm;
+
+        pthread_join(scheduler->workers[i].thread, NULL);
+        main->vm->instructionCount += vm->instructionCount;
+        main->vm->loop.futureCount += vm->loop.futureCount;
+        main->vm->loop.futurePeak += vm->loop.futurePeak;
+        addPauses(&main->vm->loop.pauses, &vm->loop.pauses);
+    }
+}
+
+void lockGlobals(Scheduler* scheduler)
+{
+    pthread_mutex_lock(&scheduler->globals);
+}
+
+void unlockGlobals(Scheduler* scheduler)
+{
+    pthread_mutex_unlock(&scheduler->globals);
+}
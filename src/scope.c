@@ -1,28 +1,24 @@
 #include "scope.h"
+#include "arena.h"
 #include "ast.h"
 #include "table.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
 
-Scope* createScope(Scope* parent)
+// A scope and its symbols go with the arena.
+Scope* createScope(Arena* arena, Scope* parent)
 {
-    Scope* scope = malloc(sizeof(Scope));
+    Scope* scope = allocateArena(arena, sizeof(Scope));
     scope->parent = parent;
     scope->localCount = 0;
     scope->level = getLevel(parent) + 1;
 
-    initTable(&scope->symbols, 32);
+    initArenaTable(&scope->symbols, 32, arena);
     
     return scope;
 }
 
-void freeScope(Scope* scope)
-{
-    freeTable(&scope->symbols);
-    free(scope);
-}
-
 size_t getLocalCount(Scope* scope)
 {
     return scope->localCount;
@@ -38,6 +34,12 @@ bool isTopLevel(Scope* scope)
     return scope->level == 1;
 }
 
+// Takes a local slot without a name, returning its position.
+size_t reserveLocal(Scope* scope)
+{
+    return scope->localCount++;
+}
+
 AST* setLocalSymbol(Scope* scope, StringObject* id, AST* symbol)
 {
     if (setTableAt(&scope->symbols, id, symbol)) {
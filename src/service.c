@@ -1,26 +1,125 @@
 #include "service.h"
+#include "intern.h"
+#include "native.h"
+#include "stringobject.h"
+#include "table.h"
 #include "token.h"
+#include "vector.h"
+#include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 
-Service services[SERVICES_MAX] = {
-    {"exit", SOP_EXIT, 0, {}, T_NONE},
-    {"print", SOP_PRINT, 1, {T_INT}, T_NONE},
-    {"clamp", SOP_CLAMP, 3, {T_INT, T_INT, T_INT}, T_INT},
-    {"abs", SOP_ABS, 1, {T_INT}, T_INT},
-    {"min", SOP_MIN, 2, {T_INT, T_INT}, T_INT},
-    {"max", SOP_MAX, 2, {T_INT, T_INT}, T_INT},
-    {"byteorder", SOP_BYTEORDER, 0, {}, T_INT}
-};
-
-Service* getServiceByName(char* name)
+ServiceRegistry serviceRegistry;
+
+static void registerFuture(const char* name, service_t function, int paramCount, const int* params)
+{
+    registerService(name, function, T_INT, paramCount, params)->future = true;
+}
+
+static void registerBuiltins()
+{
+    static const int one[] = {T_INT};
+    static const int two[] = {T_INT, T_INT};
+    static const int three[] = {T_INT, T_INT, T_INT};
+
+    registerService("exit", __exit, T_NONE, 0, NULL);
+    registerService("print", __print, T_NONE, 1, one);
+    registerService("clamp", __clamp, T_INT, 3, three);
+    registerService("abs", __abs, T_INT, 1, one);
+    registerService("min", __min, T_INT, 2, two);
+    registerService("max", __max, T_INT, 2, two);
+    registerService("byteorder", __byteorder, T_INT, 0, NULL);
+    registerService("popcount", __popcount, T_INT, 1, one);
+    registerService("clz", __clz, T_INT, 1, one);
+    registerService("ctz", __ctz, T_INT, 1, one);
+    registerService("rotl", __rotl, T_INT, 2, two);
+    registerService("rotr", __rotr, T_INT, 2, two);
+    registerService("bswap", __bswap, T_INT, 1, one);
+    registerFuture("timer", __timer, 1, one);
+    registerService("cancel", __cancel, T_INT, 1, one);
+    registerFuture("readable", __readable, 1, one);
+    registerFuture("writable", __writable, 1, one);
+    registerService("tcplisten", __tcplisten, T_INT, 1, one);
+    registerService("tcpaccept", __tcpaccept, T_INT, 1, one);
+    registerService("tcpconnect", __tcpconnect, T_INT, 1, one);
+    registerService("tcpsend", __tcpsend, T_INT, 2, two);
+    registerService("tcprecv", __tcprecv, T_INT, 1, one);
+    registerService("closefd", __closefd, T_INT, 1, one);
+    registerService("channew", __channew, T_INT, 1, one);
+    registerFuture("chansend", __chansend, 2, two);
+    registerFuture("chanrecv", __chanrecv, 1, one);
+    registerService("closechannel", __chanclose, T_INT, 1, one);
+}
+
+void initServices()
+{
+    initVector(&serviceRegistry.services);
+    initTable(&serviceRegistry.names, 64);
+    pthread_mutex_init(&serviceRegistry.lock, NULL);
+    registerBuiltins();
+}
+
+void freeServices()
+{
+    for (size_t i = 0; i < countVector(&serviceRegistry.services); i++) {
+        Service* service = serviceRegistry.services.data[i];
+
+        free(service);
+    }
+
+    freeVector(&serviceRegistry.services);
+    freeTable(&serviceRegistry.names);
+    pthread_mutex_destroy(&serviceRegistry.lock);
+}
+
+// Adds a native the scripts can call by name with params, which holds
+// paramCount type ids, returning typeId or nothing when that is T_NONE.
+// Returns NULL when the name is taken or the service cannot be encoded.
+Service* registerService(const char* name, service_t function, int typeId, int paramCount, const int* params)
 {
-    for (int i = 0; i < SERVICES_MAX; i++) {
-        Service* service = &services[i];
+    ServiceRegistry* registry = &serviceRegistry;
+
+    if (paramCount < 0 || paramCount > SERVICE_PARAMS_MAX) {
+        return NULL;
+    }
 
-        if (strcmp(name, service->name) == 0) {
-            return service;
-        }
+    StringObject* key = internString(name, strlen(name));
+    Service* service = malloc(sizeof(Service));
+
+    pthread_mutex_lock(&registry->lock);
+
+    size_t count = countVector(&registry->services);
+
+    if (count == SERVICES_MAX || !setTableAt(&registry->names, key, service)) {
+        pthread_mutex_unlock(&registry->lock);
+        free(service);
+        return NULL;
     }
 
-    return NULL;
+    service->name = key;
+    service->opcode = count;
+    service->paramCount = paramCount;
+    service->resultCount = typeId != T_NONE;
+    service->typeId = typeId;
+    service->future = false;
+
+    if (paramCount > 0) {
+        memcpy(service->params, params, sizeof(int) * paramCount);
+    }
+
+    registry->functions[count] = function;
+    pushVectorItem(&registry->services, service);
+    pthread_mutex_unlock(&registry->lock);
+
+    return service;
+}
+
+// name is interned.
+Service* getServiceByName(StringObject* name)
+{
+    pthread_mutex_lock(&serviceRegistry.lock);
+    Service* service = getTableAt(&serviceRegistry.names, name);
+    pthread_mutex_unlock(&serviceRegistry.lock);
+
+    return service;
 }
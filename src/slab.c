@@ -0,0 +1,100 @@
+#include "slab.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* outOfMemoryError = "Error: Out of memory\n";
+
+// Each thread takes and frees blocks without a lock. A block freed on
+// another thread than the one it came from joins the free list of the
+// thread that freed it.
+static _Thread_local SlabClass classes[SLAB_CLASSES];
+static Slab* slabs = NULL;
+static pthread_mutex_t slabLock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t getClass(size_t size)
+{
+    return (size - 1) / SLAB_ALIGN;
+}
+
+// Only called once what is left of the last slab is smaller than a block
+// of the class, so all that is dropped is that remainder, which is never
+// handed out. It goes with the slab at exit.
+static void refillClass(SlabClass* class)
+{
+    Slab* slab = malloc(SLAB_SIZE);
+
+    if (!slab) {
+        fprintf(stderr, "%s", outOfMemoryError);
+        exit(1);
+    }
+
+    pthread_mutex_lock(&slabLock);
+    slab->next = slabs;
+    slabs = slab;
+    pthread_mutex_unlock(&slabLock);
+
+    class->next = slab->blocks;
+    class->end = (char*)slab + SLAB_SIZE;
+}
+
+// Blocks larger than the largest class come from malloc.
+void* allocateSlab(size_t size)
+{
+    if (size == 0 || size > SLAB_SIZE_MAX) {
+        return malloc(size);
+    }
+
+    size_t index = getClass(size);
+    size_t blockSize = (index + 1) * SLAB_ALIGN;
+    SlabClass* class = &classes[index];
+    Block* block = class->free;
+
+    if (block) {
+        class->free = block->next;
+        return block;
+    }
+
+    if ((size_t)(class->end - class->next) < blockSize) {
+        refillClass(class);
+    }
+
+    block = (Block*)class->next;
+    class->next += blockSize;
+
+    return block;
+}
+
+// size is what the block was allocated with.
+void freeSlab(void* block, size_t size)
+{
+    if (size == 0 || size > SLAB_SIZE_MAX) {
+        return free(block);
+    }
+
+    if (!block) {
+        return;
+    }
+
+    SlabClass* class = &classes[getClass(size)];
+
+    ((Block*)block)->next = class->free;
+    class->free = block;
+}
+
+// Only called at exit, once no other thread is left.
+void freeSlabs()
+{
+    pthread_mutex_lock(&slabLock);
+
+    while (slabs) {
+        Slab* next = slabs->next;
+        free(slabs);
+        slabs = next;
+    }
+
+    pthread_mutex_unlock(&slabLock);
+    memset(classes, 0, sizeof(classes));
+}
@@ -16,18 +16,10 @@ StringObject* createStringObject(char* chars, size_t length, size_t hash)
     return string;
 }
 
-StringObject* copyStringObject(const char* chars, size_t len)
-{
-    size_t hash = hashStringObject(chars, len);
-    char* dst = strndup(chars, len);
-
-    return createStringObject(dst, len, hash);
-}
-
 void freeStringObject(StringObject* string)
 {
     free(string->chars);
-    free(string);
+    FREE_OBJECT(StringObject, string);
 }
 
 bool compareStringObject(StringObject* a, StringObject* b)
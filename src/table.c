@@ -1,11 +1,14 @@
 #include "table.h"
+#include "arena.h"
+#include "slab.h"
 #include "stringobject.h"
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
-TableItem* createTableItem(StringObject* key, void* value, TableItem* next)
+TableItem* createTableItem(Arena* arena, StringObject* key, void* value, TableItem* next)
 {
-    TableItem* item = malloc(sizeof(TableItem));
+    TableItem* item = arena ? allocateArena(arena, sizeof(TableItem)) : allocateSlab(sizeof(TableItem));
     item->key = key;
     item->value = value;
     item->next = next;
@@ -19,18 +22,41 @@ void freeTableItem(TableItem* item)
         freeTableItem(item->next);
     }
 
-    free(item);
+    freeSlab(item, sizeof(TableItem));
+}
+
+static TableItem** createBuckets(Table* table)
+{
+    if (!table->arena) {
+        return calloc(table->capacity, sizeof(TableItem*));
+    }
+
+    TableItem** data = allocateArena(table->arena, sizeof(TableItem*) * table->capacity);
+
+    memset(data, 0, sizeof(TableItem*) * table->capacity);
+
+    return data;
 }
 
 void initTable(Table* table, size_t capacity)
+{
+    initArenaTable(table, capacity, NULL);
+}
+
+void initArenaTable(Table* table, size_t capacity, Arena* arena)
 {
     table->capacity = capacity;
-    table->data = calloc(table->capacity, sizeof(TableItem*));
+    table->arena = arena;
+    table->data = createBuckets(table);
     table->count = 0;
 }
 
 void freeTable(Table* table)
 {
+    if (table->arena) {
+        return;
+    }
+
     for (int i = 0; i < table->capacity; i++) {
         TableItem* item = table->data[i];
 
@@ -56,7 +82,7 @@ void* getTableAt(Table* table, StringObject* key)
     size_t index = key->hash % table->capacity;
     TableItem* current = table->data[index];
 
-    while (current && !compareStringObject(current->key, key)) {
+    while (current && current->key != key) {
         current = current->next;
     }
 
@@ -67,21 +93,54 @@ void* getTableAt(Table* table, StringObject* key)
     return NULL;
 }
 
+// Doubles the bucket count once there are as many items as buckets, so
+// chains stay short however many keys are added.
+static void growTable(Table* table)
+{
+    size_t capacity = table->capacity;
+    TableItem** data = table->data;
+
+    table->capacity = capacity * 2;
+    table->data = createBuckets(table);
+
+    for (size_t i = 0; i < capacity; i++) {
+        TableItem* item = data[i];
+
+        while (item) {
+            TableItem* next = item->next;
+            size_t index = item->key->hash % table->capacity;
+
+            item->next = table->data[index];
+            table->data[index] = item;
+            item = next;
+        }
+    }
+
+    if (!table->arena) {
+        free(data);
+    }
+}
+
 bool setTableAt(Table* table, StringObject* key, void* value)
 {
     size_t index = key->hash % table->capacity;
     TableItem* current = table->data[index];
 
     while (current) {
-        if (compareStringObject(current->key, key)) {
+        if (current->key == key) {
             return false;
         }
 
         current = current->next;
     }
 
+    if (table->count == table->capacity) {
+        growTable(table);
+        index = key->hash % table->capacity;
+    }
+
     TableItem* next = table->data[index];
-    table->data[index] = createTableItem(key, value, next);
+    table->data[index] = createTableItem(table->arena, key, value, next);
     table->count++;
 
     return true;
@@ -93,7 +152,7 @@ bool deleteTableAt(Table* table, StringObject* key)
     TableItem* prev = NULL;
     TableItem* current = table->data[index];
 
-    while (current && !compareStringObject(current->key, key)) {
+    while (current && current->key != key) {
         prev = current;
         current = current->next;
     }
@@ -108,7 +167,10 @@ bool deleteTableAt(Table* table, StringObject* key)
         prev->next = current->next;
     }
 
-    freeTableItem(current);
+    if (!table->arena) {
+        current->next = NULL;
+        freeTableItem(current);
+    }
 
     return true;
 }
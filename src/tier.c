@@ -0,0 +1,211 @@
+#include "tier.h"
+#include "functionobject.h"
+#include "jit.h"
+#include "moduleobject.h"
+#include "optimizer.h"
+#include "trace.h"
+#include "vector.h"
+#include "vm.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+static const char* tierNames[] = {
+    [TIER_INTERPRETED] = "interpreted",
+    [TIER_OPTIMIZED]   = "optimized",
+    [TIER_NATIVE]      = "native"
+};
+
+void initTierPolicy(TierPolicy* policy)
+{
+    policy->optimizeThreshold = TIER_OPTIMIZE_THRESHOLD;
+    policy->nativeThreshold = TIER_NATIVE_THRESHOLD;
+    policy->traceThreshold = TIER_TRACE_THRESHOLD;
+}
+
+static uint64_t getHotness(FunctionObject* function)
+{
+    return function->callCount + function->loopCount;
+}
+
+static bool isDue(uint32_t threshold, uint64_t hotness)
+{
+    return threshold != 0 && hotness >= threshold;
+}
+
+// The hotness at which the function is looked at again: the lowest
+// threshold it has not reached of the tiers above it. Tiers that failed
+// are not retried.
+static uint64_t getNextThreshold(VM* vm, FunctionObject* function, uint64_t hotness)
+{
+    TierPolicy* policy = &vm->policy;
+    uint64_t next = UINT64_MAX;
+
+    if (function->tier < TIER_OPTIMIZED && policy->optimizeThreshold > hotness) {
+        next = policy->optimizeThreshold;
+    }
+
+    if (function->tier < TIER_NATIVE && vm->jit.mode != JIT_OFF
+        && policy->nativeThreshold > hotness && policy->nativeThreshold < next) {
+        next = policy->nativeThreshold;
+    }
+
+    return next;
+}
+
+// Called when a function reaches its next threshold. Moves it up every
+// tier it qualifies for and returns whether it now runs native code.
+bool promoteFunction(VM* vm, FunctionObject* function)
+{
+    TierPolicy* policy = &vm->policy;
+    uint64_t hotness = getHotness(function);
+
+    if (function->tier < TIER_OPTIMIZED && isDue(policy->optimizeThreshold, hotness)
+        && optimizeFunction(vm, function, NULL)) {
+        function->tier = TIER_OPTIMIZED;
+    }
+
+    if (function->tier < TIER_NATIVE && vm->jit.mode != JIT_OFF
+        && isDue(policy->nativeThreshold, hotness) && compileNative(vm, function)) {
+        function->tier = TIER_NATIVE;
+    }
+
+    function->nextTier = getNextThreshold(vm, function, hotness);
+
+    return function->native != NULL;
+}
+
+static bool isCurrentCode(FunctionObject* function, uint8_t* ip)
+{
+    return ip >= function->code.data && ip < function->code.data + function->code.count;
+}
+
+// In trace mode a loop that reaches its threshold is recorded, and one
+// that is not recorded now backs off before the next attempt.
+static LoopAction traceLoop(VM* vm, LoopCounter* loop)
+{
+    uint32_t threshold = vm->policy.traceThreshold;
+    Tracer* tracer = &vm->tracer;
+
+    if (threshold == 0) {
+        loop->threshold = UINT64_MAX;
+        return LOOP_INTERPRET;
+    }
+
+    if (loop->count < threshold) {
+        loop->threshold = threshold;
+        return LOOP_INTERPRET;
+    }
+
+    loop->threshold = loop->count + TRACE_BACKOFF;
+
+    if (tracer->recording || tracer->traceCount == TRACES_MAX) {
+        return LOOP_INTERPRET;
+    }
+
+    return LOOP_RECORD;
+}
+
+// Backward branches of this loop until the function is looked at again.
+// Frames still running code that was replaced check back now and then.
+static uint64_t getLoopThreshold(LoopCounter* loop)
+{
+    FunctionObject* function = loop->function;
+
+    if (function->native) {
+        return loop->count + TIER_OSR_BACKOFF;
+    }
+
+    if (function->nextTier == UINT64_MAX) {
+        return UINT64_MAX;
+    }
+
+    return loop->count + (function->nextTier - getHotness(function));
+}
+
+// Called when a loop reaches its threshold with ip at the loop header.
+// The function moves up as a call would move it and the running frame
+// follows it there: into optimized bytecode by moving ip, into native code
+// by returning LOOP_ENTER_NATIVE. This is how code that is never called
+// again, like the top level, leaves the interpreter. A generator goes no
+// further than optimized bytecode: its operands are away from its frame,
+// on the stack of whoever resumed it, where native code and traces do not
+// look for them.
+LoopAction promoteLoop(VM* vm, LoopCounter* loop, uint8_t** ip)
+{
+    FunctionObject* function = loop->function;
+    TierPolicy* policy = &vm->policy;
+    uint64_t hotness = getHotness(function);
+
+    if (isCurrentCode(function, *ip)) {
+        if (function->tier < TIER_OPTIMIZED && isDue(policy->optimizeThreshold, hotness)
+            && optimizeFunction(vm, function, ip)) {
+            function->tier = TIER_OPTIMIZED;
+        }
+
+        if (function->tier < TIER_NATIVE && vm->jit.mode == JIT_BASELINE && !function->generator
+            && isDue(policy->nativeThreshold, hotness) && compileNative(vm, function)) {
+            function->tier = TIER_NATIVE;
+        }
+
+        function->nextTier = getNextThreshold(vm, function, hotness);
+    }
+
+    if (function->generator) {
+        loop->threshold = getLoopThreshold(loop);
+        return LOOP_INTERPRET;
+    }
+
+    if (vm->jit.mode == JIT_TRACE) {
+        return traceLoop(vm, loop);
+    }
+
+    if (function->native && loop->entry && isCurrentCode(function, *ip)) {
+        loop->threshold = loop->count + 1;
+        return LOOP_ENTER_NATIVE;
+    }
+
+    loop->threshold = getLoopThreshold(loop);
+
+    return LOOP_INTERPRET;
+}
+
+const char* getTierName(Tier tier)
+{
+    return tierNames[tier];
+}
+
+// Native code and traces do not count, so the counts are those of the
+// interpreted tiers.
+void printCounters(ModuleObject* module)
+{
+    fprintf(stderr, "functions:\n");
+
+    for (size_t i = 0; i < countVector(&module->functions); i++) {
+        FunctionObject* function = module->functions.data[i];
+
+        fprintf(stderr, "  %4zu  %12llu calls  %12llu backedges  %s\n", i,
+            (unsigned long long)function->callCount,
+            (unsigned long long)function->loopCount,
+            getTierName(function->tier));
+    }
+
+    if (countVector(&module->loops) == 0) {
+        return;
+    }
+
+    fprintf(stderr, "loops:\n");
+
+    for (size_t i = 0; i < countVector(&module->loops); i++) {
+        LoopCounter* loop = module->loops.data[i];
+        size_t function = 0;
+
+        while (module->functions.data[function] != loop->function) {
+            function++;
+        }
+
+        fprintf(stderr, "  %4zu  %12llu backedges  in function %zu\n", i,
+            (unsigned long long)loop->count, function);
+    }
+}
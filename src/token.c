@@ -30,9 +30,24 @@ bool isAssignmentToken(TokenType type)
     }
 }
 
+// The operator a compound assignment applies, or T_NONE for plain =.
+TokenType getBinaryOperatorToken(TokenType type)
+{
+    switch (type) {
+        case T_PLUS_EQUAL:      return T_PLUS;
+        case T_MINUS_EQUAL:     return T_MINUS;
+        case T_STAR_EQUAL:      return T_STAR;
+        case T_SLASH_EQUAL:     return T_SLASH;
+        case T_FLOOR_EQUAL:     return T_FLOOR;
+        case T_PERCENT_EQUAL:   return T_PERCENT;
+        case T_POWER_EQUAL:     return T_POWER;
+        default:                return T_NONE;
+    }
+}
+
 bool isTypeToken(TokenType type)
 {
-    return type == T_INT;
+    return type >= T_INT && type <= T_DOUBLE;
 }
 
 bool isComparisonToken(TokenType type)
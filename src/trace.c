@@ -0,0 +1,1206 @@
+#include "trace.h"
+#include "assembler.h"
+#include "functionobject.h"
+#include "jit.h"
+#include "native.h"
+#include "opcode.h"
+#include "service.h"
+#include "value.h"
+#include "vm.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SLOTS_MAX 32
+#define SLOT_REGISTERS_MAX 5
+#define TRACE_DEPTH_MAX 32
+
+#define POOL_SIZE ((int)(sizeof(pool) / sizeof(pool[0])))
+
+// Registers inside a trace: r12 holds the frame pointer, r13 the stack
+// pointer the trace was entered with, r14 the VM and r15 the globals.
+// Slots and temporaries share the pool; rax, rcx and rdx are scratch.
+static const Register pool[] = { RBX, RBP, RSI, RDI, R8, R9, R10, R11 };
+static const Register saved[] = { RBX, RBP, R12, R13, R14, R15 };
+
+typedef enum OperandKind
+{
+    OPERAND_CONSTANT,
+    OPERAND_REGISTER,
+    OPERAND_MEMORY
+} OperandKind;
+
+// An operand stack entry as seen while compiling. Memory operands live at
+// their own position above the stack pointer the trace was entered with.
+typedef struct Operand
+{
+    OperandKind kind;
+    int32_t value;
+    Register reg;
+    int slot;
+} Operand;
+
+// A local or global the trace reads or writes. The most used ones live in
+// registers for the whole trace and are written back when it exits.
+typedef struct Slot
+{
+    bool global;
+    int index;
+    int uses;
+    bool written;
+    Register reg;
+} Slot;
+
+// The operand stack at a guard, which its exit stub spills.
+typedef struct Snapshot
+{
+    uint8_t* ip;
+    int depth;
+    Operand stack[TRACE_DEPTH_MAX];
+    size_t jump;
+} Snapshot;
+
+typedef struct TraceCompiler
+{
+    VM* vm;
+    Tracer* tracer;
+    Assembler as;
+    Slot slots[SLOTS_MAX];
+    int slotCount;
+    int slotRegisterCount;
+    Operand stack[TRACE_DEPTH_MAX];
+    int depth;
+    Snapshot exits[TRACE_EXITS_MAX];
+    int exitCount;
+    bool failed;
+} TraceCompiler;
+
+void initTracer(Tracer* tracer)
+{
+    tracer->traceCount = 0;
+    tracer->recording = false;
+    tracer->header = NULL;
+    tracer->fp = NULL;
+    tracer->count = 0;
+}
+
+void freeTracer(Tracer* tracer)
+{
+    for (int i = 0; i < tracer->traceCount; i++) {
+        free(tracer->traces[i].exits);
+    }
+}
+
+void startRecording(Tracer* tracer, uint8_t* header, Value* fp)
+{
+    tracer->recording = true;
+    tracer->header = header;
+    tracer->fp = fp;
+    tracer->count = 0;
+}
+
+static bool abortRecording(Tracer* tracer)
+{
+    tracer->recording = false;
+
+    return false;
+}
+
+static uint16_t getOperand16(uint8_t* ip)
+{
+    return (ip[1] << 8) | ip[2];
+}
+
+static int getLocalIndex(uint8_t* ip)
+{
+    switch (ip[0]) {
+        case OP_LDL_0: case OP_STL_0:   return 0;
+        case OP_LDL_1: case OP_STL_1:   return 1;
+        case OP_LDL_2: case OP_STL_2:   return 2;
+        case OP_LDL_3: case OP_STL_3:   return 3;
+        default:                        return (int8_t)ip[1];
+    }
+}
+
+static int findSlot(TraceCompiler* c, bool global, int index)
+{
+    for (int i = 0; i < c->slotCount; i++) {
+        if (c->slots[i].global == global && c->slots[i].index == index) {
+            return i;
+        }
+    }
+
+    if (c->slotCount == SLOTS_MAX) {
+        c->failed = true;
+        return 0;
+    }
+
+    c->slots[c->slotCount] = (Slot){global, index, 0, false, NO_REGISTER};
+
+    return c->slotCount++;
+}
+
+static void useSlot(TraceCompiler* c, bool global, int index, bool write)
+{
+    Slot* slot = &c->slots[findSlot(c, global, index)];
+
+    slot->uses++;
+    slot->written |= write;
+}
+
+// Counts slot uses over the whole trace and gives registers to the most
+// used slots; what is left of the pool holds temporaries.
+static void allocateSlots(TraceCompiler* c)
+{
+    Tracer* tracer = c->tracer;
+
+    for (int i = 0; i < tracer->count; i++) {
+        uint8_t* ip = tracer->ips[i];
+
+        switch (ip[0]) {
+            case OP_LDL: case OP_LDL_0: case OP_LDL_1: case OP_LDL_2: case OP_LDL_3:
+            case OP_LDL_ADD: case OP_LDL_SUB: case OP_LDL_MUL:
+                useSlot(c, false, getLocalIndex(ip), false);
+                break;
+            case OP_STL: case OP_STL_0: case OP_STL_1: case OP_STL_2: case OP_STL_3:
+                useSlot(c, false, getLocalIndex(ip), true);
+                break;
+            case OP_LDL_LDL_ADD: case OP_LDL_LDL_SUB: case OP_LDL_LDL_MUL:
+                useSlot(c, false, (int8_t)ip[1], false);
+                useSlot(c, false, (int8_t)ip[2], false);
+                break;
+            case OP_INCL:
+                useSlot(c, false, (int8_t)ip[1], false);
+                useSlot(c, false, (int8_t)ip[1], true);
+                break;
+            case OP_LDG: case OP_LKG:
+                useSlot(c, true, ip[1], false);
+                break;
+            case OP_STG: case OP_ULG:
+                useSlot(c, true, ip[1], true);
+                break;
+        }
+    }
+
+    while (c->slotRegisterCount < SLOT_REGISTERS_MAX) {
+        Slot* best = NULL;
+
+        for (int i = 0; i < c->slotCount; i++) {
+            Slot* slot = &c->slots[i];
+
+            if (slot->reg == NO_REGISTER && (!best || slot->uses > best->uses)) {
+                best = slot;
+            }
+        }
+
+        if (!best) {
+            break;
+        }
+
+        best->reg = pool[c->slotRegisterCount++];
+    }
+}
+
+static Register getSlotBase(Slot* slot)
+{
+    return slot->global ? R15 : R12;
+}
+
+static int32_t getSlotOffset(Slot* slot)
+{
+    return slot->index * (int32_t)sizeof(Value);
+}
+
+static int32_t getStackOffset(int position)
+{
+    return position * (int32_t)sizeof(Value);
+}
+
+// Registers hold ints in their low half, so every store puts the tag back
+// first. rdx is free outside of a division.
+static void storeInt(TraceCompiler* c, Register base, int32_t disp, Register src)
+{
+    emitMovImm64(&c->as, RDX, INT_TAG);
+    emitAlu64(&c->as, ALU_OR, RDX, src);
+    emitStore(&c->as, base, disp, RDX);
+}
+
+static void storeIntImm(TraceCompiler* c, Register base, int32_t disp, int32_t imm)
+{
+    emitMovImm64(&c->as, RDX, INT_VALUE(imm));
+    emitStore(&c->as, base, disp, RDX);
+}
+
+static void loadSlots(TraceCompiler* c)
+{
+    emitLoad(&c->as, R15, R14, offsetof(VM, globals.data));
+
+    for (int i = 0; i < c->slotCount; i++) {
+        Slot* slot = &c->slots[i];
+
+        if (slot->reg != NO_REGISTER) {
+            emitLoad(&c->as, slot->reg, getSlotBase(slot), getSlotOffset(slot));
+        }
+    }
+}
+
+static void writeBackSlots(TraceCompiler* c)
+{
+    for (int i = 0; i < c->slotCount; i++) {
+        Slot* slot = &c->slots[i];
+
+        if (slot->reg != NO_REGISTER && slot->written) {
+            storeInt(c, getSlotBase(slot), getSlotOffset(slot), slot->reg);
+        }
+    }
+}
+
+static bool isTemporary(Operand* operand)
+{
+    return operand->kind == OPERAND_REGISTER && operand->slot < 0;
+}
+
+static bool isLive(TraceCompiler* c, Register reg)
+{
+    for (int i = 0; i < c->depth; i++) {
+        if (c->stack[i].kind == OPERAND_REGISTER && c->stack[i].reg == reg) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void storeOperand(TraceCompiler* c, Operand* operand, int position)
+{
+    switch (operand->kind) {
+        case OPERAND_CONSTANT:
+            return storeIntImm(c, R13, getStackOffset(position), operand->value);
+        case OPERAND_REGISTER:
+            return storeInt(c, R13, getStackOffset(position), operand->reg);
+        case OPERAND_MEMORY:
+            return;
+    }
+}
+
+static void spill(TraceCompiler* c, int position)
+{
+    storeOperand(c, &c->stack[position], position);
+    c->stack[position].kind = OPERAND_MEMORY;
+}
+
+// Takes a free register from the pool, spilling the deepest temporary when
+// every one is in use.
+static Register allocateTemporary(TraceCompiler* c)
+{
+    for (int i = c->slotRegisterCount; i < POOL_SIZE; i++) {
+        if (!isLive(c, pool[i])) {
+            return pool[i];
+        }
+    }
+
+    for (int i = 0; i < c->depth; i++) {
+        if (isTemporary(&c->stack[i])) {
+            Register reg = c->stack[i].reg;
+
+            spill(c, i);
+            return reg;
+        }
+    }
+
+    c->failed = true;
+
+    return pool[POOL_SIZE - 1];
+}
+
+static Operand* push(TraceCompiler* c)
+{
+    if (c->depth == TRACE_DEPTH_MAX) {
+        c->failed = true;
+        return &c->stack[TRACE_DEPTH_MAX - 1];
+    }
+
+    return &c->stack[c->depth++];
+}
+
+static bool pop(TraceCompiler* c, int n)
+{
+    if (c->depth < n) {
+        c->failed = true;
+        return false;
+    }
+
+    c->depth -= n;
+
+    return true;
+}
+
+static void pushConstant(TraceCompiler* c, int32_t value)
+{
+    *push(c) = (Operand){OPERAND_CONSTANT, value, NO_REGISTER, -1};
+}
+
+static void pushTemporary(TraceCompiler* c, Register reg)
+{
+    *push(c) = (Operand){OPERAND_REGISTER, 0, reg, -1};
+}
+
+static void pushMemory(TraceCompiler* c)
+{
+    *push(c) = (Operand){OPERAND_MEMORY, 0, NO_REGISTER, -1};
+}
+
+// Slots in registers are pushed as references to their register; the
+// others are loaded into a temporary.
+static void pushSlot(TraceCompiler* c, bool global, int index)
+{
+    int n = findSlot(c, global, index);
+    Slot* slot = &c->slots[n];
+
+    if (slot->reg != NO_REGISTER) {
+        *push(c) = (Operand){OPERAND_REGISTER, 0, slot->reg, n};
+        return;
+    }
+
+    Register reg = allocateTemporary(c);
+
+    emitLoad(&c->as, reg, getSlotBase(slot), getSlotOffset(slot));
+    pushTemporary(c, reg);
+}
+
+static void moveOperand(TraceCompiler* c, int position, Register reg)
+{
+    Operand* operand = &c->stack[position];
+
+    switch (operand->kind) {
+        case OPERAND_CONSTANT:
+            return emitMovImm(&c->as, reg, operand->value);
+        case OPERAND_REGISTER:
+            if (operand->reg != reg) {
+                emitMov(&c->as, reg, operand->reg);
+            }
+            return;
+        case OPERAND_MEMORY:
+            return emitLoad(&c->as, reg, R13, getStackOffset(position));
+    }
+}
+
+// Returns a register holding the operand, using scratch if it has none.
+static Register loadOperand(TraceCompiler* c, int position, Register scratch)
+{
+    Operand* operand = &c->stack[position];
+
+    if (operand->kind == OPERAND_REGISTER) {
+        return operand->reg;
+    }
+
+    moveOperand(c, position, scratch);
+
+    return scratch;
+}
+
+// Returns a temporary holding the operand that may be overwritten with
+// the result of an operation on it.
+static Register ownOperand(TraceCompiler* c, int position)
+{
+    Operand* operand = &c->stack[position];
+
+    if (isTemporary(operand)) {
+        return operand->reg;
+    }
+
+    Register reg = allocateTemporary(c);
+
+    moveOperand(c, position, reg);
+    *operand = (Operand){OPERAND_REGISTER, 0, reg, -1};
+
+    return reg;
+}
+
+static void storeSlot(TraceCompiler* c, bool global, int index)
+{
+    int n = findSlot(c, global, index);
+    Slot* slot = &c->slots[n];
+
+    if (c->depth == 0) {
+        c->failed = true;
+        return;
+    }
+
+    // Stack entries still referring to the slot keep its old value.
+    for (int i = 0; i < c->depth - 1; i++) {
+        if (c->stack[i].kind == OPERAND_REGISTER && c->stack[i].slot == n) {
+            Register reg = allocateTemporary(c);
+
+            emitMov(&c->as, reg, slot->reg);
+            c->stack[i] = (Operand){OPERAND_REGISTER, 0, reg, -1};
+        }
+    }
+
+    int position = c->depth - 1;
+    Operand* value = &c->stack[position];
+
+    if (slot->reg != NO_REGISTER) {
+        moveOperand(c, position, slot->reg);
+    } else if (value->kind == OPERAND_CONSTANT) {
+        storeIntImm(c, getSlotBase(slot), getSlotOffset(slot), value->value);
+    } else {
+        Register reg = loadOperand(c, position, RAX);
+
+        storeInt(c, getSlotBase(slot), getSlotOffset(slot), reg);
+    }
+
+    c->depth--;
+}
+
+// Folds with the wrapping arithmetic of the generated code. Divisions
+// that would trap are left to run.
+static bool fold(uint8_t opcode, int32_t a, int32_t b, int32_t* result)
+{
+    uint32_t x = a;
+    uint32_t y = b;
+
+    switch (opcode) {
+        case OP_ADD:    *result = (int32_t)(x + y); return true;
+        case OP_SUB:    *result = (int32_t)(x - y); return true;
+        case OP_MUL:    *result = (int32_t)(x * y); return true;
+        case OP_BAND:   *result = a & b; return true;
+        case OP_BOR:    *result = a | b; return true;
+        case OP_BXOR:   *result = a ^ b; return true;
+        case OP_LSL:    *result = (int32_t)(x << (y & 31)); return true;
+        case OP_LSR:
+        case OP_ASR:    *result = a >> (y & 31); return true;
+        case OP_MIN:    *result = minInt(a, b); return true;
+        case OP_MAX:    *result = maxInt(a, b); return true;
+        case OP_ROTL:   *result = rotlInt(a, b); return true;
+        case OP_ROTR:   *result = rotrInt(a, b); return true;
+        case OP_EQ:     *result = a == b; return true;
+        case OP_NE:     *result = a != b; return true;
+        case OP_LT:     *result = a < b; return true;
+        case OP_LE:     *result = a <= b; return true;
+        case OP_GT:     *result = a > b; return true;
+        case OP_GE:     *result = a >= b; return true;
+        case OP_DIV:
+        case OP_REM:
+            if (b == 0 || (a == INT32_MIN && b == -1)) {
+                return false;
+            }
+            *result = opcode == OP_DIV ? a / b : a % b;
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool foldBinary(TraceCompiler* c, uint8_t opcode)
+{
+    Operand* a = &c->stack[c->depth - 2];
+    Operand* b = &c->stack[c->depth - 1];
+    int32_t result;
+
+    if (a->kind != OPERAND_CONSTANT || b->kind != OPERAND_CONSTANT
+        || !fold(opcode, a->value, b->value, &result)) {
+        return false;
+    }
+
+    c->depth -= 2;
+    pushConstant(c, result);
+
+    return true;
+}
+
+static void arithmetic(TraceCompiler* c, AluOp op)
+{
+    Register dst = ownOperand(c, c->depth - 2);
+    Operand* b = &c->stack[c->depth - 1];
+
+    if (b->kind == OPERAND_CONSTANT) {
+        emitAluImm(&c->as, op, dst, b->value);
+    } else {
+        emitAlu(&c->as, op, dst, loadOperand(c, c->depth - 1, RAX));
+    }
+
+    c->depth--;
+}
+
+static void multiply(TraceCompiler* c)
+{
+    Register dst = ownOperand(c, c->depth - 2);
+    Operand* b = &c->stack[c->depth - 1];
+
+    if (b->kind == OPERAND_CONSTANT) {
+        emitImulImm(&c->as, dst, dst, b->value);
+    } else {
+        emitImul(&c->as, dst, loadOperand(c, c->depth - 1, RAX));
+    }
+
+    c->depth--;
+}
+
+static void divide(TraceCompiler* c, bool remainder)
+{
+    Operand* b = &c->stack[c->depth - 1];
+    Register divisor = b->kind == OPERAND_REGISTER ? b->reg : RCX;
+
+    moveOperand(c, c->depth - 2, RAX);
+    moveOperand(c, c->depth - 1, divisor);
+    emitCdq(&c->as);
+    emitUnary(&c->as, UNARY_IDIV, divisor);
+    c->depth -= 2;
+
+    Register dst = allocateTemporary(c);
+
+    emitMov(&c->as, dst, remainder ? RDX : RAX);
+    pushTemporary(c, dst);
+}
+
+static void shift(TraceCompiler* c, ShiftOp op)
+{
+    Register dst = ownOperand(c, c->depth - 2);
+    Operand* b = &c->stack[c->depth - 1];
+
+    if (b->kind == OPERAND_CONSTANT) {
+        emitShiftImm(&c->as, op, dst, b->value);
+    } else {
+        moveOperand(c, c->depth - 1, RCX);
+        emitShift(&c->as, op, dst);
+    }
+
+    c->depth--;
+}
+
+// min keeps the first operand unless it is greater than the second, max
+// unless it is less.
+static void minMax(TraceCompiler* c, Condition cond)
+{
+    Register dst = ownOperand(c, c->depth - 2);
+    Register b = loadOperand(c, c->depth - 1, RAX);
+
+    emitAlu(&c->as, ALU_CMP, dst, b);
+    emitCmov(&c->as, cond, dst, b);
+    c->depth--;
+}
+
+// clamp(x, min, max) is max when x is greater, then min when x is less.
+static void clamp(TraceCompiler* c)
+{
+    if (c->depth < 3) {
+        c->failed = true;
+        return;
+    }
+
+    Register dst = ownOperand(c, c->depth - 3);
+    Register min = loadOperand(c, c->depth - 2, RCX);
+    Register max = loadOperand(c, c->depth - 1, RAX);
+
+    emitMov(&c->as, RDX, dst);
+    emitAlu(&c->as, ALU_CMP, RDX, max);
+    emitCmov(&c->as, COND_G, dst, max);
+    emitAlu(&c->as, ALU_CMP, RDX, min);
+    emitCmov(&c->as, COND_L, dst, min);
+    c->depth -= 2;
+}
+
+static void binary(TraceCompiler* c, uint8_t opcode)
+{
+    if (c->depth < 2) {
+        c->failed = true;
+        return;
+    }
+
+    if (foldBinary(c, opcode)) {
+        return;
+    }
+
+    switch (opcode) {
+        case OP_ADD:    return arithmetic(c, ALU_ADD);
+        case OP_SUB:    return arithmetic(c, ALU_SUB);
+        case OP_BAND:   return arithmetic(c, ALU_AND);
+        case OP_BOR:    return arithmetic(c, ALU_OR);
+        case OP_BXOR:   return arithmetic(c, ALU_XOR);
+        case OP_MUL:    return multiply(c);
+        case OP_DIV:    return divide(c, false);
+        case OP_REM:    return divide(c, true);
+        case OP_LSL:    return shift(c, SHIFT_SHL);
+        case OP_ROTL:   return shift(c, SHIFT_ROL);
+        case OP_ROTR:   return shift(c, SHIFT_ROR);
+        case OP_MIN:    return minMax(c, COND_G);
+        case OP_MAX:    return minMax(c, COND_L);
+        default:        return shift(c, SHIFT_SAR);
+    }
+}
+
+static void unary(TraceCompiler* c, uint8_t opcode)
+{
+    if (c->depth < 1) {
+        c->failed = true;
+        return;
+    }
+
+    Operand* operand = &c->stack[c->depth - 1];
+
+    if (operand->kind == OPERAND_CONSTANT) {
+        int32_t x = operand->value;
+
+        switch (opcode) {
+            case OP_INC:    operand->value = (int32_t)((uint32_t)x + 1); break;
+            case OP_DEC:    operand->value = (int32_t)((uint32_t)x - 1); break;
+            case OP_NEG:    operand->value = (int32_t)(0 - (uint32_t)x); break;
+            case OP_BNOT:   operand->value = ~x; break;
+            case OP_NOT:    operand->value = !x; break;
+            case OP_ABS:    operand->value = absInt(x); break;
+            case OP_POPCNT: operand->value = popcountInt(x); break;
+            case OP_CLZ:    operand->value = clzInt(x); break;
+            case OP_CTZ:    operand->value = ctzInt(x); break;
+            case OP_BSWAP:  operand->value = bswapInt(x); break;
+        }
+        return;
+    }
+
+    if (opcode == OP_NOT) {
+        Register reg = loadOperand(c, c->depth - 1, RAX);
+
+        emitTest(&c->as, reg, reg);
+        c->depth--;
+
+        Register dst = allocateTemporary(c);
+
+        emitSetcc(&c->as, COND_E, dst);
+        return pushTemporary(c, dst);
+    }
+
+    Register dst = ownOperand(c, c->depth - 1);
+
+    switch (opcode) {
+        case OP_INC:    return emitAluImm(&c->as, ALU_ADD, dst, 1);
+        case OP_DEC:    return emitAluImm(&c->as, ALU_SUB, dst, 1);
+        case OP_NEG:    return emitUnary(&c->as, UNARY_NEG, dst);
+        case OP_BNOT:   return emitUnary(&c->as, UNARY_NOT, dst);
+        case OP_POPCNT: return emitPopcnt(&c->as, dst, dst);
+        case OP_BSWAP:  return emitBswap(&c->as, dst);
+
+        // abs is (x ^ s) - s with s the sign of x in every bit; a bit scan
+        // of zero leaves its result to the cmov.
+        case OP_ABS:
+            emitMov(&c->as, RAX, dst);
+            emitShiftImm(&c->as, SHIFT_SAR, RAX, 31);
+            emitAlu(&c->as, ALU_XOR, dst, RAX);
+            emitAlu(&c->as, ALU_SUB, dst, RAX);
+            break;
+        case OP_CLZ:
+            emitMovImm(&c->as, RAX, 63);
+            emitBsr(&c->as, dst, dst);
+            emitCmov(&c->as, COND_E, dst, RAX);
+            emitAluImm(&c->as, ALU_XOR, dst, 31);
+            break;
+        case OP_CTZ:
+            emitMovImm(&c->as, RAX, 32);
+            emitBsf(&c->as, dst, dst);
+            emitCmov(&c->as, COND_E, dst, RAX);
+            break;
+    }
+}
+
+static void duplicate(TraceCompiler* c)
+{
+    if (c->depth < 1) {
+        c->failed = true;
+        return;
+    }
+
+    Operand* top = &c->stack[c->depth - 1];
+
+    if (top->kind == OPERAND_CONSTANT || top->slot >= 0) {
+        Operand copy = *top;
+
+        *push(c) = copy;
+        return;
+    }
+
+    Register reg = allocateTemporary(c);
+
+    moveOperand(c, c->depth - 1, reg);
+    pushTemporary(c, reg);
+}
+
+// Pushes a global under the top of the stack. Traces only run without
+// workers, so nothing else can take the globals. An operand in memory
+// belongs to its position, so it moves into a register first.
+static void loadUnder(TraceCompiler* c, int index)
+{
+    if (c->depth < 1) {
+        c->failed = true;
+        return;
+    }
+
+    if (c->stack[c->depth - 1].kind == OPERAND_MEMORY) {
+        ownOperand(c, c->depth - 1);
+    }
+
+    pushSlot(c, true, index);
+
+    Operand top = c->stack[c->depth - 1];
+
+    c->stack[c->depth - 1] = c->stack[c->depth - 2];
+    c->stack[c->depth - 2] = top;
+}
+
+// Leaves the trace through a new exit when cond holds. The exit resumes
+// the interpreter at ip with the operand stack as it is now.
+static void guard(TraceCompiler* c, Condition cond, uint8_t* ip)
+{
+    if (c->exitCount == TRACE_EXITS_MAX) {
+        c->failed = true;
+        return;
+    }
+
+    Snapshot* exit = &c->exits[c->exitCount++];
+
+    exit->ip = ip;
+    exit->depth = c->depth;
+    memcpy(exit->stack, c->stack, sizeof(Operand) * c->depth);
+    exit->jump = emitJcc(&c->as, cond);
+}
+
+// A recorded jz becomes a guard for the direction it took. zero is the
+// condition under which it jumps.
+static void guardJump(TraceCompiler* c, int i, Condition zero)
+{
+    uint8_t* ip = c->tracer->ips[i];
+    uint8_t* next = ip + 3;
+    uint8_t* target = next + getOperand16(ip);
+
+    if (c->tracer->ips[i + 1] == target) {
+        guard(c, NEGATE_CONDITION(zero), next);
+    } else {
+        guard(c, zero, target);
+    }
+}
+
+static Condition getCondition(uint8_t opcode)
+{
+    switch (opcode) {
+        case OP_EQ:     return COND_E;
+        case OP_NE:     return COND_NE;
+        case OP_LT:     return COND_L;
+        case OP_LE:     return COND_LE;
+        case OP_GT:     return COND_G;
+        default:        return COND_GE;
+    }
+}
+
+// Compares the top two operands and pops them, leaving the flags set.
+static void compareOperands(TraceCompiler* c)
+{
+    Register left = loadOperand(c, c->depth - 2, RAX);
+    Operand* b = &c->stack[c->depth - 1];
+
+    if (b->kind == OPERAND_CONSTANT) {
+        emitAluImm(&c->as, ALU_CMP, left, b->value);
+    } else {
+        emitAlu(&c->as, ALU_CMP, left, loadOperand(c, c->depth - 1, RCX));
+    }
+
+    c->depth -= 2;
+}
+
+// A comparison followed by jz compiles to a compare and a conditional
+// exit; otherwise its result is materialized as 0 or 1.
+static int compare(TraceCompiler* c, int i)
+{
+    uint8_t opcode = c->tracer->ips[i][0];
+    Condition cond = getCondition(opcode);
+
+    if (c->depth < 2) {
+        c->failed = true;
+        return i + 1;
+    }
+
+    if (foldBinary(c, opcode)) {
+        return i + 1;
+    }
+
+    compareOperands(c);
+
+    if (c->tracer->ips[i + 1][0] == OP_JZ) {
+        guardJump(c, i + 1, NEGATE_CONDITION(cond));
+        return i + 2;
+    }
+
+    Register dst = allocateTemporary(c);
+
+    emitSetcc(&c->as, cond, dst);
+    pushTemporary(c, dst);
+
+    return i + 1;
+}
+
+// A branch on a constant needs no guard, only a check that the recorded
+// direction is the one it always takes.
+static void constantJump(TraceCompiler* c, int i, bool jumps)
+{
+    uint8_t* ip = c->tracer->ips[i];
+    bool taken = c->tracer->ips[i + 1] == ip + 3 + getOperand16(ip);
+
+    c->failed |= jumps != taken;
+    c->depth--;
+}
+
+static void jumpIfZero(TraceCompiler* c, int i)
+{
+    if (c->depth < 1) {
+        c->failed = true;
+        return;
+    }
+
+    Operand* operand = &c->stack[c->depth - 1];
+
+    if (operand->kind == OPERAND_CONSTANT) {
+        return constantJump(c, i, operand->value == 0);
+    }
+
+    Register reg = loadOperand(c, c->depth - 1, RAX);
+
+    emitTest(&c->as, reg, reg);
+    c->depth--;
+    guardJump(c, i, COND_E);
+}
+
+// The optimizer's fused jumps are taken when their comparison holds.
+static void compareAndJump(TraceCompiler* c, int i)
+{
+    uint8_t opcode = OP_EQ + (c->tracer->ips[i][0] - OP_JEQ);
+
+    if (c->depth < 2) {
+        c->failed = true;
+        return;
+    }
+
+    if (foldBinary(c, opcode)) {
+        return constantJump(c, i, c->stack[c->depth - 1].value != 0);
+    }
+
+    compareOperands(c);
+    guardJump(c, i, getCondition(opcode));
+}
+
+// Calls a helper with the interpreter's calling convention: the operand
+// stack and the slots are written to memory first and reloaded after.
+static void callHelper(TraceCompiler* c, void* helper, uint64_t argument, int popped)
+{
+    if (c->depth < popped) {
+        c->failed = true;
+        return;
+    }
+
+    for (int i = 0; i < c->depth; i++) {
+        spill(c, i);
+    }
+
+    writeBackSlots(c);
+    emitMov(&c->as, RDI, R14);
+    emitLea(&c->as, RSI, R13, getStackOffset(c->depth));
+    emitMovImm64(&c->as, RDX, argument);
+    emitCall(&c->as, helper);
+    loadSlots(c);
+
+    c->depth -= popped;
+    pushMemory(c);
+}
+
+// Natives are called directly on the operand stack in memory: they read
+// their arguments from it and leave their results in the same slots.
+static void callService(TraceCompiler* c, uint8_t* ip)
+{
+    int paramCount = ip[3] >> 4;
+    int resultCount = ip[3] & 15;
+
+    if (c->depth < paramCount) {
+        c->failed = true;
+        return;
+    }
+
+    for (int i = 0; i < c->depth; i++) {
+        spill(c, i);
+    }
+
+    writeBackSlots(c);
+    emitMov(&c->as, RDI, R14);
+    emitLea(&c->as, RSI, R13, getStackOffset(c->depth - paramCount));
+    emitCall(&c->as, c->vm->service[getOperand16(ip)]);
+    loadSlots(c);
+
+    c->depth -= paramCount;
+
+    for (int i = 0; i < resultCount; i++) {
+        pushMemory(c);
+    }
+}
+
+static int compileInstruction(TraceCompiler* c, int i)
+{
+    uint8_t* ip = c->tracer->ips[i];
+    ValueArray* constants = &c->vm->module->constants;
+    FunctionObject* function;
+
+    switch (ip[0]) {
+        case OP_REQS:
+            callService(c, ip);
+            break;
+        case OP_LDC:
+            pushConstant(c, AS_INT(constants->data[ip[1]]));
+            break;
+        case OP_LDG:
+            pushSlot(c, true, ip[1]);
+            break;
+        case OP_STG: case OP_ULG:
+            storeSlot(c, true, ip[1]);
+            break;
+        case OP_LKG:
+            loadUnder(c, ip[1]);
+            break;
+        case OP_LDL: case OP_LDL_0: case OP_LDL_1: case OP_LDL_2: case OP_LDL_3:
+            pushSlot(c, false, getLocalIndex(ip));
+            break;
+        case OP_STL: case OP_STL_0: case OP_STL_1: case OP_STL_2: case OP_STL_3:
+            storeSlot(c, false, getLocalIndex(ip));
+            break;
+        case OP_PUSHB:
+            pushConstant(c, (int8_t)ip[1]);
+            break;
+        case OP_PUSHH:
+            pushConstant(c, (int16_t)getOperand16(ip));
+            break;
+        case OP_PUSH_0: case OP_PUSH_1: case OP_PUSH_2: case OP_PUSH_3:
+            pushConstant(c, ip[0] - OP_PUSH_0);
+            break;
+        case OP_POP:
+            pop(c, 1);
+            break;
+        case OP_DUP:
+            duplicate(c);
+            break;
+        case OP_INC: case OP_DEC: case OP_BNOT: case OP_NOT: case OP_NEG:
+        case OP_ABS: case OP_CLZ: case OP_CTZ: case OP_BSWAP:
+            unary(c, ip[0]);
+            break;
+        case OP_POPCNT:
+            if (!hasPopcount()) {
+                c->failed = true;
+                break;
+            }
+            unary(c, ip[0]);
+            break;
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_REM:
+        case OP_BAND: case OP_BOR: case OP_BXOR: case OP_LSL: case OP_LSR: case OP_ASR:
+        case OP_MIN: case OP_MAX: case OP_ROTL: case OP_ROTR:
+            binary(c, ip[0]);
+            break;
+        case OP_CLAMP:
+            clamp(c);
+            break;
+        case OP_POW:
+            callHelper(c, jitPower, 0, 2);
+            break;
+        case OP_EQ: case OP_NE: case OP_LT: case OP_LE: case OP_GT: case OP_GE:
+            return compare(c, i);
+        case OP_JZ:
+            jumpIfZero(c, i);
+            break;
+        case OP_JEQ: case OP_JNE: case OP_JLT: case OP_JLE: case OP_JGT: case OP_JGE:
+            compareAndJump(c, i);
+            break;
+        case OP_JMP:
+            break;
+        case OP_CALL:
+            function = AS_POINTER(constants->data[getOperand16(ip)]);
+            callHelper(c, callFunction, (uintptr_t)function, function->paramCount);
+            break;
+        case OP_ADDI: case OP_SUBI: case OP_MULI: case OP_DIVI: case OP_REMI:
+            pushConstant(c, (int8_t)ip[1]);
+            binary(c, OP_ADD + (ip[0] - OP_ADDI));
+            break;
+        case OP_LDL_ADD: case OP_LDL_SUB: case OP_LDL_MUL:
+            pushSlot(c, false, (int8_t)ip[1]);
+            binary(c, OP_ADD + (ip[0] - OP_LDL_ADD));
+            break;
+        case OP_LDL_LDL_ADD: case OP_LDL_LDL_SUB: case OP_LDL_LDL_MUL:
+            pushSlot(c, false, (int8_t)ip[1]);
+            pushSlot(c, false, (int8_t)ip[2]);
+            binary(c, OP_ADD + (ip[0] - OP_LDL_LDL_ADD));
+            break;
+        case OP_INCL:
+            pushSlot(c, false, (int8_t)ip[1]);
+            pushConstant(c, (int8_t)ip[2]);
+            binary(c, OP_ADD);
+            storeSlot(c, false, (int8_t)ip[1]);
+            break;
+        default:
+            c->failed = true;
+            break;
+    }
+
+    return i + 1;
+}
+
+// Spills the operand stack an exit leaves behind, writes the slots back
+// and returns the exit's index to the interpreter.
+static void emitExit(TraceCompiler* c, int index, size_t epilogue)
+{
+    Snapshot* exit = &c->exits[index];
+
+    patchJumpTo(&c->as, exit->jump, c->as.count);
+
+    for (int i = 0; i < exit->depth; i++) {
+        storeOperand(c, &exit->stack[i], i);
+    }
+
+    writeBackSlots(c);
+    emitMovImm(&c->as, RAX, index);
+    emitJmpTo(&c->as, epilogue);
+}
+
+static void emitTrace(TraceCompiler* c)
+{
+    Tracer* tracer = c->tracer;
+    int count = sizeof(saved) / sizeof(saved[0]);
+
+    for (int i = 0; i < count; i++) {
+        emitPush(&c->as, saved[i]);
+    }
+
+    emitAlu64Imm(&c->as, ALU_SUB, RSP, 8);
+    emitMov(&c->as, R12, RDI);
+    emitMov(&c->as, R13, RSI);
+    emitMov(&c->as, R14, RDX);
+    loadSlots(c);
+
+    size_t loop = c->as.count;
+
+    for (int i = 0; i < tracer->count - 1 && !c->failed;) {
+        i = compileInstruction(c, i);
+    }
+
+    // The operand stack is balanced around a loop body.
+    c->failed |= c->depth != 0;
+    emitJmpTo(&c->as, loop);
+
+    size_t epilogue = c->as.count;
+
+    emitAlu64Imm(&c->as, ALU_ADD, RSP, 8);
+
+    for (int i = count - 1; i >= 0; i--) {
+        emitPop(&c->as, saved[i]);
+    }
+
+    emitRet(&c->as);
+
+    for (int i = 0; i < c->exitCount; i++) {
+        emitExit(c, i, epilogue);
+    }
+}
+
+static bool compileTrace(VM* vm, Tracer* tracer)
+{
+#ifdef JIT_SUPPORTED
+    TraceCompiler* c = calloc(1, sizeof(TraceCompiler));
+
+    c->vm = vm;
+    c->tracer = tracer;
+    initAssembler(&c->as);
+    allocateSlots(c);
+    emitTrace(c);
+
+    void* code = c->failed ? NULL : installCode(&vm->jit, c->as.data, c->as.count);
+
+    if (code) {
+        Trace* trace = &tracer->traces[tracer->traceCount++];
+
+        trace->code = (trace_t)code;
+        trace->header = tracer->header;
+        trace->exits = malloc(sizeof(TraceExit) * c->exitCount);
+        trace->exitCount = c->exitCount;
+
+        for (int i = 0; i < c->exitCount; i++) {
+            trace->exits[i] = (TraceExit){c->exits[i].ip, c->exits[i].depth};
+        }
+    }
+
+    freeAssembler(&c->as);
+    free(c);
+
+    return code != NULL;
+#else
+    return false;
+#endif
+}
+
+// The loop instruction that closes a compiled trace becomes a trace
+// instruction, so the next iteration enters native code.
+static bool completeRecording(VM* vm, Tracer* tracer, uint8_t* ip)
+{
+    tracer->ips[tracer->count++] = ip;
+
+    if (!compileTrace(vm, tracer)) {
+        return abortRecording(tracer);
+    }
+
+    int index = tracer->traceCount - 1;
+
+    ip[0] = OP_TRACE;
+    ip[1] = index >> 8;
+    ip[2] = index & 0xFF;
+    tracer->recording = false;
+
+    return false;
+}
+
+// Called before each instruction while recording; returns whether to keep
+// recording. Only the frame that started the trace is recorded: calls are
+// replayed through callFunction rather than inlined.
+bool recordInstruction(VM* vm, uint8_t* ip, Value* fp)
+{
+    Tracer* tracer = &vm->tracer;
+
+    if (!tracer->recording) {
+        return false;
+    }
+
+    if (fp != tracer->fp) {
+        return true;
+    }
+
+    if (tracer->count == TRACE_LENGTH_MAX - 1) {
+        return abortRecording(tracer);
+    }
+
+    switch (ip[0]) {
+        case OP_LOOP:
+            if (ip + 5 - getOperand16(ip) != tracer->header) {
+                return abortRecording(tracer);
+            }
+            return completeRecording(vm, tracer, ip);
+        case OP_HLT:
+        case OP_REG:
+        case OP_BEQ:
+        case OP_BLT:
+        case OP_BLE:
+        case OP_RET:
+        case OP_RETV:
+        case OP_TRACE:
+        case OP_ASYNC:
+        case OP_AWAIT:
+        case OP_RESOLVE:
+        case OP_GENERATE:
+        case OP_NEXT:
+        case OP_YIELD:
+        case OP_FINISH:
+        case OP_CLOSE:
+            return abortRecording(tracer);
+        default:
+            tracer->ips[tracer->count++] = ip;
+            return true;
+    }
+}
@@ -60,3 +60,69 @@ void setValueAt(ValueArray* array, size_t index, Value item)
         array->data[index] = item;
     }
 }
+
+static bool isFloatKind(NumberKind kind)
+{
+    return kind == NUMBER_F32 || kind == NUMBER_F64;
+}
+
+static int64_t toInteger(Value value, NumberKind kind)
+{
+    switch (kind) {
+        case NUMBER_I8:
+        case NUMBER_I16:
+        case NUMBER_I32:    return AS_INT(value);
+        case NUMBER_U8:
+        case NUMBER_U16:
+        case NUMBER_U32:    return AS_UINT(value);
+        default:            return AS_I64(value);
+    }
+}
+
+static Value fromInteger(int64_t n, NumberKind kind)
+{
+    switch (kind) {
+        case NUMBER_I8:     return INT_VALUE((int8_t)n);
+        case NUMBER_I16:    return INT_VALUE((int16_t)n);
+        case NUMBER_I32:    return INT_VALUE((int32_t)n);
+        case NUMBER_U8:     return UINT_VALUE((uint8_t)n);
+        case NUMBER_U16:    return UINT_VALUE((uint16_t)n);
+        case NUMBER_U32:    return UINT_VALUE((uint32_t)n);
+        case NUMBER_F32:    return FLOAT_VALUE((float)n);
+        case NUMBER_F64:    return FLOAT_VALUE((double)n);
+        default:            return I64_VALUE(n);
+    }
+}
+
+static Value fromUnsigned(uint64_t n, NumberKind kind)
+{
+    switch (kind) {
+        case NUMBER_F32:    return FLOAT_VALUE((float)n);
+        case NUMBER_F64:    return FLOAT_VALUE((double)n);
+        default:            return fromInteger((int64_t)n, kind);
+    }
+}
+
+static Value fromDouble(double d, NumberKind kind)
+{
+    switch (kind) {
+        case NUMBER_F32:    return FLOAT_VALUE((float)d);
+        case NUMBER_F64:    return FLOAT_VALUE(d);
+        case NUMBER_U64:    return I64_VALUE((uint64_t)d);
+        default:            return fromInteger((int64_t)d, kind);
+    }
+}
+
+// Converts between numeric representations the way a C cast would.
+Value convertNumber(Value value, NumberKind from, NumberKind to)
+{
+    if (isFloatKind(from)) {
+        return fromDouble(AS_FLOAT(value), to);
+    }
+
+    if (from == NUMBER_U64) {
+        return fromUnsigned(AS_U64(value), to);
+    }
+
+    return fromInteger(toInteger(value, from), to);
+}
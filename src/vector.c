@@ -1,4 +1,5 @@
 #include "vector.h"
+#include "arena.h"
 #include <stdlib.h>
 
 #define GROW_CAPACITY(capacity) ((capacity) < 8 ? 8 : (capacity) * 2)
@@ -8,11 +9,20 @@ void initVector(Vector* vector)
     vector->data = NULL;
     vector->capacity = 0;
     vector->count = 0;
+    vector->arena = NULL;
+}
+
+void initArenaVector(Vector* vector, Arena* arena)
+{
+    initVector(vector);
+    vector->arena = arena;
 }
 
 void freeVector(Vector* vector)
 {
-    free(vector->data);
+    if (!vector->arena) {
+        free(vector->data);
+    }
 }
 
 size_t countVector(Vector* vector)
@@ -22,7 +32,13 @@ size_t countVector(Vector* vector)
 
 void reserveVector(Vector* vector, size_t capacity)
 {
-    vector->data = realloc(vector->data, sizeof(void*) * capacity);
+    if (vector->arena) {
+        vector->data = reallocateArena(vector->arena, vector->data, sizeof(void*) * vector->capacity,
+            sizeof(void*) * capacity);
+    } else {
+        vector->data = realloc(vector->data, sizeof(void*) * capacity);
+    }
+
     vector->capacity = capacity;
 }
 
@@ -1,336 +1,1574 @@
 #include "vm.h"
 #include "codeobject.h"
 #include "functionobject.h"
+#include "generator.h"
+#include "jit.h"
+#include "loop.h"
 #include "moduleobject.h"
 #include "native.h"
 #include "opcode.h"
+#include "profile.h"
+#include "scheduler.h"
 #include "service.h"
+#include "tier.h"
+#include "trace.h"
 #include "value.h"
+#include "vector.h"
 #include <math.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define PUSH(value) ((vm->sp++)[0] = (value))
+// With STACK_CACHING the top of the operand stack lives in the local
+// variable tos and the memory stack holds everything below it. Handlers
+// access the stack only through these macros, so both layouts share them.
+#ifdef STACK_CACHING
+#define TOP() (tos)
+#define SECOND() (sp[-1])
+#define PUSH(value) (*sp++ = tos, tos = (value))
+#define POP() (popped = tos, tos = *--sp, popped)
+#define FLUSH() (*sp++ = tos)
+#define RELOAD() (tos = *--sp)
+#define REFILL(value) (tos = (value))
+// Native code keeps n operands in the first n slots of the operand stack;
+// here the first slot is where the initial tos spilled, so the operands
+// move up one and the last goes into tos.
+#define ADOPT(base) (tos = sp[-1], memmove((base) + 1, (base), (sp - (base) - 1) * sizeof(Value)))
+#else
+#define TOP() (sp[-1])
+#define SECOND() (sp[-2])
+#define PUSH(value) (*sp++ = (value))
+#define POP() (*--sp)
+#define FLUSH() ((void)0)
+#define RELOAD() ((void)0)
+#define REFILL(value) (PUSH(value))
+#define ADOPT(base) ((void)0)
+#endif
+
 #define PUSH_BOOL(i) (PUSH(BOOL_VALUE(i)))
 #define PUSH_FLOAT(i) (PUSH(FLOAT_VALUE(i)))
 #define PUSH_INT(i) (PUSH(INT_VALUE(i)))
 #define PUSH_POINTER(i) (PUSH(POINTER_VALUE(i)))
 
-#define POP() ((--vm->sp)[0])
 #define POP_BOOL() (AS_BOOL(POP()))
 #define POP_FLOAT() (AS_FLOAT(POP()))
 #define POP_INT() (AS_INT(POP()))
 #define POP_POINTER() (AS_POINTER(POP()))
 
-#define READ_UINT16() (vm->ip += 2, (uint16_t)((vm->ip[-2] << 8) | vm->ip[-1]))
-#define READ_UINT8() ((uint8_t)*(vm->ip++))
+#define RAW_PUSH(value) (*sp++ = (value))
+#define RAW_POP() (*--sp)
+
+#define READ_UINT16() (ip += 2, (uint16_t)((ip[-2] << 8) | ip[-1]))
+#define READ_UINT8() ((uint8_t)*(ip++))
+
+#define READ_REGISTER() (fp[READ_UINT8()])
+
+// Tasks on other workers may load and store the globals at the same time.
+#define LOAD_GLOBAL(x) (__atomic_load_n(&vm->globals.data[x], __ATOMIC_ACQUIRE))
+#define STORE_GLOBAL(x, value) (__atomic_store_n(&vm->globals.data[x], (value), __ATOMIC_RELEASE))
+
+// Takes over the frame of native code that deoptimized.
+#define RESUME() do { \
+    ip = vm->deopt.ip; \
+    fp = vm->deopt.fp; \
+    sp = vm->deopt.sp; \
+    vm->deopt.ip = NULL; \
+    if (sp > vm->deopt.base) ADOPT(vm->deopt.base); \
+} while (0)
+
+// 32-bit ints wrap around like the generated code does, signed or not:
+// the arithmetic is done unsigned, where overflow is defined. Shifts take
+// their count modulo 32, as the shift instructions do.
+#define WRAP(a, op, b) ((int32_t)((uint32_t)(a) op (uint32_t)(b)))
+
+#define READ_OPERANDS() \
+    dst = &READ_REGISTER(), \
+    a = AS_INT(READ_REGISTER()), \
+    b = AS_INT(READ_REGISTER())
+
+#define TEST_OVERFLOW(n) if (sp - vm->stack + (n) + 1 > STACK_MAX) \
+    fprintf(stderr, "Error: Stack overflow\n"), \
+    exit(1)
 
-#define TEST_OVERFLOW(n) if (vm->sp - vm->stack + (n) > STACK_MAX) \
+#define TEST_REGISTER_OVERFLOW(n) if (fp - vm->stack + (n) > STACK_MAX) \
     fprintf(stderr, "Error: Stack overflow\n"), \
     exit(1)
 
-static void initServices(VM* vm)
+#define FRAMES_MAX 256
+
+#if defined(__GNUC__) && !defined(NO_COMPUTED_GOTO)
+#define COMPUTED_GOTO
+#endif
+
+#ifdef VM_STATS
+#define COUNT_INSTRUCTION() \
+    (vm->instructionCount++, vm->profile ? recordOpcode(vm->profile, *ip) : (void)0)
+#else
+#define COUNT_INSTRUCTION() ((void)0)
+#endif
+
+#ifdef COMPUTED_GOTO
+#define DISPATCH() goto *dispatchTable[(COUNT_INSTRUCTION(), READ_UINT8())]
+#define TARGET(op) L_##op
+#define DEFAULT L_DEFAULT
+#define START_RECORDING() (dispatchTable = recordTable)
+#else
+#define DISPATCH() continue
+#define TARGET(op) case op
+#define DEFAULT default
+#define START_RECORDING() (recording = true)
+#endif
+
+typedef struct RegisterFrame
 {
-    vm->service[SOP_EXIT] = __exit;
-    vm->service[SOP_PRINT] = __print;
-    vm->service[SOP_CLAMP] = __clamp;
-    vm->service[SOP_ABS] = __abs;
-    vm->service[SOP_MIN] = __min;
-    vm->service[SOP_MAX] = __max;
-    vm->service[SOP_BYTEORDER] = __byteorder;
+    uint8_t* ip;
+    Value* fp;
+} RegisterFrame;
+
+// Return address for frames entered from native code: the callee's ret
+// lands on a halt, which hands control back to callFunction.
+static uint8_t haltCode[] = { OP_HLT };
+
+// Counts a call to an interpreted function and hands it to the tier
+// policy once it is hot enough to move up.
+static inline bool tierUp(VM* vm, FunctionObject* function)
+{
+    return ++function->callCount + function->loopCount >= function->nextTier
+        && promoteFunction(vm, function);
 }
 
-static void run(VM* vm)
+static void execute(VM* vm, uint8_t* ip, Value* sp, Value* fp)
 {
-    uint8_t opcode;
-    FunctionObject* function = AS_POINTER(vm->module->constants.data[0]);
+    FunctionObject* function;
+    Generator* generator;
+    LoopCounter* loop;
+    Trace* trace;
     int32_t a;
     int32_t b;
     int32_t x;
-    Service service;
     Value value;
+#ifdef STACK_CACHING
+    Value tos = INT_VALUE(0);
+    Value popped;
+#endif
+
+#ifdef COMPUTED_GOTO
+    static void* opcodeTable[] = {
+        [0 ... UINT8_MAX] = &&L_DEFAULT,
+        [OP_HLT]      = &&L_OP_HLT,
+        [OP_REQS]     = &&L_OP_REQS,
+        [OP_LDC]      = &&L_OP_LDC,
+        [OP_REG]      = &&L_OP_REG,
+        [OP_LDG]      = &&L_OP_LDG,
+        [OP_STG]      = &&L_OP_STG,
+        [OP_LDL]      = &&L_OP_LDL,
+        [OP_LDL_0]    = &&L_OP_LDL_0,
+        [OP_LDL_1]    = &&L_OP_LDL_1,
+        [OP_LDL_2]    = &&L_OP_LDL_2,
+        [OP_LDL_3]    = &&L_OP_LDL_3,
+        [OP_STL]      = &&L_OP_STL,
+        [OP_STL_0]    = &&L_OP_STL_0,
+        [OP_STL_1]    = &&L_OP_STL_1,
+        [OP_STL_2]    = &&L_OP_STL_2,
+        [OP_STL_3]    = &&L_OP_STL_3,
+        [OP_PUSHB]    = &&L_OP_PUSHB,
+        [OP_PUSHH]    = &&L_OP_PUSHH,
+        [OP_PUSH_0]   = &&L_OP_PUSH_0,
+        [OP_PUSH_1]   = &&L_OP_PUSH_1,
+        [OP_PUSH_2]   = &&L_OP_PUSH_2,
+        [OP_PUSH_3]   = &&L_OP_PUSH_3,
+        [OP_POP]      = &&L_OP_POP,
+        [OP_DUP]      = &&L_OP_DUP,
+        [OP_INC]      = &&L_OP_INC,
+        [OP_DEC]      = &&L_OP_DEC,
+        [OP_ADD]      = &&L_OP_ADD,
+        [OP_SUB]      = &&L_OP_SUB,
+        [OP_MUL]      = &&L_OP_MUL,
+        [OP_DIV]      = &&L_OP_DIV,
+        [OP_REM]      = &&L_OP_REM,
+        [OP_POW]      = &&L_OP_POW,
+        [OP_BAND]     = &&L_OP_BAND,
+        [OP_BOR]      = &&L_OP_BOR,
+        [OP_BXOR]     = &&L_OP_BXOR,
+        [OP_BNOT]     = &&L_OP_BNOT,
+        [OP_LSL]      = &&L_OP_LSL,
+        [OP_LSR]      = &&L_OP_LSR,
+        [OP_ASR]      = &&L_OP_ASR,
+        [OP_NOT]      = &&L_OP_NOT,
+        [OP_NEG]      = &&L_OP_NEG,
+        [OP_BEQ]      = &&L_OP_BEQ,
+        [OP_BLT]      = &&L_OP_BLT,
+        [OP_BLE]      = &&L_OP_BLE,
+        [OP_JMP]      = &&L_OP_JMP,
+        [OP_CALL]     = &&L_OP_CALL,
+        [OP_RET]      = &&L_OP_RET,
+        [OP_RETV]     = &&L_OP_RETV,
+        [OP_ADDI]     = &&L_OP_ADDI,
+        [OP_SUBI]     = &&L_OP_SUBI,
+        [OP_MULI]     = &&L_OP_MULI,
+        [OP_DIVI]     = &&L_OP_DIVI,
+        [OP_REMI]     = &&L_OP_REMI,
+        [OP_LDL_ADD]  = &&L_OP_LDL_ADD,
+        [OP_LDL_SUB]  = &&L_OP_LDL_SUB,
+        [OP_LDL_MUL]  = &&L_OP_LDL_MUL,
+        [OP_LDL_LDL_ADD] = &&L_OP_LDL_LDL_ADD,
+        [OP_LDL_LDL_SUB] = &&L_OP_LDL_LDL_SUB,
+        [OP_LDL_LDL_MUL] = &&L_OP_LDL_LDL_MUL,
+        [OP_EQ]       = &&L_OP_EQ,
+        [OP_NE]       = &&L_OP_NE,
+        [OP_LT]       = &&L_OP_LT,
+        [OP_LE]       = &&L_OP_LE,
+        [OP_GT]       = &&L_OP_GT,
+        [OP_GE]       = &&L_OP_GE,
+        [OP_JZ]       = &&L_OP_JZ,
+        [OP_LOOP]     = &&L_OP_LOOP,
+        [OP_TRACE]    = &&L_OP_TRACE,
+        [OP_CONV]     = &&L_OP_CONV,
+        [OP_ADD_I64]  = &&L_OP_ADD_I64,
+        [OP_SUB_I64]  = &&L_OP_SUB_I64,
+        [OP_MUL_I64]  = &&L_OP_MUL_I64,
+        [OP_DIV_I64]  = &&L_OP_DIV_I64,
+        [OP_REM_I64]  = &&L_OP_REM_I64,
+        [OP_NEG_I64]  = &&L_OP_NEG_I64,
+        [OP_BAND_I64] = &&L_OP_BAND_I64,
+        [OP_BOR_I64]  = &&L_OP_BOR_I64,
+        [OP_BXOR_I64] = &&L_OP_BXOR_I64,
+        [OP_BNOT_I64] = &&L_OP_BNOT_I64,
+        [OP_LSL_I64]  = &&L_OP_LSL_I64,
+        [OP_LSR_I64]  = &&L_OP_LSR_I64,
+        [OP_EQ_I64]   = &&L_OP_EQ_I64,
+        [OP_NE_I64]   = &&L_OP_NE_I64,
+        [OP_LT_I64]   = &&L_OP_LT_I64,
+        [OP_LE_I64]   = &&L_OP_LE_I64,
+        [OP_GT_I64]   = &&L_OP_GT_I64,
+        [OP_GE_I64]   = &&L_OP_GE_I64,
+        [OP_DIV_U64]  = &&L_OP_DIV_U64,
+        [OP_REM_U64]  = &&L_OP_REM_U64,
+        [OP_LSR_U64]  = &&L_OP_LSR_U64,
+        [OP_LT_U64]   = &&L_OP_LT_U64,
+        [OP_LE_U64]   = &&L_OP_LE_U64,
+        [OP_GT_U64]   = &&L_OP_GT_U64,
+        [OP_GE_U64]   = &&L_OP_GE_U64,
+        [OP_DIV_U32]  = &&L_OP_DIV_U32,
+        [OP_REM_U32]  = &&L_OP_REM_U32,
+        [OP_LSR_U32]  = &&L_OP_LSR_U32,
+        [OP_LT_U32]   = &&L_OP_LT_U32,
+        [OP_LE_U32]   = &&L_OP_LE_U32,
+        [OP_GT_U32]   = &&L_OP_GT_U32,
+        [OP_GE_U32]   = &&L_OP_GE_U32,
+        [OP_ADD_F32]  = &&L_OP_ADD_F32,
+        [OP_SUB_F32]  = &&L_OP_SUB_F32,
+        [OP_MUL_F32]  = &&L_OP_MUL_F32,
+        [OP_DIV_F32]  = &&L_OP_DIV_F32,
+        [OP_ADD_F64]  = &&L_OP_ADD_F64,
+        [OP_SUB_F64]  = &&L_OP_SUB_F64,
+        [OP_MUL_F64]  = &&L_OP_MUL_F64,
+        [OP_DIV_F64]  = &&L_OP_DIV_F64,
+        [OP_NEG_F64]  = &&L_OP_NEG_F64,
+        [OP_EQ_F64]   = &&L_OP_EQ_F64,
+        [OP_NE_F64]   = &&L_OP_NE_F64,
+        [OP_LT_F64]   = &&L_OP_LT_F64,
+        [OP_LE_F64]   = &&L_OP_LE_F64,
+        [OP_GT_F64]   = &&L_OP_GT_F64,
+        [OP_GE_F64]   = &&L_OP_GE_F64,
+        [OP_ABS]      = &&L_OP_ABS,
+        [OP_MIN]      = &&L_OP_MIN,
+        [OP_MAX]      = &&L_OP_MAX,
+        [OP_CLAMP]    = &&L_OP_CLAMP,
+        [OP_POPCNT]   = &&L_OP_POPCNT,
+        [OP_CLZ]      = &&L_OP_CLZ,
+        [OP_CTZ]      = &&L_OP_CTZ,
+        [OP_ROTL]     = &&L_OP_ROTL,
+        [OP_ROTR]     = &&L_OP_ROTR,
+        [OP_BSWAP]    = &&L_OP_BSWAP,
+        [OP_ASYNC]    = &&L_OP_ASYNC,
+        [OP_AWAIT]    = &&L_OP_AWAIT,
+        [OP_RESOLVE]  = &&L_OP_RESOLVE,
+        [OP_DETACH]   = &&L_OP_DETACH,
+        [OP_GENERATE] = &&L_OP_GENERATE,
+        [OP_NEXT]     = &&L_OP_NEXT,
+        [OP_YIELD]    = &&L_OP_YIELD,
+        [OP_FINISH]   = &&L_OP_FINISH,
+        [OP_CLOSE]    = &&L_OP_CLOSE,
+        [OP_LKG]      = &&L_OP_LKG,
+        [OP_ULG]      = &&L_OP_ULG,
+        [OP_JEQ]      = &&L_OP_JEQ,
+        [OP_JNE]      = &&L_OP_JNE,
+        [OP_JLT]      = &&L_OP_JLT,
+        [OP_JLE]      = &&L_OP_JLE,
+        [OP_JGT]      = &&L_OP_JGT,
+        [OP_JGE]      = &&L_OP_JGE,
+        [OP_INCL]     = &&L_OP_INCL,
+    };
+
+    // While a trace is recorded every instruction passes through the
+    // recorder before its handler.
+    static void* recordTable[] = {
+        [0 ... UINT8_MAX] = &&L_RECORD,
+    };
+
+    void** dispatchTable = opcodeTable;
+#else
+    bool recording = false;
+#endif
+
+    // A pending deoptimization is resumed here, which is how resumeCall
+    // gets operands back into tos.
+    if (vm->deopt.ip) {
+        RESUME();
+    }
+
+    // So is a task the loop resumed, whose top operand is the result of
+    // what it awaited.
+    if (vm->loop.resuming) {
+        vm->loop.resuming = false;
+        RELOAD();
+    }
+
+#ifdef COMPUTED_GOTO
+    DISPATCH();
+
+L_RECORD:
+    if (!recordInstruction(vm, ip - 1, fp)) {
+        dispatchTable = opcodeTable;
+    }
+
+    goto *opcodeTable[ip[-1]];
+#else
+    while (1) {
+        COUNT_INSTRUCTION();
+
+        if (recording) {
+            recording = recordInstruction(vm, ip, fp);
+        }
+
+        switch (READ_UINT8()) {
+#endif
+
+        TARGET(OP_REQS):
+            x = READ_UINT16();
+            a = READ_UINT8();
+            FLUSH();
+            sp -= a >> 4;
+            vm->service[x](vm, sp);
+            sp += a & 15;
+            RELOAD();
+            DISPATCH();
+
+        TARGET(OP_LDC):
+            x = READ_UINT8();
+            value = vm->module->constants.data[x];
+            PUSH(value);
+            DISPATCH();
+
+        TARGET(OP_REG):
+            pushValue(&vm->globals, POP());
+            DISPATCH();
+
+        TARGET(OP_LDG):
+            x = READ_UINT8();
+            value = LOAD_GLOBAL(x);
+            PUSH(value);
+            DISPATCH();
+
+        TARGET(OP_STG):
+            x = READ_UINT8();
+            STORE_GLOBAL(x, POP());
+            DISPATCH();
+
+        TARGET(OP_LDL):
+            x = (int8_t) READ_UINT8();
+            PUSH(fp[x]);
+            DISPATCH();
+
+        TARGET(OP_LDL_0):
+            PUSH(fp[0]);
+            DISPATCH();
+
+        TARGET(OP_LDL_1):
+            PUSH(fp[1]);
+            DISPATCH();
+
+        TARGET(OP_LDL_2):
+            PUSH(fp[2]);
+            DISPATCH();
+
+        TARGET(OP_LDL_3):
+            PUSH(fp[3]);
+            DISPATCH();
+
+        TARGET(OP_STL):
+            x = (int8_t) READ_UINT8();
+            fp[x] = POP();
+            DISPATCH();
+
+        TARGET(OP_STL_0):
+            fp[0] = POP();
+            DISPATCH();
+
+        TARGET(OP_STL_1):
+            fp[1] = POP();
+            DISPATCH();
+
+        TARGET(OP_STL_2):
+            fp[2] = POP();
+            DISPATCH();
+
+        TARGET(OP_STL_3):
+            fp[3] = POP();
+            DISPATCH();
+
+        TARGET(OP_PUSHB):
+            x = (int8_t) READ_UINT8();
+            PUSH_INT(x);
+            DISPATCH();
+
+        TARGET(OP_PUSHH):
+            x = (int16_t) READ_UINT16();
+            PUSH_INT(x);
+            DISPATCH();
+
+        TARGET(OP_PUSH_0):
+            PUSH_INT(0);
+            DISPATCH();
+
+        TARGET(OP_PUSH_1):
+            PUSH_INT(1);
+            DISPATCH();
+
+        TARGET(OP_PUSH_2):
+            PUSH_INT(2);
+            DISPATCH();
+
+        TARGET(OP_PUSH_3):
+            PUSH_INT(3);
+            DISPATCH();
+
+        TARGET(OP_POP):
+            (void)POP();
+            DISPATCH();
+
+        TARGET(OP_DUP):
+            PUSH(TOP());
+            DISPATCH();
+
+        TARGET(OP_INC):
+            TOP() = INT_VALUE(WRAP(AS_INT(TOP()), +, 1));
+            DISPATCH();
+
+        TARGET(OP_DEC):
+            TOP() = INT_VALUE(WRAP(AS_INT(TOP()), -, 1));
+            DISPATCH();
+
+        TARGET(OP_ADD):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(WRAP(a, +, b));
+            DISPATCH();
+
+        TARGET(OP_SUB):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(WRAP(a, -, b));
+            DISPATCH();
+
+        TARGET(OP_MUL):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(WRAP(a, *, b));
+            DISPATCH();
+
+        TARGET(OP_DIV):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(a / b);
+            DISPATCH();
+
+        TARGET(OP_REM):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(a % b);
+            DISPATCH();
+
+        TARGET(OP_POW):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            x = pow(a, b);
+            TOP() = INT_VALUE(x);
+            DISPATCH();
+
+        TARGET(OP_BAND):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(a & b);
+            DISPATCH();
+
+        TARGET(OP_BOR):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(a | b);
+            DISPATCH();
+
+        TARGET(OP_BXOR):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(a ^ b);
+            DISPATCH();
+
+        TARGET(OP_BNOT):
+            x = AS_INT(TOP());
+            TOP() = INT_VALUE(~x);
+            DISPATCH();
+
+        TARGET(OP_LSL):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(WRAP(a, <<, b & 31));
+            DISPATCH();
+
+        TARGET(OP_LSR):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(a >> b);
+            DISPATCH();
+
+        TARGET(OP_ASR):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(~(~a >> b));
+            DISPATCH();
+
+        TARGET(OP_NEG):
+            x = AS_INT(TOP());
+            TOP() = INT_VALUE(WRAP(0, -, x));
+            DISPATCH();
+
+        TARGET(OP_NOT):
+            x = AS_INT(TOP());
+            TOP() = INT_VALUE(!x);
+            DISPATCH();
+
+        TARGET(OP_BEQ):
+            b = AS_INT(TOP());
+            a = AS_INT(SECOND());
+            x = READ_UINT16();
+            if (a == b) ip += x;
+            DISPATCH();
+
+        TARGET(OP_BLT):
+            b = AS_INT(TOP());
+            a = AS_INT(SECOND());
+            x = READ_UINT16();
+            if (a < b) ip += x;
+            DISPATCH();
+
+        TARGET(OP_BLE):
+            b = AS_INT(TOP());
+            a = AS_INT(SECOND());
+            x = READ_UINT16();
+            if (a <= b) ip += x;
+            DISPATCH();
+
+        TARGET(OP_JMP):
+            x = READ_UINT16();
+            ip += x;
+            DISPATCH();
+
+        TARGET(OP_CALL):
+            x = READ_UINT16();
+            function = AS_POINTER(vm->module->constants.data[x]);
+
+            TEST_OVERFLOW(function->maxStackCount);
+            FLUSH();
+
+            if (function->native || tierUp(vm, function)) {
+                value = ((native_t)function->native)(vm, sp);
+
+                // The callee's frame is left for the interpreter to finish;
+                // only its return link is missing.
+                if (vm->deopt.ip) {
+                    sp[1] = POINTER_VALUE(ip);
+                    sp[2] = POINTER_VALUE(fp);
+                    RESUME();
+                    DISPATCH();
+                }
+
+                sp -= function->paramCount;
+                REFILL(value);
+                DISPATCH();
+            }
+
+            RAW_PUSH(INT_VALUE(function->paramCount));
+            RAW_PUSH(POINTER_VALUE(ip));
+            RAW_PUSH(POINTER_VALUE(fp));
+
+            ip = function->code.data;
+            fp = sp;
+            sp += function->localCount;
+            DISPATCH();
+
+        TARGET(OP_RET):
+            sp = fp;
+            fp = AS_POINTER(RAW_POP());
+            ip = AS_POINTER(RAW_POP());
+            x = AS_INT(RAW_POP());
+            sp -= x;
+            REFILL(INT_VALUE(0));
+            DISPATCH();
+
+        TARGET(OP_RETV):
+            value = POP();
+            sp = fp;
+            fp = AS_POINTER(RAW_POP());
+            ip = AS_POINTER(RAW_POP());
+            x = AS_INT(RAW_POP());
+            sp -= x;
+            REFILL(value);
+            DISPATCH();
+
+        TARGET(OP_ADDI):
+            x = (int8_t) READ_UINT8();
+            TOP() = INT_VALUE(WRAP(AS_INT(TOP()), +, x));
+            DISPATCH();
+
+        TARGET(OP_SUBI):
+            x = (int8_t) READ_UINT8();
+            TOP() = INT_VALUE(WRAP(AS_INT(TOP()), -, x));
+            DISPATCH();
+
+        TARGET(OP_MULI):
+            x = (int8_t) READ_UINT8();
+            TOP() = INT_VALUE(WRAP(AS_INT(TOP()), *, x));
+            DISPATCH();
+
+        TARGET(OP_DIVI):
+            x = (int8_t) READ_UINT8();
+            TOP() = INT_VALUE(AS_INT(TOP()) / x);
+            DISPATCH();
+
+        TARGET(OP_REMI):
+            x = (int8_t) READ_UINT8();
+            TOP() = INT_VALUE(AS_INT(TOP()) % x);
+            DISPATCH();
+
+        TARGET(OP_LDL_ADD):
+            x = (int8_t) READ_UINT8();
+            TOP() = INT_VALUE(WRAP(AS_INT(TOP()), +, AS_INT(fp[x])));
+            DISPATCH();
+
+        TARGET(OP_LDL_SUB):
+            x = (int8_t) READ_UINT8();
+            TOP() = INT_VALUE(WRAP(AS_INT(TOP()), -, AS_INT(fp[x])));
+            DISPATCH();
+
+        TARGET(OP_LDL_MUL):
+            x = (int8_t) READ_UINT8();
+            TOP() = INT_VALUE(WRAP(AS_INT(TOP()), *, AS_INT(fp[x])));
+            DISPATCH();
+
+        TARGET(OP_LDL_LDL_ADD):
+            a = AS_INT(fp[(int8_t) READ_UINT8()]);
+            b = AS_INT(fp[(int8_t) READ_UINT8()]);
+            PUSH_INT(WRAP(a, +, b));
+            DISPATCH();
+
+        TARGET(OP_LDL_LDL_SUB):
+            a = AS_INT(fp[(int8_t) READ_UINT8()]);
+            b = AS_INT(fp[(int8_t) READ_UINT8()]);
+            PUSH_INT(WRAP(a, -, b));
+            DISPATCH();
+
+        TARGET(OP_LDL_LDL_MUL):
+            a = AS_INT(fp[(int8_t) READ_UINT8()]);
+            b = AS_INT(fp[(int8_t) READ_UINT8()]);
+            PUSH_INT(WRAP(a, *, b));
+            DISPATCH();
+
+        TARGET(OP_EQ):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(a == b);
+            DISPATCH();
+
+        TARGET(OP_NE):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(a != b);
+            DISPATCH();
+
+        TARGET(OP_LT):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(a < b);
+            DISPATCH();
+
+        TARGET(OP_LE):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(a <= b);
+            DISPATCH();
+
+        TARGET(OP_GT):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(a > b);
+            DISPATCH();
+
+        TARGET(OP_GE):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(a >= b);
+            DISPATCH();
+
+        TARGET(OP_JZ):
+            x = READ_UINT16();
+            if (POP_INT() == 0) ip += x;
+            DISPATCH();
+
+        TARGET(OP_LOOP):
+            x = READ_UINT16();
+            loop = vm->module->loops.data[READ_UINT16()];
+            ip -= x;
+            loop->function->loopCount++;
+
+            if (++loop->count < loop->threshold) {
+                DISPATCH();
+            }
+
+            switch (promoteLoop(vm, loop, &ip)) {
+                case LOOP_INTERPRET:
+                    break;
+                case LOOP_RECORD:
+                    startRecording(&vm->tracer, ip, fp);
+                    START_RECORDING();
+                    break;
+                // Loop headers start a statement, so no operands are live.
+                case LOOP_ENTER_NATIVE:
+                    value = enterNative(vm, fp, sp, loop->entry);
+
+                    if (vm->deopt.ip) {
+                        RESUME();
+                        break;
+                    }
+
+                    sp = fp;
+                    fp = AS_POINTER(RAW_POP());
+                    ip = AS_POINTER(RAW_POP());
+                    x = AS_INT(RAW_POP());
+                    sp -= x;
+                    REFILL(value);
+                    break;
+            }
+
+            DISPATCH();
+
+        TARGET(OP_TRACE):
+            x = READ_UINT16();
+            trace = &vm->tracer.traces[x];
+            FLUSH();
+            x = trace->code(fp, sp, vm);
+            ip = trace->exits[x].ip;
+            sp += trace->exits[x].depth;
+            RELOAD();
+            DISPATCH();
+
+        TARGET(OP_CONV):
+            x = READ_UINT8();
+            TOP() = convertNumber(TOP(), x >> 4, x & 15);
+            DISPATCH();
+
+        TARGET(OP_ADD_I64):
+            value = POP();
+            TOP() = TOP() + value;
+            DISPATCH();
+
+        TARGET(OP_SUB_I64):
+            value = POP();
+            TOP() = TOP() - value;
+            DISPATCH();
+
+        TARGET(OP_MUL_I64):
+            value = POP();
+            TOP() = TOP() * value;
+            DISPATCH();
+
+        TARGET(OP_DIV_I64):
+            value = POP();
+            TOP() = I64_VALUE(AS_I64(TOP()) / AS_I64(value));
+            DISPATCH();
+
+        TARGET(OP_REM_I64):
+            value = POP();
+            TOP() = I64_VALUE(AS_I64(TOP()) % AS_I64(value));
+            DISPATCH();
+
+        TARGET(OP_NEG_I64):
+            TOP() = -TOP();
+            DISPATCH();
+
+        TARGET(OP_BAND_I64):
+            value = POP();
+            TOP() = TOP() & value;
+            DISPATCH();
+
+        TARGET(OP_BOR_I64):
+            value = POP();
+            TOP() = TOP() | value;
+            DISPATCH();
+
+        TARGET(OP_BXOR_I64):
+            value = POP();
+            TOP() = TOP() ^ value;
+            DISPATCH();
+
+        TARGET(OP_BNOT_I64):
+            TOP() = ~TOP();
+            DISPATCH();
+
+        TARGET(OP_LSL_I64):
+            value = POP();
+            TOP() = TOP() << (value & 63);
+            DISPATCH();
+
+        TARGET(OP_LSR_I64):
+            value = POP();
+            TOP() = I64_VALUE(AS_I64(TOP()) >> (value & 63));
+            DISPATCH();
+
+        TARGET(OP_EQ_I64):
+            value = POP();
+            TOP() = INT_VALUE(TOP() == value);
+            DISPATCH();
+
+        TARGET(OP_NE_I64):
+            value = POP();
+            TOP() = INT_VALUE(TOP() != value);
+            DISPATCH();
+
+        TARGET(OP_LT_I64):
+            value = POP();
+            TOP() = INT_VALUE(AS_I64(TOP()) < AS_I64(value));
+            DISPATCH();
+
+        TARGET(OP_LE_I64):
+            value = POP();
+            TOP() = INT_VALUE(AS_I64(TOP()) <= AS_I64(value));
+            DISPATCH();
+
+        TARGET(OP_GT_I64):
+            value = POP();
+            TOP() = INT_VALUE(AS_I64(TOP()) > AS_I64(value));
+            DISPATCH();
+
+        TARGET(OP_GE_I64):
+            value = POP();
+            TOP() = INT_VALUE(AS_I64(TOP()) >= AS_I64(value));
+            DISPATCH();
+
+        TARGET(OP_DIV_U64):
+            value = POP();
+            TOP() = TOP() / value;
+            DISPATCH();
+
+        TARGET(OP_REM_U64):
+            value = POP();
+            TOP() = TOP() % value;
+            DISPATCH();
+
+        TARGET(OP_LSR_U64):
+            value = POP();
+            TOP() = TOP() >> (value & 63);
+            DISPATCH();
+
+        TARGET(OP_LT_U64):
+            value = POP();
+            TOP() = INT_VALUE(TOP() < value);
+            DISPATCH();
+
+        TARGET(OP_LE_U64):
+            value = POP();
+            TOP() = INT_VALUE(TOP() <= value);
+            DISPATCH();
+
+        TARGET(OP_GT_U64):
+            value = POP();
+            TOP() = INT_VALUE(TOP() > value);
+            DISPATCH();
+
+        TARGET(OP_GE_U64):
+            value = POP();
+            TOP() = INT_VALUE(TOP() >= value);
+            DISPATCH();
+
+        TARGET(OP_DIV_U32):
+            value = POP();
+            TOP() = UINT_VALUE(AS_UINT(TOP()) / AS_UINT(value));
+            DISPATCH();
+
+        TARGET(OP_REM_U32):
+            value = POP();
+            TOP() = UINT_VALUE(AS_UINT(TOP()) % AS_UINT(value));
+            DISPATCH();
+
+        TARGET(OP_LSR_U32):
+            value = POP();
+            TOP() = UINT_VALUE(AS_UINT(TOP()) >> (value & 31));
+            DISPATCH();
+
+        TARGET(OP_LT_U32):
+            value = POP();
+            TOP() = INT_VALUE(AS_UINT(TOP()) < AS_UINT(value));
+            DISPATCH();
+
+        TARGET(OP_LE_U32):
+            value = POP();
+            TOP() = INT_VALUE(AS_UINT(TOP()) <= AS_UINT(value));
+            DISPATCH();
+
+        TARGET(OP_GT_U32):
+            value = POP();
+            TOP() = INT_VALUE(AS_UINT(TOP()) > AS_UINT(value));
+            DISPATCH();
+
+        TARGET(OP_GE_U32):
+            value = POP();
+            TOP() = INT_VALUE(AS_UINT(TOP()) >= AS_UINT(value));
+            DISPATCH();
+
+        TARGET(OP_ADD_F32):
+            value = POP();
+            TOP() = FLOAT_VALUE((float)AS_FLOAT(TOP()) + (float)AS_FLOAT(value));
+            DISPATCH();
+
+        TARGET(OP_SUB_F32):
+            value = POP();
+            TOP() = FLOAT_VALUE((float)AS_FLOAT(TOP()) - (float)AS_FLOAT(value));
+            DISPATCH();
+
+        TARGET(OP_MUL_F32):
+            value = POP();
+            TOP() = FLOAT_VALUE((float)AS_FLOAT(TOP()) * (float)AS_FLOAT(value));
+            DISPATCH();
+
+        TARGET(OP_DIV_F32):
+            value = POP();
+            TOP() = FLOAT_VALUE((float)AS_FLOAT(TOP()) / (float)AS_FLOAT(value));
+            DISPATCH();
+
+        TARGET(OP_ADD_F64):
+            value = POP();
+            TOP() = FLOAT_VALUE(AS_FLOAT(TOP()) + AS_FLOAT(value));
+            DISPATCH();
+
+        TARGET(OP_SUB_F64):
+            value = POP();
+            TOP() = FLOAT_VALUE(AS_FLOAT(TOP()) - AS_FLOAT(value));
+            DISPATCH();
+
+        TARGET(OP_MUL_F64):
+            value = POP();
+            TOP() = FLOAT_VALUE(AS_FLOAT(TOP()) * AS_FLOAT(value));
+            DISPATCH();
+
+        TARGET(OP_DIV_F64):
+            value = POP();
+            TOP() = FLOAT_VALUE(AS_FLOAT(TOP()) / AS_FLOAT(value));
+            DISPATCH();
+
+        TARGET(OP_NEG_F64):
+            TOP() = FLOAT_VALUE(-AS_FLOAT(TOP()));
+            DISPATCH();
+
+        TARGET(OP_EQ_F64):
+            value = POP();
+            TOP() = INT_VALUE(AS_FLOAT(TOP()) == AS_FLOAT(value));
+            DISPATCH();
+
+        TARGET(OP_NE_F64):
+            value = POP();
+            TOP() = INT_VALUE(AS_FLOAT(TOP()) != AS_FLOAT(value));
+            DISPATCH();
+
+        TARGET(OP_LT_F64):
+            value = POP();
+            TOP() = INT_VALUE(AS_FLOAT(TOP()) < AS_FLOAT(value));
+            DISPATCH();
+
+        TARGET(OP_LE_F64):
+            value = POP();
+            TOP() = INT_VALUE(AS_FLOAT(TOP()) <= AS_FLOAT(value));
+            DISPATCH();
+
+        TARGET(OP_GT_F64):
+            value = POP();
+            TOP() = INT_VALUE(AS_FLOAT(TOP()) > AS_FLOAT(value));
+            DISPATCH();
+
+        TARGET(OP_GE_F64):
+            value = POP();
+            TOP() = INT_VALUE(AS_FLOAT(TOP()) >= AS_FLOAT(value));
+            DISPATCH();
+
+        TARGET(OP_ABS):
+            x = AS_INT(TOP());
+            TOP() = INT_VALUE(absInt(x));
+            DISPATCH();
+
+        TARGET(OP_MIN):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(minInt(a, b));
+            DISPATCH();
+
+        TARGET(OP_MAX):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(maxInt(a, b));
+            DISPATCH();
+
+        TARGET(OP_CLAMP):
+            b = POP_INT();
+            a = POP_INT();
+            x = AS_INT(TOP());
+            TOP() = INT_VALUE(clampInt(x, a, b));
+            DISPATCH();
+
+        TARGET(OP_POPCNT):
+            x = AS_INT(TOP());
+            TOP() = INT_VALUE(popcountInt(x));
+            DISPATCH();
+
+        TARGET(OP_CLZ):
+            x = AS_INT(TOP());
+            TOP() = INT_VALUE(clzInt(x));
+            DISPATCH();
+
+        TARGET(OP_CTZ):
+            x = AS_INT(TOP());
+            TOP() = INT_VALUE(ctzInt(x));
+            DISPATCH();
+
+        TARGET(OP_ROTL):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(rotlInt(a, b));
+            DISPATCH();
+
+        TARGET(OP_ROTR):
+            b = POP_INT();
+            a = AS_INT(TOP());
+            TOP() = INT_VALUE(rotrInt(a, b));
+            DISPATCH();
+
+        TARGET(OP_BSWAP):
+            x = AS_INT(TOP());
+            TOP() = INT_VALUE(bswapInt(x));
+            DISPATCH();
+
+        // Calls like call, with the callee running as a task of its own.
+        // It stays interpreted so that it can leave its frame at an await.
+        // Under a scheduler the task is spawned instead, for any worker to
+        // start, and the caller goes on at once with its future.
+        TARGET(OP_ASYNC):
+            x = READ_UINT16();
+            function = AS_POINTER(vm->module->constants.data[x]);
+
+            if (vm->loop.scheduler) {
+                FLUSH();
+                sp -= function->paramCount;
+                REFILL(INT_VALUE(spawnTask(&vm->loop, function, sp)));
+                DISPATCH();
+            }
+
+            TEST_OVERFLOW(function->maxStackCount);
+            FLUSH();
+            startTask(&vm->loop);
+
+            RAW_PUSH(INT_VALUE(function->paramCount));
+            RAW_PUSH(POINTER_VALUE(ip));
+            RAW_PUSH(POINTER_VALUE(fp));
+
+            ip = function->code.data;
+            fp = sp;
+            sp += function->localCount;
+            DISPATCH();
+
+        // A future that is done gives its result at once. Otherwise the
+        // task hands its frame to the loop and returns as if it had
+        // finished, leaving its own future for its caller.
+        TARGET(OP_AWAIT):
+            x = POP_INT();
+
+            if (isDone(&vm->loop, x)) {
+                PUSH(takeResult(&vm->loop, x));
+                DISPATCH();
+            }
+
+            FLUSH();
+            x = suspendTask(&vm->loop, x, ip, fp, sp);
+            sp = fp;
+            fp = AS_POINTER(RAW_POP());
+            ip = AS_POINTER(RAW_POP());
+            a = AS_INT(RAW_POP());
+            sp -= a;
+            REFILL(INT_VALUE(x));
+            DISPATCH();
+
+        TARGET(OP_RESOLVE):
+            value = POP();
+            x = resolveTask(&vm->loop, value);
+            sp = fp;
+            fp = AS_POINTER(RAW_POP());
+            ip = AS_POINTER(RAW_POP());
+            a = AS_INT(RAW_POP());
+            sp -= a;
+            REFILL(INT_VALUE(x));
+            DISPATCH();
+
+        TARGET(OP_DETACH):
+            detachFuture(&vm->loop, POP_INT());
+            DISPATCH();
+
+        TARGET(OP_GENERATE):
+            x = READ_UINT16();
+            function = AS_POINTER(vm->module->constants.data[x]);
+            FLUSH();
+            sp -= function->paramCount;
+            REFILL(POINTER_VALUE(startGenerator(&vm->generators, function, sp)));
+            DISPATCH();
+
+        // Resumes the generator on its own frame, with a return link like
+        // a call's. Its operands go on top of the resumer's, so nothing
+        // is copied either way.
+        TARGET(OP_NEXT):
+            generator = POP_POINTER();
+            ip += 2;
+
+            TEST_OVERFLOW(generator->function->maxStackCount);
+            FLUSH();
+
+            generator->sp = sp;
+            generator->fp[-2] = POINTER_VALUE(ip);
+            generator->fp[-1] = POINTER_VALUE(fp);
+            fp = generator->fp;
+            ip = generator->ip;
+            DISPATCH();
+
+        TARGET(OP_YIELD):
+            value = POP();
+            generator = AS_POINTER(fp[-3]);
+            generator->ip = ip;
+            sp = generator->sp;
+            ip = AS_POINTER(fp[-2]);
+            fp = AS_POINTER(fp[-1]);
+            REFILL(value);
+            DISPATCH();
+
+        // Returns to just past the next that resumed the generator and
+        // takes the jump out of the loop that next carries.
+        TARGET(OP_FINISH):
+            generator = AS_POINTER(fp[-3]);
+            sp = generator->sp;
+            ip = AS_POINTER(fp[-2]);
+            fp = AS_POINTER(fp[-1]);
+            ip += (uint16_t)((ip[-2] << 8) | ip[-1]);
+            endGenerator(&vm->generators, generator);
+            RELOAD();
+            DISPATCH();
+
+        TARGET(OP_CLOSE):
+            endGenerator(&vm->generators, POP_POINTER());
+            DISPATCH();
+
+        TARGET(OP_LKG):
+            x = READ_UINT8();
+            if (vm->loop.scheduler) lockGlobals(vm->loop.scheduler);
+            value = TOP();
+            TOP() = LOAD_GLOBAL(x);
+            PUSH(value);
+            DISPATCH();
+
+        TARGET(OP_ULG):
+            x = READ_UINT8();
+            STORE_GLOBAL(x, POP());
+            if (vm->loop.scheduler) unlockGlobals(vm->loop.scheduler);
+            DISPATCH();
+
+        TARGET(OP_JEQ):
+            b = POP_INT();
+            a = POP_INT();
+            x = READ_UINT16();
+            if (a == b) ip += x;
+            DISPATCH();
+
+        TARGET(OP_JNE):
+            b = POP_INT();
+            a = POP_INT();
+            x = READ_UINT16();
+            if (a != b) ip += x;
+            DISPATCH();
+
+        TARGET(OP_JLT):
+            b = POP_INT();
+            a = POP_INT();
+            x = READ_UINT16();
+            if (a < b) ip += x;
+            DISPATCH();
+
+        TARGET(OP_JLE):
+            b = POP_INT();
+            a = POP_INT();
+            x = READ_UINT16();
+            if (a <= b) ip += x;
+            DISPATCH();
+
+        TARGET(OP_JGT):
+            b = POP_INT();
+            a = POP_INT();
+            x = READ_UINT16();
+            if (a > b) ip += x;
+            DISPATCH();
+
+        TARGET(OP_JGE):
+            b = POP_INT();
+            a = POP_INT();
+            x = READ_UINT16();
+            if (a >= b) ip += x;
+            DISPATCH();
+
+        TARGET(OP_INCL):
+            x = (int8_t)READ_UINT8();
+            a = (int8_t)READ_UINT8();
+            fp[x] = INT_VALUE(WRAP(AS_INT(fp[x]), +, a));
+            DISPATCH();
+
+        TARGET(OP_HLT):
+        DEFAULT:
+            FLUSH();
+            vm->ip = ip;
+            vm->sp = sp;
+            vm->fp = fp;
+            return;
+#ifndef COMPUTED_GOTO
+        }
+    }
+#endif
+}
+
+static void run(VM* vm)
+{
+    FunctionObject* function = AS_POINTER(vm->module->constants.data[0]);
+    Value* sp = vm->stack;
 
-    vm->ip = function->code.data;
-    
     TEST_OVERFLOW(function->maxStackCount);
+    execute(vm, function->code.data, sp, sp);
+}
+
+static void runRegisters(VM* vm)
+{
+    FunctionObject* function = AS_POINTER(vm->module->constants.data[0]);
+    RegisterFrame frames[FRAMES_MAX];
+    RegisterFrame* frame = frames;
+    uint8_t* ip = function->code.data;
+    Value* fp = vm->stack;
+    Value* dst;
+    int32_t a;
+    int32_t b;
+    int32_t x;
+
+    TEST_REGISTER_OVERFLOW(function->registerCount);
+
+#ifdef COMPUTED_GOTO
+    static void* dispatchTable[] = {
+        [0 ... UINT8_MAX] = &&L_DEFAULT,
+        [ROP_HLT]     = &&L_ROP_HLT,
+        [ROP_REQS]    = &&L_ROP_REQS,
+        [ROP_LDC]     = &&L_ROP_LDC,
+        [ROP_LDI]     = &&L_ROP_LDI,
+        [ROP_REG]     = &&L_ROP_REG,
+        [ROP_LDG]     = &&L_ROP_LDG,
+        [ROP_STG]     = &&L_ROP_STG,
+        [ROP_MOV]     = &&L_ROP_MOV,
+        [ROP_ADD]     = &&L_ROP_ADD,
+        [ROP_SUB]     = &&L_ROP_SUB,
+        [ROP_MUL]     = &&L_ROP_MUL,
+        [ROP_DIV]     = &&L_ROP_DIV,
+        [ROP_REM]     = &&L_ROP_REM,
+        [ROP_POW]     = &&L_ROP_POW,
+        [ROP_BAND]    = &&L_ROP_BAND,
+        [ROP_BOR]     = &&L_ROP_BOR,
+        [ROP_BXOR]    = &&L_ROP_BXOR,
+        [ROP_LSL]     = &&L_ROP_LSL,
+        [ROP_LSR]     = &&L_ROP_LSR,
+        [ROP_BNOT]    = &&L_ROP_BNOT,
+        [ROP_NOT]     = &&L_ROP_NOT,
+        [ROP_NEG]     = &&L_ROP_NEG,
+        [ROP_CALL]    = &&L_ROP_CALL,
+        [ROP_RET]     = &&L_ROP_RET,
+        [ROP_RETV]    = &&L_ROP_RETV,
+        [ROP_EQ]      = &&L_ROP_EQ,
+        [ROP_NE]      = &&L_ROP_NE,
+        [ROP_LT]      = &&L_ROP_LT,
+        [ROP_LE]      = &&L_ROP_LE,
+        [ROP_GT]      = &&L_ROP_GT,
+        [ROP_GE]      = &&L_ROP_GE,
+        [ROP_JZ]      = &&L_ROP_JZ,
+        [ROP_JMP]     = &&L_ROP_JMP,
+        [ROP_LOOP]    = &&L_ROP_LOOP,
+    };
 
-    while ((opcode = READ_UINT8())) {
-        switch (opcode) {
-            case OP_REQS:
-                x = READ_UINT8();
-                service = services[x];
-                value = vm->service[x](vm->sp - service.paramCount);
-                vm->sp -= service.paramCount;
-                PUSH(value);
-                break;
-
-            case OP_LDC:
-                x = READ_UINT8();
-                value = vm->module->constants.data[x];
-                PUSH(value);
-                break;
-
-            case OP_REG:
-                pushValue(&vm->globals, POP());
-                break;
-
-            case OP_LDG:
-                x = READ_UINT8();
-                value = vm->globals.data[x];
-                PUSH(value);
-                break;
-
-            case OP_STG:
-                x = READ_UINT8();
-                vm->globals.data[x] = POP();
-                break;
-
-            case OP_LDL:
-                x = (int8_t) READ_UINT8();
-                PUSH(vm->fp[x]);
-                break;
-
-            case OP_LDL_0:
-                PUSH(vm->fp[0]);
-                break;
-
-            case OP_LDL_1:
-                PUSH(vm->fp[1]);
-                break;
-
-            case OP_LDL_2:
-                PUSH(vm->fp[2]);
-                break;
-
-            case OP_LDL_3:
-                PUSH(vm->fp[3]);
-                break;
-
-            case OP_STL:
-                x = (int8_t) READ_UINT8();
-                vm->fp[x] = POP();
-                break;
-
-            case OP_STL_0:
-                vm->fp[0] = POP();
-                break;
-
-            case OP_STL_1:
-                vm->fp[1] = POP();
-                break;
-
-            case OP_STL_2:
-                vm->fp[2] = POP();
-                break;
-
-            case OP_STL_3:
-                vm->fp[3] = POP();
-                break;
-
-            case OP_PUSHB:
-                x = (int8_t) READ_UINT8();
-                PUSH_INT(x);
-                break;
-
-            case OP_PUSHH:
-                x = (int16_t) READ_UINT16();
-                PUSH_INT(x);
-                break;
-
-            case OP_PUSH_0:
-                PUSH_INT(0);
-                break;
-
-            case OP_PUSH_1:
-                PUSH_INT(1);
-                break;
-
-            case OP_PUSH_2:
-                PUSH_INT(2);
-                break;
-
-            case OP_PUSH_3:
-                PUSH_INT(3);
-                break;
-
-            case OP_POP:
-                vm->sp--;
-                break;
-
-            case OP_DUP:
-                PUSH(vm->sp[-1]);
-                break;
-
-            case OP_INC:
-                AS_INT(vm->sp[-1])++;
-                break;
-
-            case OP_DEC:
-                AS_INT(vm->sp[-1])--;
-                break;
-            
-            case OP_ADD:
-                b = POP_INT();
-                a = POP_INT();
-                PUSH_INT(a + b);
-                break;
-
-            case OP_SUB:
-                b = POP_INT();
-                a = POP_INT();
-                PUSH_INT(a - b);
-                break;
-
-            case OP_MUL:
-                b = POP_INT();
-                a = POP_INT();
-                PUSH_INT(a * b);
-                break;
-
-            case OP_DIV:
-                b = POP_INT();
-                a = POP_INT();
-                PUSH_INT(a / b);
-                break;
-
-            case OP_REM:
-                b = POP_INT();
-                a = POP_INT();
-                PUSH_INT(a % b);
-                break;
-
-            case OP_POW:
-                b = POP_INT();
-                a = POP_INT();
-                x = pow(a, b);
-                PUSH_INT(x);
-                break;
-
-            case OP_BAND:
-                b = POP_INT();
-                a = POP_INT();
-                PUSH_INT(a & b);
-                break;
-
-            case OP_BOR:
-                b = POP_INT();
-                a = POP_INT();
-                PUSH_INT(a | b);
-                break;
-
-            case OP_BXOR:
-                b = POP_INT();
-                a = POP_INT();
-                PUSH_INT(a ^ b);
-                break;
-
-            case OP_BNOT:
-                x = AS_INT(vm->sp[-1]);
-                vm->sp[-1] = INT_VALUE(~x);
-                break;
-
-            case OP_LSL:
-                b = POP_INT();
-                a = POP_INT();
-                PUSH_INT(a << b);
-                break;
-
-            case OP_LSR:
-                b = POP_INT();
-                a = POP_INT();
-                PUSH_INT(a >> b);
-                break;
-
-            case OP_ASR:
-                b = POP_INT();
-                a = POP_INT();
-                PUSH_INT(~(~a >> b));
-                break;
-
-            case OP_NEG:
-                x = AS_INT(vm->sp[-1]);
-                vm->sp[-1] = INT_VALUE(-x);
-                break;
-
-            case OP_NOT:
-                x = AS_INT(vm->sp[-1]);
-                vm->sp[-1] = INT_VALUE(!x);
-                break;
-
-            case OP_BEQ:
-                b = AS_INT(vm->sp[-1]);
-                a = AS_INT(vm->sp[-2]);
-                if (a == b) vm->ip += READ_UINT16();
-                break;
-
-            case OP_BLT:
-                b = AS_INT(vm->sp[-1]);
-                a = AS_INT(vm->sp[-2]);
-                if (a < b) vm->ip += READ_UINT16();
-                break;
-
-            case OP_BLE:
-                b = AS_INT(vm->sp[-1]);
-                a = AS_INT(vm->sp[-2]);
-                if (a <= b) vm->ip += READ_UINT16();
-                break;
-
-            case OP_JMP:
-                vm->ip += READ_UINT16();
-                break;
-
-            case OP_CALL:
-                x = READ_UINT16();
-                function = AS_POINTER(vm->module->constants.data[x]);
-
-                TEST_OVERFLOW(function->maxStackCount);
-                PUSH_INT(function->paramCount);
-                PUSH_POINTER(vm->ip);
-                PUSH_POINTER(vm->fp);
-
-                vm->ip = function->code.data;
-                vm->fp = vm->sp;
-                break;
-
-            case OP_RET:
-                vm->sp = vm->fp;
-                vm->fp = POP_POINTER();
-                vm->ip = POP_POINTER();
-                vm->sp -= POP_INT();
-                PUSH_INT(0);
-                break;
-
-            case OP_RETV:
-                value = POP();
-                vm->sp = vm->fp;
-                vm->fp = POP_POINTER();
-                vm->ip = POP_POINTER();
-                vm->sp -= POP_INT();
-                PUSH(value);
-                break;
-
-            default:
-                return;
+    DISPATCH();
+#else
+    while (1) {
+        COUNT_INSTRUCTION();
+
+        switch (READ_UINT8()) {
+#endif
+
+        TARGET(ROP_REQS):
+            dst = &READ_REGISTER();
+            x = READ_UINT16();
+            vm->service[x](vm, dst);
+            DISPATCH();
+
+        TARGET(ROP_LDC):
+            dst = &READ_REGISTER();
+            x = READ_UINT16();
+            dst[0] = vm->module->constants.data[x];
+            DISPATCH();
+
+        TARGET(ROP_LDI):
+            dst = &READ_REGISTER();
+            x = (int16_t) READ_UINT16();
+            dst[0] = INT_VALUE(x);
+            DISPATCH();
+
+        TARGET(ROP_REG):
+            pushValue(&vm->globals, READ_REGISTER());
+            ip += 2;
+            DISPATCH();
+
+        TARGET(ROP_LDG):
+            dst = &READ_REGISTER();
+            x = READ_UINT16();
+            dst[0] = vm->globals.data[x];
+            DISPATCH();
+
+        TARGET(ROP_STG):
+            dst = &READ_REGISTER();
+            x = READ_UINT16();
+            vm->globals.data[x] = dst[0];
+            DISPATCH();
+
+        TARGET(ROP_MOV):
+            dst = &READ_REGISTER();
+            dst[0] = READ_REGISTER();
+            ip++;
+            DISPATCH();
+
+        TARGET(ROP_ADD):
+            READ_OPERANDS();
+            dst[0] = INT_VALUE(WRAP(a, +, b));
+            DISPATCH();
+
+        TARGET(ROP_SUB):
+            READ_OPERANDS();
+            dst[0] = INT_VALUE(WRAP(a, -, b));
+            DISPATCH();
+
+        TARGET(ROP_MUL):
+            READ_OPERANDS();
+            dst[0] = INT_VALUE(WRAP(a, *, b));
+            DISPATCH();
+
+        TARGET(ROP_DIV):
+            READ_OPERANDS();
+            dst[0] = INT_VALUE(a / b);
+            DISPATCH();
+
+        TARGET(ROP_REM):
+            READ_OPERANDS();
+            dst[0] = INT_VALUE(a % b);
+            DISPATCH();
+
+        TARGET(ROP_POW):
+            READ_OPERANDS();
+            x = pow(a, b);
+            dst[0] = INT_VALUE(x);
+            DISPATCH();
+
+        TARGET(ROP_BAND):
+            READ_OPERANDS();
+            dst[0] = INT_VALUE(a & b);
+            DISPATCH();
+
+        TARGET(ROP_BOR):
+            READ_OPERANDS();
+            dst[0] = INT_VALUE(a | b);
+            DISPATCH();
+
+        TARGET(ROP_BXOR):
+            READ_OPERANDS();
+            dst[0] = INT_VALUE(a ^ b);
+            DISPATCH();
+
+        TARGET(ROP_LSL):
+            READ_OPERANDS();
+            dst[0] = INT_VALUE(WRAP(a, <<, b & 31));
+            DISPATCH();
+
+        TARGET(ROP_LSR):
+            READ_OPERANDS();
+            dst[0] = INT_VALUE(a >> b);
+            DISPATCH();
+
+        TARGET(ROP_BNOT):
+            dst = &READ_REGISTER();
+            x = AS_INT(READ_REGISTER());
+            dst[0] = INT_VALUE(~x);
+            ip++;
+            DISPATCH();
+
+        TARGET(ROP_NOT):
+            dst = &READ_REGISTER();
+            x = AS_INT(READ_REGISTER());
+            dst[0] = INT_VALUE(!x);
+            ip++;
+            DISPATCH();
+
+        TARGET(ROP_NEG):
+            dst = &READ_REGISTER();
+            x = AS_INT(READ_REGISTER());
+            dst[0] = INT_VALUE(WRAP(0, -, x));
+            ip++;
+            DISPATCH();
+
+        TARGET(ROP_CALL):
+            dst = &READ_REGISTER();
+            x = READ_UINT16();
+            function = AS_POINTER(vm->module->constants.data[x]);
+
+            if (++frame == frames + FRAMES_MAX) {
+                fprintf(stderr, "Error: Stack overflow\n");
+                exit(1);
+            }
+
+            frame->ip = ip;
+            frame->fp = fp;
+            ip = function->code.data;
+            fp = dst;
+
+            TEST_REGISTER_OVERFLOW(function->registerCount);
+            DISPATCH();
+
+        TARGET(ROP_RET):
+            fp[0] = INT_VALUE(0);
+            ip = frame->ip;
+            fp = frame->fp;
+            frame--;
+            DISPATCH();
+
+        TARGET(ROP_RETV):
+            fp[0] = READ_REGISTER();
+            ip = frame->ip;
+            fp = frame->fp;
+            frame--;
+            DISPATCH();
+
+        TARGET(ROP_EQ):
+            READ_OPERANDS();
+            dst[0] = INT_VALUE(a == b);
+            DISPATCH();
+
+        TARGET(ROP_NE):
+            READ_OPERANDS();
+            dst[0] = INT_VALUE(a != b);
+            DISPATCH();
+
+        TARGET(ROP_LT):
+            READ_OPERANDS();
+            dst[0] = INT_VALUE(a < b);
+            DISPATCH();
+
+        TARGET(ROP_LE):
+            READ_OPERANDS();
+            dst[0] = INT_VALUE(a <= b);
+            DISPATCH();
+
+        TARGET(ROP_GT):
+            READ_OPERANDS();
+            dst[0] = INT_VALUE(a > b);
+            DISPATCH();
+
+        TARGET(ROP_GE):
+            READ_OPERANDS();
+            dst[0] = INT_VALUE(a >= b);
+            DISPATCH();
+
+        TARGET(ROP_JZ):
+            x = AS_INT(READ_REGISTER());
+            a = READ_UINT16();
+            if (x == 0) ip += a;
+            DISPATCH();
+
+        TARGET(ROP_JMP):
+            ip++;
+            x = READ_UINT16();
+            ip += x;
+            DISPATCH();
+
+        TARGET(ROP_LOOP):
+            ip++;
+            x = READ_UINT16();
+            ip -= x;
+            DISPATCH();
+
+        TARGET(ROP_HLT):
+        DEFAULT:
+            vm->ip = ip;
+            vm->fp = fp;
+            return;
+#ifndef COMPUTED_GOTO
         }
     }
+#endif
 }
 
 void initVM(VM* vm, ModuleObject* module)
 {
     initValueArray(&vm->globals);
-    initServices(vm);
+    vm->service = serviceRegistry.functions;
     
     vm->module = module;
     vm->ip = NULL;
     vm->sp = vm->stack;
     vm->fp = vm->stack;
+    vm->deopt.ip = NULL;
+    vm->instructionCount = 0;
+    vm->profile = NULL;
+    initJit(&vm->jit, JIT_OFF);
+    initTracer(&vm->tracer);
+    initTierPolicy(&vm->policy);
+    initVector(&vm->retiredCode);
+    initLoop(&vm->loop);
+    initGenerators(&vm->generators);
 }
 
 void freeVM(VM* vm)
 {
     freeValueArray(&vm->globals);
+    freeJit(&vm->jit);
+    freeTracer(&vm->tracer);
+
+    for (size_t i = 0; i < countVector(&vm->retiredCode); i++) {
+        free(vm->retiredCode.data[i]);
+    }
+
+    freeVector(&vm->retiredCode);
+    freeLoop(&vm->loop);
+    freeGenerators(&vm->generators);
 }
 
 void inspectStack(VM* vm)
@@ -349,8 +1587,86 @@ void interpret(VM* vm)
         return;
     }
 
+    // The REPL may have registered externs since the last run.
+    vm->service = serviceRegistry.functions;
+
+    if (vm->module->backend == BACKEND_REGISTER) {
+        return runRegisters(vm);
+    }
+
     run(vm);
+    runLoop(vm);
+}
+
+// Calls a function whose arguments end at sp from native code and returns
+// the stack pointer just past its result.
+Value* callFunction(VM* vm, Value* sp, FunctionObject* function)
+{
+    TEST_OVERFLOW(function->maxStackCount);
+
+    if (function->native || tierUp(vm, function)) {
+        Value value = ((native_t)function->native)(vm, sp);
+
+        if (vm->deopt.ip) {
+            return resumeCall(vm, sp);
+        }
+
+        sp -= function->paramCount;
+        sp[0] = value;
+
+        return sp + 1;
+    }
+
+    sp[0] = INT_VALUE(function->paramCount);
+    sp[1] = POINTER_VALUE(haltCode);
+    sp[2] = POINTER_VALUE(NULL);
+
+    execute(vm, function->code.data, sp + 3 + function->localCount, sp + 3);
+
+    return vm->sp;
+}
+
+// Finishes a call whose native code deoptimized: the callee's frame sits
+// just past its arguments at sp and the interpreter runs it to its return.
+// Returns the stack pointer just past the result.
+Value* resumeCall(VM* vm, Value* sp)
+{
+    sp[1] = POINTER_VALUE(haltCode);
+    sp[2] = POINTER_VALUE(NULL);
+
+    execute(vm, vm->deopt.ip, vm->deopt.sp, vm->deopt.fp);
+
+    return vm->sp;
+}
+
+// Moves a suspended task's frame back to the bottom of the stack, pushes
+// the result it awaited and runs it to its next await or its end. The
+// loop only resumes tasks once the script has run, so the stack is free.
+// A spawned task that has not started yet awaited nothing.
+void resumeTask(VM* vm, Task* task)
+{
+    Value* frame = vm->stack;
+    Value* fp = frame + task->fp;
+
+    memcpy(frame, task->frame, sizeof(Value) * task->size);
+    fp[-2] = POINTER_VALUE(haltCode);
+    fp[-1] = POINTER_VALUE(NULL);
+
+    task->caller = vm->loop.current;
+    vm->loop.current = task;
+
+    if (!task->started) {
+        task->started = true;
+        return execute(vm, task->ip, frame + task->size, fp);
+    }
+
+    frame[task->size] = task->value;
+    vm->loop.resuming = true;
+
+    execute(vm, task->ip, frame + task->size + 1, fp);
 }
 
 #undef READ_UINT8
 #undef READ_UINT16
+#undef READ_REGISTER
+#undef READ_OPERANDS
@@ -0,0 +1,237 @@
+#include "wheel.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define GROW_CAPACITY(capacity) ((capacity) < 64 ? 64 : (capacity) * 2)
+
+void initWheel(TimerWheel* wheel)
+{
+    wheel->timers = NULL;
+    wheel->capacity = 0;
+    wheel->freeTimer = -1;
+    wheel->count = 0;
+    wheel->now = 0;
+
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < WHEEL_SIZE; slot++) {
+            wheel->slots[level][slot] = -1;
+        }
+
+        wheel->occupied[level] = 0;
+    }
+}
+
+void freeWheel(TimerWheel* wheel)
+{
+    free(wheel->timers);
+}
+
+static int getDigit(uint64_t tick, int level)
+{
+    return (tick >> (level * WHEEL_BITS)) & WHEEL_MASK;
+}
+
+// The level of the highest digit in which deadline and now differ.
+static int getLevel(uint64_t deadline, uint64_t now)
+{
+    uint64_t difference = deadline ^ now;
+
+    if (difference == 0) {
+        return 0;
+    }
+
+    int level = (63 - __builtin_clzll(difference)) / WHEEL_BITS;
+
+    return level < WHEEL_LEVELS ? level : WHEEL_LEVELS - 1;
+}
+
+static void linkTimer(TimerWheel* wheel, int id)
+{
+    WheelTimer* timer = &wheel->timers[id];
+    int level = getLevel(timer->deadline, wheel->now);
+    int slot = getDigit(timer->deadline, level);
+    int* head = &wheel->slots[level][slot];
+
+    timer->level = level;
+    timer->slot = slot;
+    timer->prev = -1;
+    timer->next = *head;
+
+    if (*head >= 0) {
+        wheel->timers[*head].prev = id;
+    }
+
+    *head = id;
+    wheel->occupied[level] |= (uint64_t)1 << slot;
+}
+
+static void unlinkTimer(TimerWheel* wheel, int id)
+{
+    WheelTimer* timer = &wheel->timers[id];
+    int* head = &wheel->slots[timer->level][timer->slot];
+
+    if (timer->prev >= 0) {
+        wheel->timers[timer->prev].next = timer->next;
+    } else {
+        *head = timer->next;
+    }
+
+    if (timer->next >= 0) {
+        wheel->timers[timer->next].prev = timer->prev;
+    }
+
+    if (*head < 0) {
+        wheel->occupied[timer->level] &= ~((uint64_t)1 << timer->slot);
+    }
+}
+
+// Free timers are chained through next.
+static void growTimers(TimerWheel* wheel)
+{
+    int capacity = GROW_CAPACITY(wheel->capacity);
+
+    wheel->timers = realloc(wheel->timers, sizeof(WheelTimer) * capacity);
+
+    for (int i = capacity - 1; i >= wheel->capacity; i--) {
+        wheel->timers[i].next = wheel->freeTimer;
+        wheel->freeTimer = i;
+    }
+
+    wheel->capacity = capacity;
+}
+
+static void releaseTimer(TimerWheel* wheel, int id)
+{
+    wheel->timers[id].next = wheel->freeTimer;
+    wheel->freeTimer = id;
+    wheel->count--;
+}
+
+// Returns the timer, which expires at the first tick at or after deadline
+// that the wheel has not passed yet.
+int addTimer(TimerWheel* wheel, uint64_t deadline, int future)
+{
+    if (wheel->freeTimer < 0) {
+        growTimers(wheel);
+    }
+
+    int id = wheel->freeTimer;
+    WheelTimer* timer = &wheel->timers[id];
+
+    wheel->freeTimer = timer->next;
+    timer->deadline = deadline < wheel->now ? wheel->now : deadline;
+    timer->future = future;
+    wheel->count++;
+    linkTimer(wheel, id);
+
+    return id;
+}
+
+void cancelTimer(TimerWheel* wheel, int timer)
+{
+    unlinkTimer(wheel, timer);
+    releaseTimer(wheel, timer);
+}
+
+// The first tick at which something happens: a slot of level 0 expires
+// or a slot higher up is spread over the levels below. now is the first
+// tick not yet handled, and every occupied slot starts at it or after it
+// in the current turn of its level.
+uint64_t getNextTick(TimerWheel* wheel)
+{
+    uint64_t next = WHEEL_NONE;
+
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        int shift = level * WHEEL_BITS;
+        int digit = getDigit(wheel->now, level);
+        uint64_t ahead = wheel->occupied[level];
+
+        // The slot now is in is still due if it starts at now; otherwise
+        // it was spread out when now reached its start.
+        if (wheel->now & (((uint64_t)1 << shift) - 1)) {
+            ahead = digit == WHEEL_MASK ? 0 : ahead & ~(uint64_t)0 << (digit + 1);
+        } else {
+            ahead &= ~(uint64_t)0 << digit;
+        }
+
+        if (!ahead) {
+            continue;
+        }
+
+        uint64_t turn = wheel->now >> (shift + WHEEL_BITS) << (shift + WHEEL_BITS);
+        uint64_t tick = turn | (uint64_t)__builtin_ctzll(ahead) << shift;
+
+        if (tick < next) {
+            next = tick;
+        }
+    }
+
+    return next;
+}
+
+// Spreads the slots that start at now over the levels below them, the
+// highest first.
+static void cascade(TimerWheel* wheel)
+{
+    for (int level = WHEEL_LEVELS - 1; level > 0; level--) {
+        if (wheel->now & (((uint64_t)1 << (level * WHEEL_BITS)) - 1)) {
+            continue;
+        }
+
+        int slot = getDigit(wheel->now, level);
+        int id = wheel->slots[level][slot];
+
+        wheel->slots[level][slot] = -1;
+        wheel->occupied[level] &= ~((uint64_t)1 << slot);
+
+        while (id >= 0) {
+            int next = wheel->timers[id].next;
+
+            linkTimer(wheel, id);
+            id = next;
+        }
+    }
+}
+
+// Expires the whole slot of level 0 that now is in at once.
+static void expireSlot(TimerWheel* wheel, expire_t expire, void* context)
+{
+    int slot = getDigit(wheel->now, 0);
+    int id = wheel->slots[0][slot];
+
+    wheel->slots[0][slot] = -1;
+    wheel->occupied[0] &= ~((uint64_t)1 << slot);
+
+    while (id >= 0) {
+        int next = wheel->timers[id].next;
+        int future = wheel->timers[id].future;
+
+        releaseTimer(wheel, id);
+        expire(context, future);
+        id = next;
+    }
+}
+
+// Expires every timer due up to and including tick, moving from one tick
+// where something happens to the next. expire must not add timers.
+void advanceWheel(TimerWheel* wheel, uint64_t tick, expire_t expire, void* context)
+{
+    while (wheel->now <= tick) {
+        uint64_t next = getNextTick(wheel);
+
+        if (next > tick) {
+            break;
+        }
+
+        wheel->now = next;
+        cascade(wheel);
+        expireSlot(wheel, expire, context);
+        wheel->now++;
+    }
+
+    if (wheel->now <= tick) {
+        wheel->now = tick + 1;
+    }
+}
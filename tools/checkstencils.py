@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+# Checks the stencils of src/jit.c against the listings in their comments:
+# each listing is assembled with the GNU assembler, its holes filled with
+# a marker, and has to give the bytes of the stencil, holes zeroed.
+#
+# Usage: checkstencils.py [jit.c]
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+# Holes of these kinds are eight bytes wide; the others are four.
+WIDE_HOLES = {
+    "HOLE_ARGUMENT", "HOLE_HELPER", "HOLE_SERVICE", "HOLE_CONSTANT",
+    "HOLE_INT_TAG", "HOLE_RESUME", "HOLE_RESUME_CALL",
+}
+
+MARKER = 0x7f
+
+
+class Stencil:
+    def __init__(self, name, line, listing, code, holes):
+        self.name = name
+        self.line = line
+        self.listing = listing
+        self.code = code
+        self.holes = holes
+
+
+def parseBytes(text):
+    code = bytearray()
+
+    for literal in re.findall(r'"((?:[^"\\]|\\.)*)"', text):
+        for escape in re.findall(r"\\x([0-9a-fA-F]{2})", literal):
+            code.append(int(escape, 16))
+
+    return bytes(code)
+
+
+def parseHoles(text):
+    return [(int(offset), kind) for offset, kind in re.findall(r"\{(\d+),\s*(HOLE_\w+)\}", text)]
+
+
+# The listing is the comment right above STENCIL(, up to a line of prose,
+# which ends in a full stop.
+def parseListing(lines, start):
+    listing = []
+    i = start
+
+    while i >= 0 and lines[i].strip().startswith("//"):
+        text = lines[i].strip()[2:].strip()
+
+        if text.endswith("."):
+            break
+
+        listing.insert(0, text)
+        i -= 1
+
+    return " ".join(listing), i
+
+
+def parseStencils(path):
+    with open(path) as file:
+        lines = file.read().split("\n")
+
+    stencils = []
+
+    for i, line in enumerate(lines):
+        if "STENCIL(" not in line or line.startswith("#define"):
+            continue
+
+        match = re.search(r"\[(OP_\w+)\]\s*=", line)
+        listing, above = parseListing(lines, i - 1)
+
+        if match:
+            name = match.group(1)
+        else:
+            declaration = re.search(r"Stencil\s+(\w+)\s*=", lines[above])
+            name = declaration.group(1) if declaration else "line %d" % (i + 1)
+
+        end = i
+        text = line
+
+        while not re.search(r"\)\s*[,;]\s*$", lines[end]):
+            end += 1
+            text += lines[end]
+
+        stencils.append(Stencil(name, i + 1, listing, parseBytes(text), parseHoles(text)))
+
+    return stencils
+
+
+def getWidth(kind):
+    return 8 if kind in WIDE_HOLES else 4
+
+
+def toSource(stencil):
+    source = stencil.listing
+
+    for n, (_, kind) in enumerate(stencil.holes):
+        marker = "0x" + ("%02x" % MARKER) * getWidth(kind)
+        source = re.sub(r"\bH%d\b" % n, marker, source)
+
+    source = re.sub(r"\b(byte|word|dword|qword) \[", r"\1 ptr [", source)
+    statements = [statement.strip() for statement in source.split(";")]
+
+    return ".intel_syntax noprefix\n" + "\n".join(statements) + "\n"
+
+
+def assemble(source, directory):
+    asm = os.path.join(directory, "stencil.s")
+    obj = os.path.join(directory, "stencil.o")
+    raw = os.path.join(directory, "stencil.bin")
+
+    with open(asm, "w") as file:
+        file.write(source)
+
+    result = subprocess.run(["as", "--64", asm, "-o", obj], capture_output=True, text=True)
+
+    if result.returncode != 0:
+        return None, result.stderr.strip()
+
+    subprocess.run(["objcopy", "-O", "binary", "--only-section=.text", obj, raw], check=True)
+
+    with open(raw, "rb") as file:
+        return file.read(), None
+
+
+def check(stencil, directory):
+    if not stencil.listing:
+        return "no listing"
+
+    code, error = assemble(toSource(stencil), directory)
+
+    if code is None:
+        return error
+
+    code = bytearray(code)
+
+    for offset, kind in stencil.holes:
+        width = getWidth(kind)
+
+        if bytes(code[offset:offset + width]) != bytes([MARKER]) * width:
+            return "hole %s is not at %d" % (kind, offset)
+
+        code[offset:offset + width] = bytes(width)
+
+    if bytes(code) != stencil.code:
+        return "assembles to %s\n    stencil is   %s" % (code.hex(" "), stencil.code.hex(" "))
+
+    return None
+
+
+def main():
+    path = sys.argv[1] if len(sys.argv) > 1 else "src/jit.c"
+    stencils = parseStencils(path)
+    failures = 0
+
+    with tempfile.TemporaryDirectory() as directory:
+        for stencil in stencils:
+            error = check(stencil, directory)
+
+            if error:
+                print("%s:%d: %s: %s" % (path, stencil.line, stencil.name, error))
+                failures += 1
+
+    print("%d of %d stencils match their listings" % (len(stencils) - failures, len(stencils)))
+
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,59 @@
+#!/bin/sh
+# Runs each tests/*.mb that has a .out file beside it under every variant
+# below and compares what it prints with the .out file. A test names the
+# variants it cannot run under on a "# skip:" line, and extra arguments
+# on an "# args:" line.
+#
+# Usage: runtests.sh [matchbox] [test.mb ...]
+
+MATCHBOX=${1:-build/matchbox}
+[ $# -gt 0 ] && shift
+TESTS=${*:-$(ls tests/*.mb)}
+
+VARIANTS="
+off         --jit=off
+baseline    --jit=baseline --tier-native=1
+trace       --jit=trace --tier-optimize=1 --tier-trace=2
+osr         --jit=baseline --tier-optimize=1 --tier-native=2
+register    --backend=register
+workers1    --workers=1
+workers4    --workers=4
+"
+
+actual=$(mktemp)
+log=$(mktemp)
+trap 'rm -f "$actual" "$log"' EXIT
+
+for test in $TESTS; do
+    expected=${test%.mb}.out
+
+    [ -f "$expected" ] || continue
+
+    skip=$(sed -n 's/^# skip: *//p' "$test")
+    args=$(sed -n 's/^# args: *//p' "$test")
+
+    echo "$VARIANTS" | while read -r name flags; do
+        [ -n "$name" ] || continue
+
+        case " $skip " in
+            *" $name "*) continue ;;
+        esac
+
+        # shellcheck disable=SC2086
+        timeout 60 "$MATCHBOX" $flags $args "$test" > "$actual" 2>&1
+
+        if cmp -s "$actual" "$expected"; then
+            echo "PASS $test $name"
+        else
+            echo "FAIL $test $name"
+            diff "$expected" "$actual" | head -10
+        fi
+    done
+done > "$log"
+
+passed=$(grep -c '^PASS' "$log")
+failed=$(grep -c '^FAIL' "$log")
+grep -v '^PASS' "$log"
+
+echo "$passed passed, $failed failed"
+[ "$failed" -eq 0 ]